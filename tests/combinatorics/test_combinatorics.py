@@ -7,7 +7,21 @@ def test_combinatorics():
     assert w.integer_partitions(3, 3) == [[1, 1, 1], [2, 1], [3]]
     assert w.integer_partitions(3, 2) == [[2, 1], [3]]
     assert w.integer_partitions(3, 1) == [[3]]
+    # tabulated and generated partitions
+    assert len(w.integer_partitions(16, 16)) == 231
+    assert len(w.integer_partitions(17, 17)) == 297
+
+
+def test_factorial_binomial():
+    assert w.factorial(0) == 1
+    assert w.factorial(5) == 120
+    assert w.factorial(20) == 2432902008176640000
+    assert w.binomial(10, 4) == 210
+    assert w.binomial(3, 5) == 0
+    assert w.binomial(64, 32) == 1832624140942590534
+    assert w.binomial(70, 3) == 54740
 
 
 if __name__ == "__main__":
     test_combinatorics()
+    test_factorial_binomial()
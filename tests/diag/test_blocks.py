@@ -0,0 +1,58 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.reset_blocks()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_zero_blocks():
+    """Test that products with an operator in a zero block are skipped"""
+    initialize()
+    T = w.op("t", ["v+ v+ o o"])
+    F = w.op("f", ["o+ o", "v+ v", "o+ v", "v+ o"])
+    Fd = w.op("f", ["o+ o", "v+ v"])
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), w.bch_series(Fd, T, 2), 0, 4)
+
+    w.declare_zero_block("f", "o+ v")
+    w.declare_zero_block("f", "v o+")
+    w.declare_zero_block("f", "v+ o")
+    assert len(w.op("f", ["o+ o", "v+ v", "o+ v", "v+ o"])) == 2
+
+    val = wt.contract(w.rational(1), w.bch_series(F, T, 2), 0, 4)
+    assert val == ref
+    w.reset_blocks()
+
+
+def test_diagonal_blocks():
+    """Test that the indices of diagonal blocks are identified"""
+    initialize()
+    T = w.op("t", ["v+ v+ o o"])
+    F = w.op("f", ["o+ o", "v+ v"])
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), w.bch_series(F, T, 2), 4, 4)
+
+    w.declare_diagonal_block("f", "o+ o")
+    w.declare_diagonal_block("f", "v+ v")
+    val = wt.contract(w.rational(1), w.bch_series(F, T, 2), 4, 4)
+    assert len(val) == len(ref)
+    assert val != ref
+    assert "f^{o0}_{o0}" in str(val)
+    assert "f^{v0}_{v0}" in str(val)
+
+    try:
+        w.declare_diagonal_block("f", "o+ v")
+        assert False
+    except Exception:
+        pass
+    w.reset_blocks()
+
+
+if __name__ == "__main__":
+    test_zero_blocks()
+    test_diagonal_blocks()
@@ -92,5 +92,54 @@ def cc_n(max_n):
 
     assert diagrams_count == diagrams_count_ref[:max_n + 1]       
 
+def test_cc_target():
+    """Test generating one block of the CC equations at a time"""
+    n = 3
+    ref = cc_equations(n)
+
+    wt = w.WickTheorem()
+    E0 = w.op("E_0",[''])
+    F = w.utils.gen_op('f',1,'ov','ov')
+    V = w.utils.gen_op('v',2,'ov','ov')
+    Hbar = w.bch_series(E0 + F + V,make_T(n),4)
+    for r in range(0,n + 1):
+        s = f"{'o' * r}|{'v' * r}"
+        wt.set_target(s)
+        mbeq = wt.contract(w.rational(1), Hbar, 0, 2 * n).to_manybody_equation("r")
+        assert list(mbeq.keys()) == [s]
+        assert [str(eq) for eq in mbeq[s]] == [str(eq) for eq in ref[r]]
+
+def test_cc_connected():
+    """Test that only connected terms contribute to the CC equations"""
+    n = 3
+    initialize()
+    E0 = w.op("E_0",[''])
+    F = w.utils.gen_op('f',1,'ov','ov')
+    V = w.utils.gen_op('v',2,'ov','ov')
+    Hbar = w.bch_series(E0 + F + V,make_T(n),4)
+    ref = w.WickTheorem().contract(w.rational(1), Hbar, 0, 2 * n)
+    for connectivity in [w.Connectivity.connected, w.Connectivity.linked_to_first]:
+        wt = w.WickTheorem()
+        wt.set_connectivity(connectivity)
+        assert wt.contract(w.rational(1), Hbar, 0, 2 * n) == ref
+
+def test_cc_bch():
+    """Test contracting the BCH series directly"""
+    n = 3
+    initialize()
+    E0 = w.op("E_0",[''])
+    F = w.utils.gen_op('f',1,'ov','ov')
+    V = w.utils.gen_op('v',2,'ov','ov')
+    H = E0 + F + V
+    T = make_T(n)
+    Hbar = w.bch_series(H,T,4)
+    for minrank, maxrank in [(0, 2 * n), (0, 0), (2, 2), (4, 6)]:
+        ref = w.WickTheorem().contract(w.rational(1), Hbar, minrank, maxrank)
+        val = w.WickTheorem().contract_bch(w.rational(1), H, T, 4, minrank, maxrank)
+        assert val == ref
+
 if __name__ == "__main__":
     test_cc()
+    test_cc_target()
+    test_cc_connected()
+    test_cc_bch()
@@ -60,6 +60,56 @@ def test_energy3():
     val2 = w.expression("1/2 t^{o0}_{v0} t^{o1}_{v1} v^{v0,v1}_{o0,o1}")
     print_comparison(val, val2)
     assert val == val2
+    # branches that cannot become fully contracted are pruned
+    assert wt.timers()["step 2 pruned nodes"] > 0
+
+    # contractions that differ only by the order of the two T1 operators are
+    # generated once
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), Voovv @ T1 @ T1, 0, 4)
+    timers = wt.timers()
+    assert timers["step 3 unique contractions"] == timers["step 3 contractions"]
+
+
+def test_reuse_contractions():
+    """Products with the same graph matrices reuse steps 1 and 2"""
+    initialize()
+    T1 = w.op("t", ["v+ o"])
+    U1 = w.op("u", ["v+ o"])
+    Voovv = w.op("v", ["o+ o+ v v"])
+    Woovv = w.op("w", ["o+ o+ v v"])
+
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), Voovv @ T1 @ T1, 0, 4)
+    val = wt.contract(w.rational(1), Woovv @ T1 @ T1, 0, 4)
+    assert wt.timers()["step 2 reused"] == 1
+    # the contractions of identical operators are not reused for distinct ones
+    val2 = wt.contract(w.rational(1), Woovv @ T1 @ U1, 0, 4)
+    assert wt.timers()["step 2 reused"] == 1
+
+    ref = w.WickTheorem()
+    ref.do_reuse_contractions(False)
+    assert val == ref.contract(w.rational(1), Woovv @ T1 @ T1, 0, 4)
+    assert val2 == ref.contract(w.rational(1), Woovv @ T1 @ U1, 0, 4)
+    assert "step 2 reused" not in ref.timers()
+
+
+def test_reuse_skeletons():
+    """Contractions with the same graph matrices reuse the same skeleton"""
+    initialize()
+    T2 = w.op("t", ["v+ v+ o o"])
+    Fov = w.op("f", ["o+ v"])
+    Gov = w.op("g", ["o+ v"])
+
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), Fov @ T2, 2, 2)
+    val = wt.contract(w.rational(1), Gov @ T2, 2, 2)
+    assert wt.timers()["step 3 skeletons reused"] > 0
+
+    ref = w.WickTheorem()
+    ref.do_reuse_contractions(False)
+    assert val == ref.contract(w.rational(1), Gov @ T2, 2, 2)
+    assert "step 3 skeletons reused" not in ref.timers()
 
 
 def test_r1_1():
@@ -519,6 +569,8 @@ if __name__ == "__main__":
     test_energy1()
     test_energy2()
     test_energy3()
+    test_reuse_contractions()
+    test_reuse_skeletons()
     test_r1_1()
     test_r1_2()
     test_r1_3()
@@ -0,0 +1,60 @@
+import os
+import tempfile
+
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_checkpoint():
+    """Test resuming a contraction from its checkpoint files"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    ref = w.WickTheorem().contract(w.rational(1), Hbar, 0, 4)
+
+    with tempfile.TemporaryDirectory() as directory:
+        filename = os.path.join(directory, "ccsd")
+        for nthreads in [1, 2]:
+            wt = w.WickTheorem()
+            wt.set_nthreads(nthreads)
+            wt.set_checkpoint(filename, 0.0)
+            assert wt.contract(w.rational(1), Hbar, 0, 4) == ref
+            assert len(os.listdir(directory)) > 0
+
+            # the second run restores all the products
+            wt = w.WickTheorem()
+            wt.set_checkpoint(filename, 0.0)
+            assert wt.contract(w.rational(1), Hbar, 0, 4) == ref
+            assert wt.timers()["checkpoint restored products"] == Hbar.size()
+
+            # the products of a file whose terms cannot be read are contracted
+            # again
+            names = os.listdir(directory)
+            paths = [os.path.join(directory, name) for name in names]
+            with open(max(paths, key=os.path.getsize), "r+b") as f:
+                f.seek(-40, os.SEEK_END)
+                f.write(b"\xff" * 40)
+            wt = w.WickTheorem()
+            wt.set_checkpoint(filename, 0.0)
+            assert wt.contract(w.rational(1), Hbar, 0, 4) == ref
+            assert wt.timers()["checkpoint restored products"] < Hbar.size()
+
+            # the files of a different contraction are not used
+            wt = w.WickTheorem()
+            wt.set_checkpoint(filename, 0.0)
+            val = wt.contract(w.rational(1), Hbar, 0, 2)
+            assert val == w.WickTheorem().contract(w.rational(1), Hbar, 0, 2)
+            assert wt.timers()["checkpoint restored products"] == 0
+            for name in os.listdir(directory):
+                os.remove(os.path.join(directory, name))
+
+
+if __name__ == "__main__":
+    test_checkpoint()
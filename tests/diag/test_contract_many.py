@@ -0,0 +1,35 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_contract_many():
+    """Test that contract_many reproduces separate contractions"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    Fbar = w.bch_series(F, T, 2)
+    requests = [(Hbar, 0, 0), (Hbar, 2, 2), (Hbar, 4, 4), (Fbar, 0, 2)]
+
+    wt = w.WickTheorem()
+    results = wt.contract_many(w.rational(1, 2), requests)
+    assert len(results) == len(requests)
+
+    ref = w.WickTheorem()
+    for (expr, minrank, maxrank), val in zip(requests, results):
+        assert val == ref.contract(w.rational(1, 2), expr, minrank, maxrank)
+
+    # the products of Fbar are also in Hbar, so they are contracted once
+    timers = wt.timers()
+    assert timers["contract_many products"] < timers["contract_many requested products"]
+    assert timers["contract_many products"] == Hbar.size()
+
+
+if __name__ == "__main__":
+    test_contract_many()
@@ -0,0 +1,92 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_contraction_cache():
+    """Test that cached contractions reproduce the uncached results"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), Hbar, 0, 2)
+
+    cache = w.ContractionCache()
+    wt.set_cache(cache)
+    val = wt.contract(w.rational(1), Hbar, 0, 2)
+    assert val == ref
+    assert cache.hits() == 0
+    nmisses = cache.misses()
+    assert len(cache) == nmisses
+
+    # a second object sharing the cache reuses all the contractions
+    wt2 = w.WickTheorem()
+    wt2.set_cache(cache)
+    val = wt2.contract(w.rational(1, 2), Hbar, 0, 2)
+    assert val == w.WickTheorem().contract(w.rational(1, 2), Hbar, 0, 2)
+    assert cache.hits() == nmisses
+    assert cache.misses() == nmisses
+
+    # different settings are stored separately
+    wt2.set_max_cumulant(1)
+    wt2.contract(w.rational(1), Hbar, 0, 2)
+    assert cache.misses() == 2 * nmisses
+
+    cache.clear()
+    assert len(cache) == 0
+    assert cache.hits() == 0
+
+
+def test_contraction_cache_directory(tmp_path):
+    """Test that contractions saved to disk are reused by a new cache"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(V, T, 2)
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), Hbar, 0, 2)
+
+    wt.set_cache(w.ContractionCache(str(tmp_path)))
+    val = wt.contract(w.rational(1), Hbar, 0, 2)
+    assert val == ref
+
+    # a new cache reads all the contractions from the directory
+    cache = w.ContractionCache(str(tmp_path))
+    wt.set_cache(cache)
+    val = wt.contract(w.rational(1), Hbar, 0, 2)
+    assert val == ref
+    assert cache.misses() == 0
+    assert cache.hits() == len(cache)
+
+    # the contractions are written with save
+    files = sorted(tmp_path.glob("*.wkc"))
+    assert len(files) == len(cache)
+    view = w.SerializedView.open(str(files[0]))
+    assert view.kind() == w.SerializedKind.Expression
+
+    # corrupt files are cache misses
+    files[0].write_bytes(files[0].read_bytes()[:16] + bytes(range(256)))
+    keys = sorted(tmp_path.glob("*.key"))
+    keys[-1].write_text("key")
+    cache = w.ContractionCache(str(tmp_path))
+    wt.set_cache(cache)
+    val = wt.contract(w.rational(1), Hbar, 0, 2)
+    assert val == ref
+    assert cache.misses() == 2
+
+
+if __name__ == "__main__":
+    import tempfile
+    import pathlib
+
+    test_contraction_cache()
+    with tempfile.TemporaryDirectory() as d:
+        test_contraction_cache_directory(pathlib.Path(d))
@@ -0,0 +1,37 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_balance_load():
+    """Test the assignment of products to processes"""
+    part = w.balance_load([1.0, 8.0, 2.0, 4.0, 1.0], 2)
+    assert part == [1, 0, 1, 1, 1]
+    part = w.balance_load([3.0, 3.0, 3.0], 4)
+    assert part == [0, 1, 2]
+    assert w.balance_load([], 3) == []
+
+
+def test_distributed_contraction():
+    """Test that a distributed contraction gives the serial result (run with
+    mpirun to use more than one process)"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    serial = wt.contract(w.rational(1), Hbar, 0, 4)
+    distributed = wt.contract_distributed(w.rational(1), Hbar, 0, 4)
+    assert serial == distributed
+    assert 0 <= w.mpi_rank() < w.mpi_size()
+
+
+if __name__ == "__main__":
+    test_balance_load()
+    test_distributed_contraction()
@@ -71,5 +71,159 @@ def test_energy():
     assert comp == 'R += 0.250000000 * np.einsum("ijab,abij->",T2["oovv"],v["vvoo"],optimize="optimal")'
 
 
+def test_einsum_path():
+    """Contraction paths computed at compile time"""
+    initialize()
+    T2 = w.op("T2", ["v+ v+ o o"])
+    V = w.op("v", ["o+ o+ v v"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), V @ T2 @ T2, 4, 4)
+    mbeq = expr.to_manybody_equation("R")
+
+    comp = mbeq["oo|vv"][0].compile("einsum", {"o": 4, "v": 20})
+    print(comp)
+    assert comp == 'Roovv += 0.125000000 * np.einsum("ijab,klcd,cdkl->ijab",T2["oovv"],T2["oovv"],v["vvoo"],optimize=["einsum_path",(1,2),(0,1)])'
+
+    # without dimensions einsum searches for the path
+    comp = mbeq["oo|vv"][0].compile("einsum")
+    assert comp.endswith('optimize="optimal")')
+
+
+def test_cost():
+    """Cost of the terms and blocks of a set of equations"""
+    initialize()
+    T2 = w.op("T2", ["v+ v+ o o"])
+    V = w.op("v", ["v+ v+ v v", "o+ o+ o o"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), V @ T2, 4, 4)
+    mbeq = expr.to_manybody_equation("R")
+    dims = {"o": 10, "v": 100}
+
+    costs = sorted(eq.cost(dims).flops for eq in mbeq["oo|vv"])
+    assert costs == [2 * 10**4 * 100**2, 2 * 10**2 * 100**4]
+
+    report = w.cost_report(expr, "R", dims)
+    print(report)
+    blocks = report.blocks()
+    assert len(blocks) == 1
+    assert blocks[0].block == "oo|vv"
+    assert blocks[0].total.flops == sum(costs)
+    assert blocks[0].total.max_intermediate == 0
+    assert blocks[0].total.scaling_str() == "o^2 v^4"
+    eq, cost = blocks[0].terms[0]
+    assert cost.flops == 2 * 10**2 * 100**4
+    assert str(eq) == "R^{o0,o1}_{v0,v1} += 1/8 T2^{o0,o1}_{v2,v3} v^{v2,v3}_{v0,v1}"
+    assert report.flops() == sum(costs)
+
+def test_factorize():
+    """Intermediates shared by the CCSD singles and doubles"""
+    initialize()
+    T1 = w.op("T1", ["v+ o"])
+    T2 = w.op("T2", ["v+ v+ o o"])
+    V = w.op("v", ["o+ o+ v v"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), V @ T2 @ T2, 4, 4)
+    expr += wt.contract(w.rational(1), V @ T1 @ T2, 2, 2)
+    mbeq = expr.to_manybody_equation("R")
+
+    feqs = w.factorize(mbeq)
+    print(feqs)
+    assert len(feqs.intermediates()) == 4
+    assert len(feqs.equations()) == 9
+
+    comp = feqs.compile("einsum").split("\n")
+    assert comp[1] == 'X1 = {"oo": np.einsum("ijab,abkj->ik",T2["oovv"],v["vvoo"],optimize="optimal")}'
+    assert comp[10] == 'Rov += -0.500000000 * np.einsum("ja,ij->ia",T1["ov"],X1["oo"],optimize="optimal")'
+
+    # a pair must be used at least min_uses times to become an intermediate
+    assert len(w.factorize(mbeq, min_uses=3).intermediates()) == 0
+
+
+def test_compile_cpp():
+    """C++ code that contracts with GEMM"""
+    initialize()
+    T1 = w.op("T1", ["v+ o"])
+    F = w.op("f", ["o+ o", "o+ v", "v+ o", "v+ v"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), F @ T1, 2, 2)
+    mbeq = expr.to_manybody_equation("R")
+
+    comp = mbeq["o|o"][0].compile("cpp")
+    print(comp)
+    assert "  wicked_gemm(false, false, n_o, n_o, n_v, 1.000000000, T1_ov, f_vo, R_oo);" in comp.split("\n")
+
+    code = w.compile_cpp_function("evaluate_residual", mbeq["o|o"] + mbeq["v|v"])
+    assert 'extern "C" void evaluate_residual(const size_t *n, double *const *blocks) {' in code
+    assert 'return "R_oo,T1_ov,f_vo,R_vv";' in code
+
+
+def test_compile_cupy():
+    """CuPy code that contracts with cuTENSOR"""
+    initialize()
+    T1 = w.op("T1", ["v+ o"])
+    F = w.op("f", ["o+ o", "o+ v", "v+ o", "v+ v"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), F @ T1, 2, 2)
+    mbeq = expr.to_manybody_equation("R")
+
+    comp = mbeq["o|o"][0].compile("cupy")
+    print(comp)
+    assert 'cutensor.contraction(1.000000000, T1["ov"], ("i", "a"), f["vo"], ("a", "j"), 1.0, R["oo"], ("i", "j"))' in comp.split("\n")
+
+    # the same contraction is done once
+    code = w.compile_cupy_function("evaluate_residual", mbeq["o|o"] + mbeq["o|o"])
+    print(code)
+    assert "def evaluate_residual(R, T1, f, n, workspace):" in code
+    assert code.count("cutensor.contraction(") == 1
+    assert "cutensor.contraction(2.000000000," in code
+
+
+def test_permutation_partners():
+    """Collapse permutation partners and antisymmetrize residuals"""
+    initialize()
+    lhs = w.SymbolicTerm()
+    lhs.add(w.tensor("R", ["v_0", "v_1"], ["o_0", "o_1"], w.sym.anti))
+    eqs = []
+    for o, v, factor in [
+        (["o_0", "o_1"], ["v_0", "v_1"], 1),
+        (["o_1", "o_0"], ["v_0", "v_1"], -1),
+        (["o_0", "o_1"], ["v_1", "v_0"], -1),
+        (["o_1", "o_0"], ["v_1", "v_0"], 1),
+    ]:
+        rhs = w.SymbolicTerm()
+        rhs.add(w.tensor("g", [v[0]], [o[0]], w.sym.anti))
+        rhs.add(w.tensor("h", [v[1]], [o[1]], w.sym.anti))
+        eqs.append(w.Equation(lhs, rhs, w.rational(factor)))
+
+    collapsed = w.collapse_permutation_partners(eqs)
+    assert len(collapsed) == 1
+    eq = collapsed[0]
+    print(eq)
+    assert str(eq) == "R^{o0,o1}_{v0,v1} +=  P(o0/o1) P(v0/v1) g^{o0}_{v0} h^{o1}_{v1}"
+    assert len(eq.permutations()) == 2
+    comp = eq.compile("einsum")
+    print(comp)
+    assert comp == (
+        '_P = 1.000000000 * np.einsum("ia,jb->ijab",g["ov"],h["ov"],optimize="optimal")\n'
+        "Roovv += _P - _P.transpose(1,0,2,3) - _P.transpose(0,1,3,2) + _P.transpose(1,0,3,2)"
+    )
+
+    code = w.compile_antisymmetrizer("R", "ooo|vvv", "einsum")
+    print(code)
+    assert code.count("Rooovvv = ") == 2
+    assert code.count(".transpose(") == 10
+
+
 if __name__ == "__main__":
     test_energy()
+    test_einsum_path()
+    test_cost()
+    test_factorize()
+    test_compile_cpp()
+    test_compile_cupy()
+    test_permutation_partners()
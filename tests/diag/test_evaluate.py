@@ -0,0 +1,62 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def array(shape, values=None):
+    """Return a writable buffer of doubles with a given shape"""
+    size = 1
+    for n in shape:
+        size *= n
+    buffer = memoryview(bytearray(8 * size)).cast("d", shape)
+    if values is not None:
+        for i in range(shape[0]):
+            for j in range(shape[1]):
+                buffer[i, j] = values(i, j)
+    return buffer
+
+
+def test_evaluate():
+    """Evaluate equations in place on buffers of doubles"""
+    initialize()
+    T1 = w.op("T1", ["v+ o"])
+    F = w.op("f", ["o+ o", "v+ v"])
+
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1), F @ T1, 2, 2)
+    mbeq = expr.to_manybody_equation("R")
+
+    no, nv = 2, 3
+    t1 = array([no, nv], lambda i, a: 0.1 * (i + 1) + 0.01 * a)
+    foo = array([no, no], lambda i, j: 1.0 + i + 2 * j)
+    fvv = array([nv, nv], lambda a, b: 0.5 * a - 0.25 * b)
+    r = array([no, nv])
+    arrays = {"T1ov": t1, "foo": foo, "fvv": fvv, "Rov": r}
+    w.evaluate(mbeq["o|v"], arrays)
+
+    for i in range(no):
+        for a in range(nv):
+            ref = sum(t1[i, b] * fvv[b, a] for b in range(nv))
+            ref -= sum(t1[j, a] * foo[i, j] for j in range(no))
+            print(r[i, a], ref)
+            assert abs(r[i, a] - ref) < 1.0e-12
+
+    # the results are added to the left-hand side
+    w.evaluate(expr, "R", arrays)
+    assert abs(r[1, 2] - 2.0 * ref) < 1.0e-12
+
+    # the blocks must have the right shape
+    arrays["Rov"] = array([nv, no])
+    try:
+        w.evaluate(mbeq["o|v"], arrays)
+        assert False
+    except RuntimeError:
+        pass
+
+
+if __name__ == "__main__":
+    test_evaluate()
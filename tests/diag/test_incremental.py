@@ -0,0 +1,48 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_incremental_contraction():
+    """Test updating a contraction when operators gain or lose components"""
+    initialize()
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.op("v", ["o+ o+ o o", "v+ v+ v v", "o+ v+ v o", "v+ v+ o o"])
+    T1 = w.op("t", ["v+ o"])
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+
+    def contract(expr):
+        return w.WickTheorem().contract(w.rational(1), expr, 0, 4)
+
+    inc = w.IncrementalContraction(w.WickTheorem(), w.rational(1), 0, 4)
+    Hbar1 = w.bch_series(F + V, T1, 2)
+    assert inc.update(Hbar1) == Hbar1.size()
+    assert inc.result() == contract(Hbar1)
+
+    # adding a component to T contracts only the new products
+    Hbar = w.bch_series(F + V, T, 2)
+    ndiff = inc.difference(Hbar).size()
+    assert 0 < ndiff < Hbar.size()
+    assert inc.update(Hbar) == ndiff
+    assert inc.result() == contract(Hbar)
+
+    # adding a block of V
+    V2 = V + w.op("v", ["o+ o+ v v"])
+    Hbar2 = w.bch_series(F + V2, T, 2)
+    assert inc.update(Hbar2) < Hbar2.size()
+    assert inc.result() == contract(Hbar2)
+
+    # removing components subtracts their terms
+    assert inc.update(Hbar1) > 0
+    assert inc.result() == contract(Hbar1)
+    assert inc.update(Hbar1) == 0
+    assert inc.update(w.OperatorExpression()) == Hbar1.size()
+    assert len(inc.result()) == 0
+
+
+if __name__ == "__main__":
+    test_incremental_contraction()
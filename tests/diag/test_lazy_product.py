@@ -0,0 +1,36 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_lazy_product():
+    """Test that contracting a lazy product reproduces the expanded product"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    H = F + V
+    HTT = w.LazyOperatorProduct([H, T, T])
+
+    for minrank, maxrank in [(0, 0), (2, 2), (0, 4)]:
+        expanded = HTT.expand(minrank, maxrank)
+        assert expanded == w.multiply([H, T, T], minrank, maxrank)
+        assert HTT.count(minrank, maxrank) == expanded.size()
+        assert HTT.count(minrank, maxrank) <= (H @ T @ T).size()
+
+        ref = w.WickTheorem().contract(w.rational(1, 2), H @ T @ T, minrank, maxrank)
+        wt = w.WickTheorem()
+        assert wt.contract(w.rational(1, 2), HTT, minrank, maxrank) == ref
+        assert wt.timers()["lazy product products"] == HTT.count(minrank, maxrank)
+        wt.set_nthreads(2)
+        assert wt.contract(w.rational(1, 2), HTT, minrank, maxrank) == ref
+
+    assert w.LazyOperatorProduct([]).count(0, 4) == 0
+
+
+if __name__ == "__main__":
+    test_lazy_product()
@@ -0,0 +1,40 @@
+import os
+import tempfile
+
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_memory_budget():
+    """Test summing the terms of a contraction with a small memory budget"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    ref = w.WickTheorem().contract(w.rational(1), Hbar, 0, 4)
+
+    with tempfile.TemporaryDirectory() as directory:
+        for nthreads in [1, 2]:
+            wt = w.WickTheorem()
+            wt.set_nthreads(nthreads)
+            wt.set_memory_budget(2000, directory)
+            assert wt.contract(w.rational(1), Hbar, 0, 4) == ref
+            assert wt.timers()["accumulator runs"] > 0
+            # the runs are removed after they are merged
+            assert len(os.listdir(directory)) == 0
+
+        # a large budget keeps all the terms in memory
+        wt = w.WickTheorem()
+        wt.set_memory_budget(1 << 30, directory)
+        assert wt.contract(w.rational(1), Hbar, 0, 4) == ref
+        assert wt.timers()["accumulator runs"] == 0
+
+
+if __name__ == "__main__":
+    test_memory_budget()
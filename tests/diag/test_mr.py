@@ -69,7 +69,59 @@ def test_mr3():
     ref = w.utils.string_to_expr(ref_expr)
 
 
+def test_mr_unique_contractions():
+    """Test that contractions with the same canonical graph are evaluated once"""
+    initialize()
+    T1aa = w.op("t", ["a+ a"])
+    Faa = w.op("f", ["a+ a"])
+
+    # the two T1 operators do not commute, so equivalent contractions are
+    # generated and then combined
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), Faa @ T1aa @ T1aa, 0, 6)
+    timers = wt.timers()
+    assert timers["step 3 unique contractions"] < timers["step 3 contractions"]
+
+
+def test_mr_cumulant_limits():
+    """Test the per-space and total limits on the cumulants"""
+    initialize()
+    T1aa = w.op("t", ["a+ a"])
+    Faa = w.op("f", ["a+ a"])
+    product = Faa @ T1aa @ T1aa
+
+    def remove_tensors(expr, labels):
+        result = w.Expression()
+        for term, coefficient in expr:
+            if not any(t.label() in labels for t in term.tensors()):
+                result.add(term, coefficient)
+        return result
+
+    wt = w.WickTheorem()
+    ref0 = wt.contract(w.rational(1), product, 0, 0)
+    ref2 = wt.contract(w.rational(1), product, 2, 2)
+
+    wt = w.WickTheorem()
+    wt.set_max_cumulant("a", 2)
+    val = wt.contract(w.rational(1), product, 0, 0)
+    assert val == remove_tensors(ref0, ["lambda3"])
+
+    wt = w.WickTheorem()
+    wt.set_max_total_cumulant(2)
+    val = wt.contract(w.rational(1), product, 0, 0)
+    assert val == remove_tensors(ref0, ["lambda3"])
+
+    # cumulants only in the fully contracted terms
+    wt = w.WickTheorem()
+    wt.set_max_total_cumulant(0, 1)
+    assert wt.contract(w.rational(1), product, 0, 0) == ref0
+    val = wt.contract(w.rational(1), product, 2, 2)
+    assert val == remove_tensors(ref2, ["lambda2", "lambda3"])
+
+
 if __name__ == "__main__":
     test_mr1()
     test_mr2()
     test_mr3()
+    test_mr_unique_contractions()
+    test_mr_cumulant_limits()
@@ -0,0 +1,38 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_schedule_by_cost():
+    """Test the order in which the threads contract the products"""
+    order, nsplit = w.schedule_by_cost([1.0, 10.0, 2.0, 4.0, 1.0], 2)
+    assert order == [1, 3, 2, 0, 4]
+    assert nsplit == 1
+    assert w.schedule_by_cost([1.0, 10.0, 2.0], 1) == ([1, 2, 0], 0)
+    assert w.schedule_by_cost([], 4) == ([], 0)
+
+
+def test_scheduled_contraction():
+    """Test that a product that dominates the cost is split among the threads"""
+    initialize()
+    F = w.op("f", ["v+ o"])
+    V = w.op("v", ["o+ o+ v v"])
+    T1 = w.op("t", ["v+ o"])
+    T2 = w.op("t", ["v+ v+ o o"])
+    expr = F @ T1 + V @ T2 @ T2 + F @ T2
+    ref = w.WickTheorem().contract(w.rational(1), expr, 0, 0)
+
+    # V T2 T2 costs more than the other two products together
+    wt = w.WickTheorem()
+    wt.set_nthreads(2)
+    assert wt.contract(w.rational(1), expr, 0, 0) == ref
+    assert wt.timers()["schedule split products"] == 1
+
+
+if __name__ == "__main__":
+    test_schedule_by_cost()
+    test_scheduled_contraction()
@@ -0,0 +1,64 @@
+import itertools
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", list("ijklmn"))
+    w.add_space("v", "fermion", "unoccupied", list("abcdef"))
+    w.add_space("O", "fermion", "occupied", list("IJKLMN"))
+    w.add_space("V", "fermion", "unoccupied", list("ABCDEF"))
+
+
+def hamiltonian_components(spins):
+    """Return the components of a Hamiltonian with the given spin blocks"""
+    components = []
+    for spin in spins:
+        factors = [[f"{s[0]}+", f"{s[1]}+"] for s in spin[0]]
+        factors += [[s[0], s[1]] for s in spin[1]]
+        for ops in itertools.product(*factors):
+            components.append(" ".join(ops))
+    return components
+
+
+def test_spin_integrate():
+    """Spin-integrate the CCSD equations and compare them to those obtained
+    with separate alpha and beta spaces"""
+    initialize()
+    wt = w.WickTheorem()
+
+    T = w.op("T", ["v+ o", "v+ v+ o o"])
+    H = w.op(
+        "H",
+        hamiltonian_components([(["vo"], ["vo"]), (["vo", "vo"], ["vo", "vo"])]),
+        unique=True,
+    )
+    expr = wt.contract(w.rational(1), w.bch_series(H, T, 2), 0, 4)
+    spin_expr = w.spin_integrate(expr, {"o": ("o", "O"), "v": ("v", "V")})
+
+    T = w.op(
+        "T", ["v+ o", "V+ O", "v+ v+ o o", "V+ V+ O O", "V+ v+ O o"], unique=True
+    )
+    H = w.op(
+        "H",
+        hamiltonian_components(
+            [
+                (["vo"], ["vo"]),
+                (["VO"], ["VO"]),
+                (["vo", "vo"], ["vo", "vo"]),
+                (["VO", "VO"], ["VO", "VO"]),
+                (["vo", "VO"], ["vo", "VO"]),
+            ]
+        ),
+        unique=True,
+    )
+    ref = wt.contract(w.rational(1), w.bch_series(H, T, 2), 0, 4)
+    ref.simplify()
+    assert spin_expr == ref
+
+    mbeq = spin_expr.to_manybody_equation("R")
+    assert "oO|Vv" in mbeq
+
+
+if __name__ == "__main__":
+    test_spin_integrate()
@@ -0,0 +1,106 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_statistics():
+    """Test the timers and counters of a contraction"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    result = wt.contract(w.rational(1), Hbar, 0, 4)
+    stats = wt.statistics()
+    assert stats["step 1"]["time"] >= 0.0
+    assert stats["step 1"]["elementary contractions"] > 0
+    step2 = stats["step 2"]
+    assert step2["nodes visited"] >= step2["pruned nodes"] > 0
+    assert stats["step 3"]["contractions"] == step2["contractions"]
+    assert stats["canonicalize_contraction_graph"]["permutations"] > 0
+
+    # every term emitted is kept, merged with another, or cancels one
+    emitted = stats["step 3"]["terms"]["emitted"]
+    merged = 0
+    cancelled = 0
+    for level in ["step 3", "expression"]:
+        merged += stats[level]["terms"].get("merged", 0)
+        cancelled += stats[level]["terms"].get("cancelled", 0)
+    assert emitted == len(result) + merged + 2 * cancelled
+
+    # the flat timers use the same names
+    assert wt.timers()["step 2 pruned nodes"] == step2["pruned nodes"]
+
+    # the statistics accumulate until they are reset
+    wt.contract(w.rational(1), Hbar, 0, 4)
+    assert wt.statistics()["step 3"]["terms"]["emitted"] == 2 * emitted
+    wt.reset_statistics()
+    assert wt.statistics() == {}
+    assert wt.timers() == {}
+
+
+def test_statistics_threads():
+    """Test that the counters of step 3 do not depend on the number of threads"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    serial = w.WickTheorem()
+    serial.contract(w.rational(1), Hbar, 0, 4)
+    parallel = w.WickTheorem()
+    parallel.set_nthreads(4)
+    parallel.contract(w.rational(1), Hbar, 0, 4)
+    # the workers reuse the contractions separately, so only the counters of
+    # step 3 are the same
+    step3 = serial.statistics()["step 3"]
+    parallel_step3 = parallel.statistics()["step 3"]
+    for key in ["contractions", "unique contractions", "terms"]:
+        assert step3[key] == parallel_step3[key]
+
+
+def test_product_statistics():
+    """Test the statistics of each product"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    expr = V @ T
+
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), expr, 0, 4)
+    assert wt.product_statistics() == {}
+
+    wt.reset_statistics()
+    wt.do_product_statistics(True)
+    wt.contract(w.rational(1), expr, 0, 4)
+    products = wt.product_statistics()
+    assert len(products) == expr.size()
+    total = sum(p["step 3"]["contractions"] for p in products.values())
+    assert total == wt.statistics()["step 3"]["contractions"]
+
+
+def test_cache_statistics():
+    """Test the counters of the cache lookups"""
+    initialize()
+    T = w.op("t", ["v+ v+ o o"])
+    V = w.op("v", ["o+ o+ v v"])
+
+    wt = w.WickTheorem()
+    wt.set_cache(w.ContractionCache())
+    wt.contract(w.rational(1), V @ T, 0, 0)
+    wt.contract(w.rational(1), V @ T, 0, 0)
+    assert wt.statistics()["cache"] == {"hits": 1, "misses": 1}
+
+
+if __name__ == "__main__":
+    test_statistics()
+    test_statistics_threads()
+    test_product_statistics()
+    test_cache_statistics()
@@ -0,0 +1,55 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_contraction_sink():
+    """Test that the terms passed to a sink add up to the contraction"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), Hbar, 0, 2)
+
+    val = w.Expression()
+    nterms = [0]
+
+    def sink(term, c):
+        val.add(term, c)
+        nterms[0] += 1
+
+    wt.contract(w.rational(1), Hbar, 0, 2, sink)
+    assert val == ref
+    assert nterms[0] >= len(ref)
+
+
+def test_contraction_stream():
+    """Test iterating over the terms generated by a contraction"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+
+    wt = w.WickTheorem()
+    ref = wt.contract(w.rational(1), w.commutator(V, T), 0, 4)
+
+    val = w.Expression()
+    for term, c in wt.contract_stream(w.rational(1), w.commutator(V, T), 0, 4, 8):
+        val.add(term, c)
+    assert val == ref
+
+    # stop early
+    stream = wt.contract_stream(w.rational(1), w.commutator(V, T), 0, 4, 1)
+    term, c = next(stream)
+    del stream
+
+
+if __name__ == "__main__":
+    test_contraction_sink()
+    test_contraction_stream()
@@ -0,0 +1,108 @@
+import pytest
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_threaded_contraction():
+    """Test that contracting an OperatorExpression with threads gives the serial result"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    serial = wt.contract(w.rational(1), Hbar, 0, 4)
+
+    wt.set_nthreads(4)
+    assert wt.nthreads() == 4
+    threaded = wt.contract(w.rational(1), Hbar, 0, 4)
+    assert serial == threaded
+
+
+def test_threaded_contraction_product():
+    """Test that processing the contractions of a single product with threads gives the serial result"""
+    initialize()
+    T2 = w.op("t", ["v+ v+ o o"])
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    VT2T2 = V @ T2 @ T2
+
+    wt = w.WickTheorem()
+    serial = wt.contract(w.rational(1), VT2T2, 0, 0)
+
+    wt.set_nthreads(4)
+    threaded = wt.contract(w.rational(1), VT2T2, 0, 0)
+    assert serial == threaded
+
+
+def test_pipelined_contraction_product():
+    """Test that processing the contractions of a product while they are generated gives the serial result"""
+    initialize()
+    T2 = w.op("t", ["v+ v+ o o"])
+    V = w.op("v", ["o+ o+ v v"])
+    VT2T2 = V @ T2 @ T2
+
+    wt = w.WickTheorem()
+    serial = wt.contract(w.rational(1), VT2T2, 0, 4)
+
+    wt.set_nthreads(3)
+    wt.set_pipeline(4)
+    pipelined = wt.contract(w.rational(1), VT2T2, 0, 4)
+    assert serial == pipelined
+
+
+def test_async_contraction():
+    """Test that a contraction on a separate thread gives the serial result"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    wt = w.WickTheorem()
+    serial = wt.contract(w.rational(1), Hbar, 0, 4)
+
+    calls = []
+    wt.set_nthreads(2)
+    future = wt.contract_async(
+        w.rational(1), Hbar, 0, 4, progress=lambda done, total: calls.append(total)
+    )
+    assert future.result() == serial
+    assert future.done()
+    assert future.progress() == (Hbar.size(), Hbar.size())
+    assert calls == [Hbar.size()] * Hbar.size()
+
+
+def test_async_contraction_cancel():
+    """Test cancelling a contraction from its progress callback"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+
+    futures = []
+
+    def progress(done, total):
+        if futures:
+            futures[0].cancel()
+
+    wt = w.WickTheorem()
+    futures.append(wt.contract_async(w.rational(1), Hbar, 0, 4, progress))
+    with pytest.raises(w.ContractionCancelled):
+        futures[0].result()
+    assert futures[0].cancelled()
+    assert futures[0].progress()[0] < Hbar.size()
+
+
+if __name__ == "__main__":
+    test_threaded_contraction()
+    test_threaded_contraction_product()
+    test_pipelined_contraction_product()
+    test_async_contraction()
+    test_async_contraction_cancel()
@@ -0,0 +1,75 @@
+import json
+
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_trace():
+    """Test the events recorded while contracting an expression"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+
+    # nothing is recorded when tracing is off
+    w.start_tracing()
+    w.stop_tracing()
+    assert not w.tracing_enabled()
+    wt = w.WickTheorem()
+    wt.contract(w.rational(1), F @ T, 0, 2)
+    assert w.trace_size() == 0
+
+    w.start_tracing()
+    Hbar = w.bch_series(F + V, T, 2)
+    wt.set_nthreads(2)
+    result = wt.contract(w.rational(1), Hbar, 0, 4)
+    result.to_manybody_equation("r")
+    w.stop_tracing()
+
+    events = json.loads(w.trace_json())["traceEvents"]
+    assert len(events) == w.trace_size()
+    names = [e["name"] for e in events]
+    for name in [
+        "bch_series",
+        "contract expression",
+        "contract worker",
+        "contract",
+        "step 1",
+        "step 2",
+        "step 3",
+        "to_manybody_equation",
+    ]:
+        assert name in names
+    assert names.count("contract") == Hbar.size()
+    # the events of the products are recorded on the worker threads
+    products = [e for e in events if e["name"] == "contract"]
+    assert len({e["tid"] for e in products}) <= 2
+    assert all(e["ph"] == "X" and e["dur"] >= 0.0 for e in events)
+    assert all("product" in e["args"] for e in products)
+
+
+def test_trace_file(tmp_path):
+    """Test writing a trace to a file"""
+    initialize()
+    T = w.op("t", ["v+ v+ o o"])
+    V = w.op("v", ["o+ o+ v v"])
+    filename = str(tmp_path / "trace.json")
+    with w.utils.tracing(filename):
+        w.WickTheorem().contract(w.rational(1), V @ T, 0, 0)
+    with open(filename) as f:
+        events = json.load(f)["traceEvents"]
+    assert [e["name"] for e in events if e["cat"] == "product"] == ["contract"]
+
+
+if __name__ == "__main__":
+    import tempfile
+    import pathlib
+
+    test_trace()
+    with tempfile.TemporaryDirectory() as tmp:
+        test_trace_file(pathlib.Path(tmp))
@@ -97,9 +97,182 @@ def test_expression5():
     assert str(expr) == "f^{o0}_{}"
 
 
+def test_expression_simplify():
+    """Test the simplification of terms that differ by a relabeling"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+    # the two u tensors have symmetric roles, so these terms are equal
+    expr = w.expression("-t^{o0,o1,v0,v1}_{} u^{v3}_{o0,v0,v2} u^{v2}_{o1,v1,v3}")
+    expr += w.expression("-t^{o0,o1,v0,v1}_{} u^{v3}_{o1,v1,v2} u^{v2}_{o0,v0,v3}")
+    expr.simplify()
+    ref = w.expression("-2 t^{o0,o1,v0,v1}_{} u^{v3}_{o0,v0,v2} u^{v2}_{o1,v1,v3}")
+    assert expr == ref.simplify()
+    assert len(expr) == 1
+
+
+def test_canonicalize_threads():
+    """Test that the canonical form does not depend on the number of threads"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+    lines = [
+        "t^{o1,o0}_{v0,v1}",
+        "-t^{o0,o1}_{v0,v1}",
+        "t^{o1,o0}_{v1,v0}",
+        "f^{v0}_{o1} t^{o1}_{v0}",
+        "f^{v1}_{o0} t^{o0}_{v1}",
+        "1/2 v^{v1,v0}_{o0,o1} t^{o0,o1}_{v0,v1}",
+        "-1/2 v^{v0,v1}_{o0,o1} t^{o1,o0}_{v0,v1}",
+        "v^{o0,o1}_{o1,o0}",
+    ]
+    expr = w.string_to_expr_lines("\n".join(lines))
+    serial = w.string_to_expr_lines("\n".join(lines))
+    serial.canonicalize()
+    for nthreads in [2, 4, 0]:
+        val = w.string_to_expr_lines("\n".join(lines))
+        val.canonicalize(nthreads)
+        assert val == serial
+    assert len(serial) < len(expr)
+
+
+def test_manybody_equations_blocks():
+    """Test selecting the blocks of the many-body equations"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+    T = w.op("T", ["v+ o", "v+ v+ o o"])
+    V = w.op("V", ["v+ v+ v v", "o+ o+ o o", "o+ v+ v o"])
+    expr = w.WickTheorem().contract(w.rational(1), V @ T, 0, 4)
+    ref = expr.to_manybody_equation("R")
+
+    mbeq = expr.manybody_equations("R")
+    assert list(mbeq) == list(ref.keys())
+    for block in mbeq:
+        assert [str(eq) for eq in mbeq[block]] == [str(eq) for eq in ref[block]]
+
+    for nthreads in [1, 2]:
+        mbeq = expr.manybody_equations("R", ["oo|vv", "o|v", "ooo|vvv"], nthreads)
+        assert mbeq.blocks() == ["o|v", "oo|vv"]
+        assert "oo|vv" in mbeq
+        assert "ooo|vvv" not in mbeq
+        assert mbeq.equations("ooo|vvv") == []
+        assert [str(eq) for eq in mbeq["oo|vv"]] == [str(eq) for eq in ref["oo|vv"]]
+
+
+def test_string_to_expr_lines():
+    """Test parsing an expression with one term per line"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c"])
+    expr = w.expression("-1/2 f^{v0}_{o0} t^{o0}_{v0} a+(v0) a-(o0)")
+    assert str(expr) == "-1/2 f^{v0}_{o0} t^{o0}_{v0} a+(v0) a-(o0)"
+
+    expr = w.expression("1/2 V^{o0,o1}_{v0,v1}")
+    expr += w.expression("-t^{v0}_{o0} { a+(v0) a-(o0) }")
+    assert w.string_to_expr_lines(str(expr)) == expr
+    assert w.string_to_expr_lines(str(expr) + "\n\n") == expr
+    assert w.utils.string_to_expr(str(expr)) == expr
+
+
+def test_serialize():
+    """Serialize expressions, operators and equations"""
+    import os
+    import pickle
+    import tempfile
+
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+    T2 = w.op("T2", ["v+ v+ o o"])
+    V = w.op("V", ["v+ v+ v v", "o+ o+ o o"])
+    wt = w.WickTheorem()
+    expr = wt.contract(w.rational(1, 2), V @ T2, 4, 4)
+    mbeq = expr.to_manybody_equation("R")
+
+    assert w.deserialize(w.serialize(expr)) == expr
+    assert pickle.loads(pickle.dumps(expr)) == expr
+    assert pickle.loads(pickle.dumps(V)) == V
+    eq = mbeq["oo|vv"][0]
+    assert str(pickle.loads(pickle.dumps(eq))) == str(eq)
+
+    with tempfile.TemporaryDirectory() as directory:
+        filename = os.path.join(directory, "expr.bin")
+        w.save(expr, filename)
+        view = w.SerializedView.open(filename)
+        assert view.kind() == w.SerializedKind.Expression
+        assert len(view) == len(expr)
+        term, c = view.term(0)
+        assert str(term) in str(expr)
+        assert view.to_expression() == expr
+
+        # the spaces are matched by label
+        w.reset_space()
+        w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+        w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+        data = w.serialize(w.load(filename))
+        w.reset_space()
+        w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+        w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+        assert w.deserialize(data) == expr
+
+
+def test_axpy_drain():
+    """Add scaled expressions in place and remove their terms"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d"])
+    x = w.string_to_expr_lines(
+        "f^{v0}_{o0} t^{o0}_{v0}\n2 v^{o0,o1}_{v0,v1} t^{v0,v1}_{o0,o1}"
+    )
+    y = w.expression("f^{v0}_{o0} t^{o0}_{v0}")
+
+    # y + 2 x, with x unchanged
+    expr = w.Expression()
+    expr.add(y)
+    expr.axpy(x, w.rational(2))
+    assert expr == w.string_to_expr_lines(
+        "3 f^{v0}_{o0} t^{o0}_{v0}\n4 v^{o0,o1}_{v0,v1} t^{v0,v1}_{o0,o1}"
+    )
+    assert len(x) == 2
+
+    # a vanishing scale does nothing and equal terms cancel
+    expr.axpy(x, w.rational(0))
+    assert len(expr) == 2
+    expr.axpy(x, w.rational(-2))
+    assert expr == y
+
+    # the rvalue forms used by add and + leave the argument unchanged
+    expr = w.Expression()
+    expr.add(x, w.rational(-1))
+    expr.add(x)
+    assert len(expr) == 0
+    assert x + y == w.string_to_expr_lines(
+        "2 f^{v0}_{o0} t^{o0}_{v0}\n2 v^{o0,o1}_{v0,v1} t^{v0,v1}_{o0,o1}"
+    )
+    assert len(x) == 2 and len(y) == 1
+
+    # drain passes the terms in order and leaves the expression empty
+    expr = x + y
+    terms = []
+    expr.drain(lambda term, c: terms.append((term, c)))
+    assert len(expr) == 0
+    assert [c for _, c in terms] == [c for _, c in x + y]
+    rebuilt = w.Expression()
+    for term, c in terms:
+        rebuilt.add(term, c)
+    assert rebuilt == x + y
+
+
 if __name__ == "__main__":
     test_expression()
     test_expression2()
     test_expression3()
     test_expression4()
     test_expression5()
+    test_expression_simplify()
+    test_canonicalize_threads()
+    test_manybody_equations_blocks()
+    test_string_to_expr_lines()
+    test_serialize()
+    test_axpy_drain()
@@ -0,0 +1,49 @@
+import numpy as np
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_expression_arrays():
+    """Test exporting an expression to NumPy arrays and importing it back"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    expr = w.WickTheorem().contract(w.rational(1), Hbar, 0, 4)
+
+    arrays = expr.to_arrays()
+    terms = arrays["terms"]
+    assert len(terms) == len(expr)
+    assert sorted(arrays["labels"]) == ["f", "t", "v"]
+    for n, (term, factor) in enumerate(expr):
+        assert w.rational(int(terms[n]["numerator"]), int(terms[n]["denominator"])) == factor
+        assert np.isclose(terms[n]["coefficient"], float(factor))
+        assert np.count_nonzero(arrays["ops"]["term"] == n) == len(term.ops())
+    assert np.all(np.diff(arrays["tensors"]["term"]) >= 0)
+    assert np.all(arrays["indices"]["tensor"] < len(arrays["tensors"]))
+
+    assert w.expression_from_arrays(**arrays) == expr
+
+    # the records refer to their term and tensor by position
+    e = w.expression("1/2 f^{v0}_{o0} t^{o0}_{v0}")
+    arrays = e.to_arrays()
+    assert arrays["labels"] == ["f", "t"]
+    assert list(arrays["terms"]["numerator"]) == [1]
+    assert list(arrays["terms"]["denominator"]) == [2]
+    assert list(arrays["tensors"]["label"]) == [0, 1]
+    assert list(arrays["indices"]["tensor"]) == [0, 0, 1, 1]
+    assert list(arrays["indices"]["upper"]) == [0, 1, 0, 1]
+    assert len(arrays["ops"]) == 0
+    assert w.expression_from_arrays(**arrays) == e
+
+    assert len(w.expression_from_arrays(**w.Expression().to_arrays())) == 0
+
+
+if __name__ == "__main__":
+    test_expression_arrays()
@@ -0,0 +1,56 @@
+import wicked as w
+
+
+def initialize():
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+
+def test_frozen_expression():
+    """Test converting an expression to a frozen expression and back"""
+    initialize()
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    expr = w.WickTheorem().contract(w.rational(1), Hbar, 0, 4)
+
+    frozen = expr.freeze()
+    assert len(frozen) == len(expr)
+    assert frozen.to_expression() == expr
+    assert frozen.memory_size() > 0
+
+    # the terms keep the order of the expression
+    for (term, factor), (frozen_term, frozen_factor) in zip(expr, frozen):
+        assert str(frozen_term) == str(term)
+        assert frozen_factor == factor
+    assert str(frozen.term(0)) == str(frozen[0][0])
+    assert frozen.factor(0) == frozen[0][1]
+
+    assert len(w.FrozenExpression()) == 0
+    assert w.FrozenExpression().to_expression() == w.Expression()
+
+
+def test_frozen_expression_equations():
+    """Test the many-body equations of a frozen expression"""
+    initialize()
+    T = w.op("t", ["v+ v+ o o"])
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    expr = w.WickTheorem().contract(w.rational(1), V @ T, 0, 4)
+    frozen = w.FrozenExpression(expr)
+
+    equations = expr.to_manybody_equation("r")
+    frozen_equations = frozen.to_manybody_equation("r")
+    assert equations.keys() == frozen_equations.keys()
+    for block, eqs in equations.items():
+        frozen_eqs = frozen_equations[block]
+        assert [str(eq) for eq in eqs] == [str(eq) for eq in frozen_eqs]
+
+    code = [eq.compile("einsum") for eqs in equations.values() for eq in eqs]
+    assert frozen.compile("r", "einsum") == "\n".join(code)
+
+
+if __name__ == "__main__":
+    test_frozen_expression()
+    test_frozen_expression_equations()
@@ -67,8 +67,24 @@ def test_index2():
     test_indices = w.indices("o_0,o_1,a_0,a_1,a_2,v_0,v_1")
     assert indices == test_indices
     assert sign == w.rational(-1, 1)
+    indices = w.indices("v_0,v_1,a_2,a_0,a_1,o_1,o_0")
+    sign, indices = w.canonicalize_indices(indices, True)
+    test_indices = w.indices("v_1,v_0,a_2,a_1,a_0,o_1,o_0")
+    assert indices == test_indices
+    assert sign == w.rational(1, 1)
+
+
+def test_index_range():
+    """Test that an Index out of range is rejected"""
+    for space, pos in [(-1, 0), (256, 0), (0, -1), (0, 1 << 24)]:
+        try:
+            Index(space, pos)
+            assert False
+        except RuntimeError:
+            pass
 
 
 if __name__ == "__main__":
     test_index()
     test_index2()
+    test_index_range()
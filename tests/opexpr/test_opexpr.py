@@ -38,7 +38,54 @@ def test_opexpr3():
     op2 = w.op('a', ["v+ o+ v o"])
     assert op1 == op2
 
+def test_opexpr_multiply():
+    """Test the truncated product of operator expressions"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+    wt = w.WickTheorem()
+
+    H = w.utils.gen_op("f", 1, "ov", "ov") + w.utils.gen_op("v", 2, "ov", "ov")
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+
+    # the truncated products give the same contractions as the full products
+    for factors in [[H, T], [H, T, T], [H, T, T, T]]:
+        full = factors[0]
+        for factor in factors[1:]:
+            full = full @ factor
+        for maxrank in [0, 2, 4]:
+            truncated = w.multiply(factors, 0, maxrank)
+            assert truncated.size() <= full.size()
+            assert wt.contract(truncated, 0, maxrank) == wt.contract(
+                full, 0, maxrank
+            )
+
+    # H T T T cannot contribute to the energy through a product with only
+    # excitation operators of rank larger than two
+    prod = w.multiply([H, T, T, T], 0, 0)
+    assert prod.size() < (H @ T @ T @ T).size()
+    assert w.multiply(H, T, 0, 0) == w.multiply([H, T], 0, 0)
+
+
+def test_opexpr_add_sub():
+    """Test the sum and the difference of operator expressions"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+
+    T1 = w.op("t", ["v+ o"])
+    T2 = w.op("t", ["v+ v+ o o"])
+    T = T1 + T2
+    # the operands are not changed
+    assert T1.size() == 1 and T2.size() == 1
+    assert T - T2 == T1
+    assert (T - T).size() == 0
+    assert (T - T1) + T1 == T
+
+
 if __name__ == "__main__":
     test_opexpr1()
     test_opexpr2()
     test_opexpr3()
+    test_opexpr_multiply()
+    test_opexpr_add_sub()
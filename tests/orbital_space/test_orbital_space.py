@@ -23,7 +23,44 @@ def test_orbital_space_exceptions():
     with pytest.raises(Exception):
         w.add_space("v", "fermion", "occupied", ["m", "n"])
 
+    # the number of spaces is limited by the WICKED_MAX_SPACES build option
+    w.reset_space()
+    for n in range(w.max_spaces):
+        w.add_space(chr(ord("A") + n), "fermion", "occupied", [])
+    with pytest.raises(Exception):
+        w.add_space("z", "fermion", "occupied", [])
+    w.reset_space()
+
+
+def test_orbital_space_context():
+    """Contract with a private orbital space definition"""
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b"])
+
+    mr = w.OrbitalSpaceInfo()
+    mr.add_space("c", "fermion", "occupied", ["m", "n"])
+    mr.add_space("a", "fermion", "general", ["u", "v", "w", "x", "y", "z"])
+    mr.add_space("v", "fermion", "unoccupied", ["e", "f"])
+
+    # operators are built with the definition they refer to
+    with w.orbital_space_context(mr):
+        T1 = w.op("t", ["a+ a"])
+        F = w.op("f", ["a+ a"])
+        wt = w.WickTheorem(mr)
+        val = wt.contract(w.rational(1), F @ T1, 0, 0)
+        ref = w.utils.string_to_expr(
+            """eta1^{a1}_{a0} f^{a0}_{a2} gamma1^{a2}_{a3} t^{a3}_{a1}
+f^{a1}_{a0} lambda2^{a0,a3}_{a1,a2} t^{a2}_{a3}"""
+        )
+        assert val == ref
+
+    # the global definition is untouched
+    assert w.num_spaces() == 2
+    assert w.osi().label(0) == "o"
+
 
 if __name__ == "__main__":
     test_orbital_space()
     test_orbital_space_exceptions()
+    test_orbital_space_context()
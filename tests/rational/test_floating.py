@@ -0,0 +1,36 @@
+import wicked as w
+
+
+def test_floating():
+    """Test the double-precision coefficients (available when wicked is
+    built with WICKED_FLOAT_COEFFICIENTS)"""
+    if not w.use_float_coefficients():
+        assert not hasattr(w, "floating")
+        return
+
+    third = w.floating(1, 3)
+    assert third * w.floating(3) == w.floating(1)
+    assert third.str() == "1/3"
+    assert repr(w.floating(0.5)) == "floating(0.5)"
+    assert (w.floating(0.1) + w.floating(0.2)).str() == "3/10"
+    # numbers that differ only by rounding errors are equal
+    assert w.floating(0.1) + w.floating(0.2) == w.floating(3, 10)
+    assert w.floating(1, 3) + w.rational(-1, 3) == w.floating(0)
+
+    # the terms whose factors cancel up to rounding errors are removed
+    w.reset_space()
+    w.add_space("o", "fermion", "occupied", ["i", "j", "k", "l", "m", "n"])
+    w.add_space("v", "fermion", "unoccupied", ["a", "b", "c", "d", "e", "f"])
+    T = w.op("t", ["v+ o", "v+ v+ o o"])
+    F = w.utils.gen_op("f", 1, "ov", "ov")
+    V = w.utils.gen_op("v", 2, "ov", "ov")
+    Hbar = w.bch_series(F + V, T, 2)
+    expr = w.WickTheorem().contract(w.rational(1), Hbar, 0, 0)
+    other = w.WickTheorem().contract(w.rational(1), Hbar, 0, 0)
+    assert len(expr) > 0
+    expr.add(other, w.floating(-1.0 / 3.0) * w.floating(3))
+    assert len(expr) == 0
+
+
+if __name__ == "__main__":
+    test_floating()
@@ -46,5 +46,22 @@ def test_rational():
         assert w.make_rational("-/2")
 
 
+def test_rational_overflow():
+    """Test rational numbers that do not fit in 64-bit integers"""
+    f = w.rational(1)
+    if w.use_boost_1024_int():
+        for i in range(1, 31):
+            f = f * w.rational(i)
+        assert repr(f) == "rational(265252859812191058636308480000000,1)"
+        for i in range(1, 31):
+            f = f / w.rational(i)
+        assert f == w.rational(1)
+    else:
+        with pytest.raises(Exception):
+            for i in range(1, 31):
+                f = f * w.rational(i)
+
+
 if __name__ == "__main__":
     test_rational()
+    test_rational_overflow()
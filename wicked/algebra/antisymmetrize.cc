@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+
+#include "antisymmetrize.h"
+
+namespace {
+
+/// The form of a term used to find its permutation partners
+struct PartnerForm {
+  /// A string that is the same for all the relabelings of the summed indices
+  std::string key;
+  /// The phase factor of the term with respect to its form
+  scalar_t phase;
+};
+
+std::vector<Index> block_indices(const Tensor &t) {
+  std::vector<Index> indices(t.upper().begin(), t.upper().end());
+  indices.insert(indices.end(), t.lower().begin(), t.lower().end());
+  return indices;
+}
+
+/// Return the form of the right-hand side of an equation after relabeling
+/// its indices with idx_map. The indices of the left-hand side are kept fixed
+/// by attaching to each of them a tensor with a distinct label
+PartnerForm partner_form(const Equation &eq, index_map_t idx_map) {
+  SymbolicTerm rhs = eq.rhs();
+  rhs.reindex(idx_map);
+  std::vector<Tensor> tensors = rhs.tensors();
+  const std::vector<Index> indices = block_indices(eq.lhs().tensors()[0]);
+  for (size_t k = 0; k < indices.size(); k++) {
+    tensors.push_back(Tensor("#" + std::to_string(k), {indices[k]}, {},
+                             SymmetryType::Antisymmetric));
+  }
+  SymbolicTerm term(rhs.normal_ordered(), rhs.ops(), tensors);
+  const scalar_t phase = term.simplify();
+  return {eq.lhs().str() + " += " + term.str(), phase};
+}
+
+/// Return the permutation operators that exchange the indices of the
+/// left-hand side of an equation that are in the same space and on the same
+/// side, but belong to different tensors of the right-hand side
+std::vector<PermutationOperator> candidate_operators(const Equation &eq) {
+  const Tensor &lhs = eq.lhs().tensors()[0];
+  const auto &tensors = eq.rhs().tensors();
+  auto tensor_of = [&](const Index &idx) {
+    for (size_t t = 0; t < tensors.size(); t++) {
+      const auto indices = tensors[t].indices();
+      if (std::find(indices.begin(), indices.end(), idx) != indices.end()) {
+        return static_cast<int>(t);
+      }
+    }
+    return -1;
+  };
+
+  std::vector<PermutationOperator> candidates;
+  for (const auto *indices : {&lhs.upper(), &lhs.lower()}) {
+    for (int s = 0; s < osi()->num_spaces(); s++) {
+      // the indices of this space grouped by tensor
+      std::vector<int> group_tensor;
+      std::vector<std::vector<Index>> groups;
+      for (const Index &idx : *indices) {
+        if (idx.space() != s) {
+          continue;
+        }
+        const int t = tensor_of(idx);
+        auto it = std::find(group_tensor.begin(), group_tensor.end(), t);
+        if (it == group_tensor.end()) {
+          group_tensor.push_back(t);
+          groups.push_back({idx});
+        } else {
+          groups[it - group_tensor.begin()].push_back(idx);
+        }
+      }
+      if (groups.size() > 1) {
+        candidates.push_back(PermutationOperator(groups));
+      }
+    }
+  }
+  return candidates;
+}
+
+} // namespace
+
+std::vector<Equation>
+collapse_permutation_partners(const std::vector<Equation> &equations) {
+  const size_t neqs = equations.size();
+  std::vector<PartnerForm> forms;
+  std::unordered_map<std::string, std::vector<size_t>> eqs_with_key;
+  for (size_t i = 0; i < neqs; i++) {
+    forms.push_back(partner_form(equations[i], index_map_t()));
+    eqs_with_key[forms[i].key].push_back(i);
+  }
+
+  std::vector<Equation> result;
+  std::vector<bool> used(neqs, false);
+  for (size_t i = 0; i < neqs; i++) {
+    if (used[i]) {
+      continue;
+    }
+    const Equation &eq = equations[i];
+    used[i] = true;
+    if (not eq.permutations().empty() or forms[i].phase == scalar_t(0)) {
+      result.push_back(eq);
+      continue;
+    }
+
+    // add one operator at a time and keep it if all the partners generated by
+    // the product of the operators are found
+    std::vector<PermutationOperator> accepted;
+    std::vector<size_t> members;
+    for (const auto &candidate : candidate_operators(eq)) {
+      std::vector<PermutationOperator> ops = accepted;
+      ops.push_back(candidate);
+      const auto perms = permutations(ops);
+      std::vector<size_t> matched;
+      for (size_t p = 1; p < perms.size(); p++) {
+        const PartnerForm form = partner_form(eq, perms[p].first);
+        // a partner with factor f2 and phase c2 satisfies
+        // f2 * c2 = sign * f * c, where c is the phase of the permuted term
+        const scalar_t target =
+            scalar_t(perms[p].second) * eq.rhs_factor() * form.phase;
+        auto it = eqs_with_key.find(form.key);
+        if (it == eqs_with_key.end() or form.phase == scalar_t(0)) {
+          break;
+        }
+        for (size_t j : it->second) {
+          if (not used[j] and
+              std::find(matched.begin(), matched.end(), j) == matched.end() and
+              equations[j].permutations().empty() and
+              equations[j].rhs_factor() * forms[j].phase == target) {
+            matched.push_back(j);
+            break;
+          }
+        }
+        if (matched.size() != p) {
+          break;
+        }
+      }
+      if (matched.size() + 1 == perms.size()) {
+        accepted = ops;
+        members = matched;
+      }
+    }
+    for (size_t j : members) {
+      used[j] = true;
+    }
+    result.push_back(Equation(eq.lhs(), eq.rhs(), eq.rhs_factor(), accepted));
+  }
+  return result;
+}
+
+std::map<std::string, std::vector<Equation>> collapse_permutation_partners(
+    const std::map<std::string, std::vector<Equation>> &equations) {
+  std::map<std::string, std::vector<Equation>> result;
+  for (const auto &[key, eqs] : equations) {
+    result[key] = collapse_permutation_partners(eqs);
+  }
+  return result;
+}
+
+std::string compile_antisymmetrizer(const std::string &label,
+                                    const std::string &block,
+                                    const std::string &format) {
+  // build a tensor with the indices of the block and the antisymmetrizers of
+  // the groups of indices in the same space
+  std::vector<std::vector<Index>> sides(2);
+  std::vector<int> count(osi()->num_spaces(), 0);
+  std::vector<PermutationOperator> antisymmetrizers;
+  size_t side = 0;
+  for (char c : block) {
+    if (c == '|') {
+      if (++side > 1) {
+        throw std::runtime_error("compile_antisymmetrizer() - the block '" +
+                                 block + "' has more than one bar");
+      }
+      continue;
+    }
+    const int s = osi()->label_to_space(c);
+    sides[side].push_back(Index(s, count[s]++));
+  }
+  for (const auto &indices : sides) {
+    for (int s = 0; s < osi()->num_spaces(); s++) {
+      std::vector<std::vector<Index>> groups;
+      for (const Index &idx : indices) {
+        if (idx.space() == s) {
+          groups.push_back({idx});
+        }
+      }
+      if (groups.size() > 1) {
+        antisymmetrizers.push_back(PermutationOperator(groups));
+      }
+    }
+  }
+  const Tensor t(label, sides[1], sides[0], SymmetryType::Nonsymmetric);
+
+  std::string code;
+  if (format == "einsum" or format == "cupy") {
+    const std::string name =
+        format == "einsum"
+            ? einsum_block_label(t)
+            : label + "[\"" + einsum_block_label(t).substr(label.size()) +
+                  "\"]";
+    for (const auto &op : antisymmetrizers) {
+      code += name + " = " + permuted_sum(name, t, {op}) + "\n";
+    }
+    return code;
+  }
+  if (format == "cpp") {
+    const std::string name = label + "_" +
+                             einsum_block_label(t).substr(label.size());
+    const std::vector<Index> indices = block_indices(t);
+    std::vector<std::string> dims;
+    for (const Index &idx : indices) {
+      dims.push_back(std::string("n_") + osi()->label(idx.space()));
+    }
+    const std::string size = dims.empty() ? "1" : join(dims, " * ");
+    for (const auto &op : antisymmetrizers) {
+      // the identity is already in the block
+      code += "{\n  const std::vector<double> _A(" + name + ", " + name +
+              " + " + size + ");\n";
+      const auto perms = op.permutations();
+      for (size_t p = 1; p < perms.size(); p++) {
+        std::vector<std::string> axes;
+        for (int axis : permutation_axes(indices, perms[p].first)) {
+          axes.push_back(std::to_string(axis));
+        }
+        code += "  wicked_permute_add(" + name + ", _A.data(), " +
+                (perms[p].second > 0 ? "1.0" : "-1.0") + ", {" +
+                join(dims, ", ") + "}, {" + join(axes, ", ") + "});\n";
+      }
+      code += "}\n";
+    }
+    return code;
+  }
+  throw std::runtime_error("compile_antisymmetrizer() - the format '" +
+                           format +
+                           "' is not valid. Choices are 'einsum', 'cupy', or "
+                           "'cpp'");
+}
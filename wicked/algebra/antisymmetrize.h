@@ -0,0 +1,40 @@
+#ifndef _wicked_antisymmetrize_h_
+#define _wicked_antisymmetrize_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "equation.h"
+
+/// Combine the equations that are antisymmetric permutation partners into one
+/// equation with a permutation operator. Two equations are partners with
+/// respect to a permutation of the indices of the left-hand side if they have
+/// the same left-hand side and the right-hand side of one is, up to a
+/// relabeling of the summed indices, the permuted right-hand side of the other
+/// times the sign of the permutation. The permutations tried for each
+/// equation exchange left-hand side indices of the same space (upper or lower)
+/// that belong to different tensors. For example,
+///   R^{ij}_{ab} += T^{i}_{a} T^{j}_{b} - T^{j}_{a} T^{i}_{b}
+/// is collapsed to R^{ij}_{ab} += P(i/j) T^{i}_{a} T^{j}_{b}
+std::vector<Equation>
+collapse_permutation_partners(const std::vector<Equation> &equations);
+
+/// Collapse the permutation partners of the equations returned by
+/// Expression::to_manybody_equation
+std::map<std::string, std::vector<Equation>> collapse_permutation_partners(
+    const std::map<std::string, std::vector<Equation>> &equations);
+
+/// Return the code that antisymmetrizes a residual block in place, that is,
+/// that applies the antisymmetrizer of each group of upper and lower indices
+/// in the same space. The block is given by the spaces of its indices, with
+/// the upper and lower indices separated by a bar (e.g., "ooo|vvv"), and each
+/// group is antisymmetrized with one statement, so that for "ooo|vvv" the
+/// block is read 12 times instead of once for each of the 36 permutations.
+/// The format is one of 'einsum' (e.g., the block Rooovvv), 'cupy' (the block
+/// R["ooovvv"]), or 'cpp' (the block R_ooovvv)
+std::string compile_antisymmetrizer(const std::string &label,
+                                    const std::string &block,
+                                    const std::string &format);
+
+#endif // _wicked_antisymmetrize_h_
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+
+#include "contraction_path.h"
+
+/// The largest number of tensors for which all the orders are compared
+static constexpr size_t max_optimal_path_tensors = 10;
+
+std::string ContractionPath::einsum_path() const {
+  std::vector<std::string> str_vec = {"\"einsum_path\""};
+  for (const auto &[i, j] : steps) {
+    str_vec.push_back(j < 0 ? "(" + std::to_string(i) + ",)"
+                            : "(" + std::to_string(i) + "," +
+                                  std::to_string(j) + ")");
+  }
+  return "[" + join(str_vec, ",") + "]";
+}
+
+ContractionPath optimal_contraction_path(const Tensor &lhs,
+                                         const std::vector<Tensor> &rhs,
+                                         const std::map<char, int> &dims) {
+  const size_t n = rhs.size();
+  using mask_t = uint32_t;
+
+  // the indices of the term, with their dimension and the tensors that use
+  // them (the left-hand side is bit n)
+  std::vector<Index> indices;
+  std::vector<double> index_dim;
+  std::vector<mask_t> index_tensors;
+  auto add_indices = [&](const Tensor &t, size_t bit) {
+    for (const Index &idx : t.indices()) {
+      auto it = std::find(indices.begin(), indices.end(), idx);
+      if (it == indices.end()) {
+        const char space = osi()->label(idx.space());
+        auto dim = dims.find(space);
+        if (dim == dims.end()) {
+          throw std::runtime_error(
+              "optimal_contraction_path - no dimension for the space '" +
+              std::string(1, space) + "'");
+        }
+        indices.push_back(idx);
+        index_dim.push_back(dim->second);
+        index_tensors.push_back(0);
+        it = indices.end() - 1;
+      }
+      index_tensors[it - indices.begin()] |= mask_t(1) << bit;
+    }
+  };
+  for (size_t t = 0; t < n; t++) {
+    add_indices(rhs[t], t);
+  }
+  add_indices(lhs, n);
+
+  // the cost of contracting the products of two subsets of the tensors. The
+  // indices of a product are those shared by the subset and the rest of the
+  // term
+  auto contraction_cost = [&](mask_t s1, mask_t s2) {
+    double cost = 1.0;
+    for (size_t k = 0; k < indices.size(); k++) {
+      const bool in1 = (index_tensors[k] & s1) and (index_tensors[k] & ~s1);
+      const bool in2 = (index_tensors[k] & s2) and (index_tensors[k] & ~s2);
+      if (in1 or in2) {
+        cost *= index_dim[k];
+      }
+    }
+    return 2.0 * cost;
+  };
+
+  ContractionPath path;
+  path.scaling.assign(osi()->num_spaces(), 0);
+  if (n == 0) {
+    return path;
+  }
+  if (n == 1) {
+    double cost = 1.0;
+    for (size_t k = 0; k < indices.size(); k++) {
+      cost *= index_dim[k];
+      path.scaling[indices[k].space()] += 1;
+    }
+    path.steps.emplace_back(0, -1);
+    path.flops = cost;
+    return path;
+  }
+
+  // best[s] is the cost of the cheapest way to contract the subset s and
+  // split[s] is the first part of its last contraction
+  if (n >= 8 * sizeof(mask_t)) {
+    throw std::runtime_error(
+        "optimal_contraction_path - too many tensors in the term");
+  }
+  const mask_t all = (mask_t(1) << n) - 1;
+  std::unordered_map<mask_t, double> best;
+  std::unordered_map<mask_t, mask_t> split;
+  if (n <= max_optimal_path_tensors) {
+    for (size_t t = 0; t < n; t++) {
+      best[mask_t(1) << t] = 0.0;
+    }
+    for (mask_t s = 1; s <= all; s++) {
+      if ((s & (s - 1)) == 0) {
+        continue;
+      }
+      // consider each split once by keeping the lowest tensor in s1
+      const mask_t low = s & (~s + 1);
+      best[s] = std::numeric_limits<double>::max();
+      for (mask_t s1 = (s - 1) & s; s1 > 0; s1 = (s1 - 1) & s) {
+        if (not(s1 & low)) {
+          continue;
+        }
+        const mask_t s2 = s ^ s1;
+        const double cost = best[s1] + best[s2] + contraction_cost(s1, s2);
+        if (cost < best[s]) {
+          best[s] = cost;
+          split[s] = s1;
+        }
+      }
+    }
+  } else {
+    // contract the tensors from left to right
+    mask_t s = 1;
+    best[s] = 0.0;
+    for (size_t t = 1; t < n; t++) {
+      const mask_t next = s | (mask_t(1) << t);
+      best[next] = best[s] + contraction_cost(s, mask_t(1) << t);
+      split[next] = s;
+      s = next;
+    }
+  }
+  path.flops = best[all];
+
+  // translate the tree of contractions to the numbering of numpy
+  std::vector<mask_t> operands;
+  for (size_t t = 0; t < n; t++) {
+    operands.push_back(mask_t(1) << t);
+  }
+  // the cost of the step that gives the formal scaling
+  double scaling_cost = 0.0;
+  std::function<void(mask_t)> add_steps = [&](mask_t s) {
+    if ((s & (s - 1)) == 0) {
+      return;
+    }
+    const mask_t s1 = split[s];
+    const mask_t s2 = s ^ s1;
+    add_steps(s1);
+    add_steps(s2);
+    int i = std::find(operands.begin(), operands.end(), s1) - operands.begin();
+    int j = std::find(operands.begin(), operands.end(), s2) - operands.begin();
+    if (i > j) {
+      std::swap(i, j);
+    }
+    path.steps.emplace_back(i, j);
+    operands.erase(operands.begin() + j);
+    operands.erase(operands.begin() + i);
+    operands.push_back(s);
+
+    // the size of the product and the number of indices of each space used
+    std::vector<int> step_scaling(osi()->num_spaces(), 0);
+    double size = 1.0;
+    for (size_t k = 0; k < indices.size(); k++) {
+      const bool in1 = (index_tensors[k] & s1) and (index_tensors[k] & ~s1);
+      const bool in2 = (index_tensors[k] & s2) and (index_tensors[k] & ~s2);
+      if (in1 or in2) {
+        step_scaling[indices[k].space()] += 1;
+      }
+      if ((index_tensors[k] & s) and (index_tensors[k] & ~s)) {
+        size *= index_dim[k];
+      }
+    }
+    if (s != all) {
+      path.max_intermediate = std::max(path.max_intermediate, size);
+    }
+    auto total = [](const std::vector<int> &v) {
+      return std::accumulate(v.begin(), v.end(), 0);
+    };
+    const double step_cost = contraction_cost(s1, s2);
+    if (total(step_scaling) > total(path.scaling) or
+        (total(step_scaling) == total(path.scaling) and
+         step_cost > scaling_cost)) {
+      path.scaling = step_scaling;
+      scaling_cost = step_cost;
+    }
+  };
+  add_steps(all);
+  return path;
+}
+
+ContractionPath left_to_right_contraction_path(int n) {
+  ContractionPath path;
+  if (n == 1) {
+    path.steps.emplace_back(0, -1);
+  } else if (n > 1) {
+    // the product is appended to the operands and contracted with the first
+    path.steps.emplace_back(0, 1);
+    for (int count = n - 1; count > 1; count--) {
+      path.steps.emplace_back(0, count - 1);
+    }
+  }
+  return path;
+}
@@ -0,0 +1,43 @@
+#ifndef _wicked_contraction_path_h_
+#define _wicked_contraction_path_h_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensor.h"
+
+/// An order in which to contract the tensors of a term two at a time
+struct ContractionPath {
+  /// The operands contracted at each step, numbered like in numpy.einsum_path:
+  /// the two operands are removed from the list and their product is appended
+  /// to the end of it
+  std::vector<std::pair<int, int>> steps;
+  /// The number of floating-point operations
+  double flops = 0.0;
+  /// The number of elements of the largest intermediate product
+  double max_intermediate = 0.0;
+  /// The number of indices of each orbital space (by position) in the step
+  /// with the most indices, that is, the formal scaling of the term
+  std::vector<int> scaling;
+
+  /// Return the path as the optimize argument of numpy.einsum (e.g.,
+  /// ["einsum_path",(0,1),(0,1)])
+  std::string einsum_path() const;
+};
+
+/// Return the order of pairwise contractions of the tensors rhs into lhs that
+/// requires the fewest operations. The cost of a contraction is the product of
+/// the dimensions of the indices of the two operands, and dims gives the
+/// dimension of each orbital space (by label). All the orders are compared for
+/// terms with up to 10 tensors, while larger terms are contracted from left to
+/// right
+ContractionPath optimal_contraction_path(const Tensor &lhs,
+                                         const std::vector<Tensor> &rhs,
+                                         const std::map<char, int> &dims);
+
+/// Return the path that contracts n tensors from left to right
+ContractionPath left_to_right_contraction_path(int n);
+
+#endif // _wicked_contraction_path_h_
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#include "fmt/format.h"
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+
+#include "contraction_path.h"
+#include "cost.h"
+#include "expression.h"
+
+namespace {
+
+int total_scaling(const std::vector<int> &scaling) {
+  return std::accumulate(scaling.begin(), scaling.end(), 0);
+}
+
+bool by_flops(const std::pair<Equation, EquationCost> &a,
+              const std::pair<Equation, EquationCost> &b) {
+  return a.second.flops > b.second.flops;
+}
+
+} // namespace
+
+std::string EquationCost::scaling_str() const {
+  std::vector<std::string> str_vec;
+  for (size_t s = 0; s < scaling.size(); s++) {
+    if (scaling[s] > 0) {
+      str_vec.push_back(std::string(1, osi()->label(s)) + "^" +
+                        std::to_string(scaling[s]));
+    }
+  }
+  return str_vec.empty() ? "1" : join(str_vec, " ");
+}
+
+EquationCost equation_cost(const Equation &eq,
+                           const std::map<char, int> &dims) {
+  const Tensor &lhs = eq.lhs().tensors()[0];
+  const ContractionPath path =
+      optimal_contraction_path(lhs, eq.rhs().tensors(), dims);
+  EquationCost cost;
+  cost.flops = path.flops;
+  cost.max_intermediate = path.max_intermediate;
+  cost.scaling = path.scaling;
+  if (not eq.permutations().empty()) {
+    double size = 1.0;
+    for (const Index &idx : lhs.indices()) {
+      size *= dims.at(osi()->label(idx.space()));
+    }
+    cost.flops += size * permutations(eq.permutations()).size();
+    cost.max_intermediate = std::max(cost.max_intermediate, size);
+  }
+  return cost;
+}
+
+CostReport::CostReport(const std::vector<BlockCost> &blocks)
+    : blocks_(blocks) {}
+
+double CostReport::flops() const {
+  double flops = 0.0;
+  for (const auto &block : blocks_) {
+    flops += block.total.flops;
+  }
+  return flops;
+}
+
+std::string CostReport::str(int nterms) const {
+  std::vector<std::string> lines;
+  lines.push_back(fmt::format("{:<12} {:>10} {:>12} {:>12} {:>6}", "block",
+                              "flops", "intermediate", "scaling", "terms"));
+  for (const auto &block : blocks_) {
+    lines.push_back(fmt::format("{:<12} {:>10.3e} {:>12.3e} {:>12} {:>6}",
+                                block.block, block.total.flops,
+                                block.total.max_intermediate,
+                                block.total.scaling_str(),
+                                block.terms.size()));
+    const int nshown =
+        std::min(nterms, static_cast<int>(block.terms.size()));
+    for (int k = 0; k < nshown; k++) {
+      const auto &[eq, cost] = block.terms[k];
+      lines.push_back(fmt::format("  {:>10.3e} {:>12} {}", cost.flops,
+                                  cost.scaling_str(), eq.str()));
+    }
+  }
+  lines.push_back(fmt::format("{:<12} {:>10.3e}", "total", flops()));
+  return join(lines, "\n");
+}
+
+CostReport
+cost_report(const std::map<std::string, std::vector<Equation>> &equations,
+            const std::map<char, int> &dims) {
+  std::vector<BlockCost> blocks;
+  for (const auto &[key, eqs] : equations) {
+    BlockCost block;
+    block.block = key;
+    block.total.scaling.assign(osi()->num_spaces(), 0);
+    for (const auto &eq : eqs) {
+      const EquationCost cost = equation_cost(eq, dims);
+      block.total.flops += cost.flops;
+      block.total.max_intermediate =
+          std::max(block.total.max_intermediate, cost.max_intermediate);
+      block.terms.push_back(std::make_pair(eq, cost));
+    }
+    std::stable_sort(block.terms.begin(), block.terms.end(), by_flops);
+    // the scaling of the block is that of the most expensive term among
+    // those with the most indices
+    for (const auto &term : block.terms) {
+      if (total_scaling(term.second.scaling) >
+          total_scaling(block.total.scaling)) {
+        block.total.scaling = term.second.scaling;
+      }
+    }
+    blocks.push_back(block);
+  }
+  std::stable_sort(blocks.begin(), blocks.end(),
+                   [](const BlockCost &a, const BlockCost &b) {
+                     return a.total.flops > b.total.flops;
+                   });
+  return CostReport(blocks);
+}
+
+CostReport cost_report(const Expression &expr, const std::string &label,
+                       const std::map<char, int> &dims) {
+  return cost_report(expr.to_manybody_equation(label), dims);
+}
+
+std::ostream &operator<<(std::ostream &os, const CostReport &report) {
+  os << report.str();
+  return os;
+}
@@ -0,0 +1,82 @@
+#ifndef _wicked_cost_h_
+#define _wicked_cost_h_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "equation.h"
+
+class Expression;
+
+/// The cost of evaluating an equation along its optimal contraction path
+struct EquationCost {
+  /// The number of floating-point operations
+  double flops = 0.0;
+  /// The number of elements of the largest intermediate
+  double max_intermediate = 0.0;
+  /// The number of indices of each orbital space (by position) in the most
+  /// expensive step, that is, the formal scaling
+  std::vector<int> scaling;
+
+  /// Return the formal scaling as a string (e.g., "o^2 v^4")
+  std::string scaling_str() const;
+};
+
+/// Return the cost of an equation for the dimensions dims of the orbital
+/// spaces (by label). Applying the permutation operators is counted as one
+/// operation per element of the left-hand side and permuted copy, and the
+/// term they act on as an intermediate
+EquationCost equation_cost(const Equation &eq,
+                           const std::map<char, int> &dims);
+
+/// The cost of the equations of a residual block
+struct BlockCost {
+  /// The label of the block (a key of the map of equations)
+  std::string block;
+  /// The total number of operations, the largest intermediate and the
+  /// highest scaling of the terms
+  EquationCost total;
+  /// The equations and their cost, from the most to the least expensive
+  std::vector<std::pair<Equation, EquationCost>> terms;
+};
+
+/// A breakdown of the cost of a set of equations by residual block
+class CostReport {
+public:
+  // ==> Constructor <==
+  explicit CostReport(const std::vector<BlockCost> &blocks);
+
+  // ==> Class public interface <==
+
+  /// Return the blocks, from the most to the least expensive
+  const std::vector<BlockCost> &blocks() const { return blocks_; }
+
+  /// Return the total number of operations
+  double flops() const;
+
+  /// Return a table with the cost of each block and of its nterms most
+  /// expensive terms
+  std::string str(int nterms = 3) const;
+
+private:
+  // ==> Class private data <==
+
+  std::vector<BlockCost> blocks_;
+};
+
+/// Estimate the cost of the equations returned by
+/// Expression::to_manybody_equation
+CostReport
+cost_report(const std::map<std::string, std::vector<Equation>> &equations,
+            const std::map<char, int> &dims);
+
+/// Estimate the cost of the many-body equations of an expression
+CostReport cost_report(const Expression &expr, const std::string &label,
+                       const std::map<char, int> &dims);
+
+/// Print to an output stream
+std::ostream &operator<<(std::ostream &os, const CostReport &report);
+
+#endif // _wicked_cost_h_
@@ -0,0 +1,444 @@
+#include <algorithm>
+
+#include "fmt/format.h"
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+
+#include "contraction_path.h"
+#include "cpp_codegen.h"
+#include "factorize.h"
+
+namespace {
+
+/// The functions called by the generated code
+const char *cpp_runtime = R"(
+extern "C" void dgemm_(const char *transa, const char *transb,
+                       const int *m, const int *n, const int *k,
+                       const double *alpha, const double *a, const int *lda,
+                       const double *b, const int *ldb, const double *beta,
+                       double *c, const int *ldc);
+
+/// c(m,n) += alpha * op(a) op(b) for row-major matrices, where op(a) is a(m,k)
+/// or the transpose of a(k,m)
+static void wicked_gemm(bool ta, bool tb, size_t m, size_t n, size_t k,
+                        double alpha, const double *a, const double *b,
+                        double *c) {
+  if (m == 0 or n == 0 or k == 0) {
+    return;
+  }
+  // a row-major c is the column-major matrix c^T = op(b)^T op(a)^T
+  const int im = m, in = n, ik = k;
+  const int lda = ta ? im : ik;
+  const int ldb = tb ? ik : in;
+  const double beta = 1.0;
+  dgemm_(tb ? "T" : "N", ta ? "T" : "N", &in, &im, &ik, &alpha, b, &ldb, a,
+         &lda, &beta, c, &in);
+}
+
+/// dst += alpha * src with the axes permuted, where axis k of dst is axis
+/// perm[k] of src and shape is the shape of src
+static void wicked_permute_add(double *dst, const double *src, double alpha,
+                               const std::vector<size_t> &shape,
+                               const std::vector<int> &perm) {
+  const size_t rank = shape.size();
+  std::vector<size_t> src_stride(rank, 1);
+  for (size_t k = rank; k-- > 1;) {
+    src_stride[k - 1] = src_stride[k] * shape[k];
+  }
+  std::vector<size_t> dst_shape(rank), stride(rank), idx(rank, 0);
+  size_t size = 1;
+  for (size_t k = 0; k < rank; k++) {
+    dst_shape[k] = shape[perm[k]];
+    stride[k] = src_stride[perm[k]];
+    size *= dst_shape[k];
+  }
+  size_t offset = 0;
+  for (size_t p = 0; p < size; p++) {
+    dst[p] += alpha * src[offset];
+    for (size_t k = rank; k-- > 0;) {
+      if (++idx[k] < dst_shape[k]) {
+        offset += stride[k];
+        break;
+      }
+      offset -= (dst_shape[k] - 1) * stride[k];
+      idx[k] = 0;
+    }
+  }
+}
+)";
+
+/// A tensor block used by the generated code
+struct Operand {
+  std::string name;
+  std::vector<Index> indices;
+};
+
+std::vector<Index> tensor_indices(const Tensor &t) {
+  std::vector<Index> indices(t.upper().begin(), t.upper().end());
+  indices.insert(indices.end(), t.lower().begin(), t.lower().end());
+  return indices;
+}
+
+std::string dim_name(const Index &idx) {
+  return std::string("n_") + osi()->label(idx.space());
+}
+
+/// Return the number of elements of a block (e.g., "n_o * n_v")
+std::string size_expr(const std::vector<Index> &indices) {
+  std::vector<std::string> str_vec;
+  for (const Index &idx : indices) {
+    str_vec.push_back(dim_name(idx));
+  }
+  return str_vec.empty() ? "1" : join(str_vec, " * ");
+}
+
+/// Return the shape of a block (e.g., "{n_o, n_v}")
+std::string shape_expr(const std::vector<Index> &indices) {
+  std::vector<std::string> str_vec;
+  for (const Index &idx : indices) {
+    str_vec.push_back(dim_name(idx));
+  }
+  return "{" + join(str_vec, ", ") + "}";
+}
+
+/// Return the position of an element of a block (e.g., "o0 * n_v + v0")
+std::string offset_expr(const std::vector<Index> &indices) {
+  if (indices.empty()) {
+    return "0";
+  }
+  std::string offset = indices[0].str();
+  for (size_t k = 1; k < indices.size(); k++) {
+    offset = (k == 1 ? offset : "(" + offset + ")") + " * " +
+             dim_name(indices[k]) + " + " + indices[k].str();
+  }
+  return offset;
+}
+
+bool contains(const std::vector<Index> &indices, const Index &idx) {
+  return std::find(indices.begin(), indices.end(), idx) != indices.end();
+}
+
+bool has_repeated_indices(const std::vector<Index> &indices) {
+  for (size_t k = 0; k < indices.size(); k++) {
+    if (std::count(indices.begin(), indices.end(), indices[k]) > 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Write the C++ code of a single contraction
+class ContractionWriter {
+public:
+  explicit ContractionWriter(std::string &code) : code_(code) {}
+
+  /// Add alpha times the product of the operands to c with explicit loops
+  void loops(const Operand &c, const std::vector<Operand> &ops,
+             const std::string &alpha) {
+    std::vector<Index> indices = c.indices;
+    for (const auto &op : ops) {
+      for (const Index &idx : op.indices) {
+        if (not contains(indices, idx)) {
+          indices.push_back(idx);
+        }
+      }
+    }
+    std::string indent = "  ";
+    for (const Index &idx : indices) {
+      code_ += indent + "for (size_t " + idx.str() + " = 0; " + idx.str() +
+               " < " + dim_name(idx) + "; " + idx.str() + "++)\n";
+      indent += "  ";
+    }
+    std::string product = alpha;
+    for (const auto &op : ops) {
+      product += " * " + op.name + "[" + offset_expr(op.indices) + "]";
+    }
+    code_ += indent + c.name + "[" + offset_expr(c.indices) + "] += " +
+             product + ";\n";
+  }
+
+  /// Add alpha times the contraction of a and b to c. When possible the
+  /// operands are brought to the form c(M,N) = a(M,K) b(K,N) and multiplied
+  /// with GEMM, otherwise the contraction is done with loops
+  void contract(const Operand &c, const Operand &a, const Operand &b,
+                const std::string &alpha) {
+    std::vector<Index> m, n, k;
+    bool gemm = not(has_repeated_indices(a.indices) or
+                    has_repeated_indices(b.indices) or
+                    has_repeated_indices(c.indices));
+    for (const Index &idx : a.indices) {
+      if (contains(c.indices, idx)) {
+        gemm = gemm and not contains(b.indices, idx);
+        m.push_back(idx);
+      } else {
+        gemm = gemm and contains(b.indices, idx);
+        k.push_back(idx);
+      }
+    }
+    for (const Index &idx : b.indices) {
+      if (contains(c.indices, idx)) {
+        n.push_back(idx);
+      } else {
+        gemm = gemm and contains(a.indices, idx);
+      }
+    }
+    gemm = gemm and (m.size() + n.size() == c.indices.size());
+    if (not gemm) {
+      loops(c, {a, b}, alpha);
+      return;
+    }
+
+    // bring a to the form a(M,K) or a(K,M)
+    std::string a_name = a.name;
+    bool ta = false;
+    if (a.indices == concat(k, m) and not k.empty() and not m.empty()) {
+      ta = true;
+    } else if (a.indices != concat(m, k)) {
+      a_name = permute(a, concat(m, k));
+    }
+    // bring b to the form b(K,N) or b(N,K)
+    std::string b_name = b.name;
+    bool tb = false;
+    if (b.indices == concat(n, k) and not k.empty() and not n.empty()) {
+      tb = true;
+    } else if (b.indices != concat(k, n)) {
+      b_name = permute(b, concat(k, n));
+    }
+
+    const std::string sizes =
+        size_expr(m) + ", " + size_expr(n) + ", " + size_expr(k);
+    const std::string flags =
+        std::string(ta ? "true" : "false") + ", " + (tb ? "true" : "false");
+    const std::vector<Index> mn = concat(m, n);
+    if (c.indices == mn) {
+      code_ += "  wicked_gemm(" + flags + ", " + sizes + ", " + alpha + ", " +
+               a_name + ", " + b_name + ", " + c.name + ");\n";
+      return;
+    }
+    // multiply into c(M,N) and transpose the result
+    const std::string t_name = temporary(mn);
+    code_ += "  wicked_gemm(" + flags + ", " + sizes + ", 1.0, " + a_name +
+             ", " + b_name + ", " + t_name + ");\n";
+    code_ += "  wicked_permute_add(" + c.name + ", " + t_name + ", " + alpha +
+             ", " + shape_expr(mn) + ", " + permutation(mn, c.indices) +
+             ");\n";
+  }
+
+  /// Declare a block of zeros and return its name
+  std::string temporary(const std::vector<Index> &indices) {
+    const std::string name = "W" + std::to_string(num_temporaries_++);
+    code_ += "  std::vector<double> " + name + "_buffer(" +
+             size_expr(indices) + ");\n";
+    code_ += "  double *" + name + " = " + name + "_buffer.data();\n";
+    return name;
+  }
+
+private:
+  std::string &code_;
+  int num_temporaries_ = 0;
+
+  static std::vector<Index> concat(const std::vector<Index> &v1,
+                                   const std::vector<Index> &v2) {
+    std::vector<Index> result = v1;
+    result.insert(result.end(), v2.begin(), v2.end());
+    return result;
+  }
+
+  /// Return the axes of src that go to each axis of dst (e.g., "{1, 0}")
+  static std::string permutation(const std::vector<Index> &src,
+                                 const std::vector<Index> &dst) {
+    std::vector<std::string> str_vec;
+    for (const Index &idx : dst) {
+      str_vec.push_back(std::to_string(
+          std::find(src.begin(), src.end(), idx) - src.begin()));
+    }
+    return "{" + join(str_vec, ", ") + "}";
+  }
+
+  /// Copy a block to a temporary with the indices in a new order and return
+  /// the name of the temporary
+  std::string permute(const Operand &op, const std::vector<Index> &indices) {
+    const std::string name = temporary(indices);
+    code_ += "  wicked_permute_add(" + name + ", " + op.name + ", 1.0, " +
+             shape_expr(op.indices) + ", " +
+             permutation(op.indices, indices) + ");\n";
+    return name;
+  }
+};
+
+/// Indent all the lines of a string
+std::string indent_lines(const std::string &s, const std::string &indent) {
+  std::string result;
+  size_t start = 0;
+  while (start < s.size()) {
+    size_t end = s.find('\n', start);
+    end = (end == std::string::npos) ? s.size() : end + 1;
+    result += indent + s.substr(start, end - start);
+    start = end;
+  }
+  return result;
+}
+
+/// Return a C++ source file for a set of equations that use intermediates
+std::string compile_cpp_source(const std::string &name,
+                               const std::vector<Equation> &intermediates,
+                               const std::vector<Equation> &equations,
+                               const std::map<char, int> &dims) {
+  TraceScope trace("compile_cpp_function", "codegen");
+  // the blocks passed to the function and the spaces they use
+  std::vector<std::string> blocks;
+  std::vector<bool> used_spaces(osi()->num_spaces(), false);
+  std::vector<std::string> intermediate_blocks;
+  for (const auto &eq : intermediates) {
+    intermediate_blocks.push_back(cpp_block_label(eq.lhs().tensors()[0]));
+  }
+  for (const auto *eqs : {&intermediates, &equations}) {
+    for (const auto &eq : *eqs) {
+      for (const auto *term : {&eq.lhs(), &eq.rhs()}) {
+        for (const Tensor &t : term->tensors()) {
+          const std::string block = cpp_block_label(t);
+          if (std::find(blocks.begin(), blocks.end(), block) == blocks.end() and
+              std::find(intermediate_blocks.begin(), intermediate_blocks.end(),
+                        block) == intermediate_blocks.end()) {
+            blocks.push_back(block);
+          }
+          for (const Index &idx : t.indices()) {
+            used_spaces[idx.space()] = true;
+          }
+        }
+      }
+    }
+  }
+
+  std::string code = "// Generated by wicked\n#include <cstddef>\n"
+                     "#include <vector>\n";
+  code += cpp_runtime;
+  code += "\nextern \"C\" const char *" + name + "_blocks() {\n  return \"" +
+          join(blocks, ",") + "\";\n}\n\n";
+  code += "extern \"C\" void " + name +
+          "(const size_t *n, double *const *blocks) {\n";
+  for (int s = 0; s < osi()->num_spaces(); s++) {
+    if (used_spaces[s]) {
+      code += std::string("  const size_t n_") + osi()->label(s) + " = n[" +
+              std::to_string(s) + "];\n";
+    }
+  }
+  for (size_t b = 0; b < blocks.size(); b++) {
+    code += "  double *" + blocks[b] + " = blocks[" + std::to_string(b) +
+            "];\n";
+  }
+  for (const auto &eq : intermediates) {
+    const Tensor &t = eq.lhs().tensors()[0];
+    const std::string block = cpp_block_label(t);
+    code += "  std::vector<double> " + block + "_buffer(" +
+            size_expr(tensor_indices(t)) + ");\n";
+    code += "  double *" + block + " = " + block + "_buffer.data();\n";
+  }
+  for (const auto *eqs : {&intermediates, &equations}) {
+    for (const auto &eq : *eqs) {
+      code += indent_lines(eq.compile("cpp", dims), "  ");
+    }
+  }
+  code += "}\n";
+  return code;
+}
+
+} // namespace
+
+std::string cpp_block_label(const Tensor &t) {
+  std::string label = t.label() + "_";
+  for (const auto &l : t.upper()) {
+    label += osi()->label(l.space());
+  }
+  for (const auto &l : t.lower()) {
+    label += osi()->label(l.space());
+  }
+  return label;
+}
+
+std::string compile_cpp(const Tensor &lhs, const std::vector<Tensor> &rhs,
+                        scalar_t factor, const std::map<char, int> &dims,
+                        const std::vector<PermutationOperator> &permutations) {
+  if (not permutations.empty()) {
+    const Tensor tmp("_P", lhs.lower(), lhs.upper(), lhs.symmetry());
+    const std::vector<Index> indices = tensor_indices(lhs);
+    const std::string block = cpp_block_label(tmp);
+    std::string code = "{\n";
+    code += "  std::vector<double> " + block + "_buffer(" +
+            size_expr(indices) + ");\n";
+    code += "  double *" + block + " = " + block + "_buffer.data();\n";
+    code += indent_lines(compile_cpp(tmp, rhs, factor, dims), "  ");
+    for (const auto &[idx_map, sign] : ::permutations(permutations)) {
+      std::vector<std::string> axes;
+      for (int axis : permutation_axes(indices, idx_map)) {
+        axes.push_back(std::to_string(axis));
+      }
+      code += "  wicked_permute_add(" + cpp_block_label(lhs) + ", " + block +
+              ", " + (sign > 0 ? "1.0" : "-1.0") + ", " + shape_expr(indices) +
+              ", {" + join(axes, ", ") + "});\n";
+    }
+    return code + "}\n";
+  }
+
+  std::vector<Operand> ops;
+  for (const Tensor &t : rhs) {
+    ops.push_back({cpp_block_label(t), tensor_indices(t)});
+  }
+  const Operand result{cpp_block_label(lhs), tensor_indices(lhs)};
+  const std::string alpha = fmt::format("{:.9f}", factor.to_double());
+
+  std::string code = "{\n";
+  ContractionWriter writer(code);
+  if (ops.size() < 2) {
+    writer.loops(result, ops, alpha);
+    return code + "}\n";
+  }
+
+  const auto steps = dims.empty()
+                         ? left_to_right_contraction_path(ops.size()).steps
+                         : optimal_contraction_path(lhs, rhs, dims).steps;
+
+  for (size_t s = 0; s < steps.size(); s++) {
+    const auto [i, j] = steps[s];
+    const Operand a = ops[i];
+    const Operand b = ops[j];
+    ops.erase(ops.begin() + j);
+    ops.erase(ops.begin() + i);
+    if (s + 1 == steps.size()) {
+      writer.contract(result, a, b, alpha);
+      break;
+    }
+    // the product keeps the indices used by the other operands
+    std::vector<Index> kept;
+    for (const auto *op : {&a, &b}) {
+      for (const Index &idx : op->indices) {
+        bool used = contains(result.indices, idx);
+        for (const auto &other : ops) {
+          used = used or contains(other.indices, idx);
+        }
+        if (used and not contains(kept, idx)) {
+          kept.push_back(idx);
+        }
+      }
+    }
+    const Operand c{writer.temporary(kept), kept};
+    writer.contract(c, a, b, "1.0");
+    ops.push_back(c);
+  }
+  return code + "}\n";
+}
+
+std::string compile_cpp_function(const std::string &name,
+                                 const std::vector<Equation> &equations,
+                                 const std::map<char, int> &dims) {
+  return compile_cpp_source(name, {}, equations, dims);
+}
+
+std::string compile_cpp_function(const std::string &name,
+                                 const FactorizedEquations &equations,
+                                 const std::map<char, int> &dims) {
+  return compile_cpp_source(name, equations.intermediates(),
+                            equations.equations(), dims);
+}
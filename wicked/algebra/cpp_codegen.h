@@ -0,0 +1,51 @@
+#ifndef _wicked_cpp_codegen_h_
+#define _wicked_cpp_codegen_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "equation.h"
+
+class FactorizedEquations;
+
+/// Return the name of the variable that holds the block of a tensor in the
+/// C++ code, that is, the label and the spaces of the upper and lower indices
+/// separated by an underscore (e.g., "T2_vvoo")
+std::string cpp_block_label(const Tensor &t);
+
+/// Return the C++ code that adds factor times the contraction of the tensors
+/// rhs to lhs. The blocks are dense row-major arrays with the upper indices
+/// first, and the dimension of each space is stored in a variable called n_
+/// followed by the label of the space (e.g., n_o). Each pair of tensors is
+/// contracted with one GEMM call, after transposing the operands when
+/// needed, unless the pair has indices that GEMM cannot handle (e.g., indices
+/// shared by the operands and the result), which are contracted with loops.
+/// The order of the contractions is optimized for the dimensions dims when
+/// they are given, otherwise the tensors are contracted from left to right.
+/// If permutation operators are given, the contraction is stored in a
+/// temporary and each of its permuted copies is added to lhs
+std::string
+compile_cpp(const Tensor &lhs, const std::vector<Tensor> &rhs, scalar_t factor,
+            const std::map<char, int> &dims = {},
+            const std::vector<PermutationOperator> &permutations = {});
+
+/// Return a C++ source file that defines a function to evaluate a set of
+/// equations, which can be compiled into a shared library and linked to
+/// BLAS. The function has the signature
+///   extern "C" void name(const size_t *n, double *const *blocks)
+/// where n holds the dimensions of the orbital spaces and blocks the pointers
+/// to the tensor blocks, in the order returned by the function
+///   extern "C" const char *name_blocks()
+/// as a comma-separated list
+std::string compile_cpp_function(const std::string &name,
+                                 const std::vector<Equation> &equations,
+                                 const std::map<char, int> &dims = {});
+
+/// Return a C++ source file for a set of factorized equations. The
+/// intermediates are allocated inside the function and are not blocks of it
+std::string compile_cpp_function(const std::string &name,
+                                 const FactorizedEquations &equations,
+                                 const std::map<char, int> &dims = {});
+
+#endif // _wicked_cpp_codegen_h_
@@ -0,0 +1,275 @@
+#include <algorithm>
+
+#include "fmt/format.h"
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+
+#include "contraction_path.h"
+#include "cupy_codegen.h"
+#include "factorize.h"
+
+namespace {
+
+/// The imports and functions used by the generated code
+const char *cupy_runtime = R"(import cupy as cp
+from cupyx import cutensor
+
+
+def _workspace(workspace, key, shape):
+    """Return a buffer of the workspace, allocated at the first call"""
+    buffer = workspace.get((key, shape))
+    if buffer is None:
+        buffer = workspace[(key, shape)] = cp.empty(shape)
+    return buffer
+)";
+
+/// A tensor block used by the generated code and the letters of its indices
+struct Operand {
+  std::string expr;
+  std::string modes;
+};
+
+/// Return the expression of a block (e.g., T2["oovv"])
+std::string block_expr(const Tensor &t) {
+  return t.label() + "[\"" +
+         einsum_block_label(t).substr(t.label().size()) + "\"]";
+}
+
+/// Return a Python tuple with the elements of a vector
+std::string python_tuple(const std::vector<std::string> &str_vec) {
+  return "(" + join(str_vec, ", ") + (str_vec.size() == 1 ? ",)" : ")");
+}
+
+/// Return the modes of a block for cuTENSOR (e.g., ("i", "a"))
+std::string modes_tuple(const std::string &modes) {
+  std::vector<std::string> str_vec;
+  for (char c : modes) {
+    str_vec.push_back(std::string("\"") + c + "\"");
+  }
+  return python_tuple(str_vec);
+}
+
+/// Return true if cuTENSOR can contract a and b to c. This requires each
+/// mode to appear in two of the blocks and at most once in each of them
+bool is_cutensor_contraction(const Operand &a, const Operand &b,
+                             const Operand &c) {
+  for (const auto *op : {&a, &b, &c}) {
+    for (char m : op->modes) {
+      if (std::count(op->modes.begin(), op->modes.end(), m) > 1) {
+        return false;
+      }
+      int count = 0;
+      for (const auto *other : {&a, &b, &c}) {
+        count += other->modes.find(m) != std::string::npos;
+      }
+      if (count < 2) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Return a CuPy source file for a set of equations that use intermediates
+std::string compile_cupy_source(const std::string &name,
+                                const std::vector<Equation> &intermediates,
+                                const std::vector<Equation> &equations,
+                                const std::map<char, int> &dims) {
+  TraceScope trace("compile_cupy_function", "codegen");
+  // the labels of the tensors passed to the function
+  std::vector<std::string> intermediate_labels;
+  for (const auto &eq : intermediates) {
+    intermediate_labels.push_back(eq.lhs().tensors()[0].label());
+  }
+  std::vector<std::string> labels;
+  for (const auto *eqs : {&equations, &intermediates}) {
+    for (const auto &eq : *eqs) {
+      for (const auto *term : {&eq.lhs(), &eq.rhs()}) {
+        for (const Tensor &t : term->tensors()) {
+          if (std::find(labels.begin(), labels.end(), t.label()) ==
+                  labels.end() and
+              std::find(intermediate_labels.begin(), intermediate_labels.end(),
+                        t.label()) == intermediate_labels.end()) {
+            labels.push_back(t.label());
+          }
+        }
+      }
+    }
+  }
+
+  // equations that do the same contraction on the same blocks are combined
+  std::vector<std::string> keys;
+  std::vector<Equation> combined;
+  for (const auto &eq : equations) {
+    const Tensor &lhs = eq.lhs().tensors()[0];
+    const std::string key =
+        einsum_block_label(lhs) + compile_einsum(lhs, eq.rhs().tensors()) +
+        (eq.permutations().empty()
+             ? ""
+             : permuted_sum("", lhs, eq.permutations()));
+    auto it = std::find(keys.begin(), keys.end(), key);
+    if (it == keys.end()) {
+      keys.push_back(key);
+      combined.push_back(eq);
+    } else {
+      Equation &other = combined[it - keys.begin()];
+      other = Equation(other.lhs(), other.rhs(),
+                       other.rhs_factor() + eq.rhs_factor(),
+                       other.permutations());
+    }
+  }
+
+  std::string code = std::string(cupy_runtime) + "\n\ndef " + name + "(" +
+                     join(labels, ", ") + (labels.empty() ? "" : ", ") +
+                     "n, workspace):\n";
+  for (const auto &eq : intermediates) {
+    const Tensor &t = eq.lhs().tensors()[0];
+    std::vector<std::string> shape;
+    for (const auto *indices : {&t.upper(), &t.lower()}) {
+      for (const Index &idx : *indices) {
+        shape.push_back(std::string("n[\"") + osi()->label(idx.space()) +
+                        "\"]");
+      }
+    }
+    const std::string block = einsum_block_label(t).substr(t.label().size());
+    code += "    " + t.label() + " = {\"" + block +
+            "\": _workspace(workspace, \"" + t.label() + "\", " +
+            python_tuple(shape) + ")}\n";
+    code += "    " + block_expr(t) + ".fill(0.0)\n";
+  }
+  auto add_equation = [&](const Equation &eq) {
+    if (eq.rhs_factor() == scalar_t(0)) {
+      return;
+    }
+    const std::string eq_code = eq.compile("cupy", dims);
+    size_t start = 0;
+    while (start < eq_code.size()) {
+      size_t end = eq_code.find('\n', start);
+      end = (end == std::string::npos) ? eq_code.size() : end + 1;
+      code += "    " + eq_code.substr(start, end - start);
+      start = end;
+    }
+  };
+  std::for_each(intermediates.begin(), intermediates.end(), add_equation);
+  std::for_each(combined.begin(), combined.end(), add_equation);
+  if (intermediates.empty() and combined.empty()) {
+    code += "    pass\n";
+  }
+  return code;
+}
+
+} // namespace
+
+std::string compile_cupy(const Tensor &lhs, const std::vector<Tensor> &rhs,
+                         scalar_t factor, const std::map<char, int> &dims,
+                         const std::vector<PermutationOperator> &permutations) {
+  if (not permutations.empty()) {
+    const Tensor tmp("_P", lhs.lower(), lhs.upper(), lhs.symmetry());
+    std::vector<std::string> shape;
+    for (const auto *indices : {&lhs.upper(), &lhs.lower()}) {
+      for (const Index &idx : *indices) {
+        shape.push_back(std::string("n[\"") + osi()->label(idx.space()) +
+                        "\"]");
+      }
+    }
+    const std::string block =
+        einsum_block_label(tmp).substr(tmp.label().size());
+    return "_P = {\"" + block + "\": _workspace(workspace, \"_P\", " +
+           python_tuple(shape) + ")}\n" + block_expr(tmp) + ".fill(0.0)\n" +
+           compile_cupy(tmp, rhs, factor, dims) + block_expr(lhs) +
+           " += " + permuted_sum(block_expr(tmp), lhs, permutations) + "\n";
+  }
+
+  const std::vector<std::string> indices = einsum_indices(lhs, rhs);
+  std::map<char, char> letter_space;
+  for (size_t t = 0; t <= rhs.size(); t++) {
+    const Tensor &tensor = t < rhs.size() ? rhs[t] : lhs;
+    size_t k = 0;
+    for (const auto *idx_vec : {&tensor.upper(), &tensor.lower()}) {
+      for (const Index &idx : *idx_vec) {
+        letter_space[indices[t][k++]] = osi()->label(idx.space());
+      }
+    }
+  }
+
+  std::vector<Operand> ops;
+  for (size_t t = 0; t < rhs.size(); t++) {
+    ops.push_back({block_expr(rhs[t]), indices[t]});
+  }
+  const Operand result{block_expr(lhs), indices.back()};
+  const std::string alpha = fmt::format("{:.9f}", factor.to_double());
+
+  if (ops.empty()) {
+    return result.expr + " += " + alpha + "\n";
+  }
+  if (ops.size() == 1) {
+    return result.expr + " += " + alpha + " * cp.einsum(\"" + ops[0].modes +
+           "->" + result.modes + "\", " + ops[0].expr + ")\n";
+  }
+
+  const auto steps = dims.empty()
+                         ? left_to_right_contraction_path(ops.size()).steps
+                         : optimal_contraction_path(lhs, rhs, dims).steps;
+  std::string code;
+  for (size_t s = 0; s < steps.size(); s++) {
+    const auto [i, j] = steps[s];
+    const Operand a = ops[i];
+    const Operand b = ops[j];
+    ops.erase(ops.begin() + j);
+    ops.erase(ops.begin() + i);
+
+    Operand c = result;
+    const bool last = (s + 1 == steps.size());
+    if (not last) {
+      // the product keeps the indices used by the other operands
+      std::vector<std::string> shape;
+      c.modes.clear();
+      for (char m : a.modes + b.modes) {
+        bool used = result.modes.find(m) != std::string::npos;
+        for (const auto &other : ops) {
+          used = used or other.modes.find(m) != std::string::npos;
+        }
+        if (used and c.modes.find(m) == std::string::npos) {
+          c.modes += m;
+          shape.push_back(std::string("n[\"") + letter_space[m] + "\"]");
+        }
+      }
+      c.expr = "W" + std::to_string(s);
+      if (is_cutensor_contraction(a, b, c)) {
+        code += c.expr + " = _workspace(workspace, " + std::to_string(s) +
+                ", " + python_tuple(shape) + ")\n";
+      }
+    }
+
+    const std::string step_alpha = last ? alpha : "1.0";
+    if (is_cutensor_contraction(a, b, c)) {
+      code += "cutensor.contraction(" + step_alpha + ", " + a.expr + ", " +
+              modes_tuple(a.modes) + ", " + b.expr + ", " +
+              modes_tuple(b.modes) + ", " + (last ? "1.0" : "0.0") + ", " +
+              c.expr + ", " + modes_tuple(c.modes) + ")\n";
+    } else {
+      const std::string product = "cp.einsum(\"" + a.modes + "," + b.modes +
+                                  "->" + c.modes + "\", " + a.expr + ", " +
+                                  b.expr + ")";
+      code += last ? c.expr + " += " + alpha + " * " + product + "\n"
+                   : c.expr + " = " + product + "\n";
+    }
+    ops.push_back(c);
+  }
+  return code;
+}
+
+std::string compile_cupy_function(const std::string &name,
+                                  const std::vector<Equation> &equations,
+                                  const std::map<char, int> &dims) {
+  return compile_cupy_source(name, {}, equations, dims);
+}
+
+std::string compile_cupy_function(const std::string &name,
+                                  const FactorizedEquations &equations,
+                                  const std::map<char, int> &dims) {
+  return compile_cupy_source(name, equations.intermediates(),
+                             equations.equations(), dims);
+}
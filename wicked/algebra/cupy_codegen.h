@@ -0,0 +1,44 @@
+#ifndef _wicked_cupy_codegen_h_
+#define _wicked_cupy_codegen_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "equation.h"
+
+class FactorizedEquations;
+
+/// Return the CuPy code that adds factor times the contraction of the tensors
+/// rhs to lhs on the GPU. Each pair of tensors is contracted with one call to
+/// cuTENSOR (cupyx.cutensor.contraction) and the products are stored in
+/// buffers taken from the dictionary workspace, which are allocated at the
+/// first call and reused afterwards. The dimensions of the spaces are read
+/// from the dictionary n (e.g., n["o"]). The order of the contractions is
+/// optimized for the dimensions dims when they are given, otherwise the
+/// tensors are contracted from left to right. If permutation operators are
+/// given, the contraction is stored in a buffer of the workspace and the sum
+/// of its permuted copies is added to lhs
+std::string
+compile_cupy(const Tensor &lhs, const std::vector<Tensor> &rhs,
+             scalar_t factor, const std::map<char, int> &dims = {},
+             const std::vector<PermutationOperator> &permutations = {});
+
+/// Return the source of a Python function that evaluates a set of equations
+/// with CuPy. The function takes the dictionaries of blocks of each tensor
+/// (the left-hand sides must hold preallocated device arrays), followed by
+/// the dimensions n and the workspace, in the order
+///   def name(<labels>, n, workspace)
+/// Equations that perform the same contraction on the same blocks are
+/// evaluated together with one call
+std::string compile_cupy_function(const std::string &name,
+                                  const std::vector<Equation> &equations,
+                                  const std::map<char, int> &dims = {});
+
+/// Return the source of a Python function for a set of factorized equations.
+/// The intermediates are stored in the workspace
+std::string compile_cupy_function(const std::string &name,
+                                  const FactorizedEquations &equations,
+                                  const std::map<char, int> &dims = {});
+
+#endif // _wicked_cupy_codegen_h_
@@ -3,6 +3,9 @@
 
 #include "fmt/format.h"
 
+#include "contraction_path.h"
+#include "cpp_codegen.h"
+#include "cupy_codegen.h"
 #include "equation.h"
 #include "expression.h"
 #include "helpers/helpers.h"
@@ -14,21 +17,51 @@ Equation::Equation(const SymbolicTerm &lhs, const SymbolicTerm &rhs,
                    scalar_t factor)
     : lhs_(lhs), rhs_(rhs), factor_(factor) {}
 
+Equation::Equation(const SymbolicTerm &lhs, const SymbolicTerm &rhs,
+                   scalar_t factor,
+                   const std::vector<PermutationOperator> &permutations)
+    : lhs_(lhs), rhs_(rhs), factor_(factor), permutations_(permutations) {
+  const std::vector<Index> lhs_indices =
+      lhs.tensors().empty() ? std::vector<Index>()
+                            : lhs.tensors()[0].indices();
+  for (const auto &p : permutations_) {
+    for (const auto &group : p.groups()) {
+      for (const Index &idx : group) {
+        if (std::find(lhs_indices.begin(), lhs_indices.end(), idx) ==
+            lhs_indices.end()) {
+          throw std::runtime_error(
+              "Equation::Equation() - the permutation operator " + p.str() +
+              " acts on an index that is not on the left-hand side");
+        }
+      }
+    }
+  }
+}
+
 const SymbolicTerm &Equation::lhs() const { return lhs_; }
 
 const SymbolicTerm &Equation::rhs() const { return rhs_; }
 
 scalar_t Equation::rhs_factor() const { return factor_; }
 
+const std::vector<PermutationOperator> &Equation::permutations() const {
+  return permutations_;
+}
+
 Expression Equation::rhs_expression() const {
   Expression expr;
-  expr.add(rhs(), rhs_factor());
+  for (auto [idx_map, sign] : ::permutations(permutations_)) {
+    SymbolicTerm term = rhs();
+    term.reindex(idx_map);
+    expr.add(term, sign * rhs_factor());
+  }
   return expr;
 }
 
 bool Equation::operator==(Equation const &other) const {
   return ((lhs() == other.lhs()) and (rhs() == other.rhs()) and
-          (rhs_factor() == other.rhs_factor()));
+          (rhs_factor() == other.rhs_factor()) and
+          (permutations() == other.permutations()));
 }
 
 std::string Equation::str() const {
@@ -36,20 +69,42 @@ std::string Equation::str() const {
   str_vec.push_back(lhs_.str());
   str_vec.push_back("+=");
   str_vec.push_back(factor_.str());
+  for (const auto &p : permutations_) {
+    str_vec.push_back(p.str());
+  }
   str_vec.push_back(rhs_.str());
   return (join(str_vec, " "));
 }
 
 std::string Equation::latex() const { return str(); }
 
+std::string permuted_sum(const std::string &block, const Tensor &lhs,
+                         const std::vector<PermutationOperator> &ops) {
+  std::string sum;
+  for (const auto &[idx_map, sign] : permutations(ops)) {
+    std::vector<Index> indices(lhs.upper().begin(), lhs.upper().end());
+    indices.insert(indices.end(), lhs.lower().begin(), lhs.lower().end());
+    const std::vector<int> axes = permutation_axes(indices, idx_map);
+    std::vector<std::string> axes_str;
+    bool identity = true;
+    for (size_t k = 0; k < axes.size(); k++) {
+      axes_str.push_back(std::to_string(axes[k]));
+      identity = identity and (axes[k] == static_cast<int>(k));
+    }
+    sum += sum.empty() ? (sign > 0 ? "" : "-") : (sign > 0 ? " + " : " - ");
+    sum += block + (identity ? "" : ".transpose(" + join(axes_str, ",") + ")");
+  }
+  return sum;
+}
+
 std::string get_unique_index(const std::string &s,
                              std::map<std::string, std::string> &index_map,
-                             std::vector<char> &unused_indices);
+                             std::vector<std::string> &unused_indices);
 
 std::string
 get_unique_tensor_indices(const Tensor &t,
                           std::map<std::string, std::string> &index_map,
-                          std::vector<char> &unused_indices);
+                          std::vector<std::string> &unused_indices);
 
 std::string get_unique_index(const std::string &s,
                              std::map<std::string, std::string> &index_map,
@@ -92,7 +147,57 @@ get_unique_tensor_indices(const Tensor &t,
   return indices;
 }
 
-std::string Equation::compile(const std::string &format) const {
+std::string einsum_block_label(const Tensor &t) {
+  std::string label = t.label();
+  for (const auto &l : t.upper()) {
+    label += osi()->label(l.space());
+  }
+  for (const auto &l : t.lower()) {
+    label += osi()->label(l.space());
+  }
+  return label;
+}
+
+std::vector<std::string> einsum_indices(const Tensor &lhs,
+                                        const std::vector<Tensor> &rhs) {
+  std::map<std::string, std::string> index_map;
+  std::vector<std::string> unused_indices = {
+      "Z", "Y", "X", "W", "V", "U", "T", "S", "R", "Q", "P", "O", "N",
+      "M", "L", "K", "J", "I", "H", "G", "F", "E", "D", "C", "B", "A",
+      "z", "y", "x", "w", "v", "u", "t", "s", "r", "q", "p", "o", "n",
+      "m", "l", "k", "j", "i", "h", "g", "f", "e", "d", "c", "b", "a"};
+
+  std::vector<std::string> indices_vec;
+  for (const auto &t : rhs) {
+    indices_vec.push_back(
+        get_unique_tensor_indices(t, index_map, unused_indices));
+  }
+  indices_vec.push_back(
+      get_unique_tensor_indices(lhs, index_map, unused_indices));
+  return indices_vec;
+}
+
+std::string compile_einsum(const Tensor &lhs, const std::vector<Tensor> &rhs,
+                           const std::map<char, int> &dims) {
+  std::vector<std::string> indices_vec = einsum_indices(lhs, rhs);
+  const std::string lhs_indices = indices_vec.back();
+  indices_vec.pop_back();
+
+  std::vector<std::string> args_vec;
+  args_vec.push_back("\"" + join(indices_vec, ",") + "->" + lhs_indices +
+                     "\"");
+  for (const auto &t : rhs) {
+    std::string block = einsum_block_label(t).substr(t.label().size());
+    args_vec.push_back(t.label() + "[\"" + block + "\"]");
+  }
+  const std::string optimize =
+      dims.empty() ? "\"optimal\""
+                   : optimal_contraction_path(lhs, rhs, dims).einsum_path();
+  return "np.einsum(" + join(args_vec, ",") + ",optimize=" + optimize + ")";
+}
+
+std::string Equation::compile(const std::string &format,
+                              const std::map<char, int> &dims) const {
   if (format == "ambit") {
     std::vector<std::string> str_vec;
     str_vec.push_back(lhs_.compile(format) + " += " + factor_.compile(format));
@@ -101,57 +206,29 @@ std::string Equation::compile(const std::string &format) const {
   }
 
   if (format == "einsum") {
-    std::vector<std::string> str_vec;
     const auto &lhs_tensor = lhs().tensors()[0];
-
-    std::string lhs_tensor_label = lhs_tensor.label();
-    for (const auto &l : lhs_tensor.upper()) {
-      lhs_tensor_label += orbital_subspaces->label(l.space());
+    const std::string product =
+        fmt::format("{:.9f}", rhs_factor().to_double()) + " * " +
+        compile_einsum(lhs_tensor, rhs().tensors(), dims);
+    if (permutations_.empty()) {
+      return einsum_block_label(lhs_tensor) + " += " + product;
     }
-    for (const auto &l : lhs_tensor.lower()) {
-      lhs_tensor_label += orbital_subspaces->label(l.space());
-    }
-
-    str_vec.push_back(lhs_tensor_label +
-                      " += " + fmt::format("{:.9f}", rhs_factor().to_double()) +
-                      " * np.einsum(");
-
-    std::map<std::string, std::string> index_map;
-    std::vector<std::string> unused_indices = {
-        "Z", "Y", "X", "W", "V", "U", "T", "S", "R", "Q", "P", "O", "N",
-        "M", "L", "K", "J", "I", "H", "G", "F", "E", "D", "C", "B", "A",
-        "z", "y", "x", "w", "v", "u", "t", "s", "r", "q", "p", "o", "n",
-        "m", "l", "k", "j", "i", "h", "g", "f", "e", "d", "c", "b", "a"};
-
-    std::vector<std::string> indices_vec;
-    for (const auto &t : rhs().tensors()) {
-      std::string tensor_indices =
-          get_unique_tensor_indices(t, index_map, unused_indices);
-      indices_vec.push_back(tensor_indices);
-    }
-
-    std::vector<std::string> args_vec;
-    args_vec.push_back(
-        "\"" + join(indices_vec, ",") + "->" +
-        get_unique_tensor_indices(lhs_tensor, index_map, unused_indices) +
-        "\"");
-    for (const auto &t : rhs().tensors()) {
-      std::string t_label = t.label() + "[\"";
-      for (const auto &l : t.upper()) {
-        t_label += orbital_subspaces->label(l.space());
-      }
-      for (const auto &l : t.lower()) {
-        t_label += orbital_subspaces->label(l.space());
-      }
-      t_label += "\"]";
-      args_vec.push_back(t_label);
-    }
-    str_vec.push_back(join(args_vec, ","));
-    str_vec.push_back(",optimize=\"optimal\")");
-    return join(str_vec, "");
+    return "_P = " + product + "\n" + einsum_block_label(lhs_tensor) +
+           " += " + permuted_sum("_P", lhs_tensor, permutations_);
+  }
+  if (format == "cpp") {
+    return "// " + str() + "\n" +
+           compile_cpp(lhs().tensors()[0], rhs().tensors(), rhs_factor(), dims,
+                       permutations_);
+  }
+  if (format == "cupy") {
+    return "# " + str() + "\n" +
+           compile_cupy(lhs().tensors()[0], rhs().tensors(), rhs_factor(),
+                        dims, permutations_);
   }
   std::string msg = "Equation::compile() - the argument '" + format +
-                    "' is not valid. Choices are 'ambit' or 'einsum'";
+                    "' is not valid. Choices are 'ambit', 'einsum', 'cpp', or "
+                    "'cupy'";
   throw std::runtime_error(msg);
   return "";
 }
@@ -1,7 +1,9 @@
 #ifndef _wicked_equation_h_
 #define _wicked_equation_h_
 
+#include "permutation_operator.h"
 #include "symbolic_term.h"
+#include <map>
 #include <vector>
 
 class Expression;
@@ -12,6 +14,11 @@ public:
   // ==> Constructor <==
   Equation(const SymbolicTerm &lhs, const SymbolicTerm &rhs, scalar_t factor);
 
+  /// Construct the equation lhs += factor P_1 P_2 ... rhs, where P_1, P_2, ...
+  /// are permutation operators acting on the indices of the left-hand side
+  Equation(const SymbolicTerm &lhs, const SymbolicTerm &rhs, scalar_t factor,
+           const std::vector<PermutationOperator> &permutations);
+
   // ==> Class public interface <==
 
   /// Return the symbolic term on the left-hand side of the equation
@@ -23,7 +30,11 @@ public:
   /// Return the factor for the left-hand side equation
   scalar_t rhs_factor() const;
 
-  /// Return the right-hand side of the equation
+  /// Return the permutation operators applied to the right-hand side
+  const std::vector<PermutationOperator> &permutations() const;
+
+  /// Return the right-hand side of the equation (with the permutation
+  /// operators expanded)
   Expression rhs_expression() const;
 
   /// Comparison operator
@@ -35,8 +46,13 @@ public:
   /// Return a LaTeX representation
   std::string latex() const;
 
-  /// Return a compilable representation
-  std::string compile(const std::string &format) const;
+  /// Return a compilable representation. For the einsum format, if the
+  /// dimensions of the orbital spaces are given (by label), the order of the
+  /// contractions is found here and passed to einsum instead of searching for
+  /// it at each call. The permutation operators are applied by evaluating the
+  /// right-hand side once and adding all its permuted copies in one statement
+  std::string compile(const std::string &format,
+                      const std::map<char, int> &dims = {}) const;
 
 private:
   // ==> Class private data <==
@@ -47,6 +63,8 @@ private:
   SymbolicTerm rhs_;
   /// The factor of the left-hand side
   scalar_t factor_;
+  /// The permutation operators applied to the right-hand side
+  std::vector<PermutationOperator> permutations_;
 
   // ==> Class private functions <==
 };
@@ -54,4 +72,26 @@ private:
 /// Print to an output stream
 std::ostream &operator<<(std::ostream &os, const Equation &eterm);
 
+/// Return the name of the block of a tensor used in the einsum code, that is,
+/// the label followed by the spaces of the upper and lower indices (e.g.,
+/// "T2vvoo")
+std::string einsum_block_label(const Tensor &t);
+
+/// Return the letters used by einsum for the indices of each tensor of rhs and
+/// of lhs (the last element)
+std::vector<std::string> einsum_indices(const Tensor &lhs,
+                                        const std::vector<Tensor> &rhs);
+
+/// Return the einsum call that contracts the tensors rhs to the indices of lhs
+/// (e.g., np.einsum("ia,ai->",T1["ov"],f["vo"],optimize="optimal")). If the
+/// dimensions of the spaces are given, the optimal path is computed here
+std::string compile_einsum(const Tensor &lhs, const std::vector<Tensor> &rhs,
+                           const std::map<char, int> &dims = {});
+
+/// Return the Python expression that sums the permuted copies of a block of
+/// lhs generated by a product of permutation operators (e.g.,
+/// "W - W.transpose(1,0,2,3)")
+std::string permuted_sum(const std::string &block, const Tensor &lhs,
+                         const std::vector<PermutationOperator> &ops);
+
 #endif // _wicked_equation_h_
@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "helpers/orbital_space.h"
+
+#include "contraction_path.h"
+#include "evaluate.h"
+#include "expression.h"
+
+#ifdef WICKED_USE_BLAS
+extern "C" void dgemm_(const char *transa, const char *transb, const int *m,
+                       const int *n, const int *k, const double *alpha,
+                       const double *a, const int *lda, const double *b,
+                       const int *ldb, const double *beta, double *c,
+                       const int *ldc);
+#endif
+
+namespace {
+
+/// A block used during the evaluation of a term. Intermediate blocks own
+/// their data
+struct Operand {
+  const double *data = nullptr;
+  std::vector<Index> indices;
+  std::shared_ptr<std::vector<double>> storage;
+};
+
+std::vector<Index> block_indices(const Tensor &t) {
+  std::vector<Index> indices(t.upper().begin(), t.upper().end());
+  indices.insert(indices.end(), t.lower().begin(), t.lower().end());
+  return indices;
+}
+
+bool contains(const std::vector<Index> &indices, const Index &idx) {
+  return std::find(indices.begin(), indices.end(), idx) != indices.end();
+}
+
+bool has_repeated_indices(const std::vector<Index> &indices) {
+  for (const Index &idx : indices) {
+    if (std::count(indices.begin(), indices.end(), idx) > 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// The dimensions of the orbital spaces and the number of threads of the
+/// matrix products done without BLAS
+struct EvaluationContext {
+  std::vector<size_t> dims;
+  int nthreads;
+
+  size_t size(const std::vector<Index> &indices) const {
+    size_t n = 1;
+    for (const Index &idx : indices) {
+      n *= dims[idx.space()];
+    }
+    return n;
+  }
+};
+
+/// Add alpha times the product of the operands to the block c by looping over
+/// all the indices. Indices that appear only in the operands are summed over
+void loops(double *c, const std::vector<Index> &c_indices,
+           const std::vector<const Operand *> &ops, double alpha,
+           const EvaluationContext &ctx) {
+  std::vector<Index> indices;
+  for (const Index &idx : c_indices) {
+    if (not contains(indices, idx)) {
+      indices.push_back(idx);
+    }
+  }
+  for (const auto *op : ops) {
+    for (const Index &idx : op->indices) {
+      if (not contains(indices, idx)) {
+        indices.push_back(idx);
+      }
+    }
+  }
+  std::vector<size_t> dims;
+  size_t total = 1;
+  for (const Index &idx : indices) {
+    dims.push_back(ctx.dims[idx.space()]);
+    total *= dims.back();
+  }
+  if (total == 0) {
+    return;
+  }
+
+  // the strides of each block (the first one is c) along each index
+  const size_t nblocks = ops.size() + 1;
+  std::vector<std::vector<size_t>> strides(nblocks,
+                                           std::vector<size_t>(indices.size()));
+  for (size_t b = 0; b < nblocks; b++) {
+    const auto &block_idx = b == 0 ? c_indices : ops[b - 1]->indices;
+    size_t stride = 1;
+    for (size_t q = block_idx.size(); q-- > 0;) {
+      const auto pos =
+          std::find(indices.begin(), indices.end(), block_idx[q]) -
+          indices.begin();
+      strides[b][pos] += stride;
+      stride *= ctx.dims[block_idx[q].space()];
+    }
+  }
+
+  std::vector<size_t> idx(indices.size(), 0);
+  std::vector<size_t> offset(nblocks, 0);
+  for (size_t p = 0; p < total; p++) {
+    double product = alpha;
+    for (size_t b = 1; b < nblocks; b++) {
+      product *= ops[b - 1]->data[offset[b]];
+    }
+    c[offset[0]] += product;
+    for (size_t u = indices.size(); u-- > 0;) {
+      for (size_t b = 0; b < nblocks; b++) {
+        offset[b] += strides[b][u];
+      }
+      if (++idx[u] < dims[u]) {
+        break;
+      }
+      for (size_t b = 0; b < nblocks; b++) {
+        offset[b] -= dims[u] * strides[b][u];
+      }
+      idx[u] = 0;
+    }
+  }
+}
+
+/// c(m,n) += alpha a(m,k) b(k,n) for row-major matrices. ctx gives the number
+/// of threads, which is not used with BLAS
+void gemm(size_t m, size_t n, size_t k, double alpha, const double *a,
+          const double *b, double *c,
+          [[maybe_unused]] const EvaluationContext &ctx) {
+  if (m == 0 or n == 0 or k == 0) {
+    return;
+  }
+#ifdef WICKED_USE_BLAS
+  // a row-major c is the column-major matrix c^T = b^T a^T
+  const int im = m, in = n, ik = k;
+  const double beta = 1.0;
+  dgemm_("N", "N", &in, &im, &ik, &alpha, b, &in, a, &ik, &beta, c, &in);
+#else
+  // the rows of c are distributed among the threads, and the rows of b are
+  // processed in panels that stay in cache
+  constexpr size_t panel = 128;
+  auto rows = [&](size_t first, size_t last) {
+    for (size_t p0 = 0; p0 < k; p0 += panel) {
+      const size_t p1 = std::min(k, p0 + panel);
+      for (size_t i = first; i < last; i++) {
+        double *ci = c + i * n;
+        for (size_t p = p0; p < p1; p++) {
+          const double aip = alpha * a[i * k + p];
+          const double *bp = b + p * n;
+          for (size_t j = 0; j < n; j++) {
+            ci[j] += aip * bp[j];
+          }
+        }
+      }
+    }
+  };
+  // small products are not worth the cost of starting the threads
+  const double flops = static_cast<double>(m) * n * k;
+  const size_t nworkers =
+      flops < 1.0e6 ? 1 : std::min(static_cast<size_t>(ctx.nthreads), m);
+  if (nworkers <= 1) {
+    rows(0, m);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nworkers; t++) {
+    threads.push_back(
+        std::thread(rows, m * t / nworkers, m * (t + 1) / nworkers));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+#endif
+}
+
+/// Return a block of zeros with the given indices
+Operand zeros(const std::vector<Index> &indices, const EvaluationContext &ctx) {
+  Operand op;
+  op.indices = indices;
+  op.storage = std::make_shared<std::vector<double>>(ctx.size(indices), 0.0);
+  op.data = op.storage->data();
+  return op;
+}
+
+/// Return a copy of a block with the indices in a new order
+Operand permute(const Operand &op, const std::vector<Index> &indices,
+                const EvaluationContext &ctx) {
+  if (op.indices == indices) {
+    return op;
+  }
+  Operand result = zeros(indices, ctx);
+  loops(result.storage->data(), indices, {&op}, 1.0, ctx);
+  return result;
+}
+
+std::vector<Index> concat(const std::vector<Index> &v1,
+                          const std::vector<Index> &v2) {
+  std::vector<Index> result = v1;
+  result.insert(result.end(), v2.begin(), v2.end());
+  return result;
+}
+
+/// Add alpha times the contraction of a and b to the block c. When possible
+/// the operands are brought to the form c(M,N) = a(M,K) b(K,N) and multiplied
+/// with GEMM, otherwise the contraction is done with loops
+void contract(double *c, const std::vector<Index> &c_indices,
+              const Operand &a, const Operand &b, double alpha,
+              const EvaluationContext &ctx) {
+  std::vector<Index> m, n, k;
+  bool use_gemm = not(has_repeated_indices(a.indices) or
+                      has_repeated_indices(b.indices) or
+                      has_repeated_indices(c_indices));
+  for (const Index &idx : a.indices) {
+    if (contains(c_indices, idx)) {
+      use_gemm = use_gemm and not contains(b.indices, idx);
+      m.push_back(idx);
+    } else {
+      use_gemm = use_gemm and contains(b.indices, idx);
+      k.push_back(idx);
+    }
+  }
+  for (const Index &idx : b.indices) {
+    if (contains(c_indices, idx)) {
+      n.push_back(idx);
+    } else {
+      use_gemm = use_gemm and contains(a.indices, idx);
+    }
+  }
+  use_gemm = use_gemm and (m.size() + n.size() == c_indices.size());
+  if (not use_gemm) {
+    loops(c, c_indices, {&a, &b}, alpha, ctx);
+    return;
+  }
+
+  const Operand am = permute(a, concat(m, k), ctx);
+  const Operand bm = permute(b, concat(k, n), ctx);
+  const std::vector<Index> mn = concat(m, n);
+  if (c_indices == mn) {
+    gemm(ctx.size(m), ctx.size(n), ctx.size(k), alpha, am.data, bm.data, c,
+         ctx);
+    return;
+  }
+  // multiply into c(M,N) and transpose the result
+  Operand t = zeros(mn, ctx);
+  gemm(ctx.size(m), ctx.size(n), ctx.size(k), alpha, am.data, bm.data,
+       t.storage->data(), ctx);
+  loops(c, c_indices, {&t}, 1.0, ctx);
+}
+
+/// Return the block of a tensor and check that its shape is consistent with
+/// the dimensions of the spaces found so far (a zero dimension is unknown)
+const TensorBlock &find_block(const Tensor &t,
+                              const std::map<std::string, TensorBlock> &blocks,
+                              std::vector<size_t> &dims,
+                              std::vector<bool> &known) {
+  const std::string name = einsum_block_label(t);
+  auto it = blocks.find(name);
+  if (it == blocks.end()) {
+    throw std::runtime_error("evaluate() - the block " + name +
+                             " is missing");
+  }
+  const TensorBlock &block = it->second;
+  const std::vector<Index> indices = block_indices(t);
+  if (indices.empty()) {
+    size_t size = 1;
+    for (size_t d : block.shape) {
+      size *= d;
+    }
+    if (size != 1) {
+      throw std::runtime_error("evaluate() - the block " + name +
+                               " should have one element");
+    }
+    return block;
+  }
+  if (block.shape.size() != indices.size()) {
+    throw std::runtime_error("evaluate() - the block " + name + " has " +
+                             std::to_string(block.shape.size()) +
+                             " dimensions instead of " +
+                             std::to_string(indices.size()));
+  }
+  for (size_t k = 0; k < indices.size(); k++) {
+    const int s = indices[k].space();
+    if (known[s] and dims[s] != block.shape[k]) {
+      throw std::runtime_error(
+          "evaluate() - the block " + name + " has dimension " +
+          std::to_string(block.shape[k]) + " for the space " +
+          osi()->label(s) + " instead of " + std::to_string(dims[s]));
+    }
+    dims[s] = block.shape[k];
+    known[s] = true;
+  }
+  return block;
+}
+
+/// Evaluate one equation (the blocks have been checked by find_block)
+void evaluate_equation(const Equation &eq,
+                       const std::map<std::string, TensorBlock> &blocks,
+                       const std::map<char, int> &space_dims,
+                       const EvaluationContext &ctx) {
+  const Tensor &lhs = eq.lhs().tensors()[0];
+  const std::vector<Index> lhs_indices = block_indices(lhs);
+  double *lhs_data = blocks.at(einsum_block_label(lhs)).data;
+
+  const auto &rhs = eq.rhs().tensors();
+  std::vector<Operand> ops;
+  for (const Tensor &t : rhs) {
+    Operand op;
+    op.data = blocks.at(einsum_block_label(t)).data;
+    op.indices = block_indices(t);
+    ops.push_back(op);
+  }
+  const double alpha = eq.rhs_factor().to_double();
+
+  // with permutation operators the term is stored in a temporary
+  Operand result;
+  double *c = lhs_data;
+  if (not eq.permutations().empty()) {
+    result = zeros(lhs_indices, ctx);
+    c = result.storage->data();
+  }
+
+  if (ops.size() < 2) {
+    std::vector<const Operand *> op_ptrs;
+    for (const auto &op : ops) {
+      op_ptrs.push_back(&op);
+    }
+    loops(c, lhs_indices, op_ptrs, alpha, ctx);
+  } else {
+    const auto steps = optimal_contraction_path(lhs, rhs, space_dims).steps;
+    for (size_t s = 0; s < steps.size(); s++) {
+      const auto [i, j] = steps[s];
+      const Operand a = ops[i];
+      const Operand b = ops[j];
+      ops.erase(ops.begin() + j);
+      ops.erase(ops.begin() + i);
+      if (s + 1 == steps.size()) {
+        contract(c, lhs_indices, a, b, alpha, ctx);
+        break;
+      }
+      // the product keeps the indices used by the other operands
+      std::vector<Index> kept;
+      for (const auto *op : {&a, &b}) {
+        for (const Index &idx : op->indices) {
+          bool used = contains(lhs_indices, idx);
+          for (const auto &other : ops) {
+            used = used or contains(other.indices, idx);
+          }
+          if (used and not contains(kept, idx)) {
+            kept.push_back(idx);
+          }
+        }
+      }
+      Operand product = zeros(kept, ctx);
+      contract(product.storage->data(), kept, a, b, 1.0, ctx);
+      ops.push_back(product);
+    }
+  }
+
+  if (eq.permutations().empty()) {
+    return;
+  }
+  // add the permuted copies of the term: the copy obtained by relabeling the
+  // indices with idx_map has the index idx_map[idx] on the axis of idx
+  for (const auto &[idx_map, sign] : permutations(eq.permutations())) {
+    Operand permuted = result;
+    for (Index &idx : permuted.indices) {
+      auto it = idx_map.find(idx);
+      idx = (it == idx_map.end()) ? idx : it->second;
+    }
+    loops(lhs_data, lhs_indices, {&permuted}, sign, ctx);
+  }
+}
+
+} // namespace
+
+void evaluate(const std::vector<Equation> &equations,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads) {
+  // find the dimensions of the spaces from the shapes of the blocks
+  EvaluationContext ctx;
+  ctx.dims.assign(osi()->num_spaces(), 0);
+  ctx.nthreads =
+      nthreads > 0
+          ? nthreads
+          : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  std::vector<bool> known(ctx.dims.size(), false);
+  for (const auto &eq : equations) {
+    find_block(eq.lhs().tensors()[0], blocks, ctx.dims, known);
+    for (const Tensor &t : eq.rhs().tensors()) {
+      find_block(t, blocks, ctx.dims, known);
+    }
+  }
+  std::map<char, int> space_dims;
+  for (int s = 0; s < osi()->num_spaces(); s++) {
+    space_dims[osi()->label(s)] = static_cast<int>(ctx.dims[s]);
+  }
+
+  for (const auto &eq : equations) {
+    evaluate_equation(eq, blocks, space_dims, ctx);
+  }
+}
+
+void evaluate(const std::map<std::string, std::vector<Equation>> &equations,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads) {
+  std::vector<Equation> eqs;
+  for (const auto &[key, block_eqs] : equations) {
+    eqs.insert(eqs.end(), block_eqs.begin(), block_eqs.end());
+  }
+  evaluate(eqs, blocks, nthreads);
+}
+
+void evaluate(const Expression &expr, const std::string &label,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads) {
+  evaluate(expr.to_manybody_equation(label), blocks, nthreads);
+}
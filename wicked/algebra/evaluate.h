@@ -0,0 +1,44 @@
+#ifndef _wicked_evaluate_h_
+#define _wicked_evaluate_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "equation.h"
+
+class Expression;
+
+/// A dense block of a tensor stored in row-major order with the upper indices
+/// first. The data is not owned by the block
+struct TensorBlock {
+  double *data = nullptr;
+  std::vector<size_t> shape;
+};
+
+/// Evaluate a set of equations numerically, adding the right-hand side of
+/// each equation to its left-hand side. The blocks are identified by the
+/// names used by Equation::compile("einsum"), that is, the label followed by
+/// the spaces of the upper and lower indices (e.g., "T2oovv"), and their
+/// shapes determine the dimensions of the orbital spaces. The tensors of each
+/// term are contracted two at a time in the order that requires the fewest
+/// operations, using GEMM (BLAS when available) for the contractions that can
+/// be written as matrix products and loops for the others. Without BLAS, the
+/// matrix products are done with nthreads threads (0 = number of hardware
+/// threads). With BLAS, nthreads is ignored and the threads are those of the
+/// BLAS library
+void evaluate(const std::vector<Equation> &equations,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads = 0);
+
+/// Evaluate the equations returned by Expression::to_manybody_equation
+void evaluate(const std::map<std::string, std::vector<Equation>> &equations,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads = 0);
+
+/// Evaluate an expression into the blocks of the tensor label
+void evaluate(const Expression &expr, const std::string &label,
+              const std::map<std::string, TensorBlock> &blocks,
+              int nthreads = 0);
+
+#endif // _wicked_evaluate_h_
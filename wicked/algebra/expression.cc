@@ -1,9 +1,16 @@
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <iterator>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
 
 #include "helpers/helpers.h"
 #include "helpers/orbital_space.h"
 #include "helpers/stl_utils.hpp"
+#include "helpers/trace.h"
 
 #include "equation.h"
 #include "expression.h"
@@ -30,48 +37,248 @@ void Expression::add(const Term &sterm) {
 
 void Expression::add(const std::pair<SymbolicTerm, scalar_t> &term_factor,
                      scalar_t scale) {
+  add_to_map(terms_, term_factor.first, scale * term_factor.second);
+}
 
-  const SymbolicTerm &term = term_factor.first;
-  scalar_t factor = term_factor.second;
+void Expression::add(std::pair<SymbolicTerm, scalar_t> &&term_factor,
+                     scalar_t scale) {
+  add_to_map(terms_, std::move(term_factor.first),
+             scale * term_factor.second);
+}
 
-  auto search = terms_.find(term);
+void Expression::add(const Expression &expr, scalar_t scale) {
+  axpy(expr, scale);
+}
 
-  if (search != terms_.end()) {
-    /// Found, then just add the factor to the existing term
-    search->second += scale * factor;
-    if (search->second == 0) {
-      terms_.erase(search);
+void Expression::add(Expression &&expr, scalar_t scale) {
+  axpy(std::move(expr), scale);
+}
+
+namespace {
+/// Return the number of threads to use (0 = all hardware threads)
+int num_threads(int nthreads) {
+  return nthreads > 0
+             ? nthreads
+             : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/// Call fn(id) for id = 0, 1, ..., nthreads - 1 on separate threads that see
+/// the orbital spaces of the caller
+template <class Fn> void run_threads(int nthreads, const Fn &fn) {
+  if (nthreads == 1) {
+    fn(0);
+    return;
+  }
+  const OrbitalSpaceInfo *caller_osi = osi();
+  std::vector<std::thread> threads;
+  for (int id = 0; id < nthreads; id++) {
+    threads.push_back(std::thread([&fn, caller_osi, id]() {
+      OrbitalSpaceContext context(caller_osi);
+      fn(id);
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+/// Return the sum of the (term, factor) pairs stored in several containers.
+/// The terms are partitioned by hash, each part is combined (adding the
+/// containers in order) and sorted on its own thread, and the sorted parts are
+/// merged into the result. The terms merged with an equal one and those
+/// cancelled are added to nmerged and ncancelled
+template <class Part>
+std::map<SymbolicTerm, scalar_t>
+sum_terms(const std::vector<const Part *> &parts, int nthreads,
+          size_t &nmerged, size_t &ncancelled) {
+  using item_t = std::pair<const SymbolicTerm *, const scalar_t *>;
+  // more parts than threads balance the work
+  const size_t nbuckets = 4 * nthreads;
+
+  // 1. partition the terms of each container by hash
+  std::vector<std::vector<std::vector<item_t>>> buckets(
+      parts.size(), std::vector<std::vector<item_t>>(nbuckets));
+  std::atomic<size_t> next(0);
+  run_threads(nthreads, [&](int) {
+    for (size_t n = next++; n < parts.size(); n = next++) {
+      for (const auto &[term, c] : *parts[n]) {
+        const size_t b = std::hash<SymbolicTerm>()(term) % nbuckets;
+        buckets[n][b].emplace_back(&term, &c);
+      }
+    }
+  });
+
+  // 2. combine and sort the terms of each bucket
+  struct Hash {
+    size_t operator()(const SymbolicTerm *t) const {
+      return std::hash<SymbolicTerm>()(*t);
+    }
+  };
+  struct Equal {
+    bool operator()(const SymbolicTerm *a, const SymbolicTerm *b) const {
+      return *a == *b;
+    }
+  };
+  using sorted_t = std::vector<std::pair<const SymbolicTerm *, scalar_t>>;
+  std::vector<sorted_t> sorted(nbuckets);
+  std::vector<size_t> bucket_merged(nbuckets, 0);
+  std::vector<size_t> bucket_cancelled(nbuckets, 0);
+  next = 0;
+  run_threads(nthreads, [&](int) {
+    for (size_t b = next++; b < nbuckets; b = next++) {
+      std::unordered_map<const SymbolicTerm *, scalar_t, Hash, Equal> sum;
+      for (size_t n = 0; n < parts.size(); n++) {
+        // the same steps as add_to_map
+        for (const auto &[term, c] : buckets[n][b]) {
+          if (*c == 0) {
+            continue;
+          }
+          auto [it, inserted] = sum.try_emplace(term, scalar_t(0));
+          it->second += *c;
+          if (it->second == 0) {
+            sum.erase(it);
+            bucket_cancelled[b] += 1;
+          } else if (not inserted) {
+            bucket_merged[b] += 1;
+          }
+        }
+      }
+      sorted[b].assign(sum.begin(), sum.end());
+      std::sort(sorted[b].begin(), sorted[b].end(),
+                [](const auto &a, const auto &b) { return *a.first < *b.first; });
+    }
+  });
+
+  // 3. merge the sorted buckets (equal terms are in the same bucket)
+  using head_t = std::pair<size_t, size_t>;
+  auto greater = [&sorted](const head_t &a, const head_t &b) {
+    return *sorted[b.first][b.second].first < *sorted[a.first][a.second].first;
+  };
+  std::priority_queue<head_t, std::vector<head_t>, decltype(greater)> heads(
+      greater);
+  for (size_t b = 0; b < nbuckets; b++) {
+    nmerged += bucket_merged[b];
+    ncancelled += bucket_cancelled[b];
+    if (not sorted[b].empty()) {
+      heads.emplace(b, 0);
     }
-  } else {
-    terms_[term] = scale * factor;
   }
+  std::map<SymbolicTerm, scalar_t> result;
+  while (not heads.empty()) {
+    auto [b, k] = heads.top();
+    heads.pop();
+    result.emplace_hint(result.end(), *sorted[b][k].first,
+                        sorted[b][k].second);
+    if (k + 1 < sorted[b].size()) {
+      heads.emplace(b, k + 1);
+    }
+  }
+  return result;
 }
+} // namespace
+
+Expression &Expression::canonicalize(int nthreads) {
+  nthreads = std::min(num_threads(nthreads), static_cast<int>(terms_.size()));
+  if (nthreads <= 1) {
+    std::map<SymbolicTerm, scalar_t> canonical_terms;
+    for (const auto &[k, v] : terms_) {
+      SymbolicTerm term = k;
+      scalar_t factor = term.canonicalize();
+      factor *= v;
+      add_to_map(canonical_terms, std::move(term), factor);
+    }
+    terms_ = std::move(canonical_terms);
+    return *this;
+  }
 
-void Expression::add(const Expression &expr, scalar_t scale) {
-  for (const auto &kv : expr.terms()) {
-    add(kv, scale);
+  // each thread canonicalizes a contiguous range of terms
+  TraceScope trace("canonicalize", "algebra");
+  std::vector<const std::pair<const SymbolicTerm, scalar_t> *> items;
+  items.reserve(terms_.size());
+  for (const auto &item : terms_) {
+    items.push_back(&item);
+  }
+  using chunk_t = std::vector<std::pair<SymbolicTerm, scalar_t>>;
+  std::vector<chunk_t> chunks(nthreads);
+  run_threads(nthreads, [&](int id) {
+    const size_t first = items.size() * id / nthreads;
+    const size_t last = items.size() * (id + 1) / nthreads;
+    chunks[id].reserve(last - first);
+    for (size_t n = first; n < last; n++) {
+      SymbolicTerm term = items[n]->first;
+      scalar_t factor = term.canonicalize();
+      factor *= items[n]->second;
+      chunks[id].emplace_back(std::move(term), factor);
+    }
+  });
+  std::vector<const chunk_t *> parts;
+  for (const auto &chunk : chunks) {
+    parts.push_back(&chunk);
+  }
+  size_t nmerged = 0;
+  size_t ncancelled = 0;
+  terms_ = sum_terms(parts, nthreads, nmerged, ncancelled);
+  return *this;
+}
+
+Expression merge_expressions(const std::vector<const HashedExpression *> &parts,
+                             int nthreads, size_t *nmerged,
+                             size_t *ncancelled) {
+  size_t merged = 0;
+  size_t cancelled = 0;
+  Expression result;
+  nthreads = num_threads(nthreads);
+  if ((nthreads == 1) or (parts.size() < 2)) {
+    HashedExpression sum;
+    for (const HashedExpression *part : parts) {
+      for (const auto &[term, c] : part->terms()) {
+        const AddOutcome outcome = sum.add(term, c);
+        merged += (outcome == AddOutcome::Merged);
+        cancelled += (outcome == AddOutcome::Cancelled);
+      }
+    }
+    std::move(sum).add_to(result);
+  } else {
+    TraceScope trace("merge expressions", "algebra");
+    std::vector<const HashedExpression::vecspace_t *> maps;
+    for (const HashedExpression *part : parts) {
+      maps.push_back(&part->terms());
+    }
+    result.terms() = sum_terms(maps, nthreads, merged, cancelled);
   }
+  if (nmerged) {
+    *nmerged += merged;
+  }
+  if (ncancelled) {
+    *ncancelled += cancelled;
+  }
+  return result;
 }
 
-Expression &Expression::canonicalize() {
-  std::map<SymbolicTerm, scalar_t> canonical_terms;
+Expression &Expression::simplify() {
+  std::map<SymbolicTerm, scalar_t> simplified_terms;
   for (const auto &[k, v] : terms_) {
     SymbolicTerm term = k;
-    scalar_t factor = term.canonicalize();
+    scalar_t factor = term.simplify();
     factor *= v;
-    add_to_map(canonical_terms, term, factor);
+    add_to_map(simplified_terms, std::move(term), factor);
   }
-  terms_ = canonical_terms;
+  terms_ = std::move(simplified_terms);
   return *this;
 }
 
 Expression &Expression::reindex(index_map_t &idx_map) {
+  return reindex(DenseIndexMap(idx_map));
+}
+
+Expression &Expression::reindex(const DenseIndexMap &idx_map) {
   std::map<SymbolicTerm, scalar_t> reindexed_terms;
   for (auto &kv : terms_) {
     SymbolicTerm term = kv.first;
     term.reindex(idx_map);
-    add_to_map(reindexed_terms, term, kv.second);
+    add_to_map(reindexed_terms, std::move(term), kv.second);
   }
+  terms_ = std::move(reindexed_terms);
   return *this;
 }
 
@@ -113,47 +320,180 @@ std::string Expression::latex(const std::string &sep) const {
   return join(str_vec, sep);
 }
 
+manybody_block_t manybody_block(const SymbolicTerm &term) {
+  manybody_block_t block = {};
+  for (const auto &op : term.ops()) {
+    // creation operators give lower indices of the lhs tensor
+    const bool lower = op.type() == SQOperatorType::Creation;
+    block[2 * op.index().space() + lower] += 1;
+  }
+  return block;
+}
+
+std::string manybody_block_str(const manybody_block_t &block) {
+  std::string upper;
+  std::string lower;
+  for (int s = 0, maxs = osi()->num_spaces(); s < maxs; s++) {
+    upper += std::string(block[2 * s], osi()->label(s));
+    lower += std::string(block[2 * s + 1], osi()->label(s));
+  }
+  std::reverse(lower.begin(), lower.end());
+  return upper + "|" + lower;
+}
+
+manybody_block_t parse_manybody_block(const std::string &s) {
+  const size_t bar = s.find('|');
+  if (bar == std::string::npos) {
+    throw std::runtime_error("parse_manybody_block: the block \"" + s +
+                             "\" does not have the form \"upper|lower\"");
+  }
+  manybody_block_t block = {};
+  for (size_t k = 0; k < s.size(); k++) {
+    if ((k == bar) or is_space_char(s[k])) {
+      continue;
+    }
+    block[2 * osi()->label_to_space(s[k]) + (k > bar)] += 1;
+  }
+  return block;
+}
+
+namespace {
+/// Convert a term to the many-body equation label = factor * tensors
+Equation manybody_equation(const SymbolicTerm &term, scalar_t factor,
+                           const std::string &label) {
+  std::vector<Index> lower;
+  std::vector<Index> upper;
+  for (const auto &op : term.ops()) {
+    if (op.type() == SQOperatorType::Creation) {
+      lower.push_back(op.index());
+    } else {
+      // upper indices are read in reverse order
+      upper.insert(upper.begin(), op.index());
+    }
+  }
+  SymbolicTerm lhs;
+  lhs.add(Tensor(label, lower, upper, SymmetryType::Antisymmetric));
+
+  SymbolicTerm rhs;
+  for (const auto &tensor : term.tensors()) {
+    rhs.add(tensor);
+  }
+  return Equation(lhs, rhs, factor);
+}
+
+/// The smallest number of terms of a block created by each thread
+constexpr size_t min_terms_per_thread = 1024;
+} // namespace
+
+std::pair<std::string, Equation>
+make_manybody_equation(const SymbolicTerm &term, scalar_t factor,
+                       const std::string &label) {
+  return {manybody_block_str(manybody_block(term)),
+          manybody_equation(term, factor, label)};
+}
+
 std::map<std::string, std::vector<Equation>>
 Expression::to_manybody_equation(const std::string &label) const {
+  TraceScope trace("to_manybody_equation", "algebra");
   std::map<std::string, std::vector<Equation>> result;
-  for (const auto &term_factor : terms_) {
-    std::vector<Index> lower;
-    std::vector<Index> upper;
-    const SymbolicTerm &term = term_factor.first;
-    scalar_t factor = term_factor.second;
-    for (const auto &op : term.ops()) {
-      if (op.type() == SQOperatorType::Creation) {
-        lower.push_back(op.index());
-      } else {
-        // upper indices are read in reverse order
-        upper.insert(upper.begin(), op.index());
-      }
+  const ManyBodyEquations equations(*this, label);
+  for (size_t n = 0; n < equations.size(); n++) {
+    result.emplace(equations.blocks()[n], equations.equations(n));
+  }
+  return result;
+}
+
+ManyBodyEquations::ManyBodyEquations(const Expression &expr,
+                                     const std::string &label,
+                                     const std::vector<std::string> &blocks,
+                                     int nthreads)
+    : label_(label), nthreads_(num_threads(nthreads)) {
+  TraceScope trace("group manybody equations", "algebra");
+  std::vector<manybody_block_t> wanted;
+  for (const auto &block : blocks) {
+    wanted.push_back(parse_manybody_block(block));
+  }
+  std::sort(wanted.begin(), wanted.end());
+
+  std::vector<const term_t *> terms;
+  terms.reserve(expr.size());
+  for (const auto &term_factor : expr.terms()) {
+    terms.push_back(&term_factor);
+  }
+
+  // find the block of each term
+  std::vector<manybody_block_t> term_blocks(terms.size());
+  const int nworkers = std::max<int>(
+      1, std::min<size_t>(nthreads_, terms.size() / min_terms_per_thread));
+  run_threads(nworkers, [&](int id) {
+    const size_t begin = terms.size() * id / nworkers;
+    const size_t end = terms.size() * (id + 1) / nworkers;
+    for (size_t n = begin; n < end; n++) {
+      term_blocks[n] = manybody_block(terms[n]->first);
     }
-    SymbolicTerm lhs;
-    Tensor lhs_tensor(label, lower, upper, SymmetryType::Antisymmetric);
-    auto signature = lhs_tensor.signature();
-    // convert the signature to a string (to bypass limitations of pybind11)
-    std::string signature_str_upper;
-    std::string signature_str_lower;
-    int pos = 0;
-    for (const auto &[u, l] : signature) {
-      signature_str_upper += std::string(u, orbital_subspaces->label(pos));
-      signature_str_lower += std::string(l, orbital_subspaces->label(pos));
-      pos += 1;
+  });
+
+  // group the terms of the wanted blocks
+  std::map<manybody_block_t, std::vector<const term_t *>> grouped;
+  for (size_t n = 0; n < terms.size(); n++) {
+    if (wanted.empty() or std::binary_search(wanted.begin(), wanted.end(),
+                                             term_blocks[n])) {
+      grouped[term_blocks[n]].push_back(terms[n]);
     }
-    reverse(signature_str_lower.begin(), signature_str_lower.end());
-    auto signature_str = signature_str_upper + "|" + signature_str_lower;
-    lhs.add(lhs_tensor);
+  }
+
+  // store the blocks in the order of their keys
+  std::map<std::string, std::vector<const term_t *>> by_key;
+  for (auto &[block, block_terms] : grouped) {
+    by_key.emplace(manybody_block_str(block), std::move(block_terms));
+  }
+  for (auto &[key, block_terms] : by_key) {
+    keys_.push_back(key);
+    terms_.push_back(std::move(block_terms));
+  }
+}
+
+bool ManyBodyEquations::contains(const std::string &block) const {
+  // blocks are compared by their contents (e.g., "vo|ov" and "ov|ov" are
+  // the same block)
+  const std::string key = manybody_block_str(parse_manybody_block(block));
+  return std::binary_search(keys_.begin(), keys_.end(), key);
+}
 
-    SymbolicTerm rhs;
-    for (const auto &tensor : term.tensors()) {
-      rhs.add(tensor);
+std::vector<Equation> ManyBodyEquations::equations(size_t n) const {
+  if (n >= size()) {
+    throw std::out_of_range("ManyBodyEquations: block index out of range");
+  }
+  const std::vector<const term_t *> &terms = terms_[n];
+  const int nworkers = std::max<int>(
+      1, std::min<size_t>(nthreads_, terms.size() / min_terms_per_thread));
+  std::vector<std::vector<Equation>> parts(nworkers);
+  run_threads(nworkers, [&](int id) {
+    const size_t begin = terms.size() * id / nworkers;
+    const size_t end = terms.size() * (id + 1) / nworkers;
+    parts[id].reserve(end - begin);
+    for (size_t k = begin; k < end; k++) {
+      parts[id].push_back(
+          manybody_equation(terms[k]->first, terms[k]->second, label_));
     }
-    result[signature_str].push_back(Equation(lhs, rhs, factor));
+  });
+  std::vector<Equation> result = std::move(parts[0]);
+  for (int id = 1; id < nworkers; id++) {
+    std::move(parts[id].begin(), parts[id].end(), std::back_inserter(result));
   }
   return result;
 }
 
+std::vector<Equation>
+ManyBodyEquations::equations(const std::string &block) const {
+  const std::string key = manybody_block_str(parse_manybody_block(block));
+  auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+  if ((it == keys_.end()) or (*it != key)) {
+    return {};
+  }
+  return equations(it - keys_.begin());
+}
+
 std::ostream &operator<<(std::ostream &os, const Expression &sum) {
   os << sum.str();
   return os;
@@ -167,10 +507,10 @@ Expression make_operator_expr(const std::string &label,
   for (const std::string &s : components) {
     auto s_vec = split(s);
 
-    std::vector<int> cre_count(orbital_subspaces->num_spaces(), 0);
-    std::vector<int> ann_count(orbital_subspaces->num_spaces(), 0);
+    std::vector<int> cre_count(osi()->num_spaces(), 0);
+    std::vector<int> ann_count(osi()->num_spaces(), 0);
     for (const auto &s : s_vec) {
-      int space = orbital_subspaces->label_to_space(s[0]);
+      int space = osi()->label_to_space(s[0]);
       ann_count[space] += 1;
     }
 
@@ -179,7 +519,7 @@ Expression make_operator_expr(const std::string &label,
 
     // parse "v+ o"
     for (const auto &s : s_vec) {
-      int space = orbital_subspaces->label_to_space(s[0]);
+      int space = osi()->label_to_space(s[0]);
       if (s.size() == 2) {
         auto idx = Index(space, cre_count[space]);
         cre.push_back(idx);
@@ -208,8 +548,6 @@ Expression make_operator_expr(const std::string &label,
 }
 
 Expression string_to_expr(const std::string &s, SymmetryType symmetry) {
-
-  TensorSyntax syntax = TensorSyntax::Wicked;
   Expression sum;
 
   // if we have an empty string, do not parse it (the code below would interpret
@@ -217,36 +555,79 @@ Expression string_to_expr(const std::string &s, SymmetryType symmetry) {
   if (s.size() == 0)
     return sum;
 
-  //"f^{v0}_{o0} t^{o0}_{v0}"
-  std::string factor_re;
-  std::string tensor_re;
-  std::string operator_re;
-  if (syntax == TensorSyntax::Wicked) {
-    tensor_re = "([a-zA-Z0-9]+\\^\\{[\\w,\\s]*\\}_\\{[\\w,\\s]*\\})";
-    operator_re = "a([+-]{1,1})\\(([\\w,\\d]*)\\)";
-    factor_re = "^\\s*([+-]?\\d*\\/?\\d*)\\s*";
-  }
-
-  auto tensors = findall(s, tensor_re);
+  // "-1/2 f^{v0}_{o0} t^{o0}_{v0} a+(v0) a-(o0)"
+  const size_t n = s.size();
 
-  SymbolicTerm term;
-  for (const auto &t : tensors) {
-    term.add(make_tensor_from_str(t, symmetry));
+  // the factor at the start of the string (an empty factor is 1)
+  size_t k = 0;
+  while (k < n and is_space_char(s[k])) {
+    k++;
   }
+  const size_t factor_start = k;
+  if (k < n and (s[k] == '+' or s[k] == '-')) {
+    k++;
+  }
+  while (k < n and is_digit_char(s[k])) {
+    k++;
+  }
+  if (k < n and s[k] == '/') {
+    k++;
+  }
+  while (k < n and is_digit_char(s[k])) {
+    k++;
+  }
+  scalar_t factor =
+      make_rational_from_str(s.substr(factor_start, k - factor_start));
 
-  auto operators = findall(s, operator_re);
-
-  for (size_t n = 0; n < operators.size(); n += 2) {
-    SQOperatorType type = operators[n] == "+" ? SQOperatorType::Creation
+  // find the tensors and the operators in one pass, skipping any other
+  // character. A tensor can only start at the beginning of its label
+  SymbolicTerm term;
+  for (k = 0; k < n;) {
+    if (k == 0 or not is_alnum_char(s[k - 1])) {
+      const size_t end = match_tensor_str(s, k);
+      if (end != std::string::npos) {
+        term.add(make_tensor_from_str(s.substr(k, end - k), symmetry));
+        k = end;
+        continue;
+      }
+    }
+    // an operator of the form "a+(v0)" or "a-(o0)"
+    if (s[k] == 'a' and k + 2 < n and (s[k + 1] == '+' or s[k + 1] == '-') and
+        s[k + 2] == '(') {
+      size_t end = k + 3;
+      while (end < n and (is_word_char(s[end]) or s[end] == ',')) {
+        end++;
+      }
+      if (end < n and s[end] == ')') {
+        SQOperatorType type = s[k + 1] == '+' ? SQOperatorType::Creation
                                               : SQOperatorType::Annihilation;
-    Index index = make_index_from_str(operators[n + 1]);
-    term.add(SQOperator(type, index));
+        Index index = make_index_from_str(s.substr(k + 3, end - k - 3));
+        term.add(SQOperator(type, index));
+        k = end + 1;
+        continue;
+      }
+    }
+    k++;
   }
 
-  auto factor_vec = findall(s, factor_re);
-  scalar_t factor = make_rational_from_str(factor_vec[0]);
-
   sum.add(term, factor);
 
   return sum;
 }
+
+Expression string_to_expr_lines(const std::string &s, SymmetryType symmetry) {
+  Expression sum;
+  size_t start = 0;
+  while (start <= s.size()) {
+    size_t end = s.find('\n', start);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    for (const auto &[term, c] :
+         string_to_expr(s.substr(start, end - start), symmetry)) {
+      sum.add(term, c);
+    }
+    start = end + 1;
+  }
+  return sum;
+}
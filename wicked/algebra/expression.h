@@ -1,15 +1,20 @@
 #ifndef _wicked_expression_h_
 #define _wicked_expression_h_
 
+#include <array>
 #include <map>
 #include <vector>
 
 #include "equation.h"
 #include "helpers/algebra.hpp"
+#include "helpers/orbital_space.h"
 #include "index.h"
 #include "term.h"
 #include "wicked-def.h"
 
+/// A hash table used to accumulate the terms of an expression
+using HashedExpression = HashedAlgebra<SymbolicTerm, scalar_t>;
+
 /// A class to represent an algebraic expression
 class Expression : public Algebra<SymbolicTerm, scalar_t> {
 public:
@@ -32,15 +37,25 @@ public:
   /// Add a term that can optionally be scaled
   void add(const std::pair<SymbolicTerm, scalar_t> &term_factor,
            scalar_t scale = 1);
+  void add(std::pair<SymbolicTerm, scalar_t> &&term_factor,
+           scalar_t scale = 1);
 
-  /// Add a term that can optionally be scaled
+  /// Add an expression that can optionally be scaled (see Algebra::axpy)
   void add(const Expression &expr, scalar_t scale = 1);
+  void add(Expression &&expr, scalar_t scale = 1);
+
+  /// Canonicalize this sum. With more than one thread (0 = all hardware
+  /// threads), the terms are canonicalized independently and combined as in
+  /// merge_expressions, so the result does not depend on nthreads
+  Expression &canonicalize(int nthreads = 1);
 
-  /// Canonicalize this sum
-  Expression &canonicalize();
+  /// Simplify the terms of this sum (see SymbolicTerm::simplify) and combine
+  /// those that differ only by a relabeling of the indices
+  Expression &simplify();
 
   /// Reindex this sum
   Expression &reindex(index_map_t &idx_map);
+  Expression &reindex(const DenseIndexMap &idx_map);
 
   /// Compare this expression to another one
   bool operator==(const Expression &other);
@@ -67,12 +82,87 @@ public:
 /// Print to an output stream
 std::ostream &operator<<(std::ostream &os, const Expression &sum);
 
+/// Convert a term to the many-body equation label = factor * tensors and
+/// return it with the key of its block (see Expression::to_manybody_equation)
+std::pair<std::string, Equation>
+make_manybody_equation(const SymbolicTerm &term, scalar_t factor,
+                       const std::string &label);
+
+/// The block of a many-body equation, stored as the number of upper and lower
+/// indices of the lhs tensor in each space (upper(0), lower(0), upper(1), ...)
+using manybody_block_t = std::array<uint8_t, 2 * max_orbital_spaces>;
+
+/// Return the block of the many-body equation of a term
+manybody_block_t manybody_block(const SymbolicTerm &term);
+
+/// Return the key of a block (e.g., "oo|vv", see to_manybody_equation)
+std::string manybody_block_str(const manybody_block_t &block);
+
+/// Return the block with a given key. The order of the spaces on each side of
+/// "|" does not matter
+manybody_block_t parse_manybody_block(const std::string &s);
+
+/// The many-body equations of an expression grouped by block (see
+/// Expression::to_manybody_equation), optionally restricted to some blocks.
+/// The terms are grouped by block when this object is created, but the
+/// equations of a block are created only when they are requested. The
+/// expression must outlive this object
+class ManyBodyEquations {
+public:
+  /// Group the terms of expr in the blocks listed (all if empty) using
+  /// nthreads threads (0 = all hardware threads)
+  ManyBodyEquations(const Expression &expr, const std::string &label,
+                    const std::vector<std::string> &blocks = {},
+                    int nthreads = 1);
+
+  /// Return the number of blocks with at least one term
+  size_t size() const { return keys_.size(); }
+
+  /// Return the keys of the blocks in the order of to_manybody_equation
+  const std::vector<std::string> &blocks() const { return keys_; }
+
+  /// Return true if a block has at least one term
+  bool contains(const std::string &block) const;
+
+  /// Return the equations of the n-th block. Large blocks are created with
+  /// several threads
+  std::vector<Equation> equations(size_t n) const;
+
+  /// Return the equations of a block (empty if it has no terms)
+  std::vector<Equation> equations(const std::string &block) const;
+
+private:
+  using term_t = std::pair<const SymbolicTerm, scalar_t>;
+  /// The label of the lhs tensors
+  std::string label_;
+  /// The number of threads
+  int nthreads_;
+  /// The key of each block
+  std::vector<std::string> keys_;
+  /// The terms of each block, in the order of the expression
+  std::vector<std::vector<const term_t *>> terms_;
+};
+
+/// Return the sum of several tables of terms computed with nthreads threads
+/// (0 = all hardware threads). The terms are partitioned by hash, each part is
+/// combined (adding the tables in order) and sorted on a separate thread, and
+/// the sorted parts are merged, so the result does not depend on nthreads. The
+/// number of terms combined with an equal one and of those that cancelled one
+/// are added to nmerged and ncancelled (if not null)
+Expression merge_expressions(const std::vector<const HashedExpression *> &parts,
+                             int nthreads, size_t *nmerged = nullptr,
+                             size_t *ncancelled = nullptr);
+
 /// The syntax used to input a tensor expression
 enum class TensorSyntax { Wicked, TCE };
 
 ///// Create a sum from a string
 Expression string_to_expr(const std::string &s, SymmetryType symmetry);
 
+/// Create a sum from a string with one term per line (e.g., the output of
+/// Expression::str). Empty lines are skipped
+Expression string_to_expr_lines(const std::string &s, SymmetryType symmetry);
+
 Expression make_operator_expr(const std::string &label,
                               const std::vector<std::string> &components,
                               bool normal_ordered, SymmetryType symmetry,
@@ -0,0 +1,144 @@
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+
+#include "expression.h"
+#include "expression_arrays.h"
+
+namespace {
+/// Convert a numerator or denominator to a 64-bit integer
+int64_t to_int64(const rational_t &x) {
+  if ((x > rational_t(std::numeric_limits<int64_t>::max())) or
+      (x < rational_t(std::numeric_limits<int64_t>::min()))) {
+    throw std::runtime_error(
+        "to_arrays: a coefficient does not fit in 64-bit integers");
+  }
+  return static_cast<int64_t>(x);
+}
+
+/// Return the index with a given space and position
+Index make_index(int32_t space, int32_t pos) {
+  if ((space < 0) or (space >= osi()->num_spaces()) or (pos < 0)) {
+    throw std::runtime_error("from_arrays: invalid index (space = " +
+                             std::to_string(space) +
+                             ", pos = " + std::to_string(pos) + ")");
+  }
+  return Index(space, pos);
+}
+} // namespace
+
+ExpressionArrays to_arrays(const Expression &expr) {
+  TraceScope trace("to_arrays", "algebra");
+  ExpressionArrays arrays;
+  std::unordered_map<std::size_t, int32_t> label_ids;
+  arrays.terms.reserve(expr.size());
+  for (const auto &[term, factor] : expr.terms()) {
+    const int64_t term_id = arrays.terms.size();
+    arrays.terms.push_back({to_int64(factor.numerator()),
+                            to_int64(factor.denominator()), factor.to_double(),
+                            term.normal_ordered()});
+    for (const auto &tensor : term.tensors()) {
+      const int64_t tensor_id = arrays.tensors.size();
+      const Label &label = tensor.label_id();
+      auto [it, inserted] =
+          label_ids.emplace(label.hash(), arrays.labels.size());
+      if (inserted) {
+        arrays.labels.push_back(label.str());
+      }
+      arrays.tensors.push_back(
+          {term_id, it->second, static_cast<int8_t>(tensor.symmetry())});
+      for (const Index &idx : tensor.lower()) {
+        arrays.indices.push_back(
+            {term_id, tensor_id, false, idx.space(), idx.pos()});
+      }
+      for (const Index &idx : tensor.upper()) {
+        arrays.indices.push_back(
+            {term_id, tensor_id, true, idx.space(), idx.pos()});
+      }
+    }
+    for (const auto &op : term.ops()) {
+      arrays.ops.push_back({term_id, op.is_creation(), op.index().space(),
+                            op.index().pos()});
+    }
+  }
+  return arrays;
+}
+
+Expression from_arrays(const ExpressionArrays &arrays) {
+  TraceScope trace("from_arrays", "algebra");
+  const size_t nterms = arrays.terms.size();
+  const size_t ntensors = arrays.tensors.size();
+  std::vector<Label> labels(arrays.labels.begin(), arrays.labels.end());
+
+  Expression result;
+  size_t t = 0; // the next tensor
+  size_t i = 0; // the next index
+  size_t o = 0; // the next operator
+  std::vector<Tensor> tensors;
+  std::vector<SQOperator> ops;
+  std::vector<Index> lower;
+  std::vector<Index> upper;
+  for (size_t n = 0; n < nterms; n++) {
+    const TermRecord &term = arrays.terms[n];
+    if (term.denominator == 0) {
+      throw std::runtime_error("from_arrays: a term has a zero denominator");
+    }
+    tensors.clear();
+    for (; (t < ntensors) and (arrays.tensors[t].term == int64_t(n)); t++) {
+      const TensorRecord &tensor = arrays.tensors[t];
+      if ((tensor.label < 0) or (tensor.label >= int32_t(labels.size()))) {
+        throw std::runtime_error("from_arrays: a tensor label is out of range");
+      }
+      if ((tensor.symmetry < 0) or
+          (tensor.symmetry > int8_t(SymmetryType::Nonsymmetric))) {
+        throw std::runtime_error("from_arrays: invalid tensor symmetry");
+      }
+      lower.clear();
+      upper.clear();
+      for (; (i < arrays.indices.size()) and
+             (arrays.indices[i].tensor == int64_t(t));
+           i++) {
+        const IndexRecord &idx = arrays.indices[i];
+        if (idx.term != int64_t(n)) {
+          throw std::runtime_error(
+              "from_arrays: an index and its tensor belong to different "
+              "terms");
+        }
+        (idx.upper ? upper : lower).push_back(make_index(idx.space, idx.pos));
+      }
+      tensors.emplace_back(labels[tensor.label], lower, upper,
+                           static_cast<SymmetryType>(tensor.symmetry));
+    }
+    ops.clear();
+    for (; (o < arrays.ops.size()) and (arrays.ops[o].term == int64_t(n));
+         o++) {
+      const OperatorRecord &op = arrays.ops[o];
+      ops.emplace_back(op.creation ? SQOperatorType::Creation
+                                   : SQOperatorType::Annihilation,
+                       make_index(op.space, op.pos));
+    }
+    result.add(SymbolicTerm(term.normal_ordered, ops, tensors),
+               scalar_t(rational_t(term.numerator),
+                        rational_t(term.denominator)));
+  }
+  // every record must have been consumed by a term
+  if (t < ntensors) {
+    throw std::runtime_error(
+        "from_arrays: the tensors are not grouped by increasing term or refer "
+        "to a term out of range");
+  }
+  if (i < arrays.indices.size()) {
+    throw std::runtime_error(
+        "from_arrays: the indices are not grouped by increasing tensor or "
+        "refer to a tensor out of range");
+  }
+  if (o < arrays.ops.size()) {
+    throw std::runtime_error(
+        "from_arrays: the ops are not grouped by increasing term or refer to "
+        "a term out of range");
+  }
+  return result;
+}
@@ -0,0 +1,75 @@
+#ifndef _wicked_expression_arrays_h_
+#define _wicked_expression_arrays_h_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Expression;
+
+/// A term of an expression
+struct TermRecord {
+  /// The coefficient as a fraction and as a double
+  int64_t numerator;
+  int64_t denominator;
+  double coefficient;
+  /// Are the operators normal ordered?
+  uint8_t normal_ordered;
+};
+
+/// A tensor of a term
+struct TensorRecord {
+  /// The position of the term in ExpressionArrays::terms
+  int64_t term;
+  /// The position of the label in ExpressionArrays::labels
+  int32_t label;
+  /// The symmetry (see SymmetryType)
+  int8_t symmetry;
+};
+
+/// An index of a tensor. The lower indices of a tensor come before the upper
+/// ones
+struct IndexRecord {
+  /// The position of the term and of the tensor in ExpressionArrays
+  int64_t term;
+  int64_t tensor;
+  /// Is this an upper index?
+  uint8_t upper;
+  /// The orbital space and the position of the index (see Index)
+  int32_t space;
+  int32_t pos;
+};
+
+/// A second quantized operator of a term
+struct OperatorRecord {
+  /// The position of the term in ExpressionArrays::terms
+  int64_t term;
+  /// Is this a creation operator?
+  uint8_t creation;
+  /// The orbital space and the position of the index (see Index)
+  int32_t space;
+  int32_t pos;
+};
+
+/// The structure of an expression stored in tables with one record per term,
+/// tensor, index, and operator, in the order of the expression. Used to
+/// exchange expressions with NumPy without creating an object for each term
+struct ExpressionArrays {
+  /// The labels of the tensors (each appears once)
+  std::vector<std::string> labels;
+  std::vector<TermRecord> terms;
+  std::vector<TensorRecord> tensors;
+  std::vector<IndexRecord> indices;
+  std::vector<OperatorRecord> ops;
+};
+
+/// Return the tables of an expression. Throws if a coefficient does not fit in
+/// 64-bit integers
+ExpressionArrays to_arrays(const Expression &expr);
+
+/// Create an expression from tables in the format of to_arrays (the double
+/// coefficients are ignored). The records of each table must be grouped by
+/// term (and the indices by tensor) in increasing order
+Expression from_arrays(const ExpressionArrays &arrays);
+
+#endif // _wicked_expression_arrays_h_
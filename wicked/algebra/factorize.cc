@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+
+#include "factorize.h"
+
+namespace {
+
+/// The contraction of two tensors of a term written with canonical indices
+struct PairForm {
+  /// A string that is the same for all the contractions that differ only by a
+  /// relabeling of the indices
+  std::string key;
+  /// The positions of the two tensors in the term
+  size_t first;
+  size_t second;
+  /// The two tensors written with canonical indices
+  std::vector<Tensor> tensors;
+  /// The lower and upper indices of the intermediate (canonical)
+  std::vector<Index> lower;
+  std::vector<Index> upper;
+  /// Map from the canonical indices to the indices of the term
+  index_map_t to_term;
+};
+
+/// Write the contraction of tensors p and q of a term with canonical indices.
+/// The indices are numbered in the order they appear in p and then q, and
+/// the ones that also appear in the rest of the term are the indices of the
+/// intermediate (upper indices first)
+PairForm pair_form(const std::vector<Tensor> &tensors, size_t p, size_t q,
+                   const std::map<Index, int> &num_uses) {
+  PairForm form;
+  form.first = p;
+  form.second = q;
+
+  index_map_t to_canonical;
+  std::vector<int> counter(osi()->num_spaces(), 0);
+  for (size_t t : {p, q}) {
+    for (const auto *indices : {&tensors[t].upper(), &tensors[t].lower()}) {
+      for (const Index &idx : *indices) {
+        if (to_canonical.count(idx) == 0) {
+          Index canonical(idx.space(), counter[idx.space()]++);
+          to_canonical[idx] = canonical;
+          form.to_term[canonical] = idx;
+        }
+      }
+    }
+  }
+
+  // an index is external if it is used by a tensor other than p and q
+  auto is_external = [&](const Index &idx) {
+    const auto &tp = tensors[p].indices();
+    const auto &tq = tensors[q].indices();
+    int uses = num_uses.at(idx);
+    uses -= std::count(tp.begin(), tp.end(), idx);
+    uses -= std::count(tq.begin(), tq.end(), idx);
+    return uses > 0;
+  };
+
+  std::set<Index> added;
+  for (size_t t : {p, q}) {
+    for (const Index &idx : tensors[t].upper()) {
+      if (is_external(idx) and added.insert(idx).second) {
+        form.upper.push_back(to_canonical[idx]);
+      }
+    }
+  }
+  for (size_t t : {p, q}) {
+    for (const Index &idx : tensors[t].lower()) {
+      if (is_external(idx) and added.insert(idx).second) {
+        form.lower.push_back(to_canonical[idx]);
+      }
+    }
+  }
+
+  for (size_t t : {p, q}) {
+    Tensor tensor = tensors[t];
+    tensor.reindex(to_canonical);
+    form.key += tensor.str();
+    form.tensors.push_back(tensor);
+  }
+  form.key += "->" +
+              Tensor("", form.lower, form.upper, SymmetryType::Nonsymmetric)
+                  .str();
+  return form;
+}
+
+/// Return the number of tensors and operators of an equation that use each
+/// index
+std::map<Index, int> index_uses(const Equation &eq) {
+  std::map<Index, int> num_uses;
+  for (const auto *term : {&eq.lhs(), &eq.rhs()}) {
+    for (const Tensor &t : term->tensors()) {
+      for (const Index &idx : t.indices()) {
+        num_uses[idx] += 1;
+      }
+    }
+    for (const SQOperator &op : term->ops()) {
+      num_uses[op.index()] += 1;
+    }
+  }
+  return num_uses;
+}
+
+/// Return true if tensors p and q of a term share an index that is summed
+/// over and at least another tensor is left once they are contracted
+bool is_contractible_pair(const std::vector<Tensor> &tensors, size_t p,
+                          size_t q, const std::map<Index, int> &num_uses) {
+  if (tensors.size() < 3) {
+    return false;
+  }
+  const auto &tp = tensors[p].indices();
+  const auto &tq = tensors[q].indices();
+  for (const Index &idx : tp) {
+    if (std::find(tq.begin(), tq.end(), idx) != tq.end() and
+        num_uses.at(idx) == 2) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Find all the contractible pairs of an equation and call f on the canonical
+/// form of each of them. The two orders of a pair are compared and the one
+/// with the smallest key is used
+template <typename F> void for_each_pair(const Equation &eq, F f) {
+  const auto &tensors = eq.rhs().tensors();
+  const auto num_uses = index_uses(eq);
+  for (size_t p = 0; p < tensors.size(); p++) {
+    for (size_t q = p + 1; q < tensors.size(); q++) {
+      if (not is_contractible_pair(tensors, p, q, num_uses)) {
+        continue;
+      }
+      PairForm pq = pair_form(tensors, p, q, num_uses);
+      PairForm qp = pair_form(tensors, q, p, num_uses);
+      if (not f(qp.key < pq.key ? qp : pq)) {
+        return;
+      }
+    }
+  }
+}
+
+/// Replace a pair of tensors of an equation with an intermediate
+Equation replace_pair(const Equation &eq, const PairForm &form,
+                      const Label &label) {
+  Tensor intermediate(label, form.lower, form.upper,
+                      SymmetryType::Nonsymmetric);
+  index_map_t to_term = form.to_term;
+  intermediate.reindex(to_term);
+
+  const auto &tensors = eq.rhs().tensors();
+  std::vector<Tensor> new_tensors;
+  for (size_t t = 0; t < tensors.size(); t++) {
+    if (t == std::min(form.first, form.second)) {
+      new_tensors.push_back(intermediate);
+    } else if (t != form.first and t != form.second) {
+      new_tensors.push_back(tensors[t]);
+    }
+  }
+  SymbolicTerm rhs(eq.rhs().normal_ordered(), eq.rhs().ops(), new_tensors);
+  return Equation(eq.lhs(), rhs, eq.rhs_factor(), eq.permutations());
+}
+
+} // namespace
+
+FactorizedEquations::FactorizedEquations(
+    const std::vector<Equation> &intermediates,
+    const std::vector<Equation> &equations)
+    : intermediates_(intermediates), equations_(equations) {}
+
+std::string FactorizedEquations::str() const {
+  std::vector<std::string> str_vec;
+  for (const auto &eq : intermediates_) {
+    str_vec.push_back(eq.str());
+  }
+  for (const auto &eq : equations_) {
+    str_vec.push_back(eq.str());
+  }
+  return join(str_vec, "\n");
+}
+
+std::string FactorizedEquations::compile(const std::string &format,
+                                        const std::map<char, int> &dims) const {
+  TraceScope trace("compile", "codegen");
+  std::vector<std::string> str_vec;
+  for (const auto &eq : intermediates_) {
+    if (format == "einsum") {
+      const auto &lhs_tensor = eq.lhs().tensors()[0];
+      std::string block =
+          einsum_block_label(lhs_tensor).substr(lhs_tensor.label().size());
+      str_vec.push_back(lhs_tensor.label() + " = {\"" + block + "\": " +
+                        compile_einsum(lhs_tensor, eq.rhs().tensors(), dims) +
+                        "}");
+    } else {
+      str_vec.push_back(eq.compile(format, dims));
+    }
+  }
+  for (const auto &eq : equations_) {
+    str_vec.push_back(eq.compile(format, dims));
+  }
+  return join(str_vec, "\n");
+}
+
+FactorizedEquations factorize(const std::vector<Equation> &equations,
+                              const std::string &prefix, int min_uses) {
+  TraceScope trace("factorize", "codegen");
+  std::vector<Equation> intermediates;
+  std::vector<Equation> result = equations;
+
+  for (int n = 0;; n++) {
+    // count the number of equations that contain each pair
+    std::map<std::string, std::pair<int, PairForm>> pairs;
+    for (const auto &eq : result) {
+      std::set<std::string> found;
+      for_each_pair(eq, [&](const PairForm &form) {
+        if (found.insert(form.key).second) {
+          auto it = pairs.find(form.key);
+          if (it == pairs.end()) {
+            pairs.emplace(form.key, std::make_pair(1, form));
+          } else {
+            it->second.first += 1;
+          }
+        }
+        return true;
+      });
+    }
+
+    // pick the most common pair (the first in the order of the keys if there
+    // is a tie)
+    const std::pair<int, PairForm> *best = nullptr;
+    for (const auto &[key, count_form] : pairs) {
+      if (best == nullptr or count_form.first > best->first) {
+        best = &count_form;
+      }
+    }
+    if (best == nullptr or best->first < min_uses) {
+      break;
+    }
+
+    const PairForm &best_form = best->second;
+    const Label label(prefix + std::to_string(n));
+    Tensor intermediate(label, best_form.lower, best_form.upper,
+                        SymmetryType::Nonsymmetric);
+    intermediates.emplace_back(SymbolicTerm(false, {}, {intermediate}),
+                               SymbolicTerm(false, {}, best_form.tensors),
+                               scalar_t(1));
+
+    // replace the pair in all the equations (a term may contain it more than
+    // once)
+    for (auto &eq : result) {
+      for (bool replaced = true; replaced;) {
+        replaced = false;
+        for_each_pair(eq, [&](const PairForm &form) {
+          if (form.key == best_form.key) {
+            eq = replace_pair(eq, form, label);
+            replaced = true;
+            return false;
+          }
+          return true;
+        });
+      }
+    }
+  }
+  return FactorizedEquations(intermediates, result);
+}
+
+FactorizedEquations
+factorize(const std::map<std::string, std::vector<Equation>> &equations,
+          const std::string &prefix, int min_uses) {
+  std::vector<Equation> eqs;
+  for (const auto &[block, block_eqs] : equations) {
+    eqs.insert(eqs.end(), block_eqs.begin(), block_eqs.end());
+  }
+  return factorize(eqs, prefix, min_uses);
+}
+
+std::ostream &operator<<(std::ostream &os, const FactorizedEquations &feqs) {
+  os << feqs.str();
+  return os;
+}
@@ -0,0 +1,64 @@
+#ifndef _wicked_factorize_h_
+#define _wicked_factorize_h_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "equation.h"
+
+/// A set of equations in which the binary contractions shared by several
+/// terms are computed once and stored in intermediate tensors. The
+/// intermediates are defined in the order in which they must be computed
+/// (an intermediate may depend on the ones defined before it)
+class FactorizedEquations {
+public:
+  // ==> Constructor <==
+  FactorizedEquations(const std::vector<Equation> &intermediates,
+                      const std::vector<Equation> &equations);
+
+  // ==> Class public interface <==
+
+  /// Return the equations that define the intermediates
+  const std::vector<Equation> &intermediates() const { return intermediates_; }
+
+  /// Return the equations rewritten in terms of the intermediates
+  const std::vector<Equation> &equations() const { return equations_; }
+
+  /// Return a string representation
+  std::string str() const;
+
+  /// Return a compilable representation. The intermediates are computed first
+  /// and, for the einsum format, stored in dictionaries of blocks like the
+  /// other tensors (e.g., X0 = {"ov": np.einsum(...)}). The dimensions of
+  /// the spaces are used like in Equation::compile
+  std::string compile(const std::string &format,
+                      const std::map<char, int> &dims = {}) const;
+
+private:
+  // ==> Class private data <==
+
+  /// The definitions of the intermediates
+  std::vector<Equation> intermediates_;
+  /// The equations that use the intermediates
+  std::vector<Equation> equations_;
+};
+
+/// Find the contractions of two tensors that appear in at least min_uses terms
+/// of a set of equations and replace them with intermediates labeled with
+/// prefix followed by a number. Contractions are matched up to a relabeling
+/// of their indices, and the most common one is factored out first, so that
+/// intermediates can also contain other intermediates
+FactorizedEquations factorize(const std::vector<Equation> &equations,
+                              const std::string &prefix = "X",
+                              int min_uses = 2);
+
+/// Factorize the equations returned by Expression::to_manybody_equation
+FactorizedEquations
+factorize(const std::map<std::string, std::vector<Equation>> &equations,
+          const std::string &prefix = "X", int min_uses = 2);
+
+/// Print to an output stream
+std::ostream &operator<<(std::ostream &os, const FactorizedEquations &feqs);
+
+#endif // _wicked_factorize_h_
@@ -0,0 +1,133 @@
+#include <stdexcept>
+#include <unordered_map>
+
+#include "helpers/helpers.h"
+#include "helpers/trace.h"
+
+#include "expression.h"
+#include "frozen_expression.h"
+
+FrozenExpression::FrozenExpression()
+    : term_tensors_(1, 0), term_indices_(1, 0), term_ops_(1, 0) {}
+
+FrozenExpression::FrozenExpression(const Expression &expr)
+    : FrozenExpression() {
+  TraceScope trace("freeze", "algebra");
+  std::unordered_map<std::size_t, uint32_t> label_ids;
+  factors_.reserve(expr.size());
+  term_tensors_.reserve(expr.size() + 1);
+  term_indices_.reserve(expr.size() + 1);
+  term_ops_.reserve(expr.size() + 1);
+  for (const auto &[term, factor] : expr.terms()) {
+    for (const auto &tensor : term.tensors()) {
+      if (tensor.lower().size() > 255 or tensor.upper().size() > 255) {
+        throw std::runtime_error(
+            "FrozenExpression: a tensor has more than 255 lower or upper "
+            "indices");
+      }
+      const Label &label = tensor.label_id();
+      auto [it, inserted] = label_ids.emplace(label.hash(), labels_.size());
+      if (inserted) {
+        labels_.push_back(label);
+      }
+      tensor_labels_.push_back(it->second);
+      tensor_symmetry_.push_back(static_cast<uint8_t>(tensor.symmetry()));
+      tensor_rank_.emplace_back(tensor.lower().size(), tensor.upper().size());
+      for (const Index &idx : tensor.lower()) {
+        indices_.push_back(idx.hash());
+      }
+      for (const Index &idx : tensor.upper()) {
+        indices_.push_back(idx.hash());
+      }
+    }
+    for (const auto &op : term.ops()) {
+      ops_.push_back(op.index().hash());
+      creation_.push_back(op.is_creation());
+    }
+    normal_ordered_.push_back(term.normal_ordered());
+    factors_.push_back(factor);
+    term_tensors_.push_back(tensor_labels_.size());
+    term_indices_.push_back(indices_.size());
+    term_ops_.push_back(ops_.size());
+  }
+}
+
+SymbolicTerm FrozenExpression::term(size_t n) const {
+  std::vector<Tensor> tensors;
+  tensors.reserve(term_tensors_[n + 1] - term_tensors_[n]);
+  const uint32_t *idx = indices_.data() + term_indices_[n];
+  std::vector<Index> lower;
+  std::vector<Index> upper;
+  for (uint64_t t = term_tensors_[n]; t < term_tensors_[n + 1]; t++) {
+    const auto [nlower, nupper] = tensor_rank_[t];
+    lower.clear();
+    upper.clear();
+    for (int k = 0; k < nlower; k++) {
+      lower.push_back(Index::from_hash(*idx++));
+    }
+    for (int k = 0; k < nupper; k++) {
+      upper.push_back(Index::from_hash(*idx++));
+    }
+    tensors.emplace_back(labels_[tensor_labels_[t]], lower, upper,
+                         static_cast<SymmetryType>(tensor_symmetry_[t]));
+  }
+  std::vector<SQOperator> ops;
+  ops.reserve(term_ops_[n + 1] - term_ops_[n]);
+  for (uint64_t k = term_ops_[n]; k < term_ops_[n + 1]; k++) {
+    ops.emplace_back(creation_[k] ? SQOperatorType::Creation
+                                  : SQOperatorType::Annihilation,
+                     Index::from_hash(ops_[k]));
+  }
+  return SymbolicTerm(normal_ordered_[n], ops, tensors);
+}
+
+size_t FrozenExpression::memory_size() const {
+  return labels_.size() * sizeof(Label) +
+         (term_tensors_.size() + term_indices_.size() + term_ops_.size()) *
+             sizeof(uint64_t) +
+         (normal_ordered_.size() + creation_.size() + 7) / 8 +
+         tensor_labels_.size() * sizeof(uint32_t) + tensor_symmetry_.size() +
+         tensor_rank_.size() * sizeof(std::pair<uint8_t, uint8_t>) +
+         (indices_.size() + ops_.size()) * sizeof(uint32_t) +
+         factors_.size() * sizeof(scalar_t);
+}
+
+Expression FrozenExpression::to_expression() const {
+  Expression result;
+  for (size_t n = 0; n < size(); n++) {
+    result.add(term(n), factors_[n]);
+  }
+  return result;
+}
+
+std::map<std::string, std::vector<Equation>>
+FrozenExpression::to_manybody_equation(const std::string &label) const {
+  TraceScope trace("to_manybody_equation", "algebra");
+  std::map<std::string, std::vector<Equation>> result;
+  for (size_t n = 0; n < size(); n++) {
+    auto [block, eq] = make_manybody_equation(term(n), factors_[n], label);
+    result[block].push_back(std::move(eq));
+  }
+  return result;
+}
+
+std::string FrozenExpression::compile(const std::string &label,
+                                      const std::string &format,
+                                      const std::map<char, int> &dims) const {
+  TraceScope trace("compile", "codegen");
+  // find the block of each term first, then decode the terms again block by
+  // block so that only one equation is stored at a time
+  std::map<std::string, std::vector<size_t>> blocks;
+  for (size_t n = 0; n < size(); n++) {
+    blocks[make_manybody_equation(term(n), factors_[n], label).first]
+        .push_back(n);
+  }
+  std::vector<std::string> str_vec;
+  for (const auto &[block, terms] : blocks) {
+    for (size_t n : terms) {
+      str_vec.push_back(make_manybody_equation(term(n), factors_[n], label)
+                            .second.compile(format, dims));
+    }
+  }
+  return join(str_vec, "\n");
+}
@@ -0,0 +1,96 @@
+#ifndef _wicked_frozen_expression_h_
+#define _wicked_frozen_expression_h_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "equation.h"
+#include "helpers/label.h"
+#include "symbolic_term.h"
+#include "wicked-def.h"
+
+class Expression;
+
+/// An immutable expression that stores its terms in flat arrays: a table of
+/// the tensor labels, the label id, symmetry and number of indices of each
+/// tensor, the indices packed as 32-bit integers, the operators and the
+/// factors. A frozen expression uses a fraction of the memory of an
+/// Expression, which allocates a node for each term and each tensor, so it is
+/// suited to hold the large results of a contraction. The terms keep the
+/// order of the expression they are created from and are decoded one at a
+/// time when they are accessed
+class FrozenExpression {
+public:
+  // ==> Constructor <==
+  FrozenExpression();
+
+  /// Construct a frozen copy of an expression
+  explicit FrozenExpression(const Expression &expr);
+
+  // ==> Class public interface <==
+
+  /// Return the number of terms
+  size_t size() const { return factors_.size(); }
+
+  /// Return true if there are no terms
+  bool empty() const { return factors_.empty(); }
+
+  /// Return the factor of the n-th term
+  const scalar_t &factor(size_t n) const { return factors_[n]; }
+
+  /// Return the n-th term
+  SymbolicTerm term(size_t n) const;
+
+  /// Return the n-th term and its factor
+  std::pair<SymbolicTerm, scalar_t> operator[](size_t n) const {
+    return {term(n), factors_[n]};
+  }
+
+  /// Return the number of bytes used to store the terms
+  size_t memory_size() const;
+
+  /// Return the terms as an Expression
+  Expression to_expression() const;
+
+  /// Convert the terms to many-body equations (see
+  /// Expression::to_manybody_equation) without creating an Expression
+  std::map<std::string, std::vector<Equation>>
+  to_manybody_equation(const std::string &label) const;
+
+  /// Return the code of the many-body equations with lhs tensor label (see
+  /// Equation::compile), one equation per line and in the order of
+  /// to_manybody_equation. Only one equation is created at a time
+  std::string compile(const std::string &label, const std::string &format,
+                      const std::map<char, int> &dims = {}) const;
+
+private:
+  /// The labels of the tensors
+  std::vector<Label> labels_;
+  /// The position of the first tensor of each term (size() + 1 elements)
+  std::vector<uint64_t> term_tensors_;
+  /// The position of the first index of each term (size() + 1 elements)
+  std::vector<uint64_t> term_indices_;
+  /// The position of the first operator of each term (size() + 1 elements)
+  std::vector<uint64_t> term_ops_;
+  /// Are the operators of each term normal ordered?
+  std::vector<bool> normal_ordered_;
+  /// The position of the label of each tensor in labels_
+  std::vector<uint32_t> tensor_labels_;
+  /// The symmetry of each tensor
+  std::vector<uint8_t> tensor_symmetry_;
+  /// The number of lower and upper indices of each tensor
+  std::vector<std::pair<uint8_t, uint8_t>> tensor_rank_;
+  /// The indices of the tensors (see Index::hash)
+  std::vector<uint32_t> indices_;
+  /// The indices of the operators
+  std::vector<uint32_t> ops_;
+  /// Is each operator a creation operator?
+  std::vector<bool> creation_;
+  /// The factor of each term
+  std::vector<scalar_t> factors_;
+};
+
+#endif // _wicked_frozen_expression_h_
@@ -5,9 +5,19 @@
 #include "helpers/orbital_space.h"
 #include "index.h"
 
-Index::Index() : index_(std::make_pair(-1, -1)) {}
-
-Index::Index(int space, int p) : index_(std::make_pair(space, p)) {}
+Index::Index() : index_(0) {}
+
+Index::Index(int space, int p)
+    : index_((static_cast<uint32_t>(space + 1) << pos_bits) |
+             static_cast<uint32_t>(p + 1)) {
+  static_assert(max_orbital_spaces < (1 << (32 - pos_bits)),
+                "Index: the orbital spaces do not fit in the packed index");
+  if ((space < 0) or (space >= max_orbital_spaces) or (p < 0) or
+      (p >= static_cast<int>(pos_mask))) {
+    throw std::runtime_error("Index: the index (" + std::to_string(space) +
+                             "," + std::to_string(p) + ") is out of range");
+  }
+}
 
 bool Index::operator==(Index const &other) const {
   return index_ == other.index_;
@@ -18,11 +28,11 @@ bool Index::operator<(Index const &other) const {
 }
 
 std::string Index::str() const {
-  return orbital_subspaces->label(space()) + std::to_string(pos());
+  return osi()->label(space()) + std::to_string(pos());
 }
 
 std::string Index::latex() const {
-  return orbital_subspaces->index_label(space(), pos());
+  return osi()->index_label(space(), pos());
 }
 
 std::string Index::compile(const std::string &format) const { return str(); }
@@ -33,36 +43,26 @@ std::ostream &operator<<(std::ostream &os, const Index &idx) {
 }
 
 scalar_t canonicalize_indices(std::vector<Index> &indices, bool reversed) {
-  std::vector<std::pair<Index, int>> idx_pos;
-  for (const auto &[n, index] : enumerate(indices)) {
-    idx_pos.push_back(std::make_pair(index, n));
-  }
-  // when reversed == false, we sort in increasing order
-  // when reversed == true, we sort in decreasing order
-  if (reversed) {
-    std::sort(idx_pos.rbegin(), idx_pos.rend());
-  } else {
-    std::sort(idx_pos.begin(), idx_pos.end());
-  }
-  std::vector<int> perm;
-  indices.clear();
-  for (const auto &[idx, pos] : idx_pos) {
-    indices.push_back(idx);
-    perm.push_back(pos);
-  }
-  return permutation_sign(perm);
+  return sort_with_permutation_sign(indices, reversed);
+}
+
+scalar_t canonicalize_indices(tensor_indices_t &indices, bool reversed) {
+  return sort_with_permutation_sign(indices, reversed);
 }
 
 Index make_index_from_str(const std::string &s) {
-  std::smatch sm;
-  auto m = std::regex_match(s, sm, std::regex("([a-zA-Z])[_]?(\\d+)"));
-  if (not m) {
+  // parse a space label, an optional underscore, and a position (e.g., "o_1")
+  size_t k = 1;
+  if (s.size() > 1 and s[1] == '_') {
+    k = 2;
+  }
+  if (s.size() <= k or not is_alpha_char(s[0]) or
+      not std::all_of(s.begin() + k, s.end(), is_digit_char)) {
     throw std::runtime_error("\nCould not convert the string " + s +
                              " to an Index object");
   }
-  std::string label = sm[1];
-  auto space = orbital_subspaces->label_to_space(label[0]);
-  size_t p = stoi(sm[2]);
+  auto space = osi()->label_to_space(s[0]);
+  size_t p = stoi(s.substr(k));
   return Index(space, p);
 }
 
@@ -103,19 +103,65 @@ index_map_t remap(const std::vector<Index> &idx_vec1,
   return result;
 }
 
-std::vector<int> num_indices_per_space(const std::vector<Index> &indices) {
-  std::vector<int> counter(orbital_subspaces->num_spaces());
+DenseIndexMap::DenseIndexMap(const index_map_t &idx_map) {
+  for (const auto &[from, to] : idx_map) {
+    set(from, to);
+  }
+}
+
+void DenseIndexMap::set(const Index &from, const Index &to) {
+  const auto space = static_cast<size_t>(from.space());
+  const auto pos = static_cast<size_t>(from.pos());
+  if (space >= map_.size()) {
+    map_.resize(space + 1);
+  }
+  if (pos >= map_[space].size()) {
+    map_[space].resize(pos + 1, 0);
+  }
+  size_ += (map_[space][pos] == 0);
+  map_[space][pos] = to.hash();
+}
+
+void DenseIndexMap::clear() {
+  if (size_ == 0) {
+    return;
+  }
+  for (auto &m : map_) {
+    std::fill(m.begin(), m.end(), 0);
+  }
+  size_ = 0;
+}
+
+template <class Container>
+std::vector<int> num_indices_per_space_impl(const Container &indices) {
+  std::vector<int> counter(osi()->num_spaces());
   for (const auto &index : indices) {
     counter[index.space()] += 1;
   }
   return counter;
 }
 
-int symmetry_factor(const std::vector<Index> &indices) {
+std::vector<int> num_indices_per_space(const std::vector<Index> &indices) {
+  return num_indices_per_space_impl(indices);
+}
+
+std::vector<int> num_indices_per_space(const tensor_indices_t &indices) {
+  return num_indices_per_space_impl(indices);
+}
+
+template <class Container> int symmetry_factor_impl(const Container &indices) {
   int result = 1;
   std::vector<int> idx_per_space = num_indices_per_space(indices);
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0, nspaces = idx_per_space.size(); s < nspaces; ++s) {
     result *= factorial(idx_per_space[s]);
   }
   return result;
 }
+
+int symmetry_factor(const std::vector<Index> &indices) {
+  return symmetry_factor_impl(indices);
+}
+
+int symmetry_factor(const tensor_indices_t &indices) {
+  return symmetry_factor_impl(indices);
+}
@@ -1,10 +1,12 @@
 #ifndef _wicked_index_h_
 #define _wicked_index_h_
 
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
 
+#include "helpers/small_vector.hpp"
 #include "wicked-def.h"
 
 /**
@@ -20,21 +22,26 @@
  *
  *     "o_1" -> Index(0,1)
  *
+ * The space and the position are packed in a 32-bit word (8 bits for the
+ * space and 24 bits for the position), which preserves the order of the pair
+ * (space,p).
  */
 class Index {
 public:
   // ==> Constructors <==
   Index();
 
+  /// Throws std::runtime_error if space is not in [0, max_orbital_spaces) or
+  /// if p does not fit in pos_bits bits
   Index(int space, int p);
 
   // ==> Class public interface <==
 
   /// @return the orbital space type
-  int space() const { return index_.first; }
+  int space() const { return static_cast<int>(index_ >> pos_bits) - 1; }
 
   /// @return the position within a space
-  int pos() const { return index_.second; }
+  int pos() const { return static_cast<int>(index_ & pos_mask) - 1; }
 
   /// Comparison operator
   /// @return true if other index is equal to this
@@ -48,6 +55,16 @@ public:
   /// (e.g., for index 1 of space 'o' returns 'o1')
   std::string str() const;
 
+  /// Return a hash value
+  std::size_t hash() const { return index_; }
+
+  /// Return the index with a given hash value (see hash)
+  static Index from_hash(std::size_t h) {
+    Index result;
+    result.index_ = static_cast<uint32_t>(h);
+    return result;
+  }
+
   /// @return a LaTeX representation
   /// This function either returns a pretty index (e.g., 'i')
   /// or a generic index (e.g., 'o1')
@@ -59,13 +76,66 @@ public:
 private:
   // ==> Class private data <==
 
-  /// Store the orbital space type and position in the space (space,p)
-  std::pair<int, int> index_;
+  /// The number of bits used to store the position
+  static constexpr int pos_bits = 24;
+  static constexpr uint32_t pos_mask = (uint32_t(1) << pos_bits) - 1;
+
+  /// Store the orbital space type and position in the space (space,p) as
+  /// ((space + 1) << pos_bits) | (p + 1). The offset maps the default Index
+  /// (-1,-1) to zero
+  uint32_t index_;
 };
 
+/// The indices of a tensor are stored inline for tensors with up to eight upper
+/// or lower indices
+using tensor_indices_t = small_vector<Index, 8>;
+
 // A Index -> Index map used for reindexing
 using index_map_t = std::map<Index, Index>;
 
+/// An Index -> Index map used for reindexing, stored as a flat array for each
+/// orbital space indexed by the position of the index. A lookup is two array
+/// accesses, so this map is preferred over index_map_t on hot paths
+class DenseIndexMap {
+public:
+  DenseIndexMap() = default;
+
+  /// Construct a map with the same entries as an index_map_t
+  explicit DenseIndexMap(const index_map_t &idx_map);
+
+  /// Map the index from to the index to
+  void set(const Index &from, const Index &to);
+
+  /// Return the index that idx is mapped to, or idx if it is not mapped
+  Index operator()(const Index &idx) const {
+    return contains(idx) ? Index::from_hash(map_[idx.space()][idx.pos()])
+                         : idx;
+  }
+
+  /// Return true if idx is mapped
+  bool contains(const Index &idx) const {
+    const auto space = static_cast<size_t>(idx.space());
+    const auto pos = static_cast<size_t>(idx.pos());
+    return space < map_.size() and pos < map_[space].size() and
+           map_[space][pos] != 0;
+  }
+
+  /// Return the number of indices mapped
+  size_t size() const { return size_; }
+
+  /// Return true if no index is mapped
+  bool empty() const { return size_ == 0; }
+
+  /// Remove all the entries (the storage is kept for reuse)
+  void clear();
+
+private:
+  /// map_[space][pos] is the hash of the index that (space,pos) is mapped to,
+  /// or zero if (space,pos) is not mapped
+  std::vector<std::vector<uint32_t>> map_;
+  size_t size_ = 0;
+};
+
 // Helper functions
 
 /// Helper function to make an Index object from a space label and position
@@ -80,6 +150,7 @@ std::ostream &operator<<(std::ostream &os, const Index &idx);
 
 /// Canonicalize a set of indices
 scalar_t canonicalize_indices(std::vector<Index> &indices, bool reversed);
+scalar_t canonicalize_indices(tensor_indices_t &indices, bool reversed);
 
 /// A function that takes two lists of indices and creates a index map for the
 /// second list that voids duplicates
@@ -88,10 +159,12 @@ index_map_t remap(const std::vector<Index> &idx_vec1,
 
 /// Helper function that counts the number of spaces in a vector of indices
 std::vector<int> num_indices_per_space(const std::vector<Index> &indices);
+std::vector<int> num_indices_per_space(const tensor_indices_t &indices);
 
 /// Return the symmetry factor of a product of indices
 /// This is the product n1! x n2! x n3! x ... where ni is the number of
 /// indices that belong to orbital space i
 int symmetry_factor(const std::vector<Index> &indices);
+int symmetry_factor(const tensor_indices_t &indices);
 
 #endif // _wicked_index_h_
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "helpers/combinatorics.h"
+#include "helpers/helpers.h"
+
+#include "permutation_operator.h"
+
+PermutationOperator::PermutationOperator(
+    const std::vector<std::vector<Index>> &groups)
+    : groups_(groups) {}
+
+std::vector<std::pair<index_map_t, int>>
+PermutationOperator::permutations() const {
+  std::vector<Index> indices;
+  for (const auto &group : groups_) {
+    indices.insert(indices.end(), group.begin(), group.end());
+  }
+
+  // the position where each group ends
+  std::vector<size_t> group_end;
+  for (const auto &group : groups_) {
+    group_end.push_back((group_end.empty() ? 0 : group_end.back()) +
+                        group.size());
+  }
+
+  // assign the positions to the groups in increasing order within each group
+  std::vector<std::pair<index_map_t, int>> result;
+  std::vector<int> image;
+  std::vector<bool> used(indices.size(), false);
+  std::function<void(size_t, int)> distribute = [&](size_t g, int first) {
+    if (g == groups_.size()) {
+      index_map_t idx_map;
+      for (size_t k = 0; k < indices.size(); k++) {
+        idx_map[indices[k]] = indices[image[k]];
+      }
+      result.emplace_back(idx_map, permutation_sign(image));
+      return;
+    }
+    if (image.size() == group_end[g]) {
+      distribute(g + 1, 0);
+      return;
+    }
+    for (int p = first; p < static_cast<int>(indices.size()); p++) {
+      if (not used[p]) {
+        used[p] = true;
+        image.push_back(p);
+        distribute(g, p + 1);
+        image.pop_back();
+        used[p] = false;
+      }
+    }
+  };
+  distribute(0, 0);
+  return result;
+}
+
+bool PermutationOperator::operator==(PermutationOperator const &other) const {
+  return groups_ == other.groups_;
+}
+
+std::string PermutationOperator::str() const {
+  std::vector<std::string> str_vec;
+  for (const auto &group : groups_) {
+    std::vector<std::string> group_str;
+    for (const Index &idx : group) {
+      group_str.push_back(idx.str());
+    }
+    str_vec.push_back(join(group_str, ","));
+  }
+  return "P(" + join(str_vec, "/") + ")";
+}
+
+std::string PermutationOperator::latex() const {
+  std::vector<std::string> str_vec;
+  for (const auto &group : groups_) {
+    std::string group_str;
+    for (const Index &idx : group) {
+      group_str += idx.latex();
+    }
+    str_vec.push_back(group_str);
+  }
+  return "P(" + join(str_vec, "/") + ")";
+}
+
+std::vector<std::pair<index_map_t, int>>
+permutations(const std::vector<PermutationOperator> &ops) {
+  std::vector<std::pair<index_map_t, int>> result = {{index_map_t(), 1}};
+  for (const auto &op : ops) {
+    std::vector<std::pair<index_map_t, int>> product;
+    for (const auto &[map2, sign2] : op.permutations()) {
+      for (const auto &[map1, sign1] : result) {
+        // apply map1 and then map2
+        index_map_t idx_map = map2;
+        for (const auto &[idx, image] : map1) {
+          auto it = map2.find(image);
+          idx_map[idx] = (it == map2.end()) ? image : it->second;
+        }
+        product.emplace_back(idx_map, sign1 * sign2);
+      }
+    }
+    result = product;
+  }
+  return result;
+}
+
+std::vector<int> permutation_axes(const std::vector<Index> &indices,
+                                  const index_map_t &idx_map) {
+  // the axis of the permuted block that goes to each axis of src
+  std::vector<int> axes(indices.size());
+  for (size_t k = 0; k < indices.size(); k++) {
+    auto it = idx_map.find(indices[k]);
+    const Index &image = (it == idx_map.end()) ? indices[k] : it->second;
+    const auto pos = std::find(indices.begin(), indices.end(), image);
+    if (pos == indices.end()) {
+      throw std::runtime_error("permutation_axes() - the index " +
+                               image.str() + " is not in the block");
+    }
+    axes[pos - indices.begin()] = k;
+  }
+  return axes;
+}
@@ -0,0 +1,55 @@
+#ifndef _wicked_permutation_operator_h_
+#define _wicked_permutation_operator_h_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "index.h"
+
+/// The antisymmetric permutation operator P(I_1/I_2/.../I_n), which sums over
+/// the distinct ways of distributing the indices among the groups I_1, ...,
+/// I_n (keeping the order within each group) weighted by the sign of the
+/// permutation. For example, P(ij/k) f(ijk) = f(ijk) - f(ikj) - f(kji)
+class PermutationOperator {
+public:
+  // ==> Constructor <==
+  explicit PermutationOperator(const std::vector<std::vector<Index>> &groups);
+
+  // ==> Class public interface <==
+
+  /// Return the groups of indices
+  const std::vector<std::vector<Index>> &groups() const { return groups_; }
+
+  /// Return the permutations generated by this operator (the identity first)
+  /// as maps from the indices to their images and the sign of each of them
+  std::vector<std::pair<index_map_t, int>> permutations() const;
+
+  /// Comparison operator
+  bool operator==(PermutationOperator const &other) const;
+
+  /// Return a string representation (e.g., "P(o0,o1/o2)")
+  std::string str() const;
+
+  /// Return a LaTeX representation (e.g., "P(ij/k)")
+  std::string latex() const;
+
+private:
+  // ==> Class private data <==
+
+  std::vector<std::vector<Index>> groups_;
+};
+
+/// Return the permutations generated by a product of permutation operators
+/// (the identity first) and their signs
+std::vector<std::pair<index_map_t, int>>
+permutations(const std::vector<PermutationOperator> &ops);
+
+/// Return the axes that apply a permutation to a block with the given indices,
+/// in the convention of numpy.transpose: if src is the block of a term t,
+/// src.transpose(axes) is the block of the term obtained by relabeling the
+/// indices of t with idx_map
+std::vector<int> permutation_axes(const std::vector<Index> &indices,
+                                  const index_map_t &idx_map);
+
+#endif // _wicked_permutation_operator_h_
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <functional>
+
+#include "helpers/orbital_space.h"
+
+#include "expression.h"
+#include "spin_integrate.h"
+
+namespace {
+
+/// The alpha and beta subspaces of each space (by position), or {-1, -1} for
+/// the spaces that are not split
+using subspaces_t = std::vector<std::pair<int, int>>;
+
+/// The positions (in the list of indices of a term) of the upper and lower
+/// indices of a tensor that must conserve spin
+struct SpinConstraint {
+  std::vector<int> upper;
+  std::vector<int> lower;
+};
+
+/// Return the subspaces of each space and check that they are consistent
+subspaces_t
+find_subspaces(const std::map<char, std::pair<char, char>> &spin_spaces);
+
+/// Return the terms obtained by spin-integrating a term
+std::vector<SymbolicTerm> spin_integrate_term(const SymbolicTerm &term,
+                                              const subspaces_t &subspaces);
+
+/// Return true if a partial assignment of spins (0 = alpha, 1 = beta, -1 =
+/// not assigned) can be completed so that a tensor conserves spin
+bool can_conserve_spin(const SpinConstraint &constraint,
+                       const std::vector<int> &spin);
+
+subspaces_t
+find_subspaces(const std::map<char, std::pair<char, char>> &spin_spaces) {
+  subspaces_t subspaces(osi()->num_spaces(), {-1, -1});
+  std::vector<int> targets;
+  for (const auto &[label, ab] : spin_spaces) {
+    const int s = osi()->label_to_space(label);
+    const int a = osi()->label_to_space(ab.first);
+    const int b = osi()->label_to_space(ab.second);
+    if (osi()->field_type(a) != osi()->field_type(s) or
+        osi()->field_type(b) != osi()->field_type(s)) {
+      throw std::runtime_error(
+          "\n  spin_integrate: the subspaces of the space '" +
+          std::string(1, label) + "' must have the same field type.");
+    }
+    subspaces[s] = {a, b};
+    targets.push_back(a);
+    targets.push_back(b);
+  }
+  std::sort(targets.begin(), targets.end());
+  if (std::adjacent_find(targets.begin(), targets.end()) != targets.end()) {
+    throw std::runtime_error(
+        "\n  spin_integrate: each alpha and beta subspace must belong to only "
+        "one space.");
+  }
+  return subspaces;
+}
+
+bool can_conserve_spin(const SpinConstraint &constraint,
+                       const std::vector<int> &spin) {
+  // the range of the number of alpha indices of the upper and lower indices
+  auto alpha_range = [&](const std::vector<int> &positions) {
+    int nalpha = 0, nfree = 0;
+    for (int k : positions) {
+      nalpha += (spin[k] == 0);
+      nfree += (spin[k] == -1);
+    }
+    return std::make_pair(nalpha, nalpha + nfree);
+  };
+  const auto [upper_min, upper_max] = alpha_range(constraint.upper);
+  const auto [lower_min, lower_max] = alpha_range(constraint.lower);
+  return upper_min <= lower_max and lower_min <= upper_max;
+}
+
+std::vector<SymbolicTerm> spin_integrate_term(const SymbolicTerm &term,
+                                              const subspaces_t &subspaces) {
+  // collect the indices to split, first those of the tensors, so that the
+  // constraints of each tensor are checked as soon as its indices are set
+  std::vector<Index> indices;
+  auto position = [&](const Index &idx) {
+    const int s = idx.space();
+    if (subspaces[s].first == -1) {
+      for (const auto &[a, b] : subspaces) {
+        if (s == a or s == b) {
+          throw std::runtime_error(
+              "\n  spin_integrate: the term " + term.str() +
+              " contains indices of a spin subspace.");
+        }
+      }
+      return -1;
+    }
+    auto it = std::find(indices.begin(), indices.end(), idx);
+    if (it != indices.end()) {
+      return static_cast<int>(it - indices.begin());
+    }
+    indices.push_back(idx);
+    return static_cast<int>(indices.size()) - 1;
+  };
+
+  std::vector<SpinConstraint> constraints;
+  for (const Tensor &t : term.tensors()) {
+    SpinConstraint constraint;
+    for (const Index &idx : t.upper()) {
+      if (int k = position(idx); k >= 0) {
+        constraint.upper.push_back(k);
+      }
+    }
+    for (const Index &idx : t.lower()) {
+      if (int k = position(idx); k >= 0) {
+        constraint.lower.push_back(k);
+      }
+    }
+    if (t.upper().size() == t.lower().size()) {
+      constraints.push_back(constraint);
+    }
+  }
+  for (const SQOperator &op : term.ops()) {
+    position(op.index());
+  }
+
+  // the constraints that involve each index
+  std::vector<std::vector<int>> index_constraints(indices.size());
+  for (size_t c = 0; c < constraints.size(); c++) {
+    for (const auto *positions :
+         {&constraints[c].upper, &constraints[c].lower}) {
+      for (int k : *positions) {
+        index_constraints[k].push_back(c);
+      }
+    }
+  }
+
+  std::vector<SymbolicTerm> result;
+  std::vector<int> spin(indices.size(), -1);
+  std::function<void(size_t)> assign = [&](size_t k) {
+    if (k == indices.size()) {
+      index_map_t idx_map;
+      for (size_t l = 0; l < indices.size(); l++) {
+        const auto &[a, b] = subspaces[indices[l].space()];
+        idx_map[indices[l]] = Index(spin[l] == 0 ? a : b, indices[l].pos());
+      }
+      SymbolicTerm spin_term = term;
+      spin_term.reindex(idx_map);
+      result.push_back(spin_term);
+      return;
+    }
+    for (int s : {0, 1}) {
+      spin[k] = s;
+      bool allowed = true;
+      for (int c : index_constraints[k]) {
+        allowed = allowed and can_conserve_spin(constraints[c], spin);
+      }
+      if (allowed) {
+        assign(k + 1);
+      }
+    }
+    spin[k] = -1;
+  };
+  assign(0);
+  return result;
+}
+
+} // namespace
+
+Expression
+spin_integrate(const Expression &expr,
+               const std::map<char, std::pair<char, char>> &spin_spaces) {
+  const subspaces_t subspaces = find_subspaces(spin_spaces);
+  Expression result;
+  for (const auto &[term, c] : expr) {
+    for (SymbolicTerm &spin_term : spin_integrate_term(term, subspaces)) {
+      const scalar_t phase = spin_term.simplify();
+      result.add(spin_term, c * phase);
+    }
+  }
+  return result;
+}
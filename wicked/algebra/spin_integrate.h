@@ -0,0 +1,25 @@
+#ifndef _wicked_spin_integrate_h_
+#define _wicked_spin_integrate_h_
+
+#include <map>
+#include <utility>
+
+class Expression;
+
+/// Spin-integrate an expression written in terms of spin orbitals.
+/// spin_spaces maps the label of each spin-orbital space to the labels of its
+/// alpha and beta subspaces (e.g., {'o': {'o', 'O'}, 'v': {'v', 'V'}}), which
+/// must be defined in the orbital space info. The alpha subspace may share
+/// the label of the spin-orbital space. Each term is replaced by the terms
+/// obtained by assigning a spin to each of its indices, keeping only the
+/// assignments for which every tensor with as many upper as lower indices
+/// conserves spin (the same number of alpha upper and lower indices). The
+/// assignments are enumerated one index at a time, discarding as early as
+/// possible those that cannot conserve spin. The resulting terms are
+/// simplified (see SymbolicTerm::simplify), so that those that differ only by
+/// a relabeling of the summed indices, including their spin, are combined
+Expression
+spin_integrate(const Expression &expr,
+               const std::map<char, std::pair<char, char>> &spin_spaces);
+
+#endif // _wicked_spin_integrate_h_
@@ -12,7 +12,7 @@ SQOperator::~SQOperator() {}
 SQOperatorType SQOperator::type() const { return operator_.first; }
 
 FieldType SQOperator::field_type() const {
-  return orbital_subspaces->field_type(space());
+  return osi()->field_type(space());
 }
 
 Index SQOperator::index() const { return operator_.second; }
@@ -24,7 +24,7 @@ bool SQOperator::is_creation() const {
 }
 
 std::string SQOperator::op_symbol() const {
-  return orbital_subspaces->op_symbol(space());
+  return osi()->op_symbol(space());
 }
 
 void SQOperator::reindex(index_map_t &idx_map) {
@@ -33,6 +33,10 @@ void SQOperator::reindex(index_map_t &idx_map) {
   }
 }
 
+void SQOperator::reindex(const DenseIndexMap &idx_map) {
+  operator_.second = idx_map(operator_.second);
+}
+
 bool SQOperator::operator<(SQOperator const &other) const {
   // first compare the type (annihilators come before creation operators)
   if (operator_.first < other.operator_.first) {
@@ -54,6 +58,12 @@ bool SQOperator::operator==(SQOperator const &other) const {
   return operator_ == other.operator_;
 }
 
+std::size_t SQOperator::hash() const {
+  std::size_t seed = static_cast<std::size_t>(operator_.first);
+  hash_combine(seed, operator_.second.hash());
+  return seed;
+}
+
 std::string SQOperator::str() const {
   std::string s = op_symbol();
   s += (is_creation() ? "+" : "-");
@@ -84,22 +94,5 @@ std::ostream &operator<<(std::ostream &os, const SQOperator &op) {
 }
 
 scalar_t canonicalize_sqops(std::vector<SQOperator> &sqops, bool reversed) {
-  std::vector<std::pair<SQOperator, int>> sqop_pos;
-  for (const auto &[n, sqop] : enumerate(sqops)) {
-    sqop_pos.push_back(std::make_pair(sqop, n));
-  }
-  // when reversed == false, we sort in increasing order
-  // when reversed == true, we sort in decreasing order
-  if (reversed) {
-    std::sort(sqop_pos.rbegin(), sqop_pos.rend());
-  } else {
-    std::sort(sqop_pos.begin(), sqop_pos.end());
-  }
-  std::vector<int> perm;
-  sqops.clear();
-  for (const auto &[sqop, pos] : sqop_pos) {
-    sqops.push_back(sqop);
-    perm.push_back(pos);
-  }
-  return permutation_sign(perm);
+  return sort_with_permutation_sign(sqops, reversed);
 }
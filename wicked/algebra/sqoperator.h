@@ -42,10 +42,14 @@ public:
 
   /// Reindex this operator
   void reindex(index_map_t &idx_map);
+  void reindex(const DenseIndexMap &idx_map);
 
   /// Return a string representation
   std::string str() const;
 
+  /// Return a hash value
+  std::size_t hash() const;
+
   /// Return a LaTeX representation
   std::string latex() const;
 
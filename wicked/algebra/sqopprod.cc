@@ -103,7 +103,7 @@ std::string SQOpProd::str() const {
   std::vector<std::string> s;
   citerate([&](bool cre, const size_t &space, const size_t &i) {
     s.push_back(std::string(cre ? "a+" : "a-") + "(" +
-                orbital_subspaces->label(space) + std::to_string(i) + ")");
+                osi()->label(space) + std::to_string(i) + ")");
   });
   return join(s, " ");
 }
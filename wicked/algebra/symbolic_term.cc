@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <numeric>
+#include <set>
 
 #include "helpers/combinatorics.h"
 #include "helpers/helpers.h"
@@ -46,6 +48,13 @@ int SymbolicTerm::nops() const { return operators_.size(); }
 // }
 
 void SymbolicTerm::reindex(index_map_t &idx_map) {
+  reindex(DenseIndexMap(idx_map));
+}
+
+void SymbolicTerm::reindex(const DenseIndexMap &idx_map) {
+  if (idx_map.empty()) {
+    return;
+  }
   for (auto &t : tensors_) {
     t.reindex(idx_map);
   }
@@ -54,130 +63,244 @@ void SymbolicTerm::reindex(index_map_t &idx_map) {
   }
 }
 
-#define NEW_CANONICALIZATION 1
+namespace {
+/// Buffers reused by SymbolicTerm::canonicalize to avoid allocations
+struct CanonicalizeScratch {
+  /// The distinct tensor labels of a term sorted in increasing order
+  std::vector<Label> labels;
+  /// The position of the label of each tensor in labels
+  std::vector<int> label_rank;
+  /// Sorted copies of the lower and upper indices of each tensor
+  std::vector<tensor_indices_t> lower, upper;
+  /// The score keys of all tensors (stored as rows of size stride)
+  std::vector<int> keys;
+  /// The order of the tensors after sorting
+  std::vector<int> order;
+  std::vector<char> placed;
+  /// Dense (space,pos) -> pos map and operator index flags
+  std::vector<int> index_map;
+  std::vector<char> is_operator_index;
+  std::vector<int> sqop_index_count;
+  std::vector<int> tens_index_count;
+};
+
+thread_local CanonicalizeScratch scratch;
+
+/// Sort the rows of size width stored in [first,first + nrows * width)
+void sort_rows(int *first, int nrows, int width) {
+  for (int i = 1; i < nrows; i++) {
+    for (int j = i; j > 0; j--) {
+      int *r = first + j * width;
+      int *l = r - width;
+      if (not std::lexicographical_compare(r, r + width, l, l + width))
+        break;
+      std::swap_ranges(r, r + width, l);
+    }
+  }
+}
+
+/// Compute the score keys of a product of tensors (see
+/// SymbolicTerm::canonicalize) and return the size of each key
+int score_tensors(const std::vector<Tensor> &tensors, CanonicalizeScratch &sc) {
+  const int nspaces = osi()->num_spaces();
+  const int ntensors = tensors.size();
+  sc.labels.clear();
+  for (const auto &tensor : tensors) {
+    sc.labels.push_back(tensor.label_id());
+  }
+  std::sort(sc.labels.begin(), sc.labels.end());
+  sc.labels.erase(std::unique(sc.labels.begin(), sc.labels.end()),
+                  sc.labels.end());
+  sc.label_rank.resize(ntensors);
+  sc.lower.resize(ntensors);
+  sc.upper.resize(ntensors);
+  for (int i = 0; i < ntensors; i++) {
+    const auto &tensor = tensors[i];
+    sc.label_rank[i] = std::lower_bound(sc.labels.begin(), sc.labels.end(),
+                                        tensor.label_id()) -
+                       sc.labels.begin();
+    sc.lower[i] = tensor.lower();
+    std::sort(sc.lower[i].begin(), sc.lower[i].end());
+    sc.upper[i] = tensor.upper();
+    std::sort(sc.upper[i].begin(), sc.upper[i].end());
+  }
+
+  const int entry_size = 1 + nspaces;
+  const int stride =
+      2 + 2 * nspaces + 2 * (1 + std::max(ntensors - 1, 0) * entry_size);
+  sc.keys.assign(ntensors * stride, 0);
+  for (int i = 0; i < ntensors; i++) {
+    int *key = sc.keys.data() + i * stride;
+    key[0] = sc.label_rank[i];
+    key[1] = tensors[i].rank();
+    for (const auto &l : sc.lower[i]) {
+      key[2 + l.space()] += 1;
+    }
+    for (const auto &u : sc.upper[i]) {
+      key[2 + nspaces + u.space()] += 1;
+    }
+    int pos = 2 + 2 * nspaces;
+    for (bool upper : {false, true}) {
+      const auto &indices = upper ? sc.upper[i] : sc.lower[i];
+      int *first_entry = key + pos;
+      int nentries = 0;
+      for (int j = 0; j < ntensors; j++) {
+        if (j == i or tensors[i] == tensors[j])
+          continue;
+        const auto &indices2 = upper ? sc.lower[j] : sc.upper[j];
+        int *entry = key + pos;
+        entry[0] = sc.label_rank[j] + 1;
+        // count the common indices (same as std::set_intersection)
+        auto it = indices.begin();
+        auto it2 = indices2.begin();
+        while (it != indices.end() and it2 != indices2.end()) {
+          if (*it < *it2) {
+            ++it;
+          } else if (*it2 < *it) {
+            ++it2;
+          } else {
+            entry[1 + it->space()] += 1;
+            ++it;
+            ++it2;
+          }
+        }
+        pos += entry_size;
+        nentries++;
+      }
+      sort_rows(first_entry, nentries, entry_size);
+      key[pos] = 0;
+      pos += 1;
+    }
+    WPRINT(std::cout << "\nScore = "; for (int k = 0; k < stride; k++) {
+      std::cout << key[k] << " ";
+    });
+  }
+
+  return stride;
+}
+} // namespace
+
 scalar_t SymbolicTerm::canonicalize() {
   scalar_t factor(1);
-
-//
-// 1. Sort the tensors according to a score function
-//
-#if NEW_CANONICALIZATION
-  using score_t =
-      std::tuple<std::string, int, std::vector<int>, std::vector<int>,
-                 std::vector<std::pair<std::string, std::vector<int>>>,
-                 std::vector<std::pair<std::string, std::vector<int>>>, Tensor>;
-#else
-  using score_t =
-      std::tuple<std::string, int, std::vector<int>, std::vector<int>, Tensor>;
-#endif
-
-  std::vector<score_t> scores;
+  auto &sc = scratch;
+  const int nspaces = osi()->num_spaces();
+  const int ntensors = tensors_.size();
 
   WPRINT(std::cout << "\n Canonicalizing: " << str() << std::endl;);
 
-  for (const auto &tensor : tensors_) {
-    // a) label
-    const std::string &label = tensor.label();
-
-    // b) rank
-    int rank = tensor.rank();
-
-    // c) number of indices per space
-    std::vector<int> num_low = num_indices_per_space(tensor.lower());
-    std::vector<int> num_upp = num_indices_per_space(tensor.upper());
-
-    // d) connectivity of lower indices
-    auto lower_conn = tensor_connectivity(tensor, false);
-
-    // d) connectivity of upper indices
-    auto upper_conn = tensor_connectivity(tensor, true);
-
-    // e) store the score
-#if NEW_CANONICALIZATION
-    scores.push_back(std::make_tuple(label, rank, num_low, num_upp, lower_conn,
-                                     upper_conn, tensor));
-    WPRINT(
-        std::cout << "\nScore = " << label << " " << rank << " ";
-        PRINT_ELEMENTS(num_low); std::cout << " "; PRINT_ELEMENTS(num_upp);
-        std::cout << " "; for (const auto &str_vec
-                               : lower_conn) {
-          std::cout << str_vec.first << " ";
-          PRINT_ELEMENTS(str_vec.second);
-        } for (const auto &str_vec
-               : upper_conn) {
-          std::cout << " " << str_vec.first << " ";
-          PRINT_ELEMENTS(str_vec.second);
-        });
-
-#else
-    scores.push_back(std::make_tuple(label, rank, num_low, num_upp, tensor));
-#endif
-  }
-
-  // sort and rearrange tensors
-  std::sort(scores.begin(), scores.end());
-  tensors_.clear();
-  for (const auto &score : scores) {
-#if NEW_CANONICALIZATION
-    tensors_.push_back(std::get<6>(score));
-#else
-    tensors_.push_back(std::get<4>(score));
-#endif
+  //
+  // 1. Sort the tensors according to a score function
+  //
+  // The score of a tensor is a row of integers that contains:
+  // a) the label (as a rank among the labels of this term)
+  // b) the rank of the tensor
+  // c) the number of lower and upper indices per space
+  // d) the connectivity of the lower and upper indices, that is, for every
+  //    other tensor its label and the number of shared indices per space.
+  //    These entries are sorted and terminated by a zero, so that comparing
+  //    rows gives the same order as comparing sorted lists of entries
+  // Ties are resolved by comparing the tensors.
+  const int stride = score_tensors(tensors_, sc);
+
+  sc.order.resize(ntensors);
+  std::iota(sc.order.begin(), sc.order.end(), 0);
+  std::sort(sc.order.begin(), sc.order.end(), [&](int a, int b) {
+    const int *ka = sc.keys.data() + a * stride;
+    const int *kb = sc.keys.data() + b * stride;
+    auto [ma, mb] = std::mismatch(ka, ka + stride, kb);
+    if (ma != ka + stride)
+      return *ma < *mb;
+    return tensors_[a] < tensors_[b];
+  });
+
+  // rearrange the tensors following the cycles of the permutation
+  sc.placed.assign(ntensors, 0);
+  for (int start = 0; start < ntensors; start++) {
+    if (sc.placed[start] or sc.order[start] == start)
+      continue;
+    Tensor tmp = std::move(tensors_[start]);
+    int k = start;
+    while (sc.order[k] != start) {
+      tensors_[k] = std::move(tensors_[sc.order[k]]);
+      sc.placed[k] = 1;
+      k = sc.order[k];
+    }
+    tensors_[k] = std::move(tmp);
+    sc.placed[k] = 1;
   }
 
   // 2. Relabel indices of tensors and operators
+  int max_pos = 0;
+  for (const auto &sqop : operators_) {
+    max_pos = std::max(max_pos, sqop.index().pos());
+  }
+  for (int i = 0; i < ntensors; i++) {
+    for (const auto &l : sc.lower[i]) {
+      max_pos = std::max(max_pos, l.pos());
+    }
+    for (const auto &u : sc.upper[i]) {
+      max_pos = std::max(max_pos, u.pos());
+    }
+  }
+  const int width = max_pos + 1;
+  auto slot = [width](const Index &idx) {
+    return idx.space() * width + idx.pos();
+  };
+  sc.index_map.assign(nspaces * width, -1);
+  sc.is_operator_index.assign(nspaces * width, 0);
   // vector to keep track of how many indices in each space
-  std::vector<int> sqop_index_count(orbital_subspaces->num_spaces(), 0);
+  sc.sqop_index_count.assign(nspaces, 0);
   // vector to keep track of how many indices in each space
-  std::vector<int> tens_index_count(orbital_subspaces->num_spaces(), 0);
-  index_map_t index_map;
-  std::map<Index, bool> is_operator_index;
+  sc.tens_index_count.assign(nspaces, 0);
 
   // a. Assign indices to free operators
   for (const auto &sqop : operators_) {
-    tens_index_count[sqop.index().space()] += 1;
-    is_operator_index[sqop.index()] = true;
+    sc.tens_index_count[sqop.index().space()] += 1;
+    sc.is_operator_index[slot(sqop.index())] = 1;
   }
 
   // b. Assign indices to tensors operators
+  auto assign_index = [&](const Index &idx) {
+    int n = slot(idx);
+    if (sc.index_map[n] < 0) {
+      // indices shared with an operator and those that are not shared are
+      // counted separately
+      auto &count = sc.is_operator_index[n] ? sc.sqop_index_count
+                                            : sc.tens_index_count;
+      sc.index_map[n] = count[idx.space()];
+      count[idx.space()] += 1;
+    }
+  };
   for (const auto &tensor : tensors_) {
-    // lower indices
     for (const auto &l : tensor.lower()) {
-      if (is_operator_index.count(l) == 0) {
-        // this index is not shared with an operator
-        if (index_map.count(l) == 0) {
-          int s = l.space();
-          index_map[l] = Index(s, tens_index_count[s]);
-          tens_index_count[s] += 1;
-        }
-      } else {
-        // this index is shared with an operator
-        if (index_map.count(l) == 0) {
-          int s = l.space();
-          index_map[l] = Index(s, sqop_index_count[s]);
-          sqop_index_count[s] += 1;
-        }
-      }
+      assign_index(l);
     }
-    // upper indices
     for (const auto &u : tensor.upper()) {
-      if (is_operator_index.count(u) == 0) {
-        if (index_map.count(u) == 0) {
-          int s = u.space();
-          index_map[u] = Index(s, tens_index_count[s]);
-          tens_index_count[s] += 1;
-        }
-      } else {
-        if (index_map.count(u) == 0) {
-          int s = u.space();
-          index_map[u] = Index(s, sqop_index_count[s]);
-          sqop_index_count[s] += 1;
-        }
-      }
+      assign_index(u);
+    }
+  }
+
+  // reindex the tensors and the operators
+  tensor_indices_t lower;
+  tensor_indices_t upper;
+  for (auto &tensor : tensors_) {
+    lower = tensor.lower();
+    for (auto &idx : lower) {
+      idx = Index(idx.space(), sc.index_map[slot(idx)]);
+    }
+    upper = tensor.upper();
+    for (auto &idx : upper) {
+      idx = Index(idx.space(), sc.index_map[slot(idx)]);
+    }
+    tensor.set_indices(lower, upper);
+  }
+  for (auto &sqop : operators_) {
+    const Index idx = sqop.index();
+    const int p = sc.index_map[slot(idx)];
+    if (p >= 0) {
+      sqop = SQOperator(sqop.type(), Index(idx.space(), p));
     }
   }
-  // reindex the tensor
-  reindex(index_map);
 
   // 3. Sort tensor indices according to canonical form
   for (auto &tensor : tensors_) {
@@ -187,61 +310,158 @@ scalar_t SymbolicTerm::canonicalize() {
   // 4. Sort operators according to canonical form
   factor *= canonicalize_sqops(operators_, false);
 
-  simplify();
-
   WPRINT(std::cout << "\n  " << str();)
 
   return factor;
 }
 
 scalar_t SymbolicTerm::simplify() {
+  // the largest number of relabelings compared before giving up (the term is
+  // then left in the form found by canonicalize)
+  constexpr size_t max_candidates = 20000;
+
+  scalar_t factor = canonicalize();
+
   WPRINT(cout << "\nSymbolic term simplification " << endl;);
-  scalar_t factor = 1;
-  // Canonicalize each space separately
-  for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
-    WPRINT(cout << "\nSpace " << orbital_subspaces->label(s) << endl;);
-
-    std::vector<std::vector<Index>> equivalent_classes;
-    std::vector<std::pair<std::bitset<64>, std::bitset<64>>> ul_bit_masks;
-    for (const auto &tensor : tensors_) {
-      std::bitset<64> upper_bits, lower_bits;
-      {
-        std::vector<Index> equivalent;
-        for (const auto &u : tensor.upper()) {
-          if (u.space() == s) {
-            equivalent.push_back(u);
-            upper_bits[u.pos()] = true;
+
+  // canonicalize sorts the tensors by a score that does not depend on the
+  // labels of the indices. Tensors with the same score can be placed in any
+  // order, and so can the indices that first appear in the same tensor (in
+  // the same space and position). The simplified term is the smallest one
+  // among all these choices
+  auto &sc = scratch;
+  const int nspaces = osi()->num_spaces();
+  const int ntensors = tensors_.size();
+  const int stride = score_tensors(tensors_, sc);
+  auto key = [&](int i) { return sc.keys.data() + i * stride; };
+  std::vector<std::pair<int, int>> tie_groups;
+  for (int i = 0; i < ntensors;) {
+    int j = i + 1;
+    while ((j < ntensors) and std::equal(key(i), key(i) + stride, key(j))) {
+      j++;
+    }
+    if (j - i > 1) {
+      tie_groups.push_back(std::make_pair(i, j));
+    }
+    i = j;
+  }
+
+  // the indices shared with an operator are numbered separately
+  std::set<Index> operator_indices;
+  std::vector<int> noperator_indices(nspaces, 0);
+  for (const auto &sqop : operators_) {
+    operator_indices.insert(sqop.index());
+    noperator_indices[sqop.index().space()] += 1;
+  }
+
+  const SymbolicTerm term = *this;
+  SymbolicTerm best;
+  scalar_t best_sign = 1;
+  bool found = false;
+  // a term that is mapped to minus itself by a relabeling is zero
+  bool is_zero = false;
+  size_t ncandidates = 0;
+
+  // compare the relabelings for one order of the tensors. Return false if
+  // there are too many candidates
+  std::vector<int> order(ntensors);
+  std::iota(order.begin(), order.end(), 0);
+  auto try_order = [&]() {
+    // collect the groups of indices that first appear together
+    std::set<Index> seen;
+    std::vector<std::vector<Index>> groups;
+    for (int t : order) {
+      for (const auto *indices :
+           {&term.tensors_[t].lower(), &term.tensors_[t].upper()}) {
+        for (int s = 0; s < nspaces; s++) {
+          for (bool is_operator : {true, false}) {
+            std::vector<Index> group;
+            for (const auto &idx : *indices) {
+              if ((idx.space() == s) and (seen.count(idx) == 0) and
+                  (operator_indices.count(idx) > 0) == is_operator) {
+                group.push_back(idx);
+              }
+            }
+            std::sort(group.begin(), group.end());
+            seen.insert(group.begin(), group.end());
+            if (not group.empty()) {
+              groups.push_back(group);
+            }
           }
         }
-        if (equivalent.size() > 0)
-          equivalent_classes.push_back(equivalent);
       }
-      {
-        std::vector<Index> equivalent;
-        for (const auto &l : tensor.lower()) {
-          if (l.space() == s) {
-            equivalent.push_back(l);
-            lower_bits[l.pos()] = true;
-          }
+    }
+    // enumerate all the orders of the indices in each group
+    DenseIndexMap idx_map;
+    for (;;) {
+      if (++ncandidates > max_candidates) {
+        return false;
+      }
+      idx_map.clear();
+      std::vector<int> operator_count(nspaces, 0);
+      std::vector<int> tensor_count(noperator_indices);
+      for (const auto &group : groups) {
+        for (const auto &idx : group) {
+          auto &count = operator_indices.count(idx) ? operator_count
+                                                    : tensor_count;
+          idx_map.set(idx, Index(idx.space(), count[idx.space()]));
+          count[idx.space()] += 1;
         }
-        if (equivalent.size() > 0)
-          equivalent_classes.push_back(equivalent);
       }
-      ul_bit_masks.push_back(std::make_pair(upper_bits, lower_bits));
+      SymbolicTerm candidate;
+      candidate.normal_ordered_ = term.normal_ordered_;
+      scalar_t sign = 1;
+      for (int t : order) {
+        Tensor tensor = term.tensors_[t];
+        tensor.reindex(idx_map);
+        sign *= tensor.canonicalize();
+        candidate.tensors_.push_back(tensor);
+      }
+      candidate.operators_ = term.operators_;
+      for (auto &sqop : candidate.operators_) {
+        sqop.reindex(idx_map);
+      }
+      sign *= canonicalize_sqops(candidate.operators_, false);
+      if ((not found) or (candidate < best)) {
+        found = true;
+        best = std::move(candidate);
+        best_sign = sign;
+        is_zero = false;
+      } else if ((sign != best_sign) and (candidate == best)) {
+        is_zero = true;
+      }
+      // go to the next combination of orders
+      size_t g = 0;
+      while ((g < groups.size()) and
+             (not std::next_permutation(groups[g].begin(), groups[g].end()))) {
+        g++;
+      }
+      if (g == groups.size()) {
+        return true;
+      }
+    }
+  };
+
+  // enumerate all the orders of the tensors with the same score
+  for (;;) {
+    if (not try_order()) {
+      WPRINT(cout << "\n  Too many relabelings to compare" << endl;);
+      return factor;
+    }
+    size_t g = 0;
+    while ((g < tie_groups.size()) and
+           (not std::next_permutation(order.begin() + tie_groups[g].first,
+                                      order.begin() + tie_groups[g].second))) {
+      g++;
+    }
+    if (g == tie_groups.size()) {
+      break;
     }
-    WPRINT(
-        for (const auto &v
-             : equivalent_classes) {
-          PRINT_ELEMENTS(v);
-          cout << endl;
-        } for (const auto &[ub, lb]
-               : ul_bit_masks) {
-          cout << ub << endl;
-          cout << lb << endl;
-        });
   }
 
-  return factor;
+  *this = best;
+  WPRINT(cout << "\n  " << str() << endl;);
+  return is_zero ? scalar_t(0) : factor * best_sign;
 }
 
 bool SymbolicTerm::operator<(const SymbolicTerm &other) const {
@@ -258,6 +478,17 @@ bool SymbolicTerm::operator==(const SymbolicTerm &other) const {
   return (tensors_ == other.tensors_) and (operators_ == other.operators_);
 }
 
+std::size_t SymbolicTerm::hash() const {
+  std::size_t seed = tensors_.size();
+  for (const Tensor &tensor : tensors_) {
+    hash_combine(seed, tensor.hash());
+  }
+  for (const SQOperator &op : operators_) {
+    hash_combine(seed, op.hash());
+  }
+  return seed;
+}
+
 std::string SymbolicTerm::str() const {
   std::vector<std::string> str_vec;
   for (const Tensor &tensor : tensors_) {
@@ -318,33 +549,3 @@ std::ostream &operator<<(std::ostream &os,
   os << term_factor.second << ' ' << term_factor.second;
   return os;
 }
-
-std::vector<std::pair<std::string, std::vector<int>>>
-SymbolicTerm::tensor_connectivity(const Tensor &t, bool upper) const {
-  std::vector<std::pair<std::string, std::vector<int>>> result;
-  auto indices = upper ? t.upper() : t.lower();
-  sort(indices.begin(), indices.end());
-  for (const auto &tensor : tensors_) {
-    if (not(t == tensor)) {
-
-      std::vector<Index> indices2 = upper ? tensor.lower() : tensor.upper();
-      sort(indices2.begin(), indices2.end());
-
-      std::vector<Index> indices3 = tensor.upper();
-      sort(indices3.begin(), indices3.end());
-
-      std::vector<Index> common_lower_indices;
-      set_intersection(indices.begin(), indices.end(), indices2.begin(),
-                       indices2.end(), back_inserter(common_lower_indices));
-
-      std::vector<Index> common_upper_indices;
-      set_intersection(indices.begin(), indices.end(), indices3.begin(),
-                       indices3.end(), back_inserter(common_upper_indices));
-
-      result.push_back(std::make_pair(
-          tensor.label(), num_indices_per_space(common_lower_indices)));
-    }
-  }
-  std::sort(result.begin(), result.end());
-  return result;
-}
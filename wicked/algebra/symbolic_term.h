@@ -54,6 +54,7 @@ public:
 
   /// Apply a re-indexing map to this symbolic term
   void reindex(index_map_t &idx_map);
+  void reindex(const DenseIndexMap &idx_map);
 
   /// Canonicalize this term and return the overall phase factor
   scalar_t canonicalize();
@@ -61,6 +62,12 @@ public:
   /// Canonicalize this term and return the overall phase factor
   // bool is_connected();
 
+  /// Bring this term to a form that is the same for all the relabelings of
+  /// its indices and return the overall phase factor. Unlike canonicalize,
+  /// this compares all the orders of the tensors with the same score and of
+  /// the indices that first appear together, so it is more expensive. The
+  /// phase factor is zero if the term vanishes by symmetry. Terms with too
+  /// many choices are only canonicalized
   scalar_t simplify();
 
   /// Comparison operator used for sorting
@@ -69,6 +76,9 @@ public:
   /// Comparison operator used for sorting
   bool operator==(const SymbolicTerm &term) const;
 
+  /// Return a hash value (consistent with operator==)
+  std::size_t hash() const;
+
   /// Return a string representation
   std::string str() const;
 
@@ -83,14 +93,16 @@ protected:
   bool normal_ordered_ = false;
   std::vector<SQOperator> operators_;
   std::vector<Tensor> tensors_;
+};
 
-  // ==> Class private functions <==
-
-  // Used in the canonicalization routine to find how the indices of a tensor
-  // connect to all the other tensors
-  std::vector<std::pair<std::string, std::vector<int>>>
-  tensor_connectivity(const Tensor &t, bool upper) const;
+/// Hash function used to store SymbolicTerm objects in unordered containers
+namespace std {
+template <> struct hash<SymbolicTerm> {
+  std::size_t operator()(const SymbolicTerm &term) const {
+    return term.hash();
+  }
 };
+} // namespace std
 
 // Helper functions
 
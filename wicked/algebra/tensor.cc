@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <deque>
 #include <iostream>
-#include <regex>
+#include <mutex>
+#include <unordered_set>
 
 #include "helpers/helpers.h"
 #include "helpers/orbital_space.h"
@@ -8,51 +10,149 @@
 #include "tensor.h"
 #include "wicked-def.h"
 
-Tensor::Tensor(const std::string &label, const std::vector<Index> &lower,
-               const std::vector<Index> &upper, SymmetryType symmetry)
-    : label_(label), lower_(lower), upper_(upper), symmetry_(symmetry) {}
+namespace {
+struct TensorDataHash {
+  template <class Data> std::size_t operator()(const Data *data) const {
+    return data->hash;
+  }
+};
+
+struct TensorDataEqual {
+  template <class Data> bool operator()(const Data *a, const Data *b) const {
+    return (a->hash == b->hash) and (a->label == b->label) and
+           (a->symmetry == b->symmetry) and (a->lower == b->lower) and
+           (a->upper == b->upper);
+  }
+};
+
+/// The global table of the data of the tensors
+template <class Data> struct TensorTable {
+  std::mutex mutex;
+  /// The elements of a deque are never moved when elements are added at the
+  /// end, so the pointers stay valid for the duration of the program
+  std::deque<Data> storage;
+  std::unordered_set<const Data *, TensorDataHash, TensorDataEqual> index;
+};
+} // namespace
+
+/// Return the global table of tensors (created on first use, so that tensors
+/// can be created during static initialization)
+template <class Data> static TensorTable<Data> &tensor_table() {
+  static TensorTable<Data> table;
+  return table;
+}
+
+void Tensor::intern(Data &data) {
+  std::size_t seed = data.label.hash();
+  for (const Index &idx : data.lower) {
+    hash_combine(seed, idx.hash());
+  }
+  hash_combine(seed, data.lower.size());
+  for (const Index &idx : data.upper) {
+    hash_combine(seed, idx.hash());
+  }
+  data.hash = seed;
+
+  // each thread keeps a cache of the tensors that it has seen to avoid taking
+  // the lock of the global table
+  thread_local std::unordered_set<const Data *, TensorDataHash,
+                                  TensorDataEqual>
+      cache;
+  if (auto it = cache.find(&data); it != cache.end()) {
+    data_ = *it;
+    return;
+  }
+  auto &table = tensor_table<Data>();
+  {
+    std::lock_guard<std::mutex> lock(table.mutex);
+    if (auto it = table.index.find(&data); it != table.index.end()) {
+      data_ = *it;
+    } else {
+      table.storage.push_back(std::move(data));
+      data_ = &table.storage.back();
+      table.index.insert(data_);
+    }
+  }
+  cache.insert(data_);
+}
+
+size_t Tensor::num_interned() {
+  auto &table = tensor_table<Data>();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  return table.storage.size();
+}
+
+Tensor::Tensor() {
+  Data data{Label(), {}, {}, SymmetryType::Antisymmetric, 0};
+  intern(data);
+}
+
+Tensor::Tensor(const Label &label, const std::vector<Index> &lower,
+               const std::vector<Index> &upper, SymmetryType symmetry) {
+  Data data{label, lower, upper, symmetry, 0};
+  intern(data);
+}
+
+void Tensor::set_lower(const tensor_indices_t &indices) {
+  Data data{data_->label, indices, data_->upper, data_->symmetry, 0};
+  intern(data);
+}
+
+void Tensor::set_upper(const tensor_indices_t &indices) {
+  Data data{data_->label, data_->lower, indices, data_->symmetry, 0};
+  intern(data);
+}
+
+void Tensor::set_indices(const tensor_indices_t &lower,
+                         const tensor_indices_t &upper) {
+  Data data{data_->label, lower, upper, data_->symmetry, 0};
+  intern(data);
+}
+
+bool Tensor::equal_indices(const Tensor &other) const {
+  return (data_->label == other.data_->label) and
+         (data_->lower == other.data_->lower) and
+         (data_->upper == other.data_->upper);
+}
 
 std::vector<std::pair<int, int>> Tensor::signature() const {
-  std::vector<std::pair<int, int>> result(orbital_subspaces->num_spaces(),
+  std::vector<std::pair<int, int>> result(osi()->num_spaces(),
                                           std::pair(0, 0));
-  for (const Index &idx : upper_) {
+  for (const Index &idx : upper()) {
     result[idx.space()].first += 1;
   }
-  for (const Index &idx : lower_) {
+  for (const Index &idx : lower()) {
     result[idx.space()].second += 1;
   }
   return result;
 }
 
 int Tensor::symmetry_factor() const {
-  return ::symmetry_factor(upper_) * ::symmetry_factor(lower_);
+  return ::symmetry_factor(upper()) * ::symmetry_factor(lower());
 }
 
 bool Tensor::operator<(Tensor const &other) const {
+  if (data_ == other.data_)
+    return false;
   // Compare the labels
-  if (label_ < other.label_)
+  if (label_id() < other.label_id())
     return true;
-  if (label_ > other.label_)
+  if (label_id() > other.label_id())
     return false;
   // Compare the lower indices
-  if (lower_ < other.lower_)
+  if (lower() < other.lower())
     return true;
-  if (lower_ > other.lower_)
+  if (lower() > other.lower())
     return false;
-  return upper_ < other.upper_;
-}
-
-bool Tensor::operator==(Tensor const &other) const {
-  return (label_ == other.label_) and (lower_ == other.lower_) and
-         (upper_ == other.upper_);
+  return upper() < other.upper();
 }
 
 std::vector<Index> Tensor::indices() const {
   std::vector<Index> vec;
-  for (const Index &idx : upper_) {
+  for (const Index &idx : upper()) {
     vec.push_back(idx);
   }
-  for (const Index &idx : lower_) {
+  for (const Index &idx : lower()) {
     vec.push_back(idx);
   }
   // Remove repeated indices
@@ -62,65 +162,85 @@ std::vector<Index> Tensor::indices() const {
 }
 
 void Tensor::reindex(index_map_t &idx_map) {
-  for (Index &idx : upper_) {
-    if (idx_map.count(idx) > 0) {
-      idx = idx_map[idx];
-    }
+  reindex(DenseIndexMap(idx_map));
+}
+
+void Tensor::reindex(const DenseIndexMap &idx_map) {
+  Data data = *data_;
+  bool changed = false;
+  for (Index &idx : data.upper) {
+    const Index new_idx = idx_map(idx);
+    changed = changed or not(new_idx == idx);
+    idx = new_idx;
   }
-  for (Index &idx : lower_) {
-    if (idx_map.count(idx) > 0) {
-      idx = idx_map[idx];
-    }
+  for (Index &idx : data.lower) {
+    const Index new_idx = idx_map(idx);
+    changed = changed or not(new_idx == idx);
+    idx = new_idx;
+  }
+  if (changed) {
+    intern(data);
   }
 }
 
 scalar_t Tensor::canonicalize() {
-  if (symmetry_ == SymmetryType::Nonsymmetric) {
+  if (symmetry() == SymmetryType::Nonsymmetric) {
     throw std::runtime_error(
         "Tensor::canonicalize cannot canonicalize a nonsymmetric tensor");
   }
+  const auto is_sorted = [](const tensor_indices_t &indices) {
+    return std::is_sorted(indices.begin(), indices.end());
+  };
+  if (is_sorted(upper()) and is_sorted(lower())) {
+    return scalar_t(1);
+  }
+  Data data = *data_;
   scalar_t sign = 1;
-  auto upper_indices = this->upper();
-  sign *= canonicalize_indices(upper_indices, false);
-  auto lower_indices = this->lower();
-  sign *= canonicalize_indices(lower_indices, false);
-  this->set_upper(upper_indices);
-  this->set_lower(lower_indices);
-  return (symmetry_ == SymmetryType::Antisymmetric) ? sign : scalar_t(1);
+  sign *= canonicalize_indices(data.upper, false);
+  sign *= canonicalize_indices(data.lower, false);
+  intern(data);
+  return (symmetry() == SymmetryType::Antisymmetric) ? sign : scalar_t(1);
 }
 
 std::string Tensor::str() const {
   std::vector<std::string> str_vec_upper;
   std::vector<std::string> str_vec_lower;
-  for (const Index &index : upper_) {
+  for (const Index &index : upper()) {
     str_vec_upper.push_back(index.str());
   }
-  for (const Index &index : lower_) {
+  for (const Index &index : lower()) {
     str_vec_lower.push_back(index.str());
   }
-  return (label_ + "^{" + join(str_vec_upper, ",") + "}_{" +
+  return (label() + "^{" + join(str_vec_upper, ",") + "}_{" +
           join(str_vec_lower, ",") + "}");
 }
 
 std::string Tensor::latex() const {
   std::vector<std::string> str_vec_upper;
   std::vector<std::string> str_vec_lower;
-  for (const Index &index : upper_) {
+  for (const Index &index : upper()) {
     str_vec_upper.push_back(index.latex());
   }
-  for (const Index &index : lower_) {
+  for (const Index &index : lower()) {
     str_vec_lower.push_back(index.latex());
   }
 
   // read the label. Here we try to separate the name (e.g., lambda) from the
   // subscript (eg. 1). For greek letters we omit the subscript.
-  std::smatch sm;
-  auto m = std::regex_match(label_, sm, std::regex("([a-zA-Z]+)[_]?(\\d+)?"));
-  if (not m) {
-    throw std::runtime_error("\nCould not parse tensor label " + label_);
+  const std::string &label = label_id().str();
+  const size_t symbol_end =
+      std::find_if_not(label.begin(), label.end(), is_alpha_char) -
+      label.begin();
+  size_t subscript_start = symbol_end;
+  if (subscript_start < label.size() and label[subscript_start] == '_') {
+    subscript_start++;
+  }
+  if (symbol_end == 0 or not std::all_of(label.begin() + subscript_start,
+                                         label.end(), is_digit_char)) {
+    throw std::runtime_error("\nCould not parse tensor label " + label);
   }
-  std::string symbol = sm[1];
-  std::string raw_subscript = sm[2];
+  std::string symbol = label.substr(0, symbol_end);
+  std::string raw_subscript = label.substr(subscript_start);
   std::vector<std::string> greek{"alpha",  "beta", "gamma", "delta", "epsilon",
                                  "zeta",   "eta",  "theta", "iota",  "kappa",
                                  "lambda", "mu",   "nu",    "xi",    "omicron",
@@ -139,15 +259,15 @@ std::string Tensor::latex() const {
 
 std::string Tensor::compile(const std::string &format) const {
   std::vector<std::string> str_vec;
-  for (const Index &index : upper_) {
+  for (const Index &index : upper()) {
     str_vec.push_back(index.compile(format));
   }
-  for (const Index &index : lower_) {
+  for (const Index &index : lower()) {
     str_vec.push_back(index.compile(format));
   }
 
-  return (str_vec.size() > 0 ? (label_ + "[" + join(str_vec, ",") + "]")
-                             : label_);
+  return (str_vec.size() > 0 ? (label() + "[" + join(str_vec, ",") + "]")
+                             : label());
 }
 
 std::ostream &operator<<(std::ostream &os, const Tensor &tensor) {
@@ -170,18 +290,47 @@ Tensor make_tensor(const std::string &label,
   return Tensor(label, lower_indices, upper_indices, symmetry);
 }
 
+size_t match_tensor_str(const std::string &s, size_t pos) {
+  auto is_index_char = [](char c) {
+    return is_word_char(c) or c == ',' or is_space_char(c);
+  };
+  const size_t n = s.size();
+  size_t k = pos;
+  while (k < n and is_alnum_char(s[k])) {
+    k++;
+  }
+  if (k == pos) {
+    return std::string::npos;
+  }
+  // match "^{...}_{...}"
+  for (const char *open : {"^{", "_{"}) {
+    if (k + 1 >= n or s[k] != open[0] or s[k + 1] != open[1]) {
+      return std::string::npos;
+    }
+    k += 2;
+    while (k < n and is_index_char(s[k])) {
+      k++;
+    }
+    if (k >= n or s[k] != '}') {
+      return std::string::npos;
+    }
+    k++;
+  }
+  return k;
+}
+
 Tensor make_tensor_from_str(const std::string &s, SymmetryType symmetry) {
-  std::smatch sm;
-  auto const tensor_re =
-      std::regex("([a-zA-Z0-9]+)\\^\\{([\\w,\\s]*)\\}_\\{([\\w,\\s]*)\\}");
-  auto m = std::regex_match(s, sm, tensor_re);
-  if (not m) {
+  if (match_tensor_str(s, 0) != s.size()) {
     throw std::runtime_error("\nCould not convert the string " + s +
                              " to a Tensor object");
   }
-  std::string label = sm[1];
-  auto upper = make_indices_from_str(sm[2]);
-  auto lower = make_indices_from_str(sm[3]);
+  // the label ends at the '^' and the upper indices at the first '}'
+  const size_t caret = s.find('^');
+  const size_t upper_end = s.find('}', caret);
+  const std::string label = s.substr(0, caret);
+  auto upper = make_indices_from_str(s.substr(caret + 2, upper_end - caret - 2));
+  auto lower =
+      make_indices_from_str(s.substr(upper_end + 3, s.size() - upper_end - 4));
   return Tensor(label, lower, upper, symmetry);
 }
 
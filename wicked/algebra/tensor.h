@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "helpers/label.h"
 #include "index.h"
 #include "wicked-def.h"
 
@@ -12,46 +13,61 @@ enum class SymmetryType { Symmetric, Antisymmetric, Nonsymmetric };
 
 /// This class represents a tensor labeled with orbital indices.
 /// It holds information about the label and the indices of the tensor.
+///
+/// Tensors are hash-consed: the data of each distinct tensor (label, indices
+/// and symmetry) is stored once in a global table, and a Tensor is a pointer
+/// to its data. Copying a tensor copies a pointer, terms that share a tensor
+/// share its storage, and two tensors with the same symmetry are equal if and
+/// only if they point to the same data. The functions that modify a tensor
+/// look up (or add) the modified data in the table
 class Tensor {
 
 public:
   // ==> Constructors <==
-  explicit Tensor() {}
+  Tensor();
 
-  Tensor(const std::string &label, const std::vector<Index> &lower,
+  Tensor(const Label &label, const std::vector<Index> &lower,
          const std::vector<Index> &upper, SymmetryType symmetry);
 
   // ==> Class public interface <==
 
   /// Return a reference to the label
-  const std::string &label() const { return label_; }
+  const std::string &label() const { return data_->label.str(); }
+
+  /// Return the interned label
+  const Label &label_id() const { return data_->label; }
 
   /// Return a reference to the lower indices
-  const std::vector<Index> &lower() const { return lower_; }
+  const tensor_indices_t &lower() const { return data_->lower; }
 
   /// Return a reference to the upper indices
-  const std::vector<Index> &upper() const { return upper_; }
+  const tensor_indices_t &upper() const { return data_->upper; }
 
   /// Return a reference to the symmetry
-  SymmetryType symmetry() const { return symmetry_; }
+  SymmetryType symmetry() const { return data_->symmetry; }
 
   /// Set the lower indices
-  void set_lower(const std::vector<Index> &indices) { lower_ = indices; }
+  void set_lower(const tensor_indices_t &indices);
 
   /// Set the upper indices
-  void set_upper(const std::vector<Index> &indices) { upper_ = indices; }
+  void set_upper(const tensor_indices_t &indices);
+
+  /// Set the lower and upper indices
+  void set_indices(const tensor_indices_t &lower,
+                   const tensor_indices_t &upper);
 
   /// Return a vector containing all indices
   std::vector<Index> indices() const;
 
   /// Reindex this tensor
   void reindex(index_map_t &idx_map);
+  void reindex(const DenseIndexMap &idx_map);
 
   /// Canonicalize this tensor and return the overall phase factor
   scalar_t canonicalize();
 
   /// Return the rank of the tensor
-  int rank() const { return lower_.size() + upper_.size(); }
+  int rank() const { return data_->lower.size() + data_->upper.size(); }
 
   /// return the signature (number of upper/lower indices in each space)
   std::vector<std::pair<int, int>> signature() const;
@@ -62,12 +78,23 @@ public:
   /// Comparison operator used for sorting
   bool operator<(Tensor const &other) const;
 
-  /// Comparison operator used for sorting
-  bool operator==(Tensor const &other) const;
+  /// Comparison operator used for sorting. The symmetry is not compared
+  bool operator==(Tensor const &other) const {
+    // tensors with the same symmetry are equal only if they share their data
+    return (data_ == other.data_) or
+           ((data_->symmetry != other.data_->symmetry) and
+            equal_indices(other));
+  }
 
   /// Return a string representation
   std::string str() const;
 
+  /// Return a hash value (consistent with operator==)
+  std::size_t hash() const { return data_->hash; }
+
+  /// Return the number of distinct tensors stored in the global table
+  static size_t num_interned();
+
   /// Return a LaTeX representation
   std::string latex() const;
 
@@ -75,12 +102,25 @@ public:
   std::string compile(const std::string &format) const;
 
 private:
+  /// The data shared by equal tensors
+  struct Data {
+    Label label;
+    tensor_indices_t lower;
+    tensor_indices_t upper;
+    SymmetryType symmetry;
+    /// The hash of the label and the indices
+    std::size_t hash;
+  };
+
+  /// Point this tensor to the copy of data stored in the global table
+  void intern(Data &data);
+
+  /// Return true if the labels and the indices of two tensors are equal
+  bool equal_indices(const Tensor &other) const;
+
   // ==> Class private data <==
 
-  std::string label_;
-  std::vector<Index> lower_;
-  std::vector<Index> upper_;
-  SymmetryType symmetry_;
+  const Data *data_;
 };
 
 /// A function to construct a tensor
@@ -93,6 +133,10 @@ Tensor make_tensor(const std::string &label,
 /// Accepts inputs of the form "t_{o0}^{v_0}"
 Tensor make_tensor_from_str(const std::string &index, SymmetryType symmetry);
 
+/// Return the end of the tensor of the form "t^{v0}_{o0}" that starts at
+/// position pos of a string, or std::string::npos if there is none
+size_t match_tensor_str(const std::string &s, size_t pos);
+
 /// Print to an output stream
 std::ostream &operator<<(std::ostream &os, const Tensor &tensor);
 
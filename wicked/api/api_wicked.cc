@@ -21,6 +21,8 @@ void export_Operator(py::module &m);
 void export_OperatorExpression(py::module &m);
 void export_WickTheorem(py::module &m);
 void export_rational(py::module &m);
+void export_serialize(py::module &m);
+void export_trace(py::module &m);
 
 PYBIND11_MODULE(_wicked, m) {
   m.doc() = "Wicked python interface";
@@ -37,4 +39,6 @@ PYBIND11_MODULE(_wicked, m) {
   export_Operator(m);
   export_OperatorExpression(m);
   export_WickTheorem(m);
+  export_serialize(m);
+  export_trace(m);
 }
@@ -9,4 +9,6 @@ using namespace pybind11::literals;
 /// Export the combinatorics
 void export_combinatorics(py::module &m) {
   m.def("integer_partitions", &integer_partitions);
+  m.def("factorial", &factorial, "n"_a);
+  m.def("binomial", &binomial, "n"_a, "k"_a);
 }
\ No newline at end of file
@@ -1,22 +1,205 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "../wicked/algebra/antisymmetrize.h"
+#include "../wicked/algebra/cost.h"
 #include "../wicked/algebra/equation.h"
+#include "../wicked/algebra/evaluate.h"
+#include "../wicked/algebra/cpp_codegen.h"
+#include "../wicked/algebra/cupy_codegen.h"
 #include "../wicked/algebra/expression.h" // for rhs_expression
+#include "../wicked/algebra/factorize.h"
+#include "../wicked/diagrams/serialize.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+/// Return the blocks that point to the data of a dictionary of arrays. The
+/// arrays must be C-contiguous arrays of doubles and are not copied
+std::map<std::string, TensorBlock>
+blocks_from_arrays(const py::dict &arrays, std::vector<py::buffer_info> &info) {
+  std::map<std::string, TensorBlock> blocks;
+  for (const auto &[key, value] : arrays) {
+    const std::string name = py::str(key);
+    info.push_back(py::reinterpret_borrow<py::buffer>(value).request());
+    const py::buffer_info &buf = info.back();
+    if (buf.format != py::format_descriptor<double>::format()) {
+      throw std::runtime_error("evaluate() - the array " + name +
+                               " does not contain doubles");
+    }
+    py::ssize_t stride = sizeof(double);
+    for (size_t k = buf.shape.size(); k-- > 0;) {
+      if (buf.shape[k] > 1 and buf.strides[k] != stride) {
+        throw std::runtime_error("evaluate() - the array " + name +
+                                 " is not C-contiguous");
+      }
+      stride *= buf.shape[k];
+    }
+    blocks[name] = TensorBlock{static_cast<double *>(buf.ptr),
+                               std::vector<size_t>(buf.shape.begin(),
+                                                   buf.shape.end())};
+  }
+  return blocks;
+}
+
+/// Evaluate equations on a dictionary of arrays without holding the GIL
+template <typename... Args>
+void evaluate_arrays(const py::dict &arrays, int nthreads,
+                     const Args &...args) {
+  std::vector<py::buffer_info> info;
+  const auto blocks = blocks_from_arrays(arrays, info);
+  py::gil_scoped_release release;
+  evaluate(args..., blocks, nthreads);
+}
+
 /// Export the Equation class
 void export_Equation(py::module &m) {
+  py::class_<PermutationOperator, std::shared_ptr<PermutationOperator>>(
+      m, "PermutationOperator")
+      .def(py::init<const std::vector<std::vector<Index>> &>())
+      .def("groups", &PermutationOperator::groups)
+      .def("__eq__", &PermutationOperator::operator==)
+      .def("__repr__", &PermutationOperator::str)
+      .def("__str__", &PermutationOperator::str)
+      .def("latex", &PermutationOperator::latex);
+
   py::class_<Equation, std::shared_ptr<Equation>>(m, "Equation")
       .def(py::init<const SymbolicTerm &, const SymbolicTerm &, scalar_t>())
+      .def(py::init<const SymbolicTerm &, const SymbolicTerm &, scalar_t,
+                    const std::vector<PermutationOperator> &>())
       .def("lhs", &Equation::lhs)
       .def("rhs", &Equation::rhs)
+      .def("permutations", &Equation::permutations)
       .def("rhs_expression", &Equation::rhs_expression)
       .def("rhs_factor", &Equation::rhs_factor)
       .def("__repr__", &Equation::str)
       .def("__str__", &Equation::str)
       .def("latex", &Equation::latex)
-      .def("compile", &Equation::compile);
-}
\ No newline at end of file
+      .def(py::pickle(
+          [](const Equation &eq) {
+            const std::map<std::string, std::vector<Equation>> equations{
+                {"", {eq}}};
+            return py::bytes(serialize(equations));
+          },
+          [](const py::bytes &data) {
+            return SerializedView(std::string(data)).equation(0).second;
+          }))
+      .def("compile", &Equation::compile, "format"_a,
+           "dims"_a = std::map<char, int>())
+      .def(
+          "cost",
+          [](const Equation &eq, const std::map<char, int> &dims) {
+            return equation_cost(eq, dims);
+          },
+          "dims"_a);
+
+  py::class_<EquationCost>(m, "EquationCost")
+      .def_readonly("flops", &EquationCost::flops)
+      .def_readonly("max_intermediate", &EquationCost::max_intermediate)
+      .def_readonly("scaling", &EquationCost::scaling)
+      .def("scaling_str", &EquationCost::scaling_str);
+
+  py::class_<BlockCost>(m, "BlockCost")
+      .def_readonly("block", &BlockCost::block)
+      .def_readonly("total", &BlockCost::total)
+      .def_readonly("terms", &BlockCost::terms);
+
+  py::class_<CostReport, std::shared_ptr<CostReport>>(m, "CostReport")
+      .def("blocks", &CostReport::blocks)
+      .def("flops", &CostReport::flops)
+      .def("str", &CostReport::str, "nterms"_a = 3)
+      .def("__repr__", [](const CostReport &r) { return r.str(); })
+      .def("__str__", [](const CostReport &r) { return r.str(); });
+
+  m.def("cost_report",
+        py::overload_cast<const std::map<std::string, std::vector<Equation>> &,
+                          const std::map<char, int> &>(&cost_report),
+        "equations"_a, "dims"_a,
+        "Estimate the operations, largest intermediate and scaling of each "
+        "term and residual block");
+  m.def("cost_report",
+        py::overload_cast<const Expression &, const std::string &,
+                          const std::map<char, int> &>(&cost_report),
+        "expr"_a, "label"_a, "dims"_a);
+
+  py::class_<FactorizedEquations, std::shared_ptr<FactorizedEquations>>(
+      m, "FactorizedEquations")
+      .def("intermediates", &FactorizedEquations::intermediates)
+      .def("equations", &FactorizedEquations::equations)
+      .def("__repr__", &FactorizedEquations::str)
+      .def("__str__", &FactorizedEquations::str)
+      .def("compile", &FactorizedEquations::compile, "format"_a,
+           "dims"_a = std::map<char, int>());
+
+  m.def("factorize",
+        py::overload_cast<const std::map<std::string, std::vector<Equation>> &,
+                          const std::string &, int>(&factorize),
+        "equations"_a, "prefix"_a = "X", "min_uses"_a = 2,
+        "Replace the contractions of two tensors shared by several terms with "
+        "intermediates");
+  m.def("factorize",
+        py::overload_cast<const std::vector<Equation> &, const std::string &,
+                          int>(&factorize),
+        "equations"_a, "prefix"_a = "X", "min_uses"_a = 2);
+
+  m.def("compile_cpp_function",
+        py::overload_cast<const std::string &, const std::vector<Equation> &,
+                          const std::map<char, int> &>(&compile_cpp_function),
+        "name"_a, "equations"_a, "dims"_a = std::map<char, int>(),
+        "Return a C++ source file with a function that evaluates a set of "
+        "equations with BLAS");
+  m.def("compile_cpp_function",
+        py::overload_cast<const std::string &, const FactorizedEquations &,
+                          const std::map<char, int> &>(&compile_cpp_function),
+        "name"_a, "equations"_a, "dims"_a = std::map<char, int>());
+
+  m.def("compile_cupy_function",
+        py::overload_cast<const std::string &, const std::vector<Equation> &,
+                          const std::map<char, int> &>(&compile_cupy_function),
+        "name"_a, "equations"_a, "dims"_a = std::map<char, int>(),
+        "Return the source of a Python function that evaluates a set of "
+        "equations on the GPU with CuPy and cuTENSOR");
+  m.def("compile_cupy_function",
+        py::overload_cast<const std::string &, const FactorizedEquations &,
+                          const std::map<char, int> &>(&compile_cupy_function),
+        "name"_a, "equations"_a, "dims"_a = std::map<char, int>());
+
+  m.def("collapse_permutation_partners",
+        py::overload_cast<
+            const std::map<std::string, std::vector<Equation>> &>(
+            &collapse_permutation_partners),
+        "equations"_a,
+        "Combine the equations that are antisymmetric permutation partners "
+        "into one equation with a permutation operator");
+  m.def("collapse_permutation_partners",
+        py::overload_cast<const std::vector<Equation> &>(
+            &collapse_permutation_partners),
+        "equations"_a);
+
+  m.def("compile_antisymmetrizer", &compile_antisymmetrizer, "label"_a,
+        "block"_a, "format"_a,
+        "Return the code that antisymmetrizes a residual block in place");
+
+  m.def(
+      "evaluate",
+      [](const std::map<std::string, std::vector<Equation>> &equations,
+         const py::dict &arrays, int nthreads) {
+        evaluate_arrays(arrays, nthreads, equations);
+      },
+      "equations"_a, "arrays"_a, "nthreads"_a = 0,
+      "Evaluate a set of equations on a dictionary of NumPy arrays (e.g., "
+      "{'T2oovv': T2, 'Roovv': R}) and add the results to the arrays of the "
+      "left-hand sides");
+  m.def(
+      "evaluate",
+      [](const std::vector<Equation> &equations, const py::dict &arrays,
+         int nthreads) { evaluate_arrays(arrays, nthreads, equations); },
+      "equations"_a, "arrays"_a, "nthreads"_a = 0);
+  m.def(
+      "evaluate",
+      [](const Expression &expr, const std::string &label,
+         const py::dict &arrays, int nthreads) {
+        evaluate_arrays(arrays, nthreads, expr, label);
+      },
+      "expr"_a, "label"_a, "arrays"_a, "nthreads"_a = 0);
+}
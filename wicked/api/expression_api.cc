@@ -1,29 +1,76 @@
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 #include "../wicked/algebra/expression.h"
+#include "../wicked/algebra/expression_arrays.h"
+#include "../wicked/algebra/frozen_expression.h"
+#include "../wicked/algebra/spin_integrate.h"
+#include "../wicked/diagrams/serialize.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+namespace {
+/// Copy a table of records to a NumPy structured array
+template <typename T> py::array_t<T> to_numpy(const std::vector<T> &table) {
+  return py::array_t<T>(table.size(), table.data());
+}
+
+/// Copy a one-dimensional NumPy structured array to a table of records
+template <typename T>
+std::vector<T>
+from_numpy(const py::array_t<T, py::array::c_style | py::array::forcecast> &a) {
+  if (a.ndim() != 1) {
+    throw std::runtime_error("expression_from_arrays: the arrays must be "
+                             "one-dimensional");
+  }
+  return std::vector<T>(a.data(), a.data() + a.size());
+}
+} // namespace
+
 /// Export the Indexclass
 void export_Expression(py::module &m) {
+  PYBIND11_NUMPY_DTYPE(TermRecord, numerator, denominator, coefficient,
+                       normal_ordered);
+  PYBIND11_NUMPY_DTYPE(TensorRecord, term, label, symmetry);
+  PYBIND11_NUMPY_DTYPE(IndexRecord, term, tensor, upper, space, pos);
+  PYBIND11_NUMPY_DTYPE(OperatorRecord, term, creation, space, pos);
+
   py::class_<Expression, std::shared_ptr<Expression>>(m, "Expression")
       .def(py::init<>())
       .def("add", py::overload_cast<const Term &>(&Expression::add))
       .def("add",
            py::overload_cast<const SymbolicTerm &, scalar_t>(&Expression::add),
            "term"_a, "coefficient"_a = scalar_t(1, 1))
-      .def("add",
-           py::overload_cast<const Expression &, scalar_t>(&Expression::add),
-           "expr"_a, "scale"_a = scalar_t(1))
+      .def(
+          "add",
+          [](Expression &self, Expression expr, scalar_t scale) {
+            self.add(std::move(expr), scale);
+          },
+          "expr"_a, "scale"_a = scalar_t(1))
+      .def(
+          "axpy",
+          [](Expression &self, const Expression &x, scalar_t a) {
+            self.axpy(x, a);
+          },
+          "x"_a, "a"_a, "Add a * x to this expression in place")
+      .def(
+          "drain",
+          [](Expression &self, const py::function &fn) {
+            self.drain([&](SymbolicTerm &&term, scalar_t c) {
+              fn(std::move(term), c);
+            });
+          },
+          "fn"_a,
+          "Remove all the terms and pass each one to fn(term, coefficient)")
       .def("__repr__", &Expression::str)
       .def("__str__", &Expression::str)
       .def("__len__", &Expression::size)
       .def("__eq__", &Expression::operator==)
       .def("__add__",
-           [](Expression lhs, const Expression &rhs) {
-             lhs += rhs;
+           [](Expression lhs, Expression rhs) {
+             lhs += std::move(rhs);
              return lhs;
            })
       .def("__iter__",
@@ -34,12 +81,132 @@ void export_Expression(py::module &m) {
       .def("latex", &Expression::latex, "sep"_a = " \\\\ \n")
       .def("to_manybody_equation", &Expression::to_manybody_equation)
       .def("to_manybody_equations", &Expression::to_manybody_equation)
-      .def("canonicalize", &Expression::canonicalize);
+      .def(
+          "manybody_equations",
+          [](const Expression &e, const std::string &label,
+             const std::vector<std::string> &blocks, int nthreads) {
+            return ManyBodyEquations(e, label, blocks, nthreads);
+          },
+          "label"_a, "blocks"_a = std::vector<std::string>(),
+          "nthreads"_a = 1, py::keep_alive<0, 1>(),
+          "Return the many-body equations of the blocks listed (e.g., "
+          "['oo|vv'], all if empty) as a mapping from block to equations. "
+          "The equations of a block are created when it is accessed")
+      .def(py::pickle(
+          [](const Expression &e) { return py::bytes(serialize(e)); },
+          [](const py::bytes &data) {
+            return deserialize_expression(std::string(data));
+          }))
+      .def("canonicalize", &Expression::canonicalize, "nthreads"_a = 1,
+           py::call_guard<py::gil_scoped_release>(),
+           "Canonicalize the terms of this expression using nthreads threads "
+           "(0 = all hardware threads)")
+      .def("simplify", &Expression::simplify,
+           "Combine the terms that differ only by a relabeling of the "
+           "indices")
+      .def(
+          "freeze", [](const Expression &e) { return FrozenExpression(e); },
+          "Return an immutable copy of this expression stored in flat arrays")
+      .def(
+          "to_arrays",
+          [](const Expression &e) {
+            const ExpressionArrays arrays = to_arrays(e);
+            py::dict d;
+            d["labels"] = arrays.labels;
+            d["terms"] = to_numpy(arrays.terms);
+            d["tensors"] = to_numpy(arrays.tensors);
+            d["indices"] = to_numpy(arrays.indices);
+            d["ops"] = to_numpy(arrays.ops);
+            return d;
+          },
+          "Return the structure of this expression as a dictionary of NumPy "
+          "structured arrays (labels, terms, tensors, indices, ops) with one "
+          "record per term, tensor, index, and operator. The records refer to "
+          "their term, tensor, and label by position");
+
+  py::class_<ManyBodyEquations, std::shared_ptr<ManyBodyEquations>>(
+      m, "ManyBodyEquations")
+      .def("__len__", &ManyBodyEquations::size)
+      .def("blocks", &ManyBodyEquations::blocks)
+      .def("keys", &ManyBodyEquations::blocks)
+      .def("__contains__", &ManyBodyEquations::contains)
+      .def(
+          "__iter__",
+          [](const ManyBodyEquations &e) {
+            return py::make_iterator(e.blocks().begin(), e.blocks().end());
+          },
+          py::keep_alive<0, 1>())
+      .def("__getitem__",
+           [](const ManyBodyEquations &e, const std::string &block) {
+             if (not e.contains(block)) {
+               throw py::key_error(block);
+             }
+             return e.equations(block);
+           })
+      .def("equations",
+           py::overload_cast<const std::string &>(
+               &ManyBodyEquations::equations, py::const_),
+           "block"_a, py::call_guard<py::gil_scoped_release>(),
+           "Return the equations of a block (empty if it has no terms)");
+
+  py::class_<FrozenExpression, std::shared_ptr<FrozenExpression>>(
+      m, "FrozenExpression")
+      .def(py::init<>())
+      .def(py::init<const Expression &>(), "expr"_a)
+      .def("__len__", &FrozenExpression::size)
+      .def("__getitem__",
+           [](const FrozenExpression &e, size_t n) {
+             if (n >= e.size()) {
+               throw py::index_error("FrozenExpression index out of range");
+             }
+             return e[n];
+           })
+      .def("term", &FrozenExpression::term, "n"_a)
+      .def("factor", &FrozenExpression::factor, "n"_a)
+      .def("memory_size", &FrozenExpression::memory_size,
+           "Return the number of bytes used to store the terms")
+      .def("to_expression", &FrozenExpression::to_expression)
+      .def("to_manybody_equation", &FrozenExpression::to_manybody_equation)
+      .def("to_manybody_equations", &FrozenExpression::to_manybody_equation)
+      .def("compile", &FrozenExpression::compile, "label"_a, "format"_a,
+           "dims"_a = std::map<char, int>(),
+           "Return the code of the many-body equations, one per line");
 
   m.def("operator_expr", &make_operator_expr, "label"_a, "components"_a,
         "normal_ordered"_a, "symmetry"_a = SymmetryType::Antisymmetric,
         "coefficient"_a = scalar_t(1));
 
+  m.def(
+      "expression_from_arrays",
+      [](const std::vector<std::string> &labels,
+         const py::array_t<TermRecord, py::array::c_style |
+                                           py::array::forcecast> &terms,
+         const py::array_t<TensorRecord, py::array::c_style |
+                                             py::array::forcecast> &tensors,
+         const py::array_t<IndexRecord, py::array::c_style |
+                                            py::array::forcecast> &indices,
+         const py::array_t<OperatorRecord, py::array::c_style |
+                                               py::array::forcecast> &ops) {
+        ExpressionArrays arrays;
+        arrays.labels = labels;
+        arrays.terms = from_numpy(terms);
+        arrays.tensors = from_numpy(tensors);
+        arrays.indices = from_numpy(indices);
+        arrays.ops = from_numpy(ops);
+        return from_arrays(arrays);
+      },
+      "labels"_a, "terms"_a, "tensors"_a, "indices"_a, "ops"_a,
+      "Create an expression from arrays in the format of "
+      "Expression.to_arrays (e.g., expression_from_arrays(**e.to_arrays()))");
+
   m.def("expression", &string_to_expr, "s"_a,
         "symmetry"_a = SymmetryType::Antisymmetric);
+
+  m.def("string_to_expr_lines", &string_to_expr_lines, "s"_a,
+        "symmetry"_a = SymmetryType::Antisymmetric,
+        "Create an expression from a string with one term per line");
+
+  m.def("spin_integrate", &spin_integrate, "expr"_a, "spin_spaces"_a,
+        "Spin-integrate an expression given the alpha and beta subspaces of "
+        "each spin-orbital space (e.g., {'o': ('o', 'O'), 'v': ('v', 'V')})");
 }
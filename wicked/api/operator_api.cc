@@ -7,6 +7,8 @@
 #include "../wicked/diagrams/operator.h"
 #include "../wicked/diagrams/operator_expression.h"
 #include "../wicked/diagrams/operator_product.h"
+#include "../wicked/diagrams/serialize.h"
+#include "../wicked/diagrams/tensor_blocks.h"
 #include "../wicked/diagrams/wick_theorem.h"
 
 namespace py = pybind11;
@@ -27,20 +29,21 @@ void export_OperatorExpression(py::module &m) {
       .def(py::init<>())
       .def(py::init<const OperatorExpression &>())
       .def(py::init<const std::vector<OperatorProduct> &, scalar_t>(),
-           py::arg("vec_vec_dop"), py::arg("factor") = rational(1))
+           py::arg("vec_vec_dop"), py::arg("factor") = scalar_t(1))
       .def("size", &OperatorExpression::size)
-      .def("add", &OperatorExpression::add)
+      .def("add",
+           py::overload_cast<const OperatorProduct &, scalar_t>(
+               &OperatorExpression::add),
+           "ops"_a, "coefficient"_a = scalar_t(1))
       .def("adjoint", &OperatorExpression::adjoint)
       .def("add2", &OperatorExpression::add2)
       .def("__add__",
-           [](OperatorExpression rhs, const OperatorExpression &lhs) {
-             rhs += lhs;
-             return rhs;
+           [](OperatorExpression rhs, OperatorExpression lhs) {
+             return std::move(rhs) + std::move(lhs);
            })
       .def("__sub__",
-           [](OperatorExpression rhs, const OperatorExpression &lhs) {
-             rhs -= lhs;
-             return rhs;
+           [](OperatorExpression rhs, OperatorExpression lhs) {
+             return std::move(rhs) - std::move(lhs);
            })
       .def("__eq__",
            [](const OperatorExpression &rhs, const OperatorExpression &lhs) {
@@ -48,11 +51,29 @@ void export_OperatorExpression(py::module &m) {
            })
       .def("__repr__", &OperatorExpression::str)
       .def("__str__", &OperatorExpression::str)
+      .def(py::pickle(
+          [](const OperatorExpression &e) { return py::bytes(serialize(e)); },
+          [](const py::bytes &data) {
+            return deserialize_operator_expression(std::string(data));
+          }))
       .def("__matmul__",
            [](const OperatorExpression &lhs, const OperatorExpression &rhs) {
              return lhs * rhs;
            })
       .def("canonicalize", &OperatorExpression::canonicalize);
+  py::class_<LazyOperatorProduct, std::shared_ptr<LazyOperatorProduct>>(
+      m, "LazyOperatorProduct")
+      .def(py::init<const std::vector<OperatorExpression> &>(), "factors"_a)
+      .def("factors", &LazyOperatorProduct::factors)
+      .def("count", &LazyOperatorProduct::count, "minrank"_a, "maxrank"_a,
+           "Return the number of products that can give contractions with "
+           "rank in the range [minrank, maxrank]")
+      .def("expand", &LazyOperatorProduct::expand, "minrank"_a, "maxrank"_a,
+           "Return the sum of the products that can give contractions with "
+           "rank in the range [minrank, maxrank]")
+      .def("__repr__", &LazyOperatorProduct::str)
+      .def("__str__", &LazyOperatorProduct::str);
+
   m.def("op", &make_diag_operator_expression, "label"_a, "components"_a,
         "unique"_a = false,
         py::call_guard<py::scoped_ostream_redirect,
@@ -77,6 +98,40 @@ void export_OperatorExpression(py::module &m) {
       },
       "Create the commutator of a list of OperatorExpression objects");
 
+  m.def("multiply",
+        py::overload_cast<const OperatorExpression &,
+                          const OperatorExpression &, int, int>(&multiply),
+        "A"_a, "B"_a, "minrank"_a, "maxrank"_a,
+        "Multiply two OperatorExpression objects keeping only the terms that "
+        "can give contractions with rank in the range [minrank, maxrank]");
+  m.def("multiply",
+        py::overload_cast<const std::vector<OperatorExpression> &, int, int>(
+            &multiply),
+        "factors"_a, "minrank"_a, "maxrank"_a,
+        "Multiply a list of OperatorExpression objects keeping only the terms "
+        "that can give contractions with rank in the range [minrank, "
+        "maxrank]");
+
+  m.def(
+      "declare_zero_block",
+      [](const std::string &label, const std::string &block) {
+        declare_block(label, block, BlockType::Zero);
+      },
+      "label"_a, "block"_a,
+      "Declare that a block of the operators with a label is zero (e.g., "
+      "declare_zero_block('f', 'o+ v')). Operators in the block are not "
+      "created by op and products that contain one are not contracted");
+  m.def(
+      "declare_diagonal_block",
+      [](const std::string &label, const std::string &block) {
+        declare_block(label, block, BlockType::Diagonal);
+      },
+      "label"_a, "block"_a,
+      "Declare that a block of the operators with a label is diagonal (e.g., "
+      "declare_diagonal_block('f', 'o+ o')). The two indices of the tensors "
+      "in the block are identified when contractions are evaluated");
+  m.def("reset_blocks", &reset_blocks, "Remove all the block declarations");
+
   m.def("bch_series", &bch_series,
         "Creates the Baker-Campbell-Hausdorff "
         "expansion of exp(-B) A exp(B) truncated at "
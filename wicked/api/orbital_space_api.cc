@@ -6,6 +6,12 @@
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+/// A Python context manager that activates an OrbitalSpaceInfo object
+struct PyOrbitalSpaceContext {
+  std::shared_ptr<OrbitalSpaceInfo> osi;
+  std::unique_ptr<OrbitalSpaceContext> guard;
+};
+
 /// Export the Indexclass
 void export_OrbitalSpaceInfo(py::module &m) {
   py::class_<OrbitalSpaceInfo, std::shared_ptr<OrbitalSpaceInfo>>(
@@ -13,6 +19,19 @@ void export_OrbitalSpaceInfo(py::module &m) {
       .def(py::init<>())
       .def("reset_space", &OrbitalSpaceInfo::reset)
       .def("add_space", &OrbitalSpaceInfo::add_space)
+      .def(
+          "add_space",
+          [](OrbitalSpaceInfo &osi, char label,
+             const std::string &field_type_str,
+             const std::string &space_type_str,
+             const std::vector<std::string> &indices,
+             const std::vector<char> &elementary_spaces) {
+            osi.add_space(label, string_to_field_type(field_type_str),
+                          string_to_space_type(space_type_str), indices,
+                          elementary_spaces);
+          },
+          "label"_a, "field_type"_a, "space_type"_a, "indices"_a,
+          "elementary_spaces"_a = std::vector<char>())
       .def("num_spaces", &OrbitalSpaceInfo::num_spaces)
       .def("label", &OrbitalSpaceInfo::label)
       .def("indices", &OrbitalSpaceInfo::indices)
@@ -21,6 +40,27 @@ void export_OrbitalSpaceInfo(py::module &m) {
 
   m.def("osi", []() { return orbital_subspaces; });
 
+  m.attr("max_spaces") = max_orbital_spaces;
+
+  py::class_<PyOrbitalSpaceContext>(m, "OrbitalSpaceContext")
+      .def("__enter__",
+           [](PyOrbitalSpaceContext &c) {
+             c.guard = std::make_unique<OrbitalSpaceContext>(c.osi);
+             return c.osi;
+           })
+      .def("__exit__",
+           [](PyOrbitalSpaceContext &c, py::args) { c.guard.reset(); });
+
+  m.def(
+      "orbital_space_context",
+      [](const std::shared_ptr<OrbitalSpaceInfo> &osi) {
+        return std::unique_ptr<PyOrbitalSpaceContext>(
+            new PyOrbitalSpaceContext{osi, nullptr});
+      },
+      "osi"_a,
+      "Return a context manager that makes an OrbitalSpaceInfo object the "
+      "active orbital space definition inside a `with` block");
+
   m.def(
       "reset_space", []() { orbital_subspaces->reset(); },
       "Reset the orbital space");
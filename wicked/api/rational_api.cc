@@ -7,36 +7,51 @@
 namespace py = pybind11;
 using namespace pybind11::literals;
 
-void export_rational(py::module &m) {
-
-  py::class_<rational, std::shared_ptr<rational>>(m, "rational")
-      .def(py::init<>())
+namespace {
+/// Export a number class with the interface of rational
+template <class T>
+py::class_<T, std::shared_ptr<T>> export_number(py::module &m,
+                                                const char *name) {
+  py::class_<T, std::shared_ptr<T>> c(m, name);
+  c.def(py::init<>())
       .def(py::init<int>())
       .def(py::init<int, int>())
-      .def("latex", &rational::latex)
-      .def("compile", &rational::compile)
-      .def("__float__", &rational::to_double)
-      .def("__eq__",
-           [](const rational &lhs, const rational &rhs) { return lhs == rhs; })
-      .def("__add__",
-           [](const rational &lhs, const rational &rhs) { return lhs + rhs; })
-      .def("__sub__",
-           [](const rational &lhs, const rational &rhs) { return lhs - rhs; })
-      .def("__mul__",
-           [](const rational &lhs, const rational &rhs) { return lhs * rhs; })
+      .def("latex", &T::latex)
+      .def("compile", &T::compile)
+      .def("__float__", &T::to_double)
+      .def("__eq__", [](const T &lhs, const T &rhs) { return lhs == rhs; })
+      .def("__add__", [](const T &lhs, const T &rhs) { return lhs + rhs; })
+      .def("__sub__", [](const T &lhs, const T &rhs) { return lhs - rhs; })
+      .def("__mul__", [](const T &lhs, const T &rhs) { return lhs * rhs; })
+      .def("__truediv__",
+           [](const T &lhs, const T &rhs) { return lhs / rhs; })
+      .def("__repr__", &T::repr)
+      .def("str", &T::str)
       .def(
           "__mul__",
-          [](const rational &lhs, OperatorExpression rhs) {
-            rhs *= lhs;
+          [](const T &lhs, OperatorExpression rhs) {
+            rhs *= scalar_t(lhs);
             return rhs;
           },
-          py::is_operator())
-      .def("__truediv__",
-           [](const rational &lhs, const rational &rhs) { return lhs / rhs; })
-      .def("__repr__", &rational::repr)
-      .def("str", &rational::str);
+          py::is_operator());
+  return c;
+}
+} // namespace
+
+void export_rational(py::module &m) {
+  export_number<rational>(m, "rational");
+#if WICKED_FLOAT_COEFFICIENTS
+  // the coefficients are floating, and rational numbers are converted when
+  // they are passed as coefficients
+  export_number<floating>(m, "floating")
+      .def(py::init<double>())
+      .def(py::init<const rational &>());
+  py::implicitly_convertible<rational, floating>();
+#endif
 
   m.def("make_rational", &make_rational_from_str);
   m.def("use_boost_1024_int", &use_boost_1024_int,
         "Return true if 1024-bit integers are used");
-}
\ No newline at end of file
+  m.def("use_float_coefficients", &use_float_coefficients,
+        "Return true if the coefficients are double-precision numbers");
+}
@@ -0,0 +1,87 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "../wicked/algebra/expression.h"
+#include "../wicked/diagrams/operator_expression.h"
+#include "../wicked/diagrams/serialize.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+/// Return the object stored in serialized data
+py::object view_to_object(const SerializedView &view) {
+  switch (view.kind()) {
+  case SerializedKind::Expression:
+    return py::cast(view.to_expression());
+  case SerializedKind::OperatorExpression:
+    return py::cast(view.to_operator_expression());
+  case SerializedKind::Equations:
+    return py::cast(view.to_equations());
+  }
+  throw std::runtime_error("\n  Unknown kind of serialized object.");
+}
+
+/// Export the serialization functions
+void export_serialize(py::module &m) {
+  py::enum_<SerializedKind>(m, "SerializedKind")
+      .value("Expression", SerializedKind::Expression)
+      .value("OperatorExpression", SerializedKind::OperatorExpression)
+      .value("Equations", SerializedKind::Equations);
+
+  py::class_<SerializedView, std::shared_ptr<SerializedView>>(
+      m, "SerializedView")
+      .def(py::init([](const py::bytes &data) {
+             return SerializedView(std::string(data));
+           }),
+           "data"_a)
+      .def_static("open", &SerializedView::open, "filename"_a,
+                  "Map a file written by save in memory")
+      .def("kind", &SerializedView::kind)
+      .def("__len__", &SerializedView::size)
+      .def("term", &SerializedView::term, "n"_a)
+      .def("equation", &SerializedView::equation, "n"_a)
+      .def("to_expression", &SerializedView::to_expression)
+      .def("to_operator_expression", &SerializedView::to_operator_expression)
+      .def("to_equations", &SerializedView::to_equations);
+
+  m.def(
+      "serialize",
+      [](const Expression &expr) { return py::bytes(serialize(expr)); },
+      "expr"_a, "Return a compact binary representation of an expression");
+  m.def(
+      "serialize",
+      [](const OperatorExpression &expr) { return py::bytes(serialize(expr)); },
+      "expr"_a,
+      "Return a compact binary representation of an operator expression");
+  m.def(
+      "serialize",
+      [](const std::map<std::string, std::vector<Equation>> &equations) {
+        return py::bytes(serialize(equations));
+      },
+      "equations"_a,
+      "Return a compact binary representation of a set of equations");
+  m.def(
+      "deserialize",
+      [](const py::bytes &data) {
+        return view_to_object(SerializedView(std::string(data)));
+      },
+      "data"_a, "Decode the object stored in serialized data");
+
+  m.def("save",
+        py::overload_cast<const Expression &, const std::string &>(&save),
+        "expr"_a, "filename"_a);
+  m.def("save",
+        py::overload_cast<const OperatorExpression &, const std::string &>(
+            &save),
+        "expr"_a, "filename"_a);
+  m.def("save",
+        py::overload_cast<const std::map<std::string, std::vector<Equation>> &,
+                          const std::string &>(&save),
+        "equations"_a, "filename"_a);
+  m.def(
+      "load",
+      [](const std::string &filename) {
+        return view_to_object(SerializedView::open(filename));
+      },
+      "filename"_a, "Load the object stored in a file written by save");
+}
@@ -19,8 +19,10 @@ void export_Tensor(py::module &m) {
       .def("__repr__", &Tensor::str)
       .def("__str__", &Tensor::str)
       .def("label", &Tensor::label)
-      .def("lower", &Tensor::lower)
-      .def("upper", &Tensor::upper)
+      .def("lower",
+           [](const Tensor &t) { return std::vector<Index>(t.lower()); })
+      .def("upper",
+           [](const Tensor &t) { return std::vector<Index>(t.upper()); })
       .def("symmetry", &Tensor::symmetry)
       .def("latex", &Tensor::latex)
       .def("compile", &Tensor::compile);
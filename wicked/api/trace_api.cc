@@ -0,0 +1,24 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "helpers/trace.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+/// Export the tracing functions
+void export_trace(py::module &m) {
+  m.def("start_tracing", &start_tracing,
+        "Remove the events recorded and start recording the time spent in "
+        "the contractions, the steps of the algorithm, and the code "
+        "generators");
+  m.def("stop_tracing", &stop_tracing, "Stop recording events");
+  m.def("tracing_enabled", &tracing_enabled,
+        "Return True if the events are recorded");
+  m.def("trace_size", &trace_size, "Return the number of events recorded");
+  m.def("trace_json", &trace_json,
+        "Return the events recorded in the trace-event JSON format (read by "
+        "chrome://tracing and Perfetto)");
+  m.def("write_trace", &write_trace, "filename"_a,
+        "Write the events recorded to a file in the trace-event JSON format");
+}
@@ -1,14 +1,246 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 #include "../wicked/diagrams/contraction.h"
+#include "../wicked/diagrams/contraction_cache.h"
+#include "../wicked/diagrams/incremental_contraction.h"
 #include "../wicked/diagrams/operator.h"
 #include "../wicked/diagrams/operator_expression.h"
 #include "../wicked/diagrams/wick_theorem.h"
+#include "../wicked/helpers/orbital_space.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+/// An iterator over the terms generated by a contraction. The contraction runs
+/// on a separate thread (without holding the GIL) and passes the terms through
+/// a bounded queue, so at most capacity terms are held in memory
+class TermStream {
+public:
+  using job_t = std::function<void(const term_sink_t &)>;
+
+  TermStream(job_t job, size_t capacity)
+      : capacity_(std::max(capacity, size_t(1))) {
+    // the worker uses a copy of the orbital spaces active on this thread
+    auto osi_copy = std::make_shared<const OrbitalSpaceInfo>(*osi());
+    worker_ = std::thread([this, job, osi_copy]() {
+      OrbitalSpaceContext context(osi_copy);
+      try {
+        job([this](const SymbolicTerm &term, scalar_t c) { push(term, c); });
+      } catch (const Cancelled &) {
+      } catch (...) {
+        error_ = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+      cv_.notify_all();
+    });
+  }
+
+  ~TermStream() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cancelled_ = true;
+      cv_.notify_all();
+    }
+    worker_.join();
+  }
+
+  /// Return the next term or raise StopIteration
+  std::pair<SymbolicTerm, scalar_t> next() {
+    py::gil_scoped_release release;
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return done_ or not queue_.empty(); });
+    if (queue_.empty()) {
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+      throw py::stop_iteration();
+    }
+    auto term = std::move(queue_.front());
+    queue_.pop_front();
+    cv_.notify_all();
+    return term;
+  }
+
+private:
+  /// Thrown on the worker thread to stop a contraction
+  struct Cancelled {};
+
+  void push(const SymbolicTerm &term, scalar_t c) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock,
+             [this] { return cancelled_ or queue_.size() < capacity_; });
+    if (cancelled_) {
+      throw Cancelled();
+    }
+    queue_.push_back(std::make_pair(term, c));
+    cv_.notify_all();
+  }
+
+  size_t capacity_;
+  std::deque<std::pair<SymbolicTerm, scalar_t>> queue_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  bool cancelled_ = false;
+  std::exception_ptr error_;
+  std::thread worker_;
+};
+
+/// The result of a contraction that runs on a separate thread (without
+/// holding the GIL). The contraction uses a copy of a WickTheorem object, and
+/// its products are contracted on the threads set with set_nthreads
+class ContractionFuture {
+public:
+  ContractionFuture(const WickTheorem &wt, scalar_t factor,
+                    const OperatorExpression &expr, int minrank, int maxrank,
+                    py::object progress)
+      : progress_(progress), total_(expr.size()) {
+    auto wt_copy = std::make_shared<WickTheorem>(wt);
+    wt_copy->set_cancel_flag(cancelled_);
+    wt_copy->set_progress_callback([this](size_t done, size_t total) {
+      ndone_ = done;
+      if (not progress_.is_none()) {
+        py::gil_scoped_acquire acquire;
+        progress_(done, total);
+      }
+    });
+    // the worker uses a copy of the orbital spaces active on this thread
+    auto osi_copy = std::make_shared<const OrbitalSpaceInfo>(*osi());
+    worker_ = std::thread(
+        [this, wt_copy, osi_copy, factor, expr, minrank, maxrank]() {
+          OrbitalSpaceContext context(osi_copy);
+          Expression result;
+          std::exception_ptr error;
+          try {
+            result = wt_copy->contract(factor, expr, minrank, maxrank);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          std::lock_guard<std::mutex> lock(mutex_);
+          result_ = std::move(result);
+          error_ = error;
+          done_ = true;
+          cv_.notify_all();
+        });
+  }
+
+  ~ContractionFuture() {
+    cancel();
+    // the worker may be waiting for the GIL to report its progress
+    py::gil_scoped_release release;
+    worker_.join();
+  }
+
+  /// Ask the contraction to stop. Returns false if it is already done
+  bool cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (done_) {
+      return false;
+    }
+    *cancelled_ = true;
+    return true;
+  }
+
+  /// Return true if the contraction was cancelled
+  bool cancelled() const { return cancelled_->load(); }
+
+  /// Return true if the contraction is finished
+  bool done() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+  }
+
+  /// Return the number of products contracted and the total number
+  std::pair<size_t, size_t> progress() const { return {ndone_.load(), total_}; }
+
+  /// Wait for the result (at most timeout seconds if a timeout is given)
+  Expression result(std::optional<double> timeout) {
+    bool finished = true;
+    {
+      py::gil_scoped_release release;
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto is_done = [this] { return done_; };
+      if (not timeout) {
+        cv_.wait(lock, is_done);
+      } else {
+        finished = cv_.wait_for(lock, std::chrono::duration<double>(*timeout),
+                                is_done);
+      }
+    }
+    if (not finished) {
+      PyErr_SetString(PyExc_TimeoutError,
+                      "The contraction did not finish in time");
+      throw py::error_already_set();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return result_;
+  }
+
+private:
+  py::object progress_;
+  const size_t total_;
+  std::atomic<size_t> ndone_{0};
+  std::shared_ptr<std::atomic<bool>> cancelled_ =
+      std::make_shared<std::atomic<bool>>(false);
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  Expression result_;
+  std::exception_ptr error_;
+  std::thread worker_;
+};
+
+/// Convert statistics to nested dictionaries following the components of the
+/// paths. A timer is stored under the key "time" of its dictionary and a
+/// counter is stored under its last component (e.g., "step 2" and
+/// "step 2/pruned nodes" give {"step 2": {"time": t, "pruned nodes": n}})
+py::dict statistics_to_dict(const Statistics &stats) {
+  py::dict result;
+  // return the dictionary of the components of path before the last one
+  auto parent = [&](const std::string &path, std::string &name) {
+    py::dict d = result;
+    size_t begin = 0;
+    for (size_t end = path.find('/'); end != std::string::npos;
+         begin = end + 1, end = path.find('/', begin)) {
+      py::str key(path.substr(begin, end - begin));
+      if (not d.contains(key)) {
+        d[key] = py::dict();
+      }
+      d = d[key].cast<py::dict>();
+    }
+    name = path.substr(begin);
+    return d;
+  };
+  std::string name;
+  for (const auto &[path, t] : stats.times()) {
+    py::dict d = parent(path, name);
+    py::str key(name);
+    if (not d.contains(key)) {
+      d[key] = py::dict();
+    }
+    d[key].cast<py::dict>()["time"] = t;
+  }
+  for (const auto &[path, n] : stats.counts()) {
+    parent(path, name)[py::str(name)] = n;
+  }
+  return result;
+}
+
 void export_WickTheorem(py::module &m) {
   py::enum_<PrintLevel>(m, "PrintLevel")
       .value("none", PrintLevel::None)
@@ -17,14 +249,72 @@ void export_WickTheorem(py::module &m) {
       .value("detailed", PrintLevel::Detailed)
       .value("all", PrintLevel::All);
 
+  py::enum_<Connectivity>(m, "Connectivity")
+      .value("all", Connectivity::All)
+      .value("connected", Connectivity::Connected)
+      .value("linked_to_first", Connectivity::LinkedToFirst);
+
+  py::class_<ContractionCache, std::shared_ptr<ContractionCache>>(
+      m, "ContractionCache")
+      .def(py::init<>())
+      .def(py::init<const std::string &>(), "directory"_a,
+           "Create a cache that also stores the contractions in a directory")
+      .def("size", &ContractionCache::size)
+      .def("hits", &ContractionCache::hits)
+      .def("misses", &ContractionCache::misses)
+      .def("clear", &ContractionCache::clear)
+      .def("directory", &ContractionCache::directory)
+      .def("__len__", &ContractionCache::size);
+
+  py::class_<TermStream>(m, "TermStream")
+      .def(
+          "__iter__", [](TermStream &s) -> TermStream & { return s; },
+          py::return_value_policy::reference_internal)
+      .def("__next__", &TermStream::next);
+
+  m.def("balance_load", &balance_load, "costs"_a, "nparts"_a,
+        "Assign items with the given costs to nparts parts with balanced "
+        "total costs and return the part of each item");
+  m.def("schedule_by_cost", &schedule_by_cost, "costs"_a, "nthreads"_a,
+        "Order items with the given costs for nthreads threads and return "
+        "the order and the number of items to split among all the threads");
+  m.def("mpi_rank", &mpi_rank,
+        "Return the rank of this process (0 without MPI support)");
+  m.def("mpi_size", &mpi_size,
+        "Return the number of MPI processes (1 without MPI support)");
+
+  py::register_exception<ContractionCancelled>(m, "ContractionCancelled",
+                                               PyExc_RuntimeError);
+
+  py::class_<ContractionFuture>(m, "ContractionFuture")
+      .def("result", &ContractionFuture::result, "timeout"_a = py::none(),
+           "Wait for the result of the contraction (raises TimeoutError if "
+           "it is not ready after timeout seconds)")
+      .def("done", &ContractionFuture::done)
+      .def("cancel", &ContractionFuture::cancel,
+           "Stop the contraction before its next product (returns False if it "
+           "is already done)")
+      .def("cancelled", &ContractionFuture::cancelled)
+      .def("progress", &ContractionFuture::progress,
+           "Return the number of products contracted and the total number");
+
+  // the synchronous contractions keep the GIL, since they use the state of the
+  // WickTheorem object. contract_async and contract_stream release it and work
+  // on a copy
   py::class_<WickTheorem, std::shared_ptr<WickTheorem>>(m, "WickTheorem")
       .def(py::init<>())
+      .def(py::init<const std::shared_ptr<OrbitalSpaceInfo> &>(), "osi"_a)
       .def("contract",
            py::overload_cast<scalar_t, const OperatorProduct &, int, int>(
                &WickTheorem::contract))
       .def("contract",
            py::overload_cast<scalar_t, const OperatorExpression &, int, int>(
                &WickTheorem::contract))
+      .def("contract",
+           py::overload_cast<scalar_t, const LazyOperatorProduct &, int, int>(
+               &WickTheorem::contract),
+           "factor"_a, "product"_a, "minrank"_a, "maxrank"_a,
+           "Contract a product of sums of operators without expanding it")
       .def(
           "contract",
           [](WickTheorem &wt, const OperatorExpression &expr, const int minrank,
@@ -32,8 +322,157 @@ void export_WickTheorem(py::module &m) {
             return wt.contract(scalar_t(1), expr, minrank, maxrank);
           },
           "expr"_a, "minrank"_a, "maxrank"_a)
+      .def("contract",
+           py::overload_cast<scalar_t, const OperatorProduct &, int, int,
+                             const term_sink_t &>(&WickTheorem::contract),
+           "factor"_a, "ops"_a, "minrank"_a, "maxrank"_a, "sink"_a,
+           "Contract a product of operators and call sink(term, coefficient) "
+           "for each term generated")
+      .def("contract",
+           py::overload_cast<scalar_t, const OperatorExpression &, int, int,
+                             const term_sink_t &>(&WickTheorem::contract),
+           "factor"_a, "expr"_a, "minrank"_a, "maxrank"_a, "sink"_a,
+           "Contract a sum of products of operators and call "
+           "sink(term, coefficient) for each term generated")
+      .def("contract_many", &WickTheorem::contract_many, "factor"_a,
+           "requests"_a,
+           "Contract a list of (expr, minrank, maxrank) requests, contracting "
+           "each distinct product only once, and return the list of results")
+      .def("contract_bch", &WickTheorem::contract_bch, "factor"_a, "A"_a,
+           "B"_a, "n"_a, "minrank"_a, "maxrank"_a,
+           "Contract the BCH series exp(-B) A exp(B) truncated at order n "
+           "keeping only the connected terms")
+      .def("contract_distributed", &WickTheorem::contract_distributed,
+           "factor"_a, "expr"_a, "minrank"_a, "maxrank"_a,
+           "Contract a sum of products of operators on all the MPI processes "
+           "(every process returns the full result)")
+      .def("contraction_cost", &WickTheorem::contraction_cost, "ops"_a,
+           "Return an estimate of the cost of contracting a product of "
+           "operators")
+      .def(
+          "contract_async",
+          [](const WickTheorem &wt, scalar_t factor,
+             const OperatorExpression &expr, int minrank, int maxrank,
+             py::object progress) {
+            return std::make_unique<ContractionFuture>(wt, factor, expr,
+                                                       minrank, maxrank,
+                                                       progress);
+          },
+          "factor"_a, "expr"_a, "minrank"_a, "maxrank"_a,
+          "progress"_a = py::none(),
+          "Contract a sum of products of operators on a separate thread and "
+          "return a ContractionFuture. progress(done, total) is called after "
+          "each product is contracted")
+      .def(
+          "contract_stream",
+          [](const WickTheorem &wt, scalar_t factor,
+             const OperatorExpression &expr, int minrank, int maxrank,
+             size_t capacity) {
+            // the job contracts with a copy of wt, which it owns
+            auto wt_copy = std::make_shared<WickTheorem>(wt);
+            return std::make_unique<TermStream>(
+                [wt_copy, factor, expr, minrank,
+                 maxrank](const term_sink_t &sink) {
+                  wt_copy->contract(factor, expr, minrank, maxrank, sink);
+                },
+                capacity);
+          },
+          "factor"_a, "expr"_a, "minrank"_a, "maxrank"_a,
+          "capacity"_a = 1024,
+          "Return an iterator over the (term, coefficient) pairs generated by "
+          "a contraction. The terms are not combined")
       .def("set_print", &WickTheorem::set_print)
-      .def("set_max_cumulant", &WickTheorem::set_max_cumulant)
+      .def("set_max_cumulant",
+           py::overload_cast<int>(&WickTheorem::set_max_cumulant))
+      .def("set_max_cumulant",
+           py::overload_cast<char, int>(&WickTheorem::set_max_cumulant),
+           "space"_a, "val"_a,
+           "Set the maximum cumulant level in one space (replaces the global "
+           "level for this space)")
+      .def("set_max_total_cumulant", &WickTheorem::set_max_total_cumulant,
+           "val"_a, "rank"_a = 0,
+           "Limit the sum of the levels of the cumulants in the terms with "
+           "rank or more uncontracted operators")
+      .def("set_connectivity", &WickTheorem::set_connectivity,
+           "connectivity"_a,
+           "Select which contractions are generated according to how the "
+           "operators are linked")
+      .def("set_target",
+           py::overload_cast<const std::vector<int> &, const std::vector<int> &>(
+               &WickTheorem::set_target),
+           "cre"_a, "ann"_a,
+           "Generate only the terms with a given number of free creation and "
+           "annihilation operators in each space (empty lists = no target)")
+      .def("set_target",
+           py::overload_cast<const std::string &>(&WickTheorem::set_target),
+           "signature"_a,
+           "Generate only the terms with a given signature (e.g., 'oo|vv')")
+      .def("set_nthreads", &WickTheorem::set_nthreads, "n"_a,
+           "Set the number of threads used to contract an OperatorExpression "
+           "(0 = all available hardware threads)")
+      .def("nthreads", &WickTheorem::nthreads)
+      .def("set_pipeline", &WickTheorem::set_pipeline, "queue_size"_a,
+           "Process the contractions of a product on other threads while "
+           "they are generated, passing them through a queue of this size "
+           "(0 = generate all the contractions first)")
       .def("do_canonicalize_graph", &WickTheorem::do_canonicalize_graph)
-      .def("timers", &WickTheorem::timers);
+      .def("do_reuse_contractions", &WickTheorem::do_reuse_contractions,
+           "val"_a,
+           "Turn on/off the reuse of the elementary and composite "
+           "contractions of products with the same graph matrices")
+      .def("set_cache", &WickTheorem::set_cache, "cache"_a,
+           "Set a cache of contracted operator products (None = no cache)")
+      .def("cache", &WickTheorem::cache)
+      .def("set_checkpoint", &WickTheorem::set_checkpoint, "filename"_a,
+           "interval"_a = 60.0,
+           "Save the state of the contractions of sums of products to the "
+           "files filename.<generation>.<worker> every interval seconds and "
+           "resume from them ('' = no checkpoints)")
+      .def("set_memory_budget", &WickTheorem::set_memory_budget, "budget"_a,
+           "directory"_a = "",
+           "Bound the memory used to sum the terms of the products of an "
+           "expression to budget bytes (0 = no limit), writing the terms "
+           "that exceed it to files in directory")
+      .def("timers", &WickTheorem::timers,
+           "Return the timers and counters in a flat dictionary")
+      .def(
+          "statistics",
+          [](const WickTheorem &wt) {
+            return statistics_to_dict(wt.statistics());
+          },
+          "Return the timers and counters in nested dictionaries (e.g., "
+          "stats['step 2']['time'] and stats['step 2']['pruned nodes'])")
+      .def(
+          "product_statistics",
+          [](const WickTheorem &wt) {
+            py::dict result;
+            for (const auto &[key, stats] : wt.product_statistics()) {
+              result[py::str(key)] = statistics_to_dict(stats);
+            }
+            return result;
+          },
+          "Return the statistics of each product contracted, stored under "
+          "the string of the product (see do_product_statistics)")
+      .def("do_product_statistics", &WickTheorem::do_product_statistics,
+           "val"_a, "Turn on/off the collection of statistics for each product")
+      .def("reset_statistics", &WickTheorem::reset_statistics,
+           "Reset all the timers and counters");
+
+  py::class_<IncrementalContraction>(m, "IncrementalContraction")
+      .def(py::init<const WickTheorem &, scalar_t, int, int>(), "wt"_a,
+           "factor"_a, "minrank"_a, "maxrank"_a,
+           "Keep the contraction of a sum of products up to date when the "
+           "sum changes (the contractions use a copy of wt)")
+      .def("difference", &IncrementalContraction::difference, "expr"_a,
+           "Return the products that update(expr) would contract")
+      .def("update", &IncrementalContraction::update, "expr"_a,
+           "Contract the products of expr that changed, update the result, "
+           "and return the number of products contracted")
+      .def("expression", &IncrementalContraction::expression,
+           "Return the sum of products contracted")
+      .def("result", &IncrementalContraction::result,
+           "Return the contraction of the sum of products")
+      .def("wick_theorem", &IncrementalContraction::wick_theorem,
+           py::return_value_policy::reference_internal,
+           "Return the object that performs the contractions");
 }
\ No newline at end of file
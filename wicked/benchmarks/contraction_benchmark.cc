@@ -0,0 +1,296 @@
+// An end-to-end benchmark of the contraction engine. Each workload defines its
+// orbital spaces, builds an operator expression, and contracts it with a fresh
+// WickTheorem object. The timings are written in JSON.
+//
+// Usage: wicked_benchmark [--threads n] [--repeat n] [--output file]
+//                         [--list] [workload ...]
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "fmt/format.h"
+
+#include "diagrams/graph_matrix.h"
+#include "diagrams/operator.h"
+#include "diagrams/operator_expression.h"
+#include "diagrams/wick_theorem.h"
+#include "helpers/orbital_space.h"
+#include "helpers/timer.hpp"
+
+/// A contraction to benchmark
+struct Workload {
+  std::string name;
+  std::string description;
+  /// Define the orbital spaces and return the expression to contract
+  std::function<OperatorExpression()> setup;
+  int minrank;
+  int maxrank;
+};
+
+/// Define the occupied (o) and unoccupied (v) spaces
+static void single_reference_spaces() {
+  orbital_subspaces->reset();
+  orbital_subspaces->add_space('o', FieldType::Fermion, SpaceType::Occupied,
+                               {"i", "j", "k", "l", "m", "n"});
+  orbital_subspaces->add_space('v', FieldType::Fermion, SpaceType::Unoccupied,
+                               {"a", "b", "c", "d", "e", "f"});
+}
+
+/// Define the core (c), active (a), and virtual (v) spaces
+static void multireference_spaces() {
+  orbital_subspaces->reset();
+  orbital_subspaces->add_space('c', FieldType::Fermion, SpaceType::Occupied,
+                               {"m", "n", "o", "p"});
+  orbital_subspaces->add_space('a', FieldType::Fermion, SpaceType::General,
+                               {"u", "v", "w", "x", "y", "z"});
+  orbital_subspaces->add_space('v', FieldType::Fermion, SpaceType::Unoccupied,
+                               {"e", "f", "g", "h"});
+}
+
+/// Return an operator with all the components of a given rank with creation
+/// operators in cre_spaces and annihilation operators in ann_spaces (the same
+/// as utils.gen_op)
+static OperatorExpression gen_op(const std::string &label, int rank,
+                                 const std::string &cre_spaces,
+                                 const std::string &ann_spaces) {
+  // all the non-decreasing (or non-increasing) sequences of spaces
+  std::function<void(const std::string &, bool, std::vector<int> &,
+                     std::vector<std::vector<int>> &)>
+      sequences = [&](const std::string &spaces, bool increasing,
+                      std::vector<int> &seq,
+                      std::vector<std::vector<int>> &result) {
+        if (static_cast<int>(seq.size()) == rank) {
+          result.push_back(seq);
+          return;
+        }
+        for (char c : spaces) {
+          int s = osi()->label_to_space(c);
+          if (seq.empty() or (increasing ? seq.back() <= s : seq.back() >= s)) {
+            seq.push_back(s);
+            sequences(spaces, increasing, seq, result);
+            seq.pop_back();
+          }
+        }
+      };
+  std::vector<int> seq;
+  std::vector<std::vector<int>> cre, ann;
+  sequences(cre_spaces, true, seq, cre);
+  sequences(ann_spaces, false, seq, ann);
+
+  std::vector<std::string> components;
+  for (const auto &c : cre) {
+    for (const auto &a : ann) {
+      std::vector<std::string> ops;
+      for (int s : c) {
+        ops.push_back(std::string(1, osi()->label(s)) + "+");
+      }
+      for (int s : a) {
+        ops.push_back(std::string(1, osi()->label(s)));
+      }
+      components.push_back(fmt::format("{}", fmt::join(ops, " ")));
+    }
+  }
+  return make_diag_operator_expression(label, components);
+}
+
+/// Return the single-reference Hamiltonian
+static OperatorExpression hamiltonian(const std::string &spaces) {
+  return make_diag_operator_expression("E_0", {""}) +
+         gen_op("f", 1, spaces, spaces) + gen_op("v", 2, spaces, spaces);
+}
+
+/// Return the coupled cluster operator up to excitation level n
+static OperatorExpression cluster_operator(int n) {
+  std::vector<std::string> components;
+  for (int k = 1; k <= n; k++) {
+    std::string cre, ann;
+    for (int i = 0; i < k; i++) {
+      cre += "v+ ";
+      ann += " o";
+    }
+    components.push_back(cre + ann);
+  }
+  return make_diag_operator_expression("t", components);
+}
+
+static std::vector<Workload> workloads() {
+  return {
+      {"mp2", "first-order amplitude equations: H + [H,T2]",
+       [] {
+         single_reference_spaces();
+         auto T2 = make_diag_operator_expression("t", {"v+ v+ o o"});
+         return bch_series(hamiltonian("ov"), T2, 1);
+       },
+       0, 4},
+      {"ccsd", "CCSD energy and residuals: BCH series to fourth order",
+       [] {
+         single_reference_spaces();
+         return bch_series(hamiltonian("ov"), cluster_operator(2), 4);
+       },
+       0, 4},
+      {"ccsdt", "CCSDT energy and residuals: BCH series to fourth order",
+       [] {
+         single_reference_spaces();
+         return bch_series(hamiltonian("ov"), cluster_operator(3), 4);
+       },
+       0, 6},
+      {"mrccsd",
+       "MR-CCSD with a general active space: BCH series to second order",
+       [] {
+         multireference_spaces();
+         auto T = gen_op("t", 1, "av", "ca") + gen_op("t", 2, "av", "ca");
+         return bch_series(hamiltonian("cav"), T, 2);
+       },
+       0, 4},
+      {"bch", "high-order nested commutators: BCH series of H and T1 + T2 "
+              "to sixth order",
+       [] {
+         single_reference_spaces();
+         return bch_series(hamiltonian("ov"), cluster_operator(2), 6);
+       },
+       0, 4},
+  };
+}
+
+/// Return the peak resident memory of this process in MiB
+static double peak_memory_mb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in KiB on Linux and in bytes on macOS
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+/// Return the result of running a workload in JSON
+static std::string run(const Workload &workload, int nthreads, int repeat) {
+  OperatorExpression expr = workload.setup();
+
+  std::vector<double> times;
+  std::map<std::string, double> timers;
+  size_t nterms = 0;
+  for (int r = 0; r < repeat; r++) {
+    WickTheorem wt;
+    wt.set_nthreads(nthreads);
+    timer t;
+    Expression result =
+        wt.contract(scalar_t(1), expr, workload.minrank, workload.maxrank);
+    times.push_back(t.get());
+    nterms = result.size();
+    timers = wt.timers();
+  }
+
+  // the throughput is measured on the fastest run
+  const double best = *std::min_element(times.begin(), times.end());
+  const double ncontractions = timers["step 3 contractions"];
+  std::vector<std::string> timer_entries;
+  for (const auto &[label, value] : timers) {
+    timer_entries.push_back(fmt::format("\"{}\": {:.6g}", label, value));
+  }
+  return fmt::format(
+      "    {{\n"
+      "      \"name\": \"{}\",\n"
+      "      \"description\": \"{}\",\n"
+      "      \"products\": {},\n"
+      "      \"minrank\": {},\n"
+      "      \"maxrank\": {},\n"
+      "      \"wall_times\": [{:.6f}],\n"
+      "      \"best_wall_time\": {:.6f},\n"
+      "      \"timers\": {{{}}},\n"
+      "      \"contractions\": {},\n"
+      "      \"terms\": {},\n"
+      "      \"contractions_per_second\": {:.6g},\n"
+      "      \"terms_per_second\": {:.6g},\n"
+      "      \"peak_memory_mb\": {:.2f}\n"
+      "    }}",
+      workload.name, workload.description, expr.size(), workload.minrank,
+      workload.maxrank, fmt::join(times, ", "), best,
+      fmt::join(timer_entries, ", "), ncontractions, nterms,
+      ncontractions / best, nterms / best, peak_memory_mb());
+}
+
+int main(int argc, char *argv[]) {
+  int nthreads = 1;
+  int repeat = 1;
+  std::string output;
+  std::vector<std::string> selected;
+  const auto all = workloads();
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if ((arg == "--threads" or arg == "--repeat" or arg == "--output") and
+        i + 1 < argc) {
+      const std::string value = argv[++i];
+      if (arg == "--threads") {
+        nthreads = std::stoi(value);
+      } else if (arg == "--repeat") {
+        repeat = std::max(1, std::stoi(value));
+      } else {
+        output = value;
+      }
+    } else if (arg == "--list") {
+      for (const auto &w : all) {
+        std::cout << fmt::format("{:8} {}\n", w.name, w.description);
+      }
+      return 0;
+    } else if (arg.size() > 0 and arg[0] == '-') {
+      std::cerr << "Usage: " << argv[0]
+                << " [--threads n] [--repeat n] [--output file] [--list] "
+                   "[workload ...]\n";
+      return 1;
+    } else {
+      selected.push_back(arg);
+    }
+  }
+  if (selected.empty()) {
+    for (const auto &w : all) {
+      selected.push_back(w.name);
+    }
+  }
+
+  std::vector<std::string> results;
+  for (const auto &name : selected) {
+    auto it = std::find_if(all.begin(), all.end(),
+                           [&](const Workload &w) { return w.name == name; });
+    if (it == all.end()) {
+      std::cerr << "Unknown workload " << name << " (see --list)\n";
+      return 1;
+    }
+    std::cerr << "Running " << name << "..." << std::endl;
+    results.push_back(run(*it, nthreads, repeat));
+  }
+
+  // the number of threads used (0 = all the hardware threads)
+  WickTheorem wt;
+  wt.set_nthreads(nthreads);
+  const int threads = wt.nthreads();
+#if USE_BOOST_1024_INT
+  const bool boost_int = true;
+#else
+  const bool boost_int = false;
+#endif
+  const std::string json = fmt::format(
+      "{{\n"
+      "  \"threads\": {},\n"
+      "  \"repeat\": {},\n"
+      "  \"boost_1024_int\": {},\n"
+      "  \"workloads\": [\n{}\n  ]\n"
+      "}}\n",
+      threads, repeat, boost_int, fmt::join(results, ",\n"));
+
+  if (output.empty()) {
+    std::cout << json;
+  } else {
+    std::ofstream(output) << json;
+  }
+  return 0;
+}
@@ -0,0 +1,396 @@
+// Microbenchmarks of the core kernels of the library. Each kernel is run on
+// inputs of increasing size until a minimum time has passed, and the time per
+// operation is written in JSON.
+//
+// Usage: wicked_microbenchmark [--min-time seconds] [--output file]
+//                              [group ...]
+// where the groups are GraphMatrix, contraction, SymbolicTerm, rational, and
+// Expression (default = all)
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "algebra/expression.h"
+#include "algebra/symbolic_term.h"
+#include "algebra/tensor.h"
+#include "diagrams/contraction.h"
+#include "diagrams/graph_matrix.h"
+#include "diagrams/operator.h"
+#include "diagrams/operator_expression.h"
+#include "diagrams/wick_theorem.h"
+#include "helpers/orbital_space.h"
+#include "helpers/timer.hpp"
+
+/// Gives access to the private kernels of WickTheorem
+struct WickTheoremKernels {
+  /// Prepare wt to run steps 2 and 3 on ops
+  static void set_product(WickTheorem &wt, const OperatorProduct &ops) {
+    wt.set_elementary_contractions(ops,
+                                   wt.generate_elementary_contractions(ops));
+  }
+
+  /// Return the candidates for the first elementary contraction of ops
+  static size_t construct_candidates(WickTheorem &wt,
+                                     const OperatorProduct &ops) {
+    std::vector<int> a(100, -1);
+    std::vector<GraphMatrix> free_graph_matrix_vec;
+    for (const auto &op : ops) {
+      free_graph_matrix_vec.push_back(op.graph_matrix());
+    }
+    return wt
+        .construct_candidates(a, 1, wt.elementary_contractions_,
+                              free_graph_matrix_vec)
+        .size();
+  }
+
+  /// Generate the composite contractions of ops
+  static size_t generate_composite_contractions(WickTheorem &wt,
+                                                const OperatorProduct &ops,
+                                                int minrank, int maxrank) {
+    wt.generate_composite_contractions(ops, minrank, maxrank);
+    return wt.contractions_.size();
+  }
+
+  /// Canonicalize the graphs of all the composite contractions of ops
+  static size_t canonicalize_graphs(WickTheorem &wt,
+                                    const OperatorProduct &ops) {
+    size_t n = 0;
+    for (size_t c = 0; c < wt.contractions_.size(); c++) {
+      auto [canonical_ops, contraction, sign] =
+          wt.canonicalize_contraction_graph(
+              ops, wt.contractions_.view(c, wt.elementary_contractions_));
+      n += contraction.size();
+    }
+    return n;
+  }
+};
+
+namespace {
+
+/// The result of a kernel
+struct Measurement {
+  std::string kernel;
+  std::string size;
+  size_t operations;
+  double ns_per_operation;
+};
+
+/// Keeps the results of the kernels alive
+volatile size_t sink = 0;
+
+double min_time = 0.2;
+
+/// Run f, which performs nops operations, until min_time has passed and
+/// return the time per operation
+Measurement measure(const std::string &kernel, const std::string &size,
+                    size_t nops, const std::function<size_t()> &f) {
+  size_t calls = 0;
+  double elapsed = 0.0;
+  for (size_t batch = 1; elapsed < min_time; batch *= 2) {
+    timer t;
+    for (size_t n = 0; n < batch; n++) {
+      sink += f();
+    }
+    elapsed += t.get();
+    calls += batch;
+  }
+  const size_t operations = calls * std::max<size_t>(nops, 1);
+  return {kernel, size, operations, 1.0e9 * elapsed / operations};
+}
+
+void single_reference_spaces() {
+  orbital_subspaces->reset();
+  orbital_subspaces->add_space('o', FieldType::Fermion, SpaceType::Occupied,
+                               {"i", "j", "k", "l", "m", "n"});
+  orbital_subspaces->add_space('v', FieldType::Fermion, SpaceType::Unoccupied,
+                               {"a", "b", "c", "d", "e", "f"});
+}
+
+/// Return the products V T2^k
+OperatorExpression vt2k(int k) {
+  auto V = make_diag_operator_expression(
+      "v", {"o+ o+ o o", "o+ v+ v o", "v+ v+ v v", "o+ o+ v v", "v+ v+ o o"});
+  auto T2 = make_diag_operator_expression("t", {"v+ v+ o o"});
+  OperatorExpression result = V;
+  for (int i = 0; i < k; i++) {
+    result = result * T2;
+  }
+  return result;
+}
+
+void graph_matrix_kernels(std::vector<Measurement> &results) {
+  std::mt19937 rng(0);
+  for (int nspaces : {2, 4, 8}) {
+    // random graph matrices with up to 3 operators per space
+    std::vector<GraphMatrix> gms;
+    for (int n = 0; n < 1024; n++) {
+      std::vector<int> cre(nspaces), ann(nspaces);
+      for (int s = 0; s < nspaces; s++) {
+        cre[s] = rng() % 4;
+        ann[s] = rng() % 4;
+      }
+      gms.push_back(GraphMatrix(cre, ann));
+    }
+    const std::string size = fmt::format("{} spaces", nspaces);
+    results.push_back(measure("GraphMatrix +=/-=", size, gms.size(), [&] {
+      GraphMatrix sum;
+      for (const auto &gm : gms) {
+        sum += gm;
+        sum -= gm;
+        sum += gm;
+      }
+      return static_cast<size_t>(sum.num_ops());
+    }));
+    results.push_back(measure("GraphMatrix <", size, gms.size(), [&] {
+      size_t n = 0;
+      for (size_t i = 1; i < gms.size(); i++) {
+        n += gms[i - 1] < gms[i];
+      }
+      return n;
+    }));
+    results.push_back(measure("GraphMatrix ==", size, gms.size(), [&] {
+      size_t n = 0;
+      for (size_t i = 1; i < gms.size(); i++) {
+        n += gms[i - 1] == gms[i];
+      }
+      return n;
+    }));
+    results.push_back(measure("GraphMatrix contains", size, gms.size(), [&] {
+      size_t n = 0;
+      for (size_t i = 1; i < gms.size(); i++) {
+        n += gms[i - 1].contains(gms[i]);
+      }
+      return n;
+    }));
+  }
+}
+
+void contraction_kernels(std::vector<Measurement> &results) {
+  for (int k = 1; k <= 3; k++) {
+    single_reference_spaces();
+    const OperatorExpression expr = vt2k(k);
+    const std::string size = fmt::format("{} operators", k + 1);
+    // all the contractions are generated
+    const int maxrank = 4 * (k + 1);
+
+    // the kernels are run on all the products of V T2^k
+    std::vector<WickTheorem> wts(expr.size());
+    std::vector<const OperatorProduct *> products;
+    for (const auto &[ops, c] : expr.terms()) {
+      WickTheoremKernels::set_product(wts[products.size()], ops);
+      products.push_back(&ops);
+    }
+
+    results.push_back(measure("construct_candidates", size, products.size(),
+                              [&] {
+                                size_t n = 0;
+                                for (size_t i = 0; i < products.size(); i++) {
+                                  n += WickTheoremKernels::construct_candidates(
+                                      wts[i], *products[i]);
+                                }
+                                return n;
+                              }));
+
+    results.push_back(measure(
+        "generate_composite_contractions", size, products.size(), [&] {
+          size_t n = 0;
+          for (size_t i = 0; i < products.size(); i++) {
+            n += WickTheoremKernels::generate_composite_contractions(
+                wts[i], *products[i], 0, maxrank);
+          }
+          return n;
+        }));
+
+    // the graphs left by the last call are canonicalized
+    size_t ngraphs = 0;
+    for (size_t i = 0; i < products.size(); i++) {
+      ngraphs += WickTheoremKernels::generate_composite_contractions(
+          wts[i], *products[i], 0, maxrank);
+    }
+    results.push_back(
+        measure("canonicalize_contraction_graph", size, ngraphs, [&] {
+          size_t n = 0;
+          for (size_t i = 0; i < products.size(); i++) {
+            n += WickTheoremKernels::canonicalize_graphs(wts[i], *products[i]);
+          }
+          return n;
+        }));
+  }
+}
+
+void symbolic_term_kernels(std::vector<Measurement> &results) {
+  for (int k = 1; k <= 3; k++) {
+    single_reference_spaces();
+    WickTheorem wt;
+    const Expression expr =
+        wt.contract(scalar_t(1), vt2k(k), 0, 4 * (k + 1));
+    std::vector<SymbolicTerm> terms;
+    for (const auto &[term, c] : expr.terms()) {
+      terms.push_back(term);
+    }
+    results.push_back(measure("SymbolicTerm::canonicalize",
+                              fmt::format("{} tensors", k + 1), terms.size(),
+                              [&] {
+                                size_t n = 0;
+                                for (const auto &term : terms) {
+                                  SymbolicTerm copy(term);
+                                  n += copy.canonicalize() == scalar_t(1);
+                                }
+                                return n;
+                              }));
+  }
+}
+
+void rational_kernels(std::vector<Measurement> &results) {
+  std::vector<std::pair<std::string, std::vector<scalar_t>>> inputs;
+  std::vector<scalar_t> small;
+  for (int n = 1; n <= 64; n++) {
+    small.push_back(scalar_t(n % 7 + 1, n % 5 + 2));
+  }
+  inputs.push_back({"64-bit", small});
+#if USE_BOOST_1024_INT
+  // numbers that do not fit in 64 bits
+  std::vector<scalar_t> large;
+  for (int n = 1; n <= 64; n++) {
+    rational_t num = rational_t(n % 7 + 1) << 90;
+    large.push_back(scalar_t(num + 1, rational_t(n % 5 + 2) << 80));
+  }
+  inputs.push_back({"1024-bit", large});
+#endif
+  for (const auto &[size, values] : inputs) {
+    results.push_back(measure("rational +", size, values.size(), [&] {
+      scalar_t sum;
+      for (const auto &v : values) {
+        sum += v;
+      }
+      return static_cast<size_t>(sum == scalar_t(0));
+    }));
+    results.push_back(measure("rational *", size, values.size(), [&] {
+      size_t n = 0;
+      for (size_t i = 1; i < values.size(); i++) {
+        n += (values[i - 1] * values[i]) == scalar_t(1);
+      }
+      return n;
+    }));
+    results.push_back(measure("rational /", size, values.size(), [&] {
+      size_t n = 0;
+      for (size_t i = 1; i < values.size(); i++) {
+        n += (values[i - 1] / values[i]) == scalar_t(1);
+      }
+      return n;
+    }));
+  }
+}
+
+void expression_kernels(std::vector<Measurement> &results) {
+  single_reference_spaces();
+  // terms t^{v_a,v_b}_{o_i,o_j} v^{o_i,o_j}_{v_c,v_d} with distinct indices
+  auto make_term = [](int n) {
+    SymbolicTerm term;
+    std::vector<Index> occ{Index(0, n % 7), Index(0, n / 7 % 7)};
+    std::vector<Index> vir{Index(1, n / 49 % 7), Index(1, n / 343 % 7)};
+    std::vector<Index> vir2{Index(1, n / 2401 % 7 + 7),
+                            Index(1, n / 16807 % 7 + 7)};
+    term.add(Tensor("t", occ, vir, SymmetryType::Antisymmetric));
+    term.add(Tensor("v", vir2, occ, SymmetryType::Antisymmetric));
+    return term;
+  };
+  for (int nterms : {1000, 10000, 100000}) {
+    Expression base;
+    for (int n = 0; n < nterms; n++) {
+      base.add(make_term(2 * n), scalar_t(1, 2));
+    }
+    // half of the terms are already in base
+    std::vector<SymbolicTerm> terms;
+    for (int n = 0; n < nterms; n++) {
+      terms.push_back(make_term(n));
+    }
+    // the terms are added and removed in alternate calls, so expr returns to
+    // its initial state
+    Expression expr(base);
+    int sign = 1;
+    results.push_back(
+        measure("add_to_map merge", fmt::format("{} terms", nterms),
+                terms.size(), [&] {
+                  for (const auto &term : terms) {
+                    expr.add(term, scalar_t(sign, 3));
+                  }
+                  sign = -sign;
+                  return expr.size();
+                }));
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const std::vector<std::pair<std::string, std::function<void(
+                                               std::vector<Measurement> &)>>>
+      groups = {{"GraphMatrix", graph_matrix_kernels},
+                {"contraction", contraction_kernels},
+                {"SymbolicTerm", symbolic_term_kernels},
+                {"rational", rational_kernels},
+                {"Expression", expression_kernels}};
+
+  std::string output;
+  std::vector<std::string> selected;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--min-time" and i + 1 < argc) {
+      min_time = std::stod(argv[++i]);
+    } else if (arg == "--output" and i + 1 < argc) {
+      output = argv[++i];
+    } else if (std::any_of(groups.begin(), groups.end(),
+                           [&](const auto &g) { return g.first == arg; })) {
+      selected.push_back(arg);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--min-time seconds] [--output file] [group ...]\n";
+      return 1;
+    }
+  }
+
+  std::vector<std::string> entries;
+  for (const auto &[name, run] : groups) {
+    if (not selected.empty() and
+        std::find(selected.begin(), selected.end(), name) == selected.end()) {
+      continue;
+    }
+    std::cerr << "Running the " << name << " kernels..." << std::endl;
+    std::vector<Measurement> results;
+    run(results);
+    for (const auto &m : results) {
+      entries.push_back(fmt::format(
+          "    {{\"kernel\": \"{}\", \"size\": \"{}\", \"operations\": {}, "
+          "\"ns_per_operation\": {:.4g}}}",
+          m.kernel, m.size, m.operations, m.ns_per_operation));
+    }
+  }
+
+#if USE_BOOST_1024_INT
+  const bool boost_int = true;
+#else
+  const bool boost_int = false;
+#endif
+  const std::string json =
+      fmt::format("{{\n"
+                  "  \"boost_1024_int\": {},\n"
+                  "  \"kernels\": [\n{}\n  ]\n"
+                  "}}\n",
+                  boost_int, fmt::join(entries, ",\n"));
+
+  if (output.empty()) {
+    std::cout << json;
+  } else {
+    std::ofstream(output) << json;
+  }
+  return 0;
+}
@@ -0,0 +1,206 @@
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "fmt/format.h"
+#include "helpers/helpers.h"
+#include "helpers/trace.h"
+
+#include "checkpoint.h"
+#include "serialize.h"
+
+namespace fs = std::filesystem;
+
+//
+// Binary format of a checkpoint file (all integers are little-endian as
+// written by the host):
+//   magic, version, key, number of products contracted, their positions,
+//   the sum of their terms (as written by serialize)
+//
+
+namespace {
+/// Identifies the checkpoint files
+const char checkpoint_file_magic[] = {'W', 'K', 'C', 'P'};
+const uint32_t checkpoint_file_version = 1;
+
+void write_uint64(std::ostream &os, uint64_t n) {
+  os.write(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+bool read_uint64(std::istream &is, uint64_t &n) {
+  return static_cast<bool>(is.read(reinterpret_cast<char *>(&n), sizeof(n)));
+}
+
+void write_string(std::ostream &os, const std::string &s) {
+  write_uint64(os, s.size());
+  os.write(s.data(), s.size());
+}
+
+bool read_string(std::istream &is, std::string &s) {
+  uint64_t size;
+  if (not read_uint64(is, size)) {
+    return false;
+  }
+  s.resize(size);
+  return static_cast<bool>(is.read(s.data(), size));
+}
+
+/// Read a checkpoint file. Returns false if the file is not valid or if it was
+/// written for a different contraction
+bool read_checkpoint(const std::string &file_name, const std::string &key,
+                     std::vector<uint64_t> &done, std::string &data) {
+  std::ifstream file(file_name, std::ios::binary);
+  char magic[sizeof(checkpoint_file_magic)];
+  if (not file.read(magic, sizeof(magic)) or
+      not std::equal(magic, magic + sizeof(magic), checkpoint_file_magic)) {
+    return false;
+  }
+  uint32_t version;
+  if (not file.read(reinterpret_cast<char *>(&version), sizeof(version)) or
+      (version != checkpoint_file_version)) {
+    return false;
+  }
+  std::string file_key;
+  uint64_t ndone;
+  if (not(read_string(file, file_key) and (file_key == key) and
+          read_uint64(file, ndone))) {
+    return false;
+  }
+  done.resize(ndone);
+  for (auto &n : done) {
+    if (not read_uint64(file, n)) {
+      return false;
+    }
+  }
+  return read_string(file, data);
+}
+
+/// Parse the suffix <generation>.<worker> of the name of a checkpoint file,
+/// where both numbers are made of digits only. Returns false if the suffix has
+/// another form
+bool parse_checkpoint_suffix(const std::string &suffix, int &generation) {
+  const char *begin = suffix.data();
+  const char *end = begin + suffix.size();
+  if ((begin == end) or not is_digit_char(*begin)) {
+    return false;
+  }
+  const auto [dot, gen_ec] = std::from_chars(begin, end, generation);
+  if ((gen_ec != std::errc()) or (end - dot < 2) or (*dot != '.') or
+      not is_digit_char(dot[1])) {
+    return false;
+  }
+  int worker;
+  const auto [last, worker_ec] = std::from_chars(dot + 1, end, worker);
+  return (worker_ec == std::errc()) and (last == end);
+}
+
+/// Call fn(path, generation) for each file named filename.<generation>.<worker>
+template <class Fn>
+void for_each_checkpoint(const std::string &filename, const Fn &fn) {
+  const fs::path path(filename);
+  const fs::path directory =
+      path.has_parent_path() ? path.parent_path() : fs::path(".");
+  std::error_code ec;
+  if (not fs::is_directory(directory, ec)) {
+    return;
+  }
+  const std::string prefix = path.filename().string() + ".";
+  for (const auto &entry : fs::directory_iterator(directory, ec)) {
+    const std::string name = entry.path().filename().string();
+    int generation;
+    if ((name.compare(0, prefix.size(), prefix) == 0) and
+        parse_checkpoint_suffix(name.substr(prefix.size()), generation)) {
+      fn(entry.path().string(), generation);
+    }
+  }
+}
+} // namespace
+
+RestoredCheckpoint restore_checkpoints(const std::string &filename,
+                                       const std::string &key,
+                                       size_t nproducts) {
+  TraceScope trace("restore checkpoints", "checkpoint");
+  RestoredCheckpoint restored;
+  restored.done.assign(nproducts, false);
+  std::vector<uint64_t> done;
+  std::string data;
+  for_each_checkpoint(filename, [&](const std::string &file_name,
+                                    int generation) {
+    // the files of every contraction are kept, so new files must not reuse
+    // the name of any of them
+    restored.next_generation =
+        std::max(restored.next_generation, generation + 1);
+    if (not read_checkpoint(file_name, key, done, data)) {
+      return;
+    }
+    // the products of a file whose terms cannot be read are contracted again
+    Expression sum;
+    try {
+      sum = deserialize_expression(data);
+    } catch (const std::exception &) {
+      return;
+    }
+    for (uint64_t n : done) {
+      if ((n >= nproducts) or restored.done[n]) {
+        throw std::runtime_error("restore_checkpoints: the file " + file_name +
+                                 " is not consistent with the other "
+                                 "checkpoint files");
+      }
+    }
+    for (uint64_t n : done) {
+      restored.done[n] = true;
+    }
+    restored.ndone += done.size();
+    restored.sum += std::move(sum);
+  });
+  return restored;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &filename,
+                                   const std::string &key, int generation,
+                                   int worker, double interval)
+    : filename_(filename.empty() ? std::string()
+                                 : fmt::format("{}.{}.{}", filename,
+                                               generation, worker)),
+      key_(key), interval_(interval) {}
+
+void CheckpointWriter::done(uint64_t n, const HashedExpression &sum) {
+  if (filename_.empty()) {
+    return;
+  }
+  done_.push_back(n);
+  if (timer_.get() >= interval_) {
+    save(sum);
+  }
+}
+
+void CheckpointWriter::save(const HashedExpression &sum) {
+  if (filename_.empty() or (done_.size() == nsaved_)) {
+    return;
+  }
+  TraceScope trace("save checkpoint", "checkpoint");
+  Expression expr;
+  sum.add_to(expr);
+  const std::string tmp_name =
+      fmt::format("{}.tmp{:08x}", filename_, std::random_device{}());
+  {
+    std::ofstream file(tmp_name, std::ios::binary);
+    file.write(checkpoint_file_magic, sizeof(checkpoint_file_magic));
+    file.write(reinterpret_cast<const char *>(&checkpoint_file_version),
+               sizeof(checkpoint_file_version));
+    write_string(file, key_);
+    write_uint64(file, done_.size());
+    for (uint64_t n : done_) {
+      write_uint64(file, n);
+    }
+    write_string(file, serialize(expr));
+    if (not file) {
+      throw std::runtime_error("CheckpointWriter: could not write " +
+                               tmp_name);
+    }
+  }
+  fs::rename(tmp_name, filename_);
+  nsaved_ = done_.size();
+  timer_.reset();
+}
@@ -0,0 +1,67 @@
+#ifndef _wicked_checkpoint_h_
+#define _wicked_checkpoint_h_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../algebra/expression.h"
+#include "helpers/timer.hpp"
+
+/// The state of a contraction of a sum of products restored from the
+/// checkpoint files of a previous run
+struct RestoredCheckpoint {
+  /// For each product (by position), true if it was contracted
+  std::vector<bool> done;
+  /// The number of products contracted
+  size_t ndone = 0;
+  /// The sum of the terms of the products contracted
+  HashedExpression sum;
+  /// The generation of the files written by the next run
+  int next_generation = 0;
+};
+
+/// Read the checkpoint files filename.<generation>.<worker> written for the
+/// contraction identified by key, which has nproducts products. Files written
+/// for other contractions are ignored, but their generation is not reused.
+/// The files whose terms cannot be read are ignored too, and their products
+/// are not marked as done
+RestoredCheckpoint restore_checkpoints(const std::string &filename,
+                                       const std::string &key,
+                                       size_t nproducts);
+
+/// Saves the products contracted by a worker and the sum of their terms to
+/// the file filename.<generation>.<worker> at most every interval seconds.
+/// Each file holds only the products contracted by one worker in one run, so
+/// the files of the workers and of successive runs can be combined in any
+/// order. Files are written to a temporary name and renamed, so a file is
+/// never partially written
+class CheckpointWriter {
+public:
+  /// Constructor. Does nothing if filename is empty
+  CheckpointWriter(const std::string &filename, const std::string &key,
+                   int generation, int worker, double interval);
+
+  /// Record that the product at position n was contracted and its terms
+  /// added to sum, and save if the interval has elapsed
+  void done(uint64_t n, const HashedExpression &sum);
+
+  /// Save the products contracted so far and their sum
+  void save(const HashedExpression &sum);
+
+private:
+  /// The name of the file ("" = no checkpoints)
+  std::string filename_;
+  /// The key of the contraction
+  std::string key_;
+  /// The minimum time between two saves
+  double interval_;
+  /// The positions of the products contracted
+  std::vector<uint64_t> done_;
+  /// The number of products saved
+  size_t nsaved_ = 0;
+  /// The time since the last save
+  timer timer_;
+};
+
+#endif // _wicked_checkpoint_h_
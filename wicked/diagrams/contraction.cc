@@ -13,8 +13,9 @@ int ElementaryContraction::num_ops() const {
 std::vector<int>
 ElementaryContraction::spaces_in_elementary_contraction() const {
   std::vector<int> vec;
+  const int nspaces = osi()->num_spaces();
   for (const auto &graph_matrix : elements_) {
-    for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+    for (int s = 0; s < nspaces; ++s) {
       if (graph_matrix.ann(s) + graph_matrix.cre(s) > 0) {
         vec.push_back(s);
       }
@@ -22,3 +23,11 @@ ElementaryContraction::spaces_in_elementary_contraction() const {
   }
   return vec;
 }
+
+CompositeContraction CompositeContractionView::to_composite_contraction() const {
+  CompositeContraction result;
+  for (const auto &el_contr : *this) {
+    result.push_back(el_contr);
+  }
+  return result;
+}
@@ -32,4 +32,107 @@ public:
   CompositeContraction() : Product<ElementaryContraction>() {}
 };
 
+/// A composite contraction that refers to a vector of elementary contractions
+/// by index instead of storing copies of them. The view does not own the
+/// elementary contractions or the indices
+class CompositeContractionView {
+public:
+  class const_iterator {
+  public:
+    const_iterator(const std::vector<ElementaryContraction> *elementary,
+                   const int *index)
+        : elementary_(elementary), index_(index) {}
+    const ElementaryContraction &operator*() const {
+      return (*elementary_)[*index_];
+    }
+    const_iterator &operator++() {
+      ++index_;
+      return *this;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return index_ != other.index_;
+    }
+
+  private:
+    const std::vector<ElementaryContraction> *elementary_;
+    const int *index_;
+  };
+
+  /// Constructor. The contraction is made of the elementary contractions
+  /// elementary[*first], ..., elementary[*(last - 1)]
+  CompositeContractionView(const std::vector<ElementaryContraction> &elementary,
+                           const int *first, const int *last)
+      : elementary_(&elementary), first_(first), last_(last) {}
+
+  /// The number of elementary contractions
+  size_t size() const { return last_ - first_; }
+
+  /// Return the n-th elementary contraction
+  const ElementaryContraction &operator[](size_t n) const {
+    return (*elementary_)[first_[n]];
+  }
+
+  const_iterator begin() const { return const_iterator(elementary_, first_); }
+  const_iterator end() const { return const_iterator(elementary_, last_); }
+
+  /// Return a copy of this contraction
+  CompositeContraction to_composite_contraction() const;
+
+private:
+  const std::vector<ElementaryContraction> *elementary_;
+  const int *first_;
+  const int *last_;
+};
+
+/// A list of composite contractions stored as indices of elementary
+/// contractions in compressed sparse row format. The indices of the n-th
+/// contraction are stored in indices_[offsets_[n]], ...,
+/// indices_[offsets_[n + 1] - 1], so the list uses two allocations in total
+class CompositeContractionList {
+public:
+  /// Constructor
+  CompositeContractionList() : offsets_(1, 0) {}
+
+  /// The number of composite contractions
+  size_t size() const { return offsets_.size() - 1; }
+
+  /// Remove all the contractions
+  void clear() {
+    offsets_.assign(1, 0);
+    indices_.clear();
+  }
+
+  /// Add a contraction made of the elementary contractions first, ..., last - 1
+  void push_back(const int *first, const int *last) {
+    indices_.insert(indices_.end(), first, last);
+    offsets_.push_back(indices_.size());
+  }
+
+  /// Add all the contractions of another list
+  void append(const CompositeContractionList &other) {
+    const size_t shift = indices_.size();
+    indices_.insert(indices_.end(), other.indices_.begin(),
+                    other.indices_.end());
+    for (size_t n = 1; n < other.offsets_.size(); n++) {
+      offsets_.push_back(shift + other.offsets_[n]);
+    }
+  }
+
+  /// Return a pointer to the first index of the n-th contraction
+  const int *begin(size_t n) const { return indices_.data() + offsets_[n]; }
+
+  /// Return a pointer past the last index of the n-th contraction
+  const int *end(size_t n) const { return indices_.data() + offsets_[n + 1]; }
+
+  /// Return a view of the n-th contraction
+  CompositeContractionView
+  view(size_t n, const std::vector<ElementaryContraction> &elementary) const {
+    return CompositeContractionView(elementary, begin(n), end(n));
+  }
+
+private:
+  std::vector<size_t> offsets_;
+  std::vector<int> indices_;
+};
+
 #endif // _wicked_contraction_h_
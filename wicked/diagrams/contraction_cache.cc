@@ -0,0 +1,153 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "fmt/format.h"
+#include "helpers/helpers.h"
+
+#include "contraction_cache.h"
+#include "serialize.h"
+
+namespace fs = std::filesystem;
+
+ContractionCache::ContractionCache(const std::string &directory)
+    : directory_(directory) {
+  fs::create_directories(directory_);
+}
+
+/// Return the name of the file that stores the contraction of a key. The key
+/// itself is stored in a file with the extension ".key", so that two keys with
+/// the same hash are told apart
+static std::string contraction_file_name(const std::string &directory,
+                                         const std::string &key) {
+  return (fs::path(directory) / fmt::format("{:016x}", fnv1a_hash(key)))
+      .string();
+}
+
+/// Read the contraction of a key saved by write_contraction. Returns false
+/// if the files do not exist, were written for a different key, or are not
+/// valid, so that a corrupt file is a cache miss
+static bool read_contraction(const std::string &file_name,
+                             const std::string &key, Expression &result) {
+  // a key of a different size is not read
+  std::error_code ec;
+  const auto key_size = fs::file_size(file_name + ".key", ec);
+  if (ec or key_size != key.size()) {
+    return false;
+  }
+  std::ifstream key_file(file_name + ".key", std::ios::binary);
+  std::string stored_key(key.size(), '\0');
+  if (not key_file.read(stored_key.data(), stored_key.size()) or
+      stored_key != key) {
+    return false;
+  }
+  try {
+    result = SerializedView::open(file_name + ".wkc").to_expression();
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+/// Write a file to a temporary file and rename it, so that other processes
+/// never read a partially written file. Returns false if the file could not
+/// be written
+template <class Write>
+static bool write_atomically(const std::string &file_name, const Write &write) {
+  const std::string tmp_name =
+      fmt::format("{}.tmp{:08x}", file_name, std::random_device{}());
+  std::error_code ec;
+  try {
+    write(tmp_name);
+  } catch (const std::exception &) {
+    fs::remove(tmp_name, ec);
+    return false;
+  }
+  fs::rename(tmp_name, file_name, ec);
+  if (ec) {
+    fs::remove(tmp_name, ec);
+    return false;
+  }
+  return true;
+}
+
+/// Save the contraction of a key. The key is written first, so the data
+/// found next to a key always belongs to it (up to a hash collision between
+/// processes that write at the same time)
+static void write_contraction(const std::string &file_name,
+                              const std::string &key,
+                              const Expression &result) {
+  // the cache is only an optimization, so a contraction that cannot be saved
+  // is kept in memory only
+  if (write_atomically(file_name + ".key", [&](const std::string &name) {
+        std::ofstream file(name, std::ios::binary);
+        if (not file.write(key.data(), key.size())) {
+          throw std::runtime_error("\n  Could not write the file " + name);
+        }
+      })) {
+    write_atomically(file_name + ".wkc",
+                     [&](const std::string &name) { save(result, name); });
+  }
+}
+
+// The files are read and written without holding the lock, so that threads
+// that find contractions in memory do not wait for the disk. The directory is
+// set by the constructor and never changes
+
+bool ContractionCache::find(const std::string &key, Expression &result) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+      hits_++;
+      result = it->second;
+      return true;
+    }
+  }
+  const bool found =
+      not directory_.empty() and
+      read_contraction(contraction_file_name(directory_, key), key, result);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (found) {
+    hits_++;
+    cache_.try_emplace(key, result);
+  } else {
+    misses_++;
+  }
+  return found;
+}
+
+void ContractionCache::insert(const std::string &key,
+                              const Expression &result) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_[key] = result;
+  }
+  if (not directory_.empty()) {
+    write_contraction(contraction_file_name(directory_, key), key, result);
+  }
+}
+
+const std::string &ContractionCache::directory() const { return directory_; }
+
+void ContractionCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+size_t ContractionCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.size();
+}
+
+size_t ContractionCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+size_t ContractionCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
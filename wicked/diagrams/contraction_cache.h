@@ -0,0 +1,59 @@
+#ifndef _wicked_contraction_cache_h_
+#define _wicked_contraction_cache_h_
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "../algebra/expression.h"
+
+/// A thread-safe cache of contracted operator products. The results are
+/// stored for a unit factor and can be shared by several WickTheorem objects.
+/// If a directory is given, the results are also saved to disk with save (one
+/// file per contraction, next to a file that stores its key) and can be reused
+/// by other processes
+class ContractionCache {
+public:
+  /// Constructor. Keeps the results in memory only
+  ContractionCache() = default;
+
+  /// Constructor. Keeps the results in memory and in the directory
+  /// (created if it does not exist)
+  explicit ContractionCache(const std::string &directory);
+
+  /// Look up the contraction stored under key (in memory first, then on
+  /// disk). Returns true and copies the result if it is found
+  bool find(const std::string &key, Expression &result);
+
+  /// Store the result of a contraction
+  void insert(const std::string &key, const Expression &result);
+
+  /// Remove all the contractions stored in memory and reset the counters.
+  /// The files on disk are not removed
+  void clear();
+
+  /// The directory used to store the contractions ("" = memory only)
+  const std::string &directory() const;
+
+  /// The number of stored contractions
+  size_t size() const;
+
+  /// The number of successful lookups
+  size_t hits() const;
+
+  /// The number of unsuccessful lookups
+  size_t misses() const;
+
+private:
+  /// The stored contractions
+  std::map<std::string, Expression> cache_;
+  /// The directory used to store the contractions
+  std::string directory_;
+  /// Counters of lookups
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  /// Protects the data of this object
+  mutable std::mutex mutex_;
+};
+
+#endif // _wicked_contraction_cache_h_
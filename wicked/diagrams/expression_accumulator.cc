@@ -0,0 +1,160 @@
+#include <filesystem>
+#include <queue>
+#include <random>
+
+#include "fmt/format.h"
+#include "helpers/trace.h"
+
+#include "expression_accumulator.h"
+#include "serialize.h"
+
+namespace fs = std::filesystem;
+
+ExpressionAccumulator::ExpressionAccumulator(size_t budget,
+                                             const std::string &directory)
+    : budget_(budget),
+      directory_(directory.empty() ? fs::temp_directory_path().string()
+                                   : directory) {}
+
+ExpressionAccumulator::~ExpressionAccumulator() {
+  for (const auto &run : runs_) {
+    std::error_code ec;
+    fs::remove(run, ec);
+  }
+}
+
+AddOutcome ExpressionAccumulator::add(SymbolicTerm &&term, scalar_t c) {
+  const size_t size = term_memory_size(term);
+  const AddOutcome outcome = terms_.add(std::move(term), c);
+  check_budget(outcome, size);
+  return outcome;
+}
+
+AddOutcome ExpressionAccumulator::add(const SymbolicTerm &term, scalar_t c) {
+  const AddOutcome outcome = terms_.add(term, c);
+  check_budget(outcome, term_memory_size(term));
+  return outcome;
+}
+
+size_t ExpressionAccumulator::term_memory_size(const SymbolicTerm &term) {
+  // a node of the hash table stores the term, its factor, the hash, and the
+  // pointer to the next node, and the table stores one pointer per bucket
+  return sizeof(std::pair<const SymbolicTerm, scalar_t>) + 3 * sizeof(void *) +
+         term.ops().size() * sizeof(SQOperator) +
+         term.tensors().size() * sizeof(Tensor);
+}
+
+void ExpressionAccumulator::check_budget(AddOutcome outcome, size_t size) {
+  if (outcome == AddOutcome::Inserted) {
+    memory_size_ += size;
+  } else if (outcome == AddOutcome::Cancelled) {
+    memory_size_ -= std::min(memory_size_, size);
+  }
+  if ((budget_ > 0) and (memory_size_ > budget_)) {
+    spill();
+  }
+}
+
+void ExpressionAccumulator::spill() {
+  TraceScope trace("spill terms", "algebra");
+  if (trace.active()) {
+    trace.add_arg("terms", std::to_string(terms_.size()));
+  }
+  // the terms are sorted by moving them to an Expression
+  Expression sorted;
+  nspilled_ += terms_.size();
+  std::move(terms_).add_to(sorted);
+  memory_size_ = 0;
+  const std::string name =
+      (fs::path(directory_) / fmt::format("wicked_run_{:08x}_{}",
+                                          std::random_device{}(), nruns_))
+          .string();
+  runs_.push_back(name);
+  nruns_ += 1;
+  save(sorted, name);
+}
+
+Expression ExpressionAccumulator::result() {
+  TraceScope trace("merge runs", "algebra");
+  if (trace.active()) {
+    trace.add_arg("runs", std::to_string(runs_.size()));
+  }
+  Expression memory;
+  std::move(terms_).add_to(memory);
+  memory_size_ = 0;
+  if (runs_.empty()) {
+    return memory;
+  }
+
+  // the sources are the runs followed by the terms in memory, and each one
+  // is read in order
+  std::vector<SerializedView> views;
+  for (const auto &run : runs_) {
+    views.push_back(SerializedView::open(run));
+  }
+  std::vector<size_t> positions(views.size(), 0);
+  auto read = [&](size_t s, SymbolicTerm &term, scalar_t &c) {
+    if (s == views.size()) {
+      if (memory.size() == 0) {
+        return false;
+      }
+      auto node = memory.terms().extract(memory.terms().begin());
+      term = std::move(node.key());
+      c = node.mapped();
+      return true;
+    }
+    if (positions[s] == views[s].size()) {
+      return false;
+    }
+    std::tie(term, c) = views[s].term(positions[s]++);
+    return true;
+  };
+
+  // the next term of each source, ordered by term
+  struct Head {
+    SymbolicTerm term;
+    scalar_t c;
+    size_t source;
+  };
+  auto greater = [](const Head &a, const Head &b) { return b.term < a.term; };
+  std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(
+      greater);
+  auto advance = [&](size_t s) {
+    Head head{SymbolicTerm(), scalar_t(0), s};
+    if (read(s, head.term, head.c)) {
+      heads.push(std::move(head));
+    }
+  };
+  for (size_t s = 0; s <= views.size(); s++) {
+    advance(s);
+  }
+
+  // equal terms are next to each other in the merged sequence
+  Expression result;
+  while (not heads.empty()) {
+    Head head = heads.top();
+    heads.pop();
+    advance(head.source);
+    while ((not heads.empty()) and (heads.top().term == head.term)) {
+      head.c += heads.top().c;
+      const size_t s = heads.top().source;
+      heads.pop();
+      advance(s);
+      nmerged_ += 1;
+    }
+    if (head.c == 0) {
+      ncancelled_ += 1;
+      continue;
+    }
+    result.terms().emplace_hint(result.terms().end(), std::move(head.term),
+                                head.c);
+  }
+
+  views.clear();
+  for (const auto &run : runs_) {
+    std::error_code ec;
+    fs::remove(run, ec);
+  }
+  runs_.clear();
+  return result;
+}
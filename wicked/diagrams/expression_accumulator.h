@@ -0,0 +1,86 @@
+#ifndef _wicked_expression_accumulator_h_
+#define _wicked_expression_accumulator_h_
+
+#include <string>
+#include <vector>
+
+#include "../algebra/expression.h"
+
+/// Sums terms using a bounded amount of memory. The terms are combined in a
+/// hash table until its estimated size exceeds the budget. The table is then
+/// sorted and written to a file (a run), and result combines the runs and the
+/// terms left in memory with a k-way merge. Terms that cancel are dropped
+/// during the merge, so the sum can be computed whenever the result fits in
+/// memory, even if the terms generated before the cancellations do not. The
+/// runs are written with save and removed when they are merged or when this
+/// object is destroyed
+class ExpressionAccumulator {
+public:
+  // ==> Constructors <==
+
+  /// Constructor. budget is the number of bytes of terms kept in memory (0 =
+  /// no limit) and directory is where the runs are written ("" = the
+  /// temporary directory of the system)
+  explicit ExpressionAccumulator(size_t budget,
+                                 const std::string &directory = "");
+
+  ExpressionAccumulator(const ExpressionAccumulator &) = delete;
+  ExpressionAccumulator &operator=(const ExpressionAccumulator &) = delete;
+
+  /// Destructor. Removes the runs that were not merged
+  ~ExpressionAccumulator();
+
+  // ==> Class public interface <==
+
+  /// Add c * term. Returns the outcome of adding the term to the terms in
+  /// memory (terms written to runs are combined only by result)
+  AddOutcome add(SymbolicTerm &&term, scalar_t c);
+  AddOutcome add(const SymbolicTerm &term, scalar_t c);
+
+  /// Return the estimated number of bytes used by the terms in memory
+  size_t memory_size() const { return memory_size_; }
+
+  /// Return the number of runs written
+  size_t nruns() const { return nruns_; }
+
+  /// Return the number of terms written to the runs
+  size_t nspilled() const { return nspilled_; }
+
+  /// Return the number of terms combined with an equal term and the number of
+  /// terms removed because their factor vanished when the runs were merged
+  size_t nmerged() const { return nmerged_; }
+  size_t ncancelled() const { return ncancelled_; }
+
+  /// Merge the runs and the terms in memory and return the sum. This object
+  /// is left empty
+  Expression result();
+
+  /// Return the estimated number of bytes used to store a term in memory
+  static size_t term_memory_size(const SymbolicTerm &term);
+
+private:
+  /// Sort the terms in memory and write them to a new run
+  void spill();
+
+  /// Spill the terms if they exceed the budget
+  void check_budget(AddOutcome outcome, size_t size);
+
+  // ==> Class private data <==
+
+  /// The maximum number of bytes of terms in memory (0 = no limit)
+  size_t budget_;
+  /// The directory of the runs
+  std::string directory_;
+  /// The terms in memory
+  HashedExpression terms_;
+  /// The estimated number of bytes used by terms_
+  size_t memory_size_ = 0;
+  /// The names of the runs not yet merged
+  std::vector<std::string> runs_;
+  size_t nruns_ = 0;
+  size_t nspilled_ = 0;
+  size_t nmerged_ = 0;
+  size_t ncancelled_ = 0;
+};
+
+#endif // _wicked_expression_accumulator_h_
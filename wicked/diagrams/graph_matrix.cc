@@ -11,73 +11,83 @@ GraphMatrix::GraphMatrix() {}
 
 GraphMatrix::GraphMatrix(const std::vector<int> &cre,
                          const std::vector<int> &ann) {
-  for (int i = 0; i < orbital_subspaces->num_spaces(); i++) {
-    elements_[i] = std::make_pair(cre[i], ann[i]);
+  for (int i = 0, nspaces = osi()->num_spaces(); i < nspaces; i++) {
+    set_cre(i, cre[i]);
+    set_ann(i, ann[i]);
   }
 }
 
-const GraphMatrix::graph_matrix_t &GraphMatrix::elements() const {
-  return elements_;
+GraphMatrix::graph_matrix_t GraphMatrix::elements() const {
+  graph_matrix_t result;
+  for (int s = 0; s < max_spaces_; s++) {
+    result[s] = elements(s);
+  }
+  return result;
 }
 
-const std::pair<int, int> &GraphMatrix::elements(int space) const {
-  return elements_[space];
+std::pair<int, int> GraphMatrix::elements(int space) const {
+  return std::make_pair(cre(space), ann(space));
 }
 
-int GraphMatrix::cre(int space) const { return elements_[space].first; }
+int GraphMatrix::cre(int space) const { return get(space, false); }
 
-int GraphMatrix::ann(int space) const { return elements_[space].second; }
+int GraphMatrix::ann(int space) const { return get(space, true); }
 
 void GraphMatrix::set_cre(int space, int value) {
-  elements_[space].first = value;
+  assert((value >= 0) and (value < 128));
+  set(space, false, value);
 }
 
 void GraphMatrix::set_ann(int space, int value) {
-  elements_[space].second = value;
+  assert((value >= 0) and (value < 128));
+  set(space, true, value);
 }
 
 int GraphMatrix::num_ops(int space) const { return cre(space) + ann(space); }
 
 int GraphMatrix::num_ops() const {
-  int r = 0;
-  for (const auto &pair : elements_) {
-    r += pair.first + pair.second;
+  // add the fields in pairs, then add the 16-bit sums
+  constexpr uint64_t even_bytes = 0x00FF00FF00FF00FFULL;
+  uint64_t sum = 0;
+  for (int w = 0; w < num_words_; w++) {
+    sum += (words_[w] & even_bytes) + ((words_[w] >> 8) & even_bytes);
   }
-  return r;
+  return static_cast<int>((sum * 0x0001000100010001ULL) >> 48);
 }
 
 bool GraphMatrix::operator<(GraphMatrix const &other) const {
-  return elements_ < other.elements_;
+  return words_ < other.words_;
 }
 
 bool GraphMatrix::operator==(GraphMatrix const &other) const {
-  return elements_ == other.elements_;
+  return words_ == other.words_;
 }
 
 bool GraphMatrix::operator!=(GraphMatrix const &other) const {
-  return elements_ != other.elements_;
+  return words_ != other.words_;
 }
 
+// The fields never overflow or become negative, so the counts can be added and
+// subtracted as whole words
 GraphMatrix &GraphMatrix::operator+=(const GraphMatrix &rhs) {
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
-    elements_[s].first += rhs.elements_[s].first;
-    elements_[s].second += rhs.elements_[s].second;
+  for (int w = 0; w < num_words_; w++) {
+    words_[w] += rhs.words_[w];
   }
   return *this;
 }
 
 GraphMatrix &GraphMatrix::operator-=(const GraphMatrix &rhs) {
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
-    elements_[s].first -= rhs.elements_[s].first;
-    elements_[s].second -= rhs.elements_[s].second;
+  assert(contains(rhs));
+  for (int w = 0; w < num_words_; w++) {
+    words_[w] -= rhs.words_[w];
   }
   return *this;
 }
 
 GraphMatrix GraphMatrix::adjoint() const {
-  std::vector<int> cre_v(orbital_subspaces->num_spaces(), 0);
-  std::vector<int> ann_v(orbital_subspaces->num_spaces(), 0);
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  std::vector<int> cre_v(osi()->num_spaces(), 0);
+  std::vector<int> ann_v(osi()->num_spaces(), 0);
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     cre_v[s] = ann(s);
     ann_v[s] = cre(s);
   }
@@ -86,24 +96,24 @@ GraphMatrix GraphMatrix::adjoint() const {
 
 std::string GraphMatrix::str() const {
   // std::vector<std::string> cv, av;
-  // for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  // for (int s = 0; s < osi()->num_spaces(); ++s) {
   //   cv.push_back(to_string(cre(s)));
   // }
-  // for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  // for (int s = 0; s < osi()->num_spaces(); ++s) {
   //   av.push_back(to_string(ann(s)));
   // }
   // return "[" + join(cv, " ") + "|" + join(av, " ") + "]";
 
   std::vector<std::string> cv, av;
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     for (int i = 0; i < cre(s); ++i) {
-      std::string op_s(1, orbital_subspaces->label(s));
+      std::string op_s(1, osi()->label(s));
       cv.push_back(op_s + "+");
     }
   }
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     for (int i = 0; i < ann(s); ++i) {
-      std::string op_s(1, orbital_subspaces->label(s));
+      std::string op_s(1, osi()->label(s));
       cv.push_back(op_s);
     }
   }
@@ -123,7 +133,7 @@ int sum_num_ops(const std::vector<GraphMatrix> &graph_matrices) {
 std::string to_string(const std::vector<GraphMatrix> &elements_vec) {
   // print the creation operator above
   std::vector<std::string> lines;
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     std::string line;
     for (const auto &graph_matrix : elements_vec) {
       line += std::to_string(graph_matrix.cre(s)) + " " +
@@ -136,10 +146,10 @@ std::string to_string(const std::vector<GraphMatrix> &elements_vec) {
 
 std::string signature(const GraphMatrix &graph_matrix) {
   std::string str;
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     str += std::to_string(graph_matrix.cre(s));
   }
-  for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+  for (int s = 0; s < osi()->num_spaces(); ++s) {
     str += to_string(graph_matrix.ann(s));
   }
   return str;
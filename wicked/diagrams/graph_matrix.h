@@ -2,21 +2,36 @@
 #define _wicked_diag_elements_h_
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "../wicked-def.h"
+#include "helpers/orbital_space.h"
 
 /// A class to keep track of creation and annilation operators,
 /// and their contractions, which we call a graph matrix.
-/// This object stores a vector of pairs of number for each space
+/// This object stores a pair of numbers for each space
 class GraphMatrix {
   // Here we use an optimized way to store the graph matrix
-  // We assume that we work at most with 8 different spaces, which
-  // should be enough for virtually any type of application
-  static constexpr int max_spaces_ = 8;
+  static constexpr int max_spaces_ = max_orbital_spaces;
   using graph_matrix_t = std::array<std::pair<int, int>, max_spaces_>;
 
+  // The counts are stored as 8-bit fields packed in 64-bit words in the
+  // order cre(0), ann(0), cre(1), ann(1), ..., starting from the most
+  // significant byte of the first word. Comparing the words therefore gives
+  // the lexicographic order of the counts. Each count must be less than 128
+  // so that several fields can be compared with a single word operation. The
+  // number of words is a compile-time constant, so the loops over the words
+  // are unrolled. The words of the spaces that are not defined are zero
+  static constexpr int fields_per_word_ = 8;
+  static constexpr int num_words_ =
+      (2 * max_spaces_ + fields_per_word_ - 1) / fields_per_word_;
+  static constexpr uint64_t high_bits_ = 0x8080808080808080ULL;
+  using words_t = std::array<uint64_t, num_words_>;
+  static_assert((max_spaces_ > 0) and (max_spaces_ < 128),
+                "WICKED_MAX_SPACES must be between 1 and 127");
+
 public:
   /// Constructor
   GraphMatrix();
@@ -25,10 +40,10 @@ public:
   GraphMatrix(const std::vector<int> &cre, const std::vector<int> &ann);
 
   /// Return a vector of pairs of creation/annihilation operators
-  const graph_matrix_t &elements() const;
+  graph_matrix_t elements() const;
 
   /// Return a pair of creation/annihilation operators in space
-  const std::pair<int, int> &elements(int space) const;
+  std::pair<int, int> elements(int space) const;
 
   /// Return the number of creation operators in space
   int cre(int space) const;
@@ -50,6 +65,26 @@ public:
   /// graph matrix in a given space
   int num_ops(int space) const;
 
+  /// Return true if this object has at least as many creation and annihilation
+  /// operators as other in every space
+  bool contains(const GraphMatrix &other) const {
+    // a field of (x | 0x80) - y keeps its high bit only if x >= y
+    uint64_t result = high_bits_;
+    for (int w = 0; w < num_words_; w++) {
+      result &= (words_[w] | high_bits_) - other.words_[w];
+    }
+    return (result & high_bits_) == high_bits_;
+  }
+
+  /// Return true if this object has no operators
+  bool empty() const {
+    uint64_t result = 0;
+    for (int w = 0; w < num_words_; w++) {
+      result |= words_[w];
+    }
+    return result == 0;
+  }
+
   /// Comparison operators used for sorting
   bool operator<(GraphMatrix const &other) const;
   bool operator==(GraphMatrix const &other) const;
@@ -73,7 +108,26 @@ public:
 private:
   /// This object stores the number of creation/annihilation
   /// operators in each space. This initializes it to all zeros
-  graph_matrix_t elements_ = {};
+  words_t words_ = {};
+
+  /// Return the word and the bit offset of the count of creation (ann = false)
+  /// or annihilation (ann = true) operators in a space
+  static std::pair<int, int> field(int space, bool ann) {
+    int n = 2 * space + ann;
+    return std::make_pair(n / fields_per_word_,
+                          8 * (fields_per_word_ - 1 - n % fields_per_word_));
+  }
+
+  int get(int space, bool ann) const {
+    auto [w, shift] = field(space, ann);
+    return static_cast<int>((words_[w] >> shift) & 0xFF);
+  }
+
+  void set(int space, bool ann, int value) {
+    auto [w, shift] = field(space, ann);
+    words_[w] = (words_[w] & ~(uint64_t(0xFF) << shift)) |
+                (static_cast<uint64_t>(value) << shift);
+  }
 };
 
 // Helper functions
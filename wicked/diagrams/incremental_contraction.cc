@@ -0,0 +1,58 @@
+#include "helpers/trace.h"
+
+#include "incremental_contraction.h"
+
+IncrementalContraction::IncrementalContraction(const WickTheorem &wt,
+                                               scalar_t factor,
+                                               const int minrank,
+                                               const int maxrank)
+    : wt_(wt), factor_(factor), minrank_(minrank), maxrank_(maxrank) {}
+
+OperatorExpression
+IncrementalContraction::difference(const OperatorExpression &expr) const {
+  // the products whose factor did not change cancel
+  return expr - expr_;
+}
+
+size_t IncrementalContraction::update(const OperatorExpression &expr) {
+  TraceScope trace("incremental update", "expression");
+  const OperatorExpression delta = difference(expr);
+  if (trace.active()) {
+    trace.add_arg("products", std::to_string(delta.size()));
+  }
+  if (delta.size() == 0) {
+    return 0;
+  }
+  if constexpr (exact_coefficients) {
+    // the result is changed only if the contraction succeeds
+    Expression terms = wt_.contract(factor_, delta, minrank_, maxrank_);
+    result_ += std::move(terms);
+    expr_ = expr;
+    return delta.size();
+  }
+
+  // the new products are contracted before anything is changed
+  std::map<OperatorProduct, Expression> contractions;
+  for (const auto &[ops, f] : expr.terms()) {
+    if (contractions_.count(ops) == 0) {
+      contractions.emplace(ops, wt_.contract(factor_, ops, minrank_, maxrank_));
+    }
+  }
+  const size_t ncontracted = contractions.size();
+  HashedExpression sum;
+  for (const auto &[ops, f] : expr.terms()) {
+    auto [it, inserted] = contractions.try_emplace(ops);
+    if (inserted) {
+      // a product contracted by a previous update
+      it->second = std::move(contractions_.at(ops));
+    }
+    for (const auto &[term, c] : it->second.terms()) {
+      sum.add(term, c * f);
+    }
+  }
+  contractions_ = std::move(contractions);
+  result_ = Expression();
+  std::move(sum).add_to(result_);
+  expr_ = expr;
+  return ncontracted;
+}
@@ -0,0 +1,67 @@
+#ifndef _wicked_incremental_contraction_h_
+#define _wicked_incremental_contraction_h_
+
+#include <map>
+
+#include "../algebra/expression.h"
+#include "operator.h"
+#include "operator_expression.h"
+#include "wick_theorem.h"
+
+/// Keeps the contraction of a sum of products of operators up to date when
+/// the sum changes. Since the contraction is linear in the factor of each
+/// product, the result for a new sum is the previous result plus the
+/// contraction of the difference between the new and the previous sums. An
+/// update therefore contracts only the products that were added or removed or
+/// whose factor changed, and patches the result by adding or subtracting their
+/// terms. With floating-point coefficients, the patches would leave rounding
+/// errors that depend on the sequence of updates. Instead, the contraction of
+/// each product with a unit factor is kept, only the new products are
+/// contracted, and the result is summed again in the order of the products.
+/// The contractions are performed by a copy of a WickTheorem object, so
+/// changing the original object does not affect the result
+class IncrementalContraction {
+public:
+  // ==> Constructors <==
+
+  /// Constructor. Contracts with a copy of wt the sums passed to update,
+  /// multiplied by factor, keeping the terms with rank in [minrank, maxrank]
+  IncrementalContraction(const WickTheorem &wt, scalar_t factor,
+                         const int minrank, const int maxrank);
+
+  // ==> Class public interface <==
+
+  /// Return the products that update(expr) would contract, with the change
+  /// of their factor
+  OperatorExpression difference(const OperatorExpression &expr) const;
+
+  /// Make expr the sum that is contracted and update the result. Returns the
+  /// number of products contracted
+  size_t update(const OperatorExpression &expr);
+
+  /// Return the sum of products contracted
+  const OperatorExpression &expression() const { return expr_; }
+
+  /// Return the contraction of the sum of products
+  const Expression &result() const { return result_; }
+
+  /// Return the object that performs the contractions
+  WickTheorem &wick_theorem() { return wt_; }
+
+private:
+  // ==> Class private data <==
+
+  WickTheorem wt_;
+  scalar_t factor_;
+  int minrank_;
+  int maxrank_;
+  /// The sum of products contracted
+  OperatorExpression expr_;
+  /// The contraction of expr_
+  Expression result_;
+  /// The contraction of each product of expr_ with a unit factor (only with
+  /// floating-point coefficients)
+  std::map<OperatorProduct, Expression> contractions_;
+};
+
+#endif // _wicked_incremental_contraction_h_
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "graph_matrix.h"
+#include "helpers/label.h"
 #include "wicked-def.h"
 
 /// A class to represent operators
@@ -23,6 +24,9 @@ public:
   /// Return the label of the operator
   const std::string &label() const;
 
+  /// Return the interned label
+  const Label &label_id() const { return label_; }
+
   /// The graph matrix object
   GraphMatrix graph_matrix() const;
 
@@ -55,7 +59,7 @@ public:
 
 private:
   /// The label of the operator
-  std::string label_;
+  Label label_;
 
   /// The number of creation/annihilation operators in each space
   GraphMatrix graph_matrix_;
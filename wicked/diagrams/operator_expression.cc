@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+
 #include "helpers/helpers.h"
 #include "helpers/orbital_space.h"
+#include "helpers/trace.h"
 
 #include "operator.h"
 #include "operator_expression.h"
+#include "tensor_blocks.h"
 
 OperatorExpression::OperatorExpression()
     : Algebra<OperatorProduct, scalar_t>() {}
@@ -15,19 +21,17 @@ OperatorExpression::OperatorExpression(
 }
 
 void OperatorExpression::add2(const OperatorExpression &expr, scalar_t factor) {
-  for (const auto &vec_dop_factor : expr.terms()) {
-    add(vec_dop_factor.first, factor * vec_dop_factor.second);
-  }
+  axpy(expr, factor);
 }
 
 void OperatorExpression::canonicalize() {
   opexpr_t canonical;
-  for (auto [prod, scalar] : terms_) {
+  for (const auto &[prod, scalar] : terms_) {
     auto newprod = prod;
     const auto sign = newprod.canonicalize();
-    add_to_map(canonical, newprod, sign * scalar);
+    add_to_map(canonical, std::move(newprod), sign * scalar);
   }
-  terms_ = canonical;
+  terms_ = std::move(canonical);
 }
 
 std::string OperatorExpression::str() const {
@@ -55,12 +59,22 @@ OperatorExpression operator+(OperatorExpression lhs,
   return lhs;
 }
 
+OperatorExpression operator+(OperatorExpression lhs, OperatorExpression &&rhs) {
+  lhs += std::move(rhs);
+  return lhs;
+}
+
 OperatorExpression operator-(OperatorExpression lhs,
                              const OperatorExpression &rhs) {
   lhs -= rhs;
   return lhs;
 }
 
+OperatorExpression operator-(OperatorExpression lhs, OperatorExpression &&rhs) {
+  lhs -= std::move(rhs);
+  return lhs;
+}
+
 std::ostream &operator<<(std::ostream &os, const OperatorExpression &opsum) {
   os << opsum.str();
   return os;
@@ -73,19 +87,28 @@ make_diag_operator_expression(const std::string &label,
   OperatorExpression result;
 
   for (const std::string &s : components) {
-    auto s_vec = findall(s, "([a-zA-Z][+^]?)");
-    std::vector<int> cre(orbital_subspaces->num_spaces());
-    std::vector<int> ann(orbital_subspaces->num_spaces());
+    std::vector<int> cre(osi()->num_spaces());
+    std::vector<int> ann(osi()->num_spaces());
 
-    for (auto const &el : s_vec) {
-      int space = orbital_subspaces->label_to_space(el[0]);
-      if (el.size() > 1) {
+    // each letter is a space label, followed by '+' or '^' for a creation
+    // operator (e.g., "v+ v+ o o")
+    for (size_t k = 0; k < s.size(); k++) {
+      if (not is_alpha_char(s[k])) {
+        continue;
+      }
+      int space = osi()->label_to_space(s[k]);
+      if (k + 1 < s.size() and (s[k + 1] == '+' or s[k + 1] == '^')) {
         cre[space] += 1;
+        k++;
       } else {
         ann[space] += 1;
       }
     }
     Operator op(label, cre, ann);
+    // skip the blocks that are declared zero
+    if (is_zero_block(op)) {
+      continue;
+    }
     // if we want unique terms, we check if the term is already in the result
     if (unique and result.contains({op})) {
       continue;
@@ -95,22 +118,214 @@ make_diag_operator_expression(const std::string &label,
   return result;
 }
 
+/// Return the total number of creation/annihilation operators in each space of
+/// a product of operators
+static GraphMatrix product_graph_matrix(const OperatorProduct &prod) {
+  GraphMatrix gm;
+  for (const auto &op : prod) {
+    gm += op.graph_matrix();
+  }
+  return gm;
+}
+
+/// Return true if a product of operators with this graph matrix can give a
+/// contraction with rank in the range [minrank, maxrank]. Each contraction
+/// removes one creation and one annihilation operator from the same space, so
+/// the rank of a contraction has the parity of num_ops() and is at least
+/// sum_s |cre(s) - ann(s)|
+static bool can_reach_rank(const GraphMatrix &gm, int minrank, int maxrank) {
+  const int num_ops = gm.num_ops();
+  int lowest = 0;
+  for (int s = 0, maxs = osi()->num_spaces(); s < maxs; s++) {
+    lowest += std::abs(gm.cre(s) - gm.ann(s));
+  }
+  const int lo = std::max(lowest, minrank + ((num_ops - minrank) % 2 != 0));
+  const int hi = std::min(num_ops, maxrank);
+  return lo <= hi;
+}
+
+OperatorExpression multiply(const OperatorExpression &A,
+                            const OperatorExpression &B, int minrank,
+                            int maxrank) {
+  return multiply(std::vector<OperatorExpression>{A, B}, minrank, maxrank);
+}
+
+LazyOperatorProduct::LazyOperatorProduct(
+    const std::vector<OperatorExpression> &factors)
+    : factors_(factors) {}
+
+LazyOperatorProduct::Generator::Generator(const LazyOperatorProduct &product,
+                                          int minrank, int maxrank,
+                                          int nexpanded)
+    : factors_(product.factors_), minrank_(minrank), maxrank_(maxrank),
+      nexpanded_(nexpanded < 0 ? factors_.size()
+                               : std::min<int>(nexpanded, factors_.size())) {
+  const int nfactors = factors_.size();
+  if (nexpanded_ == 0) {
+    return;
+  }
+  suffixes_.resize(nfactors + 1);
+  suffixes_[nfactors].push_back(GraphMatrix());
+  for (int k = nfactors - 1; k > 0; k--) {
+    std::set<GraphMatrix> gms;
+    for (const auto &[prod, c] : factors_[k]) {
+      const GraphMatrix prod_gm = product_graph_matrix(prod);
+      for (const auto &suffix : suffixes_[k + 1]) {
+        GraphMatrix gm = prod_gm;
+        gm += suffix;
+        gms.insert(gm);
+      }
+    }
+    suffixes_[k].assign(gms.begin(), gms.end());
+  }
+  its_.resize(nfactors);
+  partial_.resize(nfactors);
+  coefficients_.resize(nfactors);
+  its_[0] = factors_[0].begin();
+}
+
+bool LazyOperatorProduct::Generator::can_complete(const OperatorProduct &prod,
+                                                  int k) const {
+  const GraphMatrix prod_gm = product_graph_matrix(prod);
+  for (const auto &suffix : suffixes_[k]) {
+    GraphMatrix gm = prod_gm;
+    gm += suffix;
+    if (can_reach_rank(gm, minrank_, maxrank_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LazyOperatorProduct::Generator::next(OperatorProduct &prod,
+                                          scalar_t &factor) {
+  const int nfactors = nexpanded_;
+  if (nfactors == 0) {
+    return false;
+  }
+  // depth-first search over the terms of the factors. A term of factor k is
+  // added to the partial product only if it can be completed
+  while (depth_ >= 0) {
+    const int k = depth_;
+    if (k == nfactors) {
+      prod = partial_[k - 1];
+      factor = coefficients_[k - 1];
+      depth_ = k - 1;
+      ++its_[k - 1];
+      return true;
+    }
+    if (its_[k] == factors_[k].end()) {
+      depth_ = k - 1;
+      if (k > 0) {
+        ++its_[k - 1];
+      }
+      continue;
+    }
+    const auto &[prod_k, c_k] = *its_[k];
+    OperatorProduct new_prod = (k == 0) ? prod_k : partial_[k - 1] * prod_k;
+    if (can_complete(new_prod, k + 1)) {
+      partial_[k] = std::move(new_prod);
+      coefficients_[k] = (k == 0) ? c_k : coefficients_[k - 1] * c_k;
+      depth_ = k + 1;
+      if (k + 1 < nfactors) {
+        its_[k + 1] = factors_[k + 1].begin();
+      }
+    } else {
+      ++its_[k];
+    }
+  }
+  return false;
+}
+
+LazyOperatorProduct::Generator
+LazyOperatorProduct::generate(int minrank, int maxrank, int nexpanded) const {
+  return Generator(*this, minrank, maxrank, nexpanded);
+}
+
+size_t LazyOperatorProduct::count(int minrank, int maxrank) const {
+  size_t n = 0;
+  Generator gen = generate(minrank, maxrank);
+  OperatorProduct prod;
+  scalar_t factor;
+  while (gen.next(prod, factor)) {
+    n += 1;
+  }
+  return n;
+}
+
+OperatorExpression LazyOperatorProduct::expand(int minrank,
+                                               int maxrank) const {
+  OperatorExpression result;
+  Generator gen = generate(minrank, maxrank);
+  OperatorProduct prod;
+  scalar_t factor;
+  while (gen.next(prod, factor)) {
+    result.add(std::move(prod), factor);
+  }
+  return result;
+}
+
+std::string LazyOperatorProduct::str() const {
+  std::string s;
+  for (const auto &factor : factors_) {
+    std::vector<std::string> terms;
+    for (const auto &[prod, c] : factor) {
+      std::string term = c.str(not terms.empty());
+      for (const auto &op : prod) {
+        term += (term.empty() or term == "+" ? "" : " ") + op.str();
+      }
+      terms.push_back(term);
+    }
+    s += (s.empty() ? "(" : " (") + join(terms, " ") + ")";
+  }
+  return s;
+}
+
+OperatorExpression multiply(const std::vector<OperatorExpression> &factors,
+                            int minrank, int maxrank) {
+  return LazyOperatorProduct(factors).expand(minrank, maxrank);
+}
+
+OperatorExpression multiply(const std::vector<OperatorExpression> &factors,
+                            int minrank, int maxrank,
+                            const std::vector<OperatorExpression> &later) {
+  // the rank that a product can reach depends only on its number of
+  // operators in each space, so the later factors can be placed on the right
+  std::vector<OperatorExpression> all(factors);
+  all.insert(all.end(), later.begin(), later.end());
+  const LazyOperatorProduct product(all);
+  OperatorExpression result;
+  auto gen = product.generate(minrank, maxrank, factors.size());
+  OperatorProduct prod;
+  scalar_t factor;
+  while (gen.next(prod, factor)) {
+    result.add(std::move(prod), factor);
+  }
+  return result;
+}
+
 OperatorExpression commutator(const OperatorExpression &A,
                               const OperatorExpression &B) {
-  return A * B - B * A;
+  OperatorExpression result = A * B;
+  result.axpy(B * A, scalar_t(-1));
+  return result;
 }
 
 OperatorExpression bch_series(const OperatorExpression &A,
                               const OperatorExpression &B, int n) {
-  OperatorExpression result;
-  result += A;
-  OperatorExpression temp(A);
+  TraceScope trace("bch_series", "algebra");
+  OperatorExpression result(A);
+  OperatorExpression nested(A);
 
   for (int k = 1; k <= n; k++) {
-    OperatorExpression comm = commutator(temp, B);
-    comm *= scalar_t(1, k);
-    result += comm;
-    temp = comm;
+    nested = commutator(nested, B);
+    nested *= scalar_t(1, k);
+    // the last nested commutator is not needed anymore
+    if (k < n) {
+      result += nested;
+    } else {
+      result += std::move(nested);
+    }
   }
 
   return result;
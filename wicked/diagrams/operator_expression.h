@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "helpers/algebra.hpp"
+#include "graph_matrix.h"
 #include "operator_product.h"
 #include "wicked-def.h"
 
@@ -43,13 +44,15 @@ public:
 OperatorExpression operator*(OperatorExpression lhs,
                              const OperatorExpression &rhs);
 
-/// addition
+/// addition (the terms of a temporary rhs are moved)
 OperatorExpression operator+(OperatorExpression lhs,
                              const OperatorExpression &rhs);
+OperatorExpression operator+(OperatorExpression lhs, OperatorExpression &&rhs);
 
-/// subtraction
+/// subtraction (the terms of a temporary rhs are moved)
 OperatorExpression operator-(OperatorExpression lhs,
                              const OperatorExpression &rhs);
+OperatorExpression operator-(OperatorExpression lhs, OperatorExpression &&rhs);
 
 /// Write a string representation of the operator to a stream
 std::ostream &operator<<(std::ostream &os, const OperatorExpression &opsum);
@@ -65,6 +68,92 @@ make_diag_operator_expression(const std::string &label,
                               const std::vector<std::string> &components,
                               bool unique = false);
 
+/// Creates a new object with the product A * B truncated to the terms that can
+/// give contractions with rank in the range [minrank, maxrank]
+OperatorExpression multiply(const OperatorExpression &A,
+                            const OperatorExpression &B, int minrank,
+                            int maxrank);
+
+/// Creates a new object with the product of a list of factors truncated to the
+/// terms that can give contractions with rank in the range [minrank, maxrank].
+/// Partial products are dropped as soon as no choice of terms from the
+/// remaining factors can bring their rank into this range
+OperatorExpression multiply(const std::vector<OperatorExpression> &factors,
+                            int minrank, int maxrank);
+
+/// Creates a new object with the product of a list of factors truncated to the
+/// terms that can give contractions with rank in the range [minrank, maxrank]
+/// once they are multiplied (on either side) by one term of each of the sums
+/// in later. The sums in later are not multiplied
+OperatorExpression multiply(const std::vector<OperatorExpression> &factors,
+                            int minrank, int maxrank,
+                            const std::vector<OperatorExpression> &later);
+
+/// A product of sums of operators (e.g., H T T) that is not expanded. Its
+/// terms are generated one at a time, so the full product is never stored
+class LazyOperatorProduct {
+public:
+  /// Construct the product of a list of factors
+  LazyOperatorProduct(const std::vector<OperatorExpression> &factors);
+
+  /// Return the factors
+  const std::vector<OperatorExpression> &factors() const { return factors_; }
+
+  /// Generates the products of one term from each factor that can give
+  /// contractions with rank in the range [minrank, maxrank], in the order of
+  /// the factors. Partial products are dropped as soon as no choice of terms
+  /// from the remaining factors can bring their rank into this range. Only
+  /// the first nexpanded factors are multiplied (-1 = all), and the others
+  /// only bound the rank. The LazyOperatorProduct must outlive the generator
+  class Generator {
+  public:
+    Generator(const LazyOperatorProduct &product, int minrank, int maxrank,
+              int nexpanded = -1);
+
+    /// Store the next product and its coefficient in prod and factor. Returns
+    /// false when all the products were generated
+    bool next(OperatorProduct &prod, scalar_t &factor);
+
+  private:
+    using iterator_t = OperatorExpression::vecspace_t::const_iterator;
+    /// Return true if a product of the first k factors can be completed
+    bool can_complete(const OperatorProduct &prod, int k) const;
+
+    const std::vector<OperatorExpression> &factors_;
+    int minrank_;
+    int maxrank_;
+    /// The number of factors multiplied
+    int nexpanded_;
+    /// The graph matrices of the products that can be formed with the factors
+    /// k, k + 1, ..., nfactors - 1
+    std::vector<std::vector<GraphMatrix>> suffixes_;
+    /// The current term of each factor
+    std::vector<iterator_t> its_;
+    /// The product of the current terms of the factors 0, 1, ..., k and its
+    /// coefficient
+    std::vector<OperatorProduct> partial_;
+    std::vector<scalar_t> coefficients_;
+    /// The number of factors whose current term is part of partial_
+    int depth_ = 0;
+  };
+
+  /// Return a generator of the products that can give contractions with rank
+  /// in the range [minrank, maxrank] (see Generator for nexpanded)
+  Generator generate(int minrank, int maxrank, int nexpanded = -1) const;
+
+  /// Return the number of products generated by generate(minrank, maxrank)
+  size_t count(int minrank, int maxrank) const;
+
+  /// Return the sum of the products generated by generate(minrank, maxrank)
+  OperatorExpression expand(int minrank, int maxrank) const;
+
+  /// Return a string representation of the product
+  std::string str() const;
+
+private:
+  std::vector<OperatorExpression> factors_;
+};
+
 /// Creates a new object with the commutator [A,B]
 OperatorExpression commutator(const OperatorExpression &A,
                               const OperatorExpression &B);
@@ -1,6 +1,8 @@
 #ifndef _wicked_operator_product_h_
 #define _wicked_operator_product_h_
 
+#include <utility>
+
 #include "helpers/product.hpp"
 #include "wicked-def.h"
 
@@ -10,7 +12,7 @@ class OperatorProduct : public Product<Operator> {
 public:
   /// Constructors
   OperatorProduct() : Product<Operator>() {}
-  OperatorProduct(Product<Operator> &&opprod) : Product<Operator>(opprod) {}
+  OperatorProduct(Product<Operator> &&opprod) : Product<Operator>(std::move(opprod)) {}
   OperatorProduct(const std::vector<Operator> &operators)
       : Product<Operator>(operators) {}
   OperatorProduct(std::initializer_list<Operator> operators)
@@ -0,0 +1,579 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../algebra/expression.h"
+#include "helpers/orbital_space.h"
+#include "operator.h"
+#include "operator_expression.h"
+
+#include "serialize.h"
+
+//
+// Binary format (all integers are little-endian as written by the host):
+//   magic, version, kind, number of orbital spaces and their labels, number
+//   of labels and the labels (size and characters), number of items, offset
+//   of each item (from the end of the offsets), items
+// The items are
+//   expression: factor, term
+//   operator expression: factor, operator product
+//   equations: label of the block, left-hand side term, right-hand side
+//     term, factor, permutation operators
+// A term is stored as the normal ordered flag, the tensors (label,
+// symmetry, upper and lower indices) and the operators (type, index), and an
+// operator product as the label and the number of creation and annihilation
+// operators in each space of its operators. Labels are stored as their
+// position in the table of labels and indices as (position << 8) | space.
+// These and the numbers of elements are written with seven bits per byte. A
+// factor is stored as a tag followed by the numerator and denominator as
+// integers (tag 0) or as decimal strings (tag 1), which are used only when
+// they do not fit in 64-bit integers
+//
+
+namespace {
+
+/// Identifies the data written by serialize
+constexpr char serialized_magic[] = {'W', 'K', 'D', 'B'};
+
+/// The number of bits used to store the space of an index
+constexpr int index_space_bits = 8;
+
+/// Encodes the items of an object and the tables of its header
+class Writer {
+public:
+  template <typename T> void put(T value) {
+    body_.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void put_string(const std::string &s) {
+    put<uint32_t>(s.size());
+    body_.append(s);
+  }
+
+  /// Write an unsigned integer using seven bits per byte
+  void put_varint(uint64_t n) {
+    while (n >= 0x80) {
+      put<uint8_t>((n & 0x7f) | 0x80);
+      n >>= 7;
+    }
+    put<uint8_t>(n);
+  }
+
+  void put_label(const std::string &label) {
+    auto [it, inserted] = label_ids_.emplace(label, labels_.size());
+    if (inserted) {
+      labels_.push_back(label);
+    }
+    put_varint(it->second);
+  }
+
+  void put_index(const Index &idx) {
+    put_varint((static_cast<uint64_t>(idx.pos()) << index_space_bits) |
+               static_cast<uint64_t>(idx.space()));
+  }
+
+  void put_scalar(const scalar_t &c);
+  void put_term(const SymbolicTerm &term);
+
+  /// Mark the start of an item
+  void begin_item() { offsets_.push_back(body_.size()); }
+
+  /// Return the header followed by the items
+  std::string finish(SerializedKind kind) const;
+
+private:
+  std::string body_;
+  std::vector<uint64_t> offsets_;
+  std::vector<std::string> labels_;
+  std::unordered_map<std::string, uint32_t> label_ids_;
+};
+
+/// Decodes the items of an object
+class Reader {
+public:
+  Reader(const char *pos, const char *end, const std::vector<int> &spaces,
+         const std::vector<Label> &labels)
+      : pos_(pos), end_(end), spaces_(spaces), labels_(labels) {}
+
+  template <typename T> T get() {
+    check(sizeof(T));
+    T value;
+    std::memcpy(&value, pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return value;
+  }
+
+  std::string get_string() {
+    const uint32_t size = get<uint32_t>();
+    check(size);
+    std::string s(pos_, size);
+    pos_ += size;
+    return s;
+  }
+
+  uint64_t get_varint() {
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      const uint8_t byte = get<uint8_t>();
+      n |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return n;
+      }
+    }
+    throw std::runtime_error("\n  Invalid integer in serialized data.");
+  }
+
+  const Label &get_label() {
+    const uint64_t id = get_varint();
+    if (id >= labels_.size()) {
+      throw std::runtime_error("\n  Invalid label in serialized data.");
+    }
+    return labels_[id];
+  }
+
+  /// Return the current position of a stored space
+  int get_space(uint64_t stored) const {
+    if (stored >= spaces_.size()) {
+      throw std::runtime_error("\n  Invalid space in serialized data.");
+    }
+    if (spaces_[stored] < 0) {
+      throw std::runtime_error("\n  The serialized data uses an orbital space "
+                               "that is not defined.");
+    }
+    return spaces_[stored];
+  }
+
+  Index get_index() {
+    const uint64_t n = get_varint();
+    return Index(get_space(n & ((uint64_t(1) << index_space_bits) - 1)),
+                 n >> index_space_bits);
+  }
+
+  /// Return n after checking that n elements of at least min_size bytes fit
+  /// in the rest of the data, so that corrupt data cannot request a large
+  /// allocation
+  uint64_t check_count(uint64_t n, size_t min_size) const {
+    if (n > static_cast<uint64_t>(end_ - pos_) / min_size) {
+      throw std::runtime_error("\n  The serialized data is truncated.");
+    }
+    return n;
+  }
+
+  size_t nspaces() const { return spaces_.size(); }
+
+  const char *position() const { return pos_; }
+
+  scalar_t get_scalar();
+  SymbolicTerm get_term();
+
+private:
+  void check(size_t size) const {
+    if (static_cast<size_t>(end_ - pos_) < size) {
+      throw std::runtime_error("\n  The serialized data is truncated.");
+    }
+  }
+
+  const char *pos_;
+  const char *end_;
+  const std::vector<int> &spaces_;
+  const std::vector<Label> &labels_;
+};
+
+void Writer::put_scalar(const scalar_t &c) {
+  const rational_t num = c.numerator();
+  const rational_t den = c.denominator();
+  constexpr int64_t min = std::numeric_limits<int64_t>::min();
+  constexpr int64_t max = std::numeric_limits<int64_t>::max();
+  if (num >= min and num <= max and den >= min and den <= max) {
+    // the sign is stored in the lowest bit of the numerator (the denominator
+    // is positive)
+    const int64_t n = static_cast<int64_t>(num);
+    put<uint8_t>(0);
+    put_varint((static_cast<uint64_t>(n) << 1) ^
+               static_cast<uint64_t>(n >> 63));
+    put_varint(static_cast<uint64_t>(static_cast<int64_t>(den)));
+  } else {
+#if USE_BOOST_1024_INT
+    put<uint8_t>(1);
+    put_string(num.str());
+    put_string(den.str());
+#endif
+  }
+}
+
+void Writer::put_term(const SymbolicTerm &term) {
+  put<uint8_t>(term.normal_ordered());
+  put_varint(term.tensors().size());
+  for (const Tensor &t : term.tensors()) {
+    put_label(t.label());
+    put<uint8_t>(static_cast<uint8_t>(t.symmetry()));
+    put<uint8_t>(t.upper().size());
+    put<uint8_t>(t.lower().size());
+    for (const Index &idx : t.upper()) {
+      put_index(idx);
+    }
+    for (const Index &idx : t.lower()) {
+      put_index(idx);
+    }
+  }
+  put_varint(term.ops().size());
+  for (const SQOperator &op : term.ops()) {
+    put<uint8_t>(static_cast<uint8_t>(op.type()));
+    put_index(op.index());
+  }
+}
+
+std::string Writer::finish(SerializedKind kind) const {
+  Writer header;
+  header.body_.append(serialized_magic, sizeof(serialized_magic));
+  header.put<uint32_t>(serialization_version);
+  header.put<uint32_t>(static_cast<uint32_t>(kind));
+  header.put<uint32_t>(osi()->num_spaces());
+  for (int s = 0; s < osi()->num_spaces(); s++) {
+    header.put<char>(osi()->label(s));
+  }
+  header.put<uint32_t>(labels_.size());
+  for (const std::string &label : labels_) {
+    header.put_string(label);
+  }
+  header.put<uint64_t>(offsets_.size());
+  for (uint64_t offset : offsets_) {
+    header.put<uint64_t>(offset);
+  }
+  return header.body_ + body_;
+}
+
+scalar_t Reader::get_scalar() {
+  const uint8_t tag = get<uint8_t>();
+  if (tag == 0) {
+    const uint64_t n = get_varint();
+    const int64_t num =
+        static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+    const int64_t den = static_cast<int64_t>(get_varint());
+    if (den <= 0) {
+      throw std::runtime_error("\n  Invalid factor in serialized data.");
+    }
+    return scalar_t(rational_t(num), rational_t(den));
+  }
+#if USE_BOOST_1024_INT
+  const rational_t num(get_string());
+  const rational_t den(get_string());
+  if (den <= 0) {
+    throw std::runtime_error("\n  Invalid factor in serialized data.");
+  }
+  return scalar_t(num, den);
+#else
+  throw std::runtime_error("\n  The serialized data contains a factor that "
+                           "does not fit in a 64-bit integer.");
+#endif
+}
+
+SymbolicTerm Reader::get_term() {
+  const bool normal_ordered = get<uint8_t>();
+  // a tensor takes at least four bytes (label, symmetry and ranks)
+  std::vector<Tensor> tensors(check_count(get_varint(), 4));
+  for (Tensor &t : tensors) {
+    const Label &label = get_label();
+    const auto symmetry = static_cast<SymmetryType>(get<uint8_t>());
+    std::vector<Index> upper(get<uint8_t>());
+    std::vector<Index> lower(get<uint8_t>());
+    for (Index &idx : upper) {
+      idx = get_index();
+    }
+    for (Index &idx : lower) {
+      idx = get_index();
+    }
+    t = Tensor(label, lower, upper, symmetry);
+  }
+  std::vector<SQOperator> ops;
+  const uint64_t nops = get_varint();
+  for (uint64_t k = 0; k < nops; k++) {
+    const auto type = static_cast<SQOperatorType>(get<uint8_t>());
+    ops.push_back(SQOperator(type, get_index()));
+  }
+  return SymbolicTerm(normal_ordered, ops, tensors);
+}
+
+void write_file(const std::string &data, const std::string &filename) {
+  std::ofstream file(filename, std::ios::binary);
+  if (not file.write(data.data(), data.size())) {
+    throw std::runtime_error("\n  Could not write the file " + filename);
+  }
+}
+
+} // namespace
+
+std::string serialize(const Expression &expr) {
+  Writer writer;
+  for (const auto &[term, c] : expr) {
+    writer.begin_item();
+    writer.put_scalar(c);
+    writer.put_term(term);
+  }
+  return writer.finish(SerializedKind::Expression);
+}
+
+std::string serialize(const OperatorExpression &expr) {
+  Writer writer;
+  for (const auto &[prod, c] : expr.terms()) {
+    writer.begin_item();
+    writer.put_scalar(c);
+    writer.put_varint(prod.size());
+    for (const Operator &op : prod) {
+      writer.put_label(op.label());
+      for (int s = 0; s < osi()->num_spaces(); s++) {
+        writer.put<uint8_t>(op.cre(s));
+        writer.put<uint8_t>(op.ann(s));
+      }
+    }
+  }
+  return writer.finish(SerializedKind::OperatorExpression);
+}
+
+std::string
+serialize(const std::map<std::string, std::vector<Equation>> &equations) {
+  Writer writer;
+  for (const auto &[block, eqs] : equations) {
+    for (const Equation &eq : eqs) {
+      writer.begin_item();
+      writer.put_label(block);
+      writer.put_term(eq.lhs());
+      writer.put_term(eq.rhs());
+      writer.put_scalar(eq.rhs_factor());
+      writer.put<uint8_t>(eq.permutations().size());
+      for (const PermutationOperator &p : eq.permutations()) {
+        writer.put<uint8_t>(p.groups().size());
+        for (const auto &group : p.groups()) {
+          writer.put<uint8_t>(group.size());
+          for (const Index &idx : group) {
+            writer.put_index(idx);
+          }
+        }
+      }
+    }
+  }
+  return writer.finish(SerializedKind::Equations);
+}
+
+void save(const Expression &expr, const std::string &filename) {
+  write_file(serialize(expr), filename);
+}
+
+void save(const OperatorExpression &expr, const std::string &filename) {
+  write_file(serialize(expr), filename);
+}
+
+void save(const std::map<std::string, std::vector<Equation>> &equations,
+          const std::string &filename) {
+  write_file(serialize(equations), filename);
+}
+
+struct SerializedView::Storage {
+  /// The data when it is copied in memory
+  std::string copy;
+  /// The mapped file (nullptr if the data is copied)
+  void *map = nullptr;
+  size_t map_size = 0;
+  /// The start and size of the data
+  const char *data = nullptr;
+  size_t size = 0;
+
+  ~Storage() {
+    if (map != nullptr) {
+      munmap(map, map_size);
+    }
+  }
+};
+
+SerializedView::SerializedView(const std::string &data)
+    : SerializedView([&] {
+        auto storage = std::make_shared<Storage>();
+        storage->copy = data;
+        storage->data = storage->copy.data();
+        storage->size = storage->copy.size();
+        return std::shared_ptr<const Storage>(storage);
+      }()) {}
+
+SerializedView SerializedView::open(const std::string &filename) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("\n  Could not open the file " + filename + ": " +
+                             std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("\n  Could not read the file " + filename);
+  }
+  auto storage = std::make_shared<Storage>();
+  storage->map_size = st.st_size;
+  void *map = mmap(nullptr, storage->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("\n  Could not map the file " + filename + ": " +
+                             std::strerror(errno));
+  }
+  storage->map = map;
+  storage->data = static_cast<const char *>(map);
+  storage->size = storage->map_size;
+  return SerializedView(std::shared_ptr<const Storage>(storage));
+}
+
+SerializedView::SerializedView(std::shared_ptr<const Storage> storage)
+    : storage_(storage) {
+  const char *begin = storage_->data;
+  const char *end = begin + storage_->size;
+  if (storage_->size < sizeof(serialized_magic) or
+      not std::equal(serialized_magic,
+                     serialized_magic + sizeof(serialized_magic), begin)) {
+    throw std::runtime_error("\n  The data was not written by serialize.");
+  }
+  Reader reader(begin + sizeof(serialized_magic), end, spaces_, labels_);
+  const uint32_t version = reader.get<uint32_t>();
+  if (version != serialization_version) {
+    throw std::runtime_error("\n  Unsupported serialization version " +
+                             std::to_string(version) + ".");
+  }
+  kind_ = static_cast<SerializedKind>(reader.get<uint32_t>());
+  spaces_.resize(reader.check_count(reader.get<uint32_t>(), sizeof(char)));
+  for (int &s : spaces_) {
+    const char label = reader.get<char>();
+    s = -1;
+    for (int t = 0; t < osi()->num_spaces(); t++) {
+      if (osi()->label(t) == label) {
+        s = t;
+      }
+    }
+  }
+  labels_.resize(
+      reader.check_count(reader.get<uint32_t>(), sizeof(uint32_t)));
+  for (Label &label : labels_) {
+    label = Label(reader.get_string());
+  }
+  offsets_.resize(
+      reader.check_count(reader.get<uint64_t>(), sizeof(uint64_t)));
+  for (uint64_t &offset : offsets_) {
+    offset = reader.get<uint64_t>();
+  }
+  // make the offsets relative to the start of the data
+  const uint64_t body = reader.position() - begin;
+  for (uint64_t &offset : offsets_) {
+    offset += body;
+    if (offset >= storage_->size) {
+      throw std::runtime_error("\n  The serialized data is truncated.");
+    }
+  }
+}
+
+const char *SerializedView::item(size_t n, SerializedKind kind) const {
+  if (kind != kind_) {
+    throw std::runtime_error(
+        "\n  The serialized data contains a different kind of object.");
+  }
+  if (n >= offsets_.size()) {
+    throw std::runtime_error("\n  Item " + std::to_string(n) +
+                             " is out of range.");
+  }
+  return storage_->data + offsets_[n];
+}
+
+std::pair<SymbolicTerm, scalar_t> SerializedView::term(size_t n) const {
+  Reader reader(item(n, SerializedKind::Expression),
+                storage_->data + storage_->size, spaces_, labels_);
+  const scalar_t c = reader.get_scalar();
+  return std::make_pair(reader.get_term(), c);
+}
+
+std::pair<OperatorProduct, scalar_t>
+SerializedView::operator_term(size_t n) const {
+  Reader reader(item(n, SerializedKind::OperatorExpression),
+                storage_->data + storage_->size, spaces_, labels_);
+  const scalar_t c = reader.get_scalar();
+  OperatorProduct prod;
+  const uint64_t nops = reader.get_varint();
+  for (uint64_t k = 0; k < nops; k++) {
+    const std::string &label = reader.get_label();
+    std::vector<int> cre(osi()->num_spaces(), 0);
+    std::vector<int> ann(osi()->num_spaces(), 0);
+    for (size_t s = 0; s < reader.nspaces(); s++) {
+      const int ncre = reader.get<uint8_t>();
+      const int nann = reader.get<uint8_t>();
+      if (ncre + nann > 0) {
+        cre[reader.get_space(s)] = ncre;
+        ann[reader.get_space(s)] = nann;
+      }
+    }
+    prod.push_back(Operator(label, cre, ann));
+  }
+  return std::make_pair(prod, c);
+}
+
+std::pair<std::string, Equation> SerializedView::equation(size_t n) const {
+  Reader reader(item(n, SerializedKind::Equations),
+                storage_->data + storage_->size, spaces_, labels_);
+  const std::string &block = reader.get_label();
+  const SymbolicTerm lhs = reader.get_term();
+  const SymbolicTerm rhs = reader.get_term();
+  const scalar_t factor = reader.get_scalar();
+  std::vector<PermutationOperator> permutations;
+  const uint8_t nperms = reader.get<uint8_t>();
+  for (uint8_t k = 0; k < nperms; k++) {
+    std::vector<std::vector<Index>> groups(reader.get<uint8_t>());
+    for (auto &group : groups) {
+      group.resize(reader.get<uint8_t>());
+      for (Index &idx : group) {
+        idx = reader.get_index();
+      }
+    }
+    permutations.push_back(PermutationOperator(groups));
+  }
+  return std::make_pair(block, Equation(lhs, rhs, factor, permutations));
+}
+
+Expression SerializedView::to_expression() const {
+  Expression expr;
+  for (size_t n = 0; n < size(); n++) {
+    const auto [term, c] = this->term(n);
+    expr.add(term, c);
+  }
+  return expr;
+}
+
+OperatorExpression SerializedView::to_operator_expression() const {
+  OperatorExpression expr;
+  for (size_t n = 0; n < size(); n++) {
+    const auto [prod, c] = operator_term(n);
+    expr.add(prod, c);
+  }
+  return expr;
+}
+
+std::map<std::string, std::vector<Equation>>
+SerializedView::to_equations() const {
+  std::map<std::string, std::vector<Equation>> equations;
+  for (size_t n = 0; n < size(); n++) {
+    const auto [block, eq] = equation(n);
+    equations[block].push_back(eq);
+  }
+  return equations;
+}
+
+Expression deserialize_expression(const std::string &data) {
+  return SerializedView(data).to_expression();
+}
+
+OperatorExpression deserialize_operator_expression(const std::string &data) {
+  return SerializedView(data).to_operator_expression();
+}
+
+std::map<std::string, std::vector<Equation>>
+deserialize_equations(const std::string &data) {
+  return SerializedView(data).to_equations();
+}
@@ -0,0 +1,127 @@
+#ifndef _wicked_serialize_h_
+#define _wicked_serialize_h_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../algebra/equation.h"
+#include "helpers/label.h"
+
+class Expression;
+class OperatorExpression;
+class OperatorProduct;
+
+/// The version of the binary format written by serialize
+constexpr uint32_t serialization_version = 1;
+
+/// The kind of object stored in serialized data
+enum class SerializedKind : uint32_t {
+  Expression = 1,
+  OperatorExpression = 2,
+  Equations = 3
+};
+
+/// Return a compact binary representation of an expression. The data starts
+/// with a header (format version, kind of object, labels of the orbital
+/// spaces and a table of the labels of the tensors, operators and equation
+/// blocks), followed by the offset of each item (a term or an equation) and
+/// the items, in which labels are stored as their position in the table and
+/// indices as 32-bit integers
+std::string serialize(const Expression &expr);
+
+/// Return a compact binary representation of an operator expression
+std::string serialize(const OperatorExpression &expr);
+
+/// Return a compact binary representation of the equations returned by
+/// Expression::to_manybody_equation
+std::string
+serialize(const std::map<std::string, std::vector<Equation>> &equations);
+
+/// Write the binary representation of an expression to a file
+void save(const Expression &expr, const std::string &filename);
+
+/// Write the binary representation of an operator expression to a file
+void save(const OperatorExpression &expr, const std::string &filename);
+
+/// Write the binary representation of a set of equations to a file
+void save(const std::map<std::string, std::vector<Equation>> &equations,
+          const std::string &filename);
+
+/// A read-only view of data written by serialize, which is either copied in
+/// memory or mapped from a file. Only the header is read when the view is
+/// created, and each item is decoded when it is accessed. The orbital spaces
+/// are matched by label, so the data can be read after defining the same
+/// spaces in a different order, and reading an item that uses a space that
+/// is not defined throws an exception
+class SerializedView {
+public:
+  // ==> Constructors <==
+
+  /// View a copy of the data returned by serialize
+  explicit SerializedView(const std::string &data);
+
+  /// Map a file written by save in memory
+  static SerializedView open(const std::string &filename);
+
+  // ==> Class public interface <==
+
+  /// Return the kind of object stored
+  SerializedKind kind() const { return kind_; }
+
+  /// Return the number of items (terms or equations)
+  size_t size() const { return offsets_.size(); }
+
+  /// Return the n-th term of an expression
+  std::pair<SymbolicTerm, scalar_t> term(size_t n) const;
+
+  /// Return the n-th term of an operator expression
+  std::pair<OperatorProduct, scalar_t> operator_term(size_t n) const;
+
+  /// Return the n-th equation and the label of its block
+  std::pair<std::string, Equation> equation(size_t n) const;
+
+  /// Decode all the items of an expression
+  Expression to_expression() const;
+
+  /// Decode all the items of an operator expression
+  OperatorExpression to_operator_expression() const;
+
+  /// Decode all the equations
+  std::map<std::string, std::vector<Equation>> to_equations() const;
+
+private:
+  /// The storage of the data (a string or a mapped file)
+  struct Storage;
+
+  SerializedView(std::shared_ptr<const Storage> storage);
+
+  /// Return a pointer to the start of the n-th item
+  const char *item(size_t n, SerializedKind kind) const;
+
+  // ==> Class private data <==
+
+  std::shared_ptr<const Storage> storage_;
+  SerializedKind kind_;
+  /// The current position of each stored orbital space (-1 if not defined)
+  std::vector<int> spaces_;
+  /// The table of labels
+  std::vector<Label> labels_;
+  /// The offset of each item from the start of the data
+  std::vector<uint64_t> offsets_;
+};
+
+/// Decode an expression from the data returned by serialize
+Expression deserialize_expression(const std::string &data);
+
+/// Decode an operator expression from the data returned by serialize
+OperatorExpression deserialize_operator_expression(const std::string &data);
+
+/// Decode a set of equations from the data returned by serialize
+std::map<std::string, std::vector<Equation>>
+deserialize_equations(const std::string &data);
+
+#endif // _wicked_serialize_h_
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "helpers/helpers.h"
+#include "helpers/orbital_space.h"
+
+#include "../algebra/symbolic_term.h"
+#include "operator.h"
+#include "operator_product.h"
+#include "tensor_blocks.h"
+
+namespace {
+/// The declared blocks, stored by label and block (see block_str)
+std::map<std::pair<std::string, std::string>, BlockType> declared_blocks;
+
+/// Return a block as a sorted list of creation ("o+") and annihilation ("o")
+/// operators, so that it does not depend on the order of the operators or of
+/// the orbital spaces
+std::string block_str(std::vector<std::string> &ops) {
+  std::sort(ops.begin(), ops.end());
+  return join(ops, " ");
+}
+
+/// Return the block of a component of make_diag_operator_expression
+std::string parse_block(const std::string &s) {
+  std::vector<std::string> ops;
+  for (size_t k = 0; k < s.size(); k++) {
+    if (is_space_char(s[k])) {
+      continue;
+    }
+    if (not is_alpha_char(s[k])) {
+      throw std::runtime_error("declare_block: could not parse the block \"" +
+                               s + "\"");
+    }
+    if (k + 1 < s.size() and (s[k + 1] == '+' or s[k + 1] == '^')) {
+      ops.push_back(std::string(1, s[k]) + "+");
+      k++;
+    } else {
+      ops.push_back(std::string(1, s[k]));
+    }
+  }
+  return block_str(ops);
+}
+
+/// Return the block of an operator
+std::string operator_block(const Operator &op) {
+  std::vector<std::string> ops;
+  for (int s = 0; s < osi()->num_spaces(); s++) {
+    const std::string label(1, osi()->label(s));
+    ops.insert(ops.end(), op.cre(s), label + "+");
+    ops.insert(ops.end(), op.ann(s), label);
+  }
+  return block_str(ops);
+}
+
+/// Return the block of a tensor (the lower indices belong to creation
+/// operators and the upper ones to annihilation operators)
+std::string tensor_block(const Tensor &tensor) {
+  std::vector<std::string> ops;
+  for (const Index &idx : tensor.lower()) {
+    ops.push_back(std::string(1, osi()->label(idx.space())) + "+");
+  }
+  for (const Index &idx : tensor.upper()) {
+    ops.push_back(std::string(1, osi()->label(idx.space())));
+  }
+  return block_str(ops);
+}
+
+/// Return true if a block with a given label is declared with a given type
+bool is_declared(const std::string &label, const std::string &block,
+                 BlockType type) {
+  auto it = declared_blocks.find({label, block});
+  return (it != declared_blocks.end()) and (it->second == type);
+}
+} // namespace
+
+void declare_block(const std::string &label, const std::string &block,
+                   BlockType type) {
+  const std::string key = parse_block(block);
+  if (type == BlockType::Diagonal) {
+    // a diagonal block has the form "x x+"
+    const bool one_body = (key.size() == 4) and (key[0] == key[2]) and
+                          (key[1] == ' ') and (key[3] == '+');
+    if (not one_body) {
+      throw std::runtime_error(
+          "declare_block: a diagonal block must have one creation and one "
+          "annihilation operator in the same space (got \"" +
+          block + "\")");
+    }
+  }
+  declared_blocks[{label, key}] = type;
+}
+
+void reset_blocks() { declared_blocks.clear(); }
+
+bool is_zero_block(const Operator &op) {
+  return (not declared_blocks.empty()) and
+         is_declared(op.label(), operator_block(op), BlockType::Zero);
+}
+
+bool has_zero_block(const OperatorProduct &ops) {
+  if (declared_blocks.empty()) {
+    return false;
+  }
+  return std::any_of(ops.begin(), ops.end(), is_zero_block);
+}
+
+void apply_diagonal_blocks(SymbolicTerm &term) {
+  if (declared_blocks.empty()) {
+    return;
+  }
+  auto is_operator_index = [&term](const Index &idx) {
+    return std::any_of(term.ops().begin(), term.ops().end(),
+                       [&idx](const SQOperator &op) {
+                         return op.index() == idx;
+                       });
+  };
+  for (size_t t = 0; t < term.tensors().size(); t++) {
+    const Tensor &tensor = term.tensors()[t];
+    if ((tensor.rank() != 2) or
+        not is_declared(tensor.label(), tensor_block(tensor),
+                        BlockType::Diagonal)) {
+      continue;
+    }
+    const Index lower = tensor.lower()[0];
+    const Index upper = tensor.upper()[0];
+    if (lower == upper) {
+      continue;
+    }
+    DenseIndexMap idx_map;
+    if (not is_operator_index(upper)) {
+      idx_map.set(upper, lower);
+    } else if (not is_operator_index(lower)) {
+      idx_map.set(lower, upper);
+    } else {
+      continue;
+    }
+    term.reindex(idx_map);
+  }
+}
+
+std::string declared_blocks_key() {
+  std::string key;
+  for (const auto &[label_block, type] : declared_blocks) {
+    key += label_block.first + "[" + label_block.second + "]" +
+           (type == BlockType::Zero ? "=0 " : "=diag ");
+  }
+  return key;
+}
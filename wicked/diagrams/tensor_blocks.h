@@ -0,0 +1,46 @@
+#ifndef _wicked_tensor_blocks_h_
+#define _wicked_tensor_blocks_h_
+
+#include <string>
+
+class Operator;
+class OperatorProduct;
+class SymbolicTerm;
+
+/// The kind of a declared tensor block
+enum class BlockType { Zero, Diagonal };
+
+/// Declare that a block of the tensors (and operators) with a given label is
+/// zero or diagonal. The block is given as a component of
+/// make_diag_operator_expression (e.g., "o+ v" for the operator with one
+/// creation operator in space o and one annihilation operator in space v).
+///
+/// Operators in a zero block are skipped by make_diag_operator_expression, and
+/// products that contain one are not contracted. A diagonal block must have
+/// one creation and one annihilation operator in the same space, and its two
+/// indices are identified when a contraction is evaluated.
+///
+/// The declarations apply to all WickTheorem objects and should not be changed
+/// while contracting
+void declare_block(const std::string &label, const std::string &block,
+                   BlockType type);
+
+/// Remove all the block declarations
+void reset_blocks();
+
+/// Return true if an operator is in a block declared zero
+bool is_zero_block(const Operator &op);
+
+/// Return true if a product contains an operator in a block declared zero
+bool has_zero_block(const OperatorProduct &ops);
+
+/// Identify the indices of the tensors of a term that are in a block declared
+/// diagonal. An index that is not carried by an operator of the term is
+/// replaced by the other one. Tensors whose two indices are both carried by
+/// operators are left unchanged
+void apply_diagonal_blocks(SymbolicTerm &term);
+
+/// Return a string that lists the block declarations (used in cache keys)
+std::string declared_blocks_key();
+
+#endif // _wicked_tensor_blocks_h_
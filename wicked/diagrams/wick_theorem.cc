@@ -1,9 +1,26 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
+#include "fmt/format.h"
+
+#include "checkpoint.h"
 #include "contraction.h"
+#include "contraction_cache.h"
+#include "expression_accumulator.h"
+#include "graph_matrix.h"
+#include "helpers/bounded_queue.hpp"
+#include "helpers/orbital_space.h"
 #include "helpers/timer.hpp"
+#include "helpers/trace.h"
 #include "operator.h"
 #include "operator_expression.h"
+#include "tensor_blocks.h"
 
 #include "wick_theorem.h"
 
@@ -12,57 +29,1195 @@
     code                                                                       \
   }
 
+std::string contraction_signature(const OperatorProduct &ops,
+                                  const CompositeContraction &contractions);
+
 using namespace std;
 
+// The largest number of evaluated graphs remembered while the terms of a
+// product are streamed. When the table is full it is emptied, so a graph found
+// again is evaluated again, and the memory used does not grow with the number
+// of terms
+constexpr size_t max_remembered_graphs = 4096;
+
 WickTheorem::WickTheorem() {}
 
+WickTheorem::WickTheorem(const std::shared_ptr<OrbitalSpaceInfo> &osi)
+    : osi_(std::make_shared<const OrbitalSpaceInfo>(*osi)) {}
+
+std::shared_ptr<const OrbitalSpaceInfo>
+WickTheorem::orbital_space_info() const {
+  return osi_;
+}
+
 void WickTheorem::set_print(PrintLevel print) { print_ = print; }
 
 void WickTheorem::set_max_cumulant(int n) { maxcumulant_ = n; }
 
+void WickTheorem::set_max_cumulant(char space, int n) {
+  space_maxcumulant_[space] = n;
+}
+
+void WickTheorem::set_max_total_cumulant(int n, int rank) {
+  max_total_cumulant_[rank] = n;
+}
+
+void WickTheorem::set_connectivity(Connectivity connectivity) {
+  connectivity_ = connectivity;
+}
+
+void WickTheorem::set_target(const std::vector<int> &cre,
+                             const std::vector<int> &ann) {
+  if (cre.size() != ann.size()) {
+    throw std::runtime_error(
+        "WickTheorem::set_target: the creation and annihilation counts must "
+        "have the same size");
+  }
+  target_cre_ = cre;
+  target_ann_ = ann;
+}
+
+void WickTheorem::set_target(const std::string &signature) {
+  OrbitalSpaceContext context(osi_);
+  auto bar = signature.find('|');
+  if (bar == std::string::npos) {
+    throw std::runtime_error("WickTheorem::set_target: could not parse the "
+                             "signature " +
+                             signature);
+  }
+  // the upper (annihilation) spaces come before the bar
+  std::vector<int> cre(osi()->num_spaces(), 0);
+  std::vector<int> ann(osi()->num_spaces(), 0);
+  for (size_t i = 0; i < signature.size(); i++) {
+    if (i != bar) {
+      auto &count = i < bar ? ann : cre;
+      count[osi()->label_to_space(signature[i])] += 1;
+    }
+  }
+  set_target(cre, ann);
+}
+
+void WickTheorem::set_nthreads(int n) { nthreads_ = n; }
+
+void WickTheorem::set_pipeline(size_t queue_size) {
+  pipeline_queue_size_ = queue_size;
+}
+
+int WickTheorem::nthreads() const {
+  if (nthreads_ > 0)
+    return nthreads_;
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
 void WickTheorem::do_canonicalize_graph(bool val) {
   do_canonicalize_graph_ = val;
 }
 
-const std::map<std::string, double> &WickTheorem::timers() const {
-  return timers_;
+void WickTheorem::do_reuse_contractions(bool val) {
+  reuse_contractions_ = val;
+  if (not val) {
+    reused_elementary_contractions_.clear();
+    reused_composite_contractions_.clear();
+  }
+}
+
+std::map<std::string, double> WickTheorem::timers() const {
+  return stats_.flat();
+}
+
+const Statistics &WickTheorem::statistics() const { return stats_; }
+
+const std::map<std::string, Statistics> &
+WickTheorem::product_statistics() const {
+  return product_stats_;
+}
+
+void WickTheorem::do_product_statistics(bool val) {
+  do_product_statistics_ = val;
+}
+
+void WickTheorem::reset_statistics() {
+  stats_.clear();
+  product_stats_.clear();
+}
+
+void WickTheorem::count_term(AddOutcome outcome, Statistics &stats,
+                             const std::string &prefix) {
+  if (outcome == AddOutcome::Merged) {
+    stats.add_count(prefix + "/merged");
+  } else if (outcome == AddOutcome::Cancelled) {
+    stats.add_count(prefix + "/cancelled");
+  }
+}
+
+Expression WickTheorem::merge(const std::vector<HashedExpression> &partial,
+                              const std::string &prefix, int nthreads) {
+  std::vector<const HashedExpression *> parts;
+  for (const auto &part : partial) {
+    parts.push_back(&part);
+  }
+  size_t nmerged = 0;
+  size_t ncancelled = 0;
+  Expression result = merge_expressions(parts, nthreads, &nmerged, &ncancelled);
+  if (nmerged > 0) {
+    stats_.add_count(prefix + "/merged", nmerged);
+  }
+  if (ncancelled > 0) {
+    stats_.add_count(prefix + "/cancelled", ncancelled);
+  }
+  return result;
+}
+
+/// Return the operators of a product separated by spaces
+static std::string product_label(const OperatorProduct &ops) {
+  std::string label;
+  for (const auto &op : ops) {
+    label += (label.empty() ? "" : " ") + op.str();
+  }
+  return label;
+}
+
+void WickTheorem::merge_product_statistics(const OperatorProduct &ops,
+                                           Statistics &saved) {
+  if (not do_product_statistics_) {
+    return;
+  }
+  product_stats_[product_label(ops)] += stats_;
+  saved += stats_;
+  stats_ = std::move(saved);
+}
+
+void WickTheorem::set_cache(std::shared_ptr<ContractionCache> cache) {
+  cache_ = cache;
+}
+
+std::shared_ptr<ContractionCache> WickTheorem::cache() const { return cache_; }
+
+void WickTheorem::set_checkpoint(const std::string &filename,
+                                 double interval) {
+  checkpoint_filename_ = filename;
+  checkpoint_interval_ = interval;
+}
+
+void WickTheorem::set_memory_budget(size_t budget,
+                                    const std::string &directory) {
+  memory_budget_ = budget;
+  spill_directory_ = directory;
+}
+
+void WickTheorem::set_progress_callback(progress_callback_t callback) {
+  progress_callback_ = callback;
+}
+
+void WickTheorem::set_cancel_flag(
+    std::shared_ptr<const std::atomic<bool>> flag) {
+  cancel_flag_ = flag;
+}
+
+void WickTheorem::check_cancelled() const {
+  if (cancel_flag_ and cancel_flag_->load()) {
+    throw ContractionCancelled();
+  }
+}
+
+std::string WickTheorem::cache_key(const OperatorProduct &ops,
+                                   const int minrank, const int maxrank) const {
+  std::string key = osi()->str();
+  key += fmt::format("\n{} {} {} {} {} {} {}\n", minrank, maxrank,
+                     maxcumulant_, do_canonicalize_graph_,
+                     static_cast<int>(connectivity_),
+                     fmt::join(target_cre_, ","), fmt::join(target_ann_, ","));
+  for (const auto &[space, n] : space_maxcumulant_) {
+    key += fmt::format("{}:{} ", space, n);
+  }
+  for (const auto &[rank, n] : max_total_cumulant_) {
+    key += fmt::format("{}<={} ", rank, n);
+  }
+  key += "\n" + declared_blocks_key() + "\n";
+  for (const auto &op : ops) {
+    key += op.str() + " ";
+  }
+  return key;
+}
+
+std::string WickTheorem::graph_key(const OperatorProduct &ops) const {
+  const int nspaces = osi()->num_spaces();
+  std::string key = std::to_string(maxcumulant_);
+  for (int s = 0; s < nspaces; s++) {
+    key += fmt::format(" {}", static_cast<int>(osi()->space_type(s)));
+    auto it = space_maxcumulant_.find(osi()->label(s));
+    if (it != space_maxcumulant_.end()) {
+      key += fmt::format(":{}", it->second);
+    }
+  }
+  for (const auto &op : ops) {
+    key += " |";
+    for (int s = 0; s < nspaces; s++) {
+      key += fmt::format(" {},{}", op.cre(s), op.ann(s));
+    }
+  }
+  return key;
+}
+
+std::vector<ElementaryContraction>
+WickTheorem::reuse_elementary_contractions(const OperatorProduct &ops,
+                                           const std::string &key) {
+  auto it = reused_elementary_contractions_.find(key);
+  if (it == reused_elementary_contractions_.end()) {
+    it = reused_elementary_contractions_
+             .emplace(key,
+                      std::make_shared<const std::vector<ElementaryContraction>>(
+                          generate_elementary_contractions(ops)))
+             .first;
+  } else {
+    stats_.add_count("step 1/reused");
+  }
+  return *it->second;
+}
+
+void WickTheorem::reuse_composite_contractions(const OperatorProduct &ops,
+                                               const int minrank,
+                                               const int maxrank,
+                                               const std::string &key) {
+  // the contractions also depend on which consecutive operators are
+  // identical, since only one contraction is generated for the permutations
+  // of identical operators
+  std::string step2_key =
+      fmt::format("{}\n{} {} {} {} {}\n", key, minrank, maxrank,
+                  static_cast<int>(connectivity_), fmt::join(target_cre_, ","),
+                  fmt::join(target_ann_, ","));
+  for (size_t i = 1; i < ops.size(); i++) {
+    step2_key += (ops[i - 1] == ops[i]) ? '=' : '.';
+  }
+  for (const auto &[rank, n] : max_total_cumulant_) {
+    step2_key += fmt::format(" {}<={}", rank, n);
+  }
+  auto it = reused_composite_contractions_.find(step2_key);
+  if (it == reused_composite_contractions_.end()) {
+    generate_composite_contractions(ops, minrank, maxrank);
+    reused_composite_contractions_.emplace(
+        std::move(step2_key), std::make_shared<const CompositeContractions>(
+                                  CompositeContractions{contractions_,
+                                                        contraction_weights_}));
+  } else {
+    check_options(ops);
+    contractions_ = it->second->contractions;
+    contraction_weights_ = it->second->weights;
+    ncontractions_ = contractions_.size();
+    stats_.add_count("step 2/reused");
+    stats_.add_count("step 2/contractions", ncontractions_);
+  }
 }
 
 Expression WickTheorem::contract(scalar_t factor, const OperatorProduct &ops,
                                  const int minrank, const int maxrank) {
+  // make the orbital space context of this object visible to all the
+  // functions called on this thread
+  OrbitalSpaceContext context(osi_);
+
+  // the statistics of a product are collected from zero and then added to
+  // the total
+  Statistics saved;
+  if (do_product_statistics_) {
+    std::swap(saved, stats_);
+  }
+
+  timer t;
+  TraceScope trace("contract", "product");
+  if (trace.active()) {
+    trace.add_arg("product", product_label(ops));
+  }
+  Expression result;
+  try {
+    if (not cache_) {
+      result = contract_product(factor, ops, minrank, maxrank);
+    } else {
+      // the results are stored for a unit factor and scaled
+      const std::string key = cache_key(ops, minrank, maxrank);
+      if (cache_->find(key, result)) {
+        stats_.add_count("cache/hits");
+      } else {
+        stats_.add_count("cache/misses");
+        result = contract_product(scalar_t(1), ops, minrank, maxrank);
+        cache_->insert(key, result);
+      }
+      result *= factor;
+    }
+  } catch (...) {
+    merge_product_statistics(ops, saved);
+    throw;
+  }
+  stats_.add_time("contract", t.get());
+  merge_product_statistics(ops, saved);
+  return result;
+}
+
+Expression WickTheorem::contract_product(scalar_t factor,
+                                         const OperatorProduct &ops,
+                                         const int minrank,
+                                         const int maxrank) {
   ncontractions_ = 0;
   contractions_.clear();
+  contraction_weights_.clear();
   elementary_contractions_.clear();
 
+  // a product that contains a block declared zero vanishes
+  if (has_zero_block(ops)) {
+    stats_.add_count("zero blocks/products skipped");
+    return Expression();
+  }
+
   PRINT(
       PrintLevel::Summary, std::cout << "\nContracting the operators: ";
       for (auto &op
            : ops) { std::cout << " " << op; };
       std::cout << std::endl;)
 
-  // Step 1. Generate elementary contractions
+  // Step 1. Generate elementary contractions. These and the composite
+  // contractions depend only on the graph matrices of the operators, so they
+  // are reused for products that differ only by the labels (when not
+  // printing)
   timer t1;
-  elementary_contractions_ = generate_elementary_contractions(ops);
-  timers_["step 1"] += t1.get();
+  TraceScope trace_t1("step 1", "step");
+  const bool reuse = reuse_contractions_ and (print_ == PrintLevel::None);
+  const std::string key = reuse ? graph_key(ops) : std::string();
+  set_elementary_contractions(ops, reuse
+                                       ? reuse_elementary_contractions(ops, key)
+                                       : generate_elementary_contractions(ops));
+  stats_.add_count("step 1/elementary contractions",
+                   elementary_contractions_.size());
+  stats_.add_time("step 1", t1.get());
+  trace_t1.end();
+
+  // Steps 2 and 3 overlap when the contractions are processed by other
+  // threads while they are generated. The sums of the consumers depend on
+  // which contractions each one received, so with floating-point coefficients
+  // the contractions are generated first
+  const int nthreads = this->nthreads();
+  if (exact_coefficients and (pipeline_queue_size_ > 0) and (nthreads > 1) and
+      (print_ == PrintLevel::None)) {
+    timer t23;
+    TraceScope trace_t23("steps 2 and 3", "step");
+    Expression result =
+        contract_pipelined(factor, ops, minrank, maxrank, nthreads - 1);
+    stats_.add_time("steps 2 and 3", t23.get());
+    return result;
+  }
 
   // Step 2. Generate allowed composite contractions
   timer t2;
-  generate_composite_contractions(ops, minrank, maxrank);
-  timers_["step 2"] += t2.get();
+  TraceScope trace_t2("step 2", "step");
+  if (reuse) {
+    reuse_composite_contractions(ops, minrank, maxrank, key);
+  } else {
+    generate_composite_contractions(ops, minrank, maxrank);
+  }
+  stats_.add_time("step 2", t2.get());
+  trace_t2.end();
 
   // Step 3. Process contractions
   timer t3;
+  TraceScope trace_t3("step 3", "step");
   Expression result = process_contractions(factor, ops, minrank, maxrank);
-  timers_["step 3"] += t3.get();
+  stats_.add_time("step 3", t3.get());
   return result;
 }
 
+// A composite contraction passed from step 2 to step 3 in the pipelined mode
+struct ContractionRecord {
+  std::vector<int> contraction;
+  int weight = 1;
+  int n = 0;
+};
+
+Expression WickTheorem::contract_pipelined(scalar_t factor,
+                                           const OperatorProduct &ops,
+                                           const int minrank,
+                                           const int maxrank, int nconsumers) {
+  check_options(ops);
+  std::vector<int> a(100, -1);
+  std::vector<GraphMatrix> free_graph_matrix_vec;
+  for (const auto &op : ops) {
+    free_graph_matrix_vec.push_back(op.graph_matrix());
+  }
+  Expression result;
+  if (not is_connectivity_possible(free_graph_matrix_vec)) {
+    return result;
+  }
+
+  BoundedQueue<ContractionRecord> queue(pipeline_queue_size_);
+  std::atomic<bool> done(false);
+  std::vector<HashedExpression> partial(nconsumers);
+  std::vector<Statistics> partial_stats(nconsumers);
+  std::vector<size_t> nunique(nconsumers, 0);
+  const OrbitalSpaceInfo *caller_osi = osi();
+
+  // when a consumer fails, the other consumers and the producer stop, and the
+  // exception is rethrown after the threads are joined
+  std::atomic<bool> failed(false);
+  std::vector<std::exception_ptr> errors(nconsumers);
+  struct ConsumerFailed {};
+
+  // each consumer evaluates a canonical graph only the first time it finds it
+  // and accumulates the sum of the signs of the equivalent contractions. At
+  // most max_remembered_graphs graphs are remembered: when the table is full,
+  // its terms are added to the partial result and it is emptied
+  auto consume = [&](int id) {
+    OrbitalSpaceContext context(caller_osi);
+    TraceScope trace("step 3 consumer", "thread");
+    std::unordered_map<std::string,
+                       std::pair<std::pair<SymbolicTerm, scalar_t>, scalar_t>>
+        evaluated;
+    auto flush = [&]() {
+      for (const auto &[key, value] : evaluated) {
+        const auto &[term_factor, multiplicity] = value;
+        if (multiplicity != 0) {
+          partial_stats[id].add_count("step 3/terms/emitted");
+          count_term(partial[id].add(term_factor.first,
+                                     term_factor.second * multiplicity),
+                     partial_stats[id], "step 3/terms");
+        }
+      }
+      nunique[id] += evaluated.size();
+      evaluated.clear();
+    };
+    ContractionRecord record;
+    while (not failed) {
+      if (not queue.try_pop(record)) {
+        if (not done.load(std::memory_order_acquire)) {
+          std::this_thread::yield();
+          continue;
+        }
+        // the producer is done, but it may have pushed the last records after
+        // the first test
+        if (not queue.try_pop(record)) {
+          break;
+        }
+      }
+      const auto [best_ops, best_contractions, sign] =
+          canonicalize_composite_contraction(
+              ops,
+              CompositeContractionView(elementary_contractions_,
+                                       record.contraction.data(),
+                                       record.contraction.data() +
+                                           record.contraction.size()),
+              partial_stats[id]);
+      std::string key = contraction_signature(best_ops, best_contractions);
+      auto it = evaluated.find(key);
+      if (it == evaluated.end()) {
+        if (evaluated.size() >= max_remembered_graphs) {
+          flush();
+        }
+        auto term_factor =
+            evaluate_composite_contraction(factor, best_ops, best_contractions,
+                                           record.n, partial_stats[id]);
+        it = evaluated
+                 .emplace(std::move(key),
+                          std::make_pair(std::move(term_factor), scalar_t(0)))
+                 .first;
+      }
+      it->second.second += scalar_t(record.weight) * sign;
+    }
+    flush();
+  };
+
+  std::vector<std::thread> consumers;
+  for (int id = 0; id < nconsumers; id++) {
+    consumers.push_back(std::thread([&, id] {
+      try {
+        consume(id);
+      } catch (...) {
+        errors[id] = std::current_exception();
+        failed = true;
+      }
+    }));
+  }
+
+  // generate the contractions on this thread and wait when the queue is full
+  TraceScope trace("step 2 producer", "thread");
+  size_t npruned = 0;
+  size_t nvisited = 0;
+  ContractionRecord record;
+  std::exception_ptr producer_error;
+  try {
+    generate_contractions_backtrack(
+        a, 0, elementary_contractions_, free_graph_matrix_vec, minrank,
+        maxrank,
+        [&](const std::vector<int> &a, int k, const std::vector<GraphMatrix> &,
+            int weight) {
+          ncontractions_ += 1;
+          record.contraction.assign(a.begin(), a.begin() + k);
+          record.weight = weight;
+          record.n = ncontractions_;
+          while (not queue.try_push(record)) {
+            // the queue is never emptied if the consumers have stopped
+            if (failed) {
+              throw ConsumerFailed();
+            }
+            std::this_thread::yield();
+          }
+        },
+        npruned, nvisited);
+  } catch (...) {
+    producer_error = std::current_exception();
+  }
+  done.store(true, std::memory_order_release);
+  trace.end();
+  for (auto &t : consumers) {
+    t.join();
+  }
+  // the error of a consumer is the cause of ConsumerFailed
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  if (producer_error) {
+    std::rethrow_exception(producer_error);
+  }
+
+  // merge the partial results in the order of the consumers. The graphs found
+  // by more than one consumer, or again by a consumer after its table was
+  // emptied, are counted more than once
+  for (int id = 0; id < nconsumers; id++) {
+    stats_ += partial_stats[id];
+    stats_.add_count("step 3/unique contractions", nunique[id]);
+  }
+  stats_.add_count("step 2/pruned nodes", npruned);
+  stats_.add_count("step 2/nodes visited", nvisited);
+  stats_.add_count("step 2/contractions", ncontractions_);
+  stats_.add_count("step 3/contractions", ncontractions_);
+  return merge(partial, "step 3/terms", nconsumers);
+}
+
+void WickTheorem::contract(scalar_t factor, const OperatorProduct &ops,
+                           const int minrank, const int maxrank,
+                           const term_sink_t &sink) {
+  OrbitalSpaceContext context(osi_);
+
+  Statistics saved;
+  if (do_product_statistics_) {
+    std::swap(saved, stats_);
+  }
+  timer t;
+  TraceScope trace("contract", "product");
+  if (trace.active()) {
+    trace.add_arg("product", product_label(ops));
+  }
+  try {
+    contract_product(factor, ops, minrank, maxrank, sink);
+  } catch (...) {
+    merge_product_statistics(ops, saved);
+    throw;
+  }
+  stats_.add_time("contract", t.get());
+  merge_product_statistics(ops, saved);
+}
+
+void WickTheorem::contract_product(scalar_t factor, const OperatorProduct &ops,
+                                   const int minrank, const int maxrank,
+                                   const term_sink_t &sink) {
+  ncontractions_ = 0;
+  contractions_.clear();
+  contraction_weights_.clear();
+  elementary_contractions_.clear();
+
+  PRINT(
+      PrintLevel::Summary, std::cout << "\nContracting the operators: ";
+      for (auto &op
+           : ops) { std::cout << " " << op; };
+      std::cout << std::endl;)
+
+  // Step 1. Generate elementary contractions
+  timer t1;
+  TraceScope trace_t1("step 1", "step");
+  const bool reuse = reuse_contractions_ and (print_ == PrintLevel::None);
+  set_elementary_contractions(
+      ops, reuse ? reuse_elementary_contractions(ops, graph_key(ops))
+                 : generate_elementary_contractions(ops));
+  stats_.add_count("step 1/elementary contractions",
+                   elementary_contractions_.size());
+  stats_.add_time("step 1", t1.get());
+  trace_t1.end();
+
+  // Steps 2 and 3. Each composite contraction is processed as soon as it is
+  // found by the backtracking algorithm
+  timer t23;
+  TraceScope trace_t23("steps 2 and 3", "step");
+  check_options(ops);
+  std::vector<int> a(100, -1);
+  std::vector<GraphMatrix> free_graph_matrix_vec;
+  for (const auto &op : ops) {
+    free_graph_matrix_vec.push_back(op.graph_matrix());
+  }
+  size_t npruned = 0;
+  size_t nvisited = 0;
+  // contractions with the same canonical graph give the same term up to a
+  // sign, so a graph is evaluated only once while it is remembered
+  std::unordered_map<std::string, std::pair<SymbolicTerm, scalar_t>> evaluated;
+  size_t nevaluated = 0;
+  if (not is_connectivity_possible(free_graph_matrix_vec)) {
+    stats_.add_time("steps 2 and 3", t23.get());
+    return;
+  }
+  generate_contractions_backtrack(
+      a, 0, elementary_contractions_, free_graph_matrix_vec, minrank, maxrank,
+      [&](const std::vector<int> &a, int k, const std::vector<GraphMatrix> &,
+          int weight) {
+        ncontractions_ += 1;
+        const auto [best_ops, best_contractions, sign] =
+            canonicalize_composite_contraction(
+                ops,
+                CompositeContractionView(elementary_contractions_, a.data(),
+                                         a.data() + k),
+                stats_);
+        std::string key = contraction_signature(best_ops, best_contractions);
+        auto it = evaluated.find(key);
+        if (it == evaluated.end()) {
+          if (evaluated.size() >= max_remembered_graphs) {
+            evaluated.clear();
+          }
+          nevaluated += 1;
+          it = evaluated
+                   .emplace(std::move(key),
+                            evaluate_composite_contraction(
+                                factor, best_ops, best_contractions,
+                                ncontractions_, stats_))
+                   .first;
+        }
+        stats_.add_count("step 3/terms/emitted");
+        sink(it->second.first, scalar_t(weight) * sign * it->second.second);
+      },
+      npruned, nvisited);
+  stats_.add_count("step 2/pruned nodes", npruned);
+  stats_.add_count("step 2/nodes visited", nvisited);
+  stats_.add_count("step 2/contractions", ncontractions_);
+  stats_.add_count("step 3/contractions", ncontractions_);
+  stats_.add_count("step 3/unique contractions", nevaluated);
+  stats_.add_time("steps 2 and 3", t23.get());
+}
+
+void WickTheorem::contract(scalar_t factor, const OperatorExpression &expr,
+                           const int minrank, const int maxrank,
+                           const term_sink_t &sink) {
+  for (const auto &[ops, f] : expr.terms()) {
+    contract(factor * f, ops, minrank, maxrank, sink);
+  }
+}
+
 Expression WickTheorem::contract(scalar_t factor,
                                  const OperatorExpression &expr,
                                  const int minrank, const int maxrank) {
-  Expression result;
-  for (const auto &[ops, f] : expr.terms()) {
-    result += contract(factor * f, ops, minrank, maxrank);
+  TraceScope trace("contract expression", "expression");
+  if (trace.active()) {
+    trace.add_arg("products", std::to_string(expr.size()));
+  }
+  auto make_source = [&expr]() -> product_source_t {
+    return [&expr, it = expr.begin()](OperatorProduct &ops,
+                                      scalar_t &f) mutable {
+      if (it == expr.end()) {
+        return false;
+      }
+      ops = it->first;
+      f = it->second;
+      ++it;
+      return true;
+    };
+  };
+  return contract_products(factor, make_source, expr.size(), minrank, maxrank);
+}
+
+Expression WickTheorem::contract(scalar_t factor,
+                                 const LazyOperatorProduct &product,
+                                 const int minrank, const int maxrank) {
+  TraceScope trace("contract lazy product", "expression");
+  // counting the products does not store them and costs much less than
+  // contracting them
+  const size_t nproducts = product.count(minrank, maxrank);
+  stats_.add_count("lazy product/products", nproducts);
+  if (trace.active()) {
+    trace.add_arg("products", std::to_string(nproducts));
+  }
+  auto make_source = [&product, minrank, maxrank]() -> product_source_t {
+    return [gen = product.generate(minrank, maxrank)](
+               OperatorProduct &ops, scalar_t &f) mutable {
+      return gen.next(ops, f);
+    };
+  };
+  return contract_products(factor, make_source, nproducts, minrank, maxrank);
+}
+
+Expression
+WickTheorem::contract_products(scalar_t factor,
+                               const product_source_factory_t &make_source,
+                               size_t nproducts, const int minrank,
+                               const int maxrank) {
+  if (memory_budget_ > 0) {
+    if (not checkpoint_filename_.empty()) {
+      throw std::runtime_error("WickTheorem: checkpoints cannot be used with "
+                               "a memory budget");
+    }
+    return contract_bounded(factor, make_source, nproducts, minrank, maxrank);
+  }
+
+  // the products contracted by a previous run
+  std::vector<HashedExpression> partial;
+  RestoredCheckpoint restored;
+  std::string key;
+  if (not checkpoint_filename_.empty()) {
+    key = checkpoint_key(factor, make_source, minrank, maxrank);
+    restored = restore_checkpoints(checkpoint_filename_, key, nproducts);
+    stats_.add_count("checkpoint/restored products", restored.ndone);
+    partial.push_back(std::move(restored.sum));
+  }
+
+  // the products that are left, with their position in the source
+  product_source_t source = make_source();
+  size_t position = 0;
+  auto next = [&](OperatorProduct &ops, scalar_t &f, size_t &n) {
+    while (source(ops, f)) {
+      n = position++;
+      if ((n >= restored.done.size()) or not restored.done[n]) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // with several threads, the products that cost more than the share of one
+  // thread are contracted first on this thread, each one using all the
+  // threads, and then the workers contract the others
+  const int nthreads = std::min(this->nthreads(),
+                                static_cast<int>(nproducts - restored.ndone));
+  indexed_source_t split = next;
+  indexed_source_t rest;
+  if (nthreads > 1) {
+    schedule_products(next, nthreads, split, rest);
+  }
+
+  HashedExpression sum;
+  CheckpointWriter checkpoint(checkpoint_filename_, key,
+                              restored.next_generation,
+                              (nthreads > 1) ? nthreads : 0,
+                              checkpoint_interval_);
+  size_t ndone = restored.ndone;
+  OperatorProduct ops;
+  scalar_t f;
+  size_t n;
+  try {
+    while (split(ops, f, n)) {
+      check_cancelled();
+      Expression terms = contract(factor * f, ops, minrank, maxrank);
+      terms.drain([&](SymbolicTerm &&term, scalar_t c) {
+        count_term(sum.add(std::move(term), c), stats_, "expression/terms");
+      });
+      checkpoint.done(n, sum);
+      if (progress_callback_) {
+        progress_callback_(++ndone, nproducts);
+      }
+    }
+    checkpoint.save(sum);
+  } catch (...) {
+    // keep the products contracted before the error
+    try {
+      checkpoint.save(sum);
+    } catch (...) {
+    }
+    throw;
+  }
+  if (nthreads > 1) {
+    partial.push_back(std::move(sum));
+    contract_parallel(factor, rest, nproducts, ndone, minrank, maxrank,
+                      nthreads, key, restored.next_generation, partial);
+    return merge(partial, "expression/terms", nthreads);
+  }
+  if (partial.empty()) {
+    Expression result;
+    std::move(sum).add_to(result);
+    return result;
+  }
+  partial.push_back(std::move(sum));
+  return merge(partial, "expression/terms", 1);
+}
+
+Expression
+WickTheorem::contract_bounded(scalar_t factor,
+                              const product_source_factory_t &make_source,
+                              size_t nproducts, const int minrank,
+                              const int maxrank) {
+  ExpressionAccumulator accumulator(memory_budget_, spill_directory_);
+  product_source_t source = make_source();
+  size_t position = 0;
+  auto next = [&](OperatorProduct &ops, scalar_t &f, size_t &n) {
+    n = position++;
+    return source(ops, f);
+  };
+
+  // the products are scheduled as in contract_products
+  const int nthreads =
+      std::min(this->nthreads(), static_cast<int>(nproducts));
+  indexed_source_t split = next;
+  indexed_source_t rest;
+  if (nthreads > 1) {
+    schedule_products(next, nthreads, split, rest);
+  }
+  size_t ndone = 0;
+  OperatorProduct ops;
+  scalar_t f;
+  size_t n;
+  while (split(ops, f, n)) {
+    check_cancelled();
+    Expression terms = contract(factor * f, ops, minrank, maxrank);
+    terms.drain([&](SymbolicTerm &&term, scalar_t c) {
+      count_term(accumulator.add(std::move(term), c), stats_,
+                 "expression/terms");
+    });
+    if (progress_callback_) {
+      progress_callback_(++ndone, nproducts);
+    }
+  }
+  if (nthreads > 1) {
+    std::vector<HashedExpression> partial;
+    contract_parallel(factor, rest, nproducts, ndone, minrank, maxrank,
+                      nthreads, "", 0, partial, &accumulator);
+  }
+
+  Expression result = accumulator.result();
+  stats_.add_count("accumulator/runs", accumulator.nruns());
+  stats_.add_count("accumulator/spilled terms", accumulator.nspilled());
+  stats_.add_count("expression/terms/merged", accumulator.nmerged());
+  stats_.add_count("expression/terms/cancelled", accumulator.ncancelled());
+  return result;
+}
+
+void WickTheorem::schedule_products(const indexed_source_t &next,
+                                    int nthreads, indexed_source_t &split,
+                                    indexed_source_t &rest) {
+  TraceScope trace("schedule products", "expression");
+  struct Product {
+    OperatorProduct ops;
+    scalar_t f;
+    size_t n;
+  };
+  auto products = std::make_shared<std::vector<Product>>();
+  std::vector<double> costs;
+  // the cost depends only on the graph matrices of the operators
+  std::unordered_map<std::string, double> graph_costs;
+  Product product;
+  while (next(product.ops, product.f, product.n)) {
+    const std::string key = graph_key(product.ops);
+    auto it = graph_costs.find(key);
+    if (it == graph_costs.end()) {
+      it = graph_costs.emplace(key, contraction_cost(product.ops)).first;
+    }
+    costs.push_back(it->second);
+    products->push_back(std::move(product));
+  }
+  const auto [order, nsplit] = schedule_by_cost(costs, nthreads);
+  stats_.add_count("schedule/split products", nsplit);
+  if (trace.active()) {
+    trace.add_arg("split", std::to_string(nsplit));
+  }
+
+  // each source moves the products out of the list in its order
+  auto source = [&products](std::vector<size_t> positions) {
+    return indexed_source_t(
+        [products, positions = std::move(positions),
+         k = size_t(0)](OperatorProduct &ops, scalar_t &f, size_t &n) mutable {
+          if (k == positions.size()) {
+            return false;
+          }
+          Product &product = (*products)[positions[k++]];
+          ops = std::move(product.ops);
+          f = product.f;
+          n = product.n;
+          return true;
+        });
+  };
+  split = source(std::vector<size_t>(order.begin(), order.begin() + nsplit));
+  rest = source(std::vector<size_t>(order.begin() + nsplit, order.end()));
+}
+
+std::string
+WickTheorem::checkpoint_key(scalar_t factor,
+                            const product_source_factory_t &make_source,
+                            const int minrank, const int maxrank) const {
+  std::size_t h = fnv1a_hash(factor.str());
+  size_t nproducts = 0;
+  product_source_t source = make_source();
+  OperatorProduct ops;
+  scalar_t f;
+  while (source(ops, f)) {
+    hash_combine(h, fnv1a_hash(cache_key(ops, minrank, maxrank) + f.str()));
+    nproducts += 1;
+  }
+  return fmt::format("{:016x} {}", h, nproducts);
+}
+
+std::vector<Expression>
+WickTheorem::contract_many(scalar_t factor,
+                           const std::vector<contraction_request_t> &requests) {
+  TraceScope trace("contract_many", "expression");
+
+  // the requests that contain each distinct product (with the factor of the
+  // product) and the union of their ranges of ranks
+  struct ProductRequests {
+    std::vector<std::pair<size_t, scalar_t>> requests;
+    int minrank = 0;
+    int maxrank = 0;
+  };
+  std::map<OperatorProduct, ProductRequests> products;
+  size_t nrequested = 0;
+  for (size_t r = 0; r < requests.size(); r++) {
+    const auto &[expr, minrank, maxrank] = requests[r];
+    for (const auto &[ops, f] : expr.terms()) {
+      auto [it, inserted] = products.try_emplace(ops);
+      ProductRequests &product = it->second;
+      if (inserted) {
+        product.minrank = minrank;
+        product.maxrank = maxrank;
+      } else {
+        product.minrank = std::min(product.minrank, minrank);
+        product.maxrank = std::max(product.maxrank, maxrank);
+      }
+      product.requests.emplace_back(r, factor * f);
+      nrequested += 1;
+    }
+  }
+  stats_.add_count("contract_many/products", products.size());
+  stats_.add_count("contract_many/requested products", nrequested);
+  if (trace.active()) {
+    trace.add_arg("products", std::to_string(products.size()));
+  }
+
+  // contract each product once and route the terms by rank
+  std::vector<HashedExpression> sums(requests.size());
+  size_t ndone = 0;
+  for (const auto &[ops, product] : products) {
+    check_cancelled();
+    const Expression terms =
+        contract(scalar_t(1), ops, product.minrank, product.maxrank);
+    for (const auto &[term, c] : terms.terms()) {
+      const int rank = term.nops();
+      for (const auto &[r, f] : product.requests) {
+        if ((rank >= std::get<1>(requests[r])) and
+            (rank <= std::get<2>(requests[r]))) {
+          count_term(sums[r].add(term, f * c), stats_, "expression/terms");
+        }
+      }
+    }
+    if (progress_callback_) {
+      progress_callback_(++ndone, products.size());
+    }
+  }
+
+  std::vector<Expression> result(requests.size());
+  for (size_t r = 0; r < requests.size(); r++) {
+    std::move(sums[r]).add_to(result[r]);
   }
   return result;
 }
+
+Expression WickTheorem::contract_bch(scalar_t factor,
+                                     const OperatorExpression &A,
+                                     const OperatorExpression &B, int n,
+                                     const int minrank, const int maxrank) {
+  TraceScope trace("contract_bch", "expression");
+  // the connected terms of a nested commutator of single operators are
+  // exactly the terms that survive the cancellation. When a term is a product
+  // of several operators, the surviving terms only need B to be connected to
+  // one of them, and the operators of the product may be disconnected from
+  // each other, so the connected filter would drop some of these terms
+  bool single_operators = true;
+  for (const auto &expr : {&A, &B}) {
+    for (const auto &[ops, f] : expr->terms()) {
+      single_operators = single_operators and (ops.size() == 1);
+    }
+  }
+
+  // the zeroth order term is contracted with the connectivity selected by the
+  // user
+  HashedExpression sum;
+  sum += contract(factor, A, minrank, maxrank);
+
+  const Connectivity connectivity = connectivity_;
+  if (single_operators) {
+    connectivity_ = Connectivity::Connected;
+  }
+  try {
+    // the nested commutator of order k keeps only the products that can give
+    // contractions with rank in [minrank, maxrank] once they are multiplied by
+    // up to n - k operators B (one for each higher order), and only those that
+    // can already reach this range are contracted. The sum B + 1 stands for
+    // the choice of multiplying by B or not
+    OperatorExpression B_or_one(B);
+    B_or_one.add(OperatorProduct(), scalar_t(1));
+    OperatorExpression nested(A);
+    for (int k = 1; k <= n; k++) {
+      const std::vector<OperatorExpression> later(n - k, B_or_one);
+      OperatorExpression next = multiply({nested, B}, minrank, maxrank, later);
+      next.axpy(multiply({B, nested}, minrank, maxrank, later), scalar_t(-1));
+      next *= scalar_t(1, k);
+      nested = std::move(next);
+      sum += contract(factor, multiply({nested}, minrank, maxrank), minrank,
+                      maxrank);
+    }
+  } catch (...) {
+    connectivity_ = connectivity;
+    throw;
+  }
+  connectivity_ = connectivity;
+
+  Expression result;
+  std::move(sum).add_to(result);
+  return result;
+}
+
+void WickTheorem::contract_parallel(scalar_t factor,
+                                    const indexed_source_t &next,
+                                    size_t nproducts, size_t ndone,
+                                    const int minrank, const int maxrank,
+                                    int nthreads,
+                                    const std::string &checkpoint_key,
+                                    int generation,
+                                    std::vector<HashedExpression> &partial,
+                                    ExpressionAccumulator *accumulator) {
+  // each worker owns a copy of this object (with the same settings) and
+  // accumulates its own partial result
+  std::vector<WickTheorem> workers(nthreads, *this);
+  const size_t first = partial.size();
+  partial.resize(first + nthreads);
+
+  // the workers take the products from the source one at a time, and each
+  // product gets a ticket with the order in which it was taken
+  std::mutex source_mutex;
+  size_t ntaken = 0;
+  auto take = [&](OperatorProduct &ops, scalar_t &f, size_t &n,
+                  size_t &ticket) {
+    std::lock_guard<std::mutex> lock(source_mutex);
+    ticket = ntaken++;
+    return next(ops, f, n);
+  };
+
+  // with floating-point coefficients, the terms of the products are added in
+  // the order of their tickets to a single sum (or to accumulator), so that
+  // the result does not depend on how the workers shared the products. The
+  // results of the products contracted ahead of their turn wait in pending
+  std::mutex ordered_mutex;
+  std::map<size_t, std::pair<size_t, Expression>> pending;
+  size_t nadded = 0;
+  HashedExpression &ordered_sum = partial[first];
+  CheckpointWriter ordered_checkpoint(
+      exact_coefficients ? std::string() : checkpoint_filename_,
+      checkpoint_key, generation, 0, checkpoint_interval_);
+  auto add_in_order = [&](size_t ticket, size_t n, Expression &&result,
+                          Statistics &stats) {
+    std::lock_guard<std::mutex> lock(ordered_mutex);
+    pending.emplace(ticket, std::make_pair(n, std::move(result)));
+    for (auto it = pending.begin();
+         (it != pending.end()) and (it->first == nadded);
+         it = pending.erase(it)) {
+      auto &[position, terms] = it->second;
+      terms.drain([&](SymbolicTerm &&term, scalar_t c) {
+        count_term(accumulator ? accumulator->add(std::move(term), c)
+                               : ordered_sum.add(std::move(term), c),
+                   stats, "expression/terms");
+      });
+      if (not accumulator) {
+        ordered_checkpoint.done(position, ordered_sum);
+      }
+      nadded += 1;
+    }
+  };
+
+  // the progress is reported by the workers one at a time. When a worker
+  // fails, the others stop before their next product
+  std::mutex progress_mutex;
+  std::mutex accumulator_mutex;
+  std::atomic<bool> failed(false);
+  std::vector<std::exception_ptr> errors(nthreads);
+
+  // the workers see the orbital spaces active on the calling thread
+  const OrbitalSpaceInfo *caller_osi = osi();
+
+  auto work = [&](int id) {
+    OrbitalSpaceContext context(caller_osi);
+    TraceScope trace("contract worker", "thread");
+    WickTheorem &wt = workers[id];
+    wt.reset_statistics();
+    // the products are already distributed among threads
+    wt.nthreads_ = 1;
+    HashedExpression &sum = partial[first + id];
+    CheckpointWriter checkpoint(
+        exact_coefficients ? checkpoint_filename_ : std::string(),
+        checkpoint_key, generation, id, checkpoint_interval_);
+    try {
+      OperatorProduct ops;
+      scalar_t f;
+      size_t n;
+      size_t ticket;
+      while (not failed and take(ops, f, n, ticket)) {
+        check_cancelled();
+        Expression result = wt.contract(factor * f, ops, minrank, maxrank);
+        if constexpr (not exact_coefficients) {
+          add_in_order(ticket, n, std::move(result), wt.stats_);
+        } else if (accumulator) {
+          // the terms are added while the other workers contract
+          std::lock_guard<std::mutex> lock(accumulator_mutex);
+          result.drain([&](SymbolicTerm &&term, scalar_t c) {
+            count_term(accumulator->add(std::move(term), c), wt.stats_,
+                       "expression/terms");
+          });
+        } else {
+          result.drain([&](SymbolicTerm &&term, scalar_t c) {
+            count_term(sum.add(std::move(term), c), wt.stats_,
+                       "expression/terms");
+          });
+          checkpoint.done(n, sum);
+        }
+        if (progress_callback_) {
+          std::lock_guard<std::mutex> lock(progress_mutex);
+          progress_callback_(++ndone, nproducts);
+        }
+      }
+      checkpoint.save(sum);
+    } catch (...) {
+      errors[id] = std::current_exception();
+      failed = true;
+      // keep the products contracted before the error
+      try {
+        checkpoint.save(sum);
+      } catch (...) {
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int id = 0; id < nthreads; id++) {
+    threads.push_back(std::thread(work, id));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  // keep the products added to the ordered sum, also after an error
+  try {
+    ordered_checkpoint.save(ordered_sum);
+  } catch (...) {
+    if (not failed) {
+      throw;
+    }
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // the partial results are merged by the caller in the order of the workers
+  for (int id = 0; id < nthreads; id++) {
+    stats_ += workers[id].stats_;
+    for (const auto &[key, stats] : workers[id].product_stats_) {
+      product_stats_[key] += stats;
+    }
+  }
+}
@@ -1,30 +1,111 @@
 #ifndef _wicked_diag_theorem_h_
 #define _wicked_diag_theorem_h_
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
 
+class ContractionCache;
+class ExpressionAccumulator;
+class OrbitalSpaceInfo;
 class SQOperator;
 class Tensor;
 class SymbolicTerm;
 class Operator;
 class OperatorProduct;
 class OperatorExpression;
+class LazyOperatorProduct;
 class GraphMatrix;
 class ElementaryContraction;
 class CompositeContraction;
 
 #include "../algebra/expression.h"
+#include "contraction.h"
+#include "helpers/statistics.h"
 
 enum class PrintLevel { None, Basic, Summary, Detailed, All };
 
+/// The contractions generated by WickTheorem:
+/// All = all contractions
+/// Connected = only contractions in which all operators are linked
+/// LinkedToFirst = only contractions in which every operator is contracted
+///                 directly with the first one (e.g., H T^n when the T
+///                 operators do not contract with each other)
+enum class Connectivity { All, Connected, LinkedToFirst };
+
+/// A table of the positions of the second quantized operators of a product of
+/// operators (in the order used to evaluate a contraction). For operator o and
+/// space s, the creation operators are stored from cre_first[o * nspaces + s]
+/// and the annihilation operators in reversed order ending at
+/// ann_zero[o * nspaces + s]
+struct SQOperatorPositions {
+  int nspaces = 0;
+  std::vector<int> cre_first;
+  std::vector<int> ann_zero;
+
+  /// Return the position of the n-th creation (cre = true) or annihilation
+  /// (cre = false) operator of space s of operator o
+  int operator()(int o, int s, bool cre, int n) const {
+    const int k = o * nspaces + s;
+    return cre ? cre_first[k] + n : ann_zero[k] - n;
+  }
+};
+
+/// A function that receives the terms generated by a contraction
+using term_sink_t = std::function<void(const SymbolicTerm &, scalar_t)>;
+
+/// A function called after each product of an OperatorExpression is
+/// contracted with the number of products done and the total number
+using progress_callback_t = std::function<void(size_t, size_t)>;
+
+/// The exception thrown by WickTheorem when a contraction is cancelled
+class ContractionCancelled : public std::runtime_error {
+public:
+  ContractionCancelled() : std::runtime_error("The contraction was cancelled") {}
+};
+
+/// Assign items with the given costs to nparts parts with total costs as
+/// close as possible. The items are assigned from the most expensive one to
+/// the part with the lowest total, and ties are broken by position, so every
+/// process gets the same result. Returns the part of each item
+std::vector<int> balance_load(const std::vector<double> &costs, int nparts);
+
+/// Order items with the given costs for nthreads threads that take them one
+/// at a time. The items that cost more than the average load of a thread
+/// come first, since they delay the others however they are assigned and must
+/// be split among all the threads, followed by the other items from the most
+/// to the least expensive (each group from the most expensive item, ties
+/// broken by position). Returns the order of the items and the number of
+/// items to split
+std::pair<std::vector<size_t>, size_t>
+schedule_by_cost(const std::vector<double> &costs, int nthreads);
+
+/// Return the rank of this process in MPI_COMM_WORLD (0 without MPI support).
+/// MPI is initialized if needed
+int mpi_rank();
+
+/// Return the number of processes in MPI_COMM_WORLD (1 without MPI support).
+/// MPI is initialized if needed
+int mpi_size();
+
 /// A class to contract a product of operators
 class WickTheorem {
 
 public:
-  /// Constructor
+  /// Constructor. Uses the global orbital space information at the time a
+  /// contraction is performed
   WickTheorem();
 
+  /// Constructor. Uses a private copy of an orbital space definition. Several
+  /// objects created this way can work with different orbital spaces at the
+  /// same time (e.g., on different threads)
+  explicit WickTheorem(const std::shared_ptr<OrbitalSpaceInfo> &osi);
+
   /// Contract a product of operators
   Expression contract(scalar_t factor, const OperatorProduct &ops,
                       const int minrank, const int maxrank);
@@ -33,26 +114,282 @@ public:
   Expression contract(scalar_t factor, const OperatorExpression &expr,
                       const int minrank, const int maxrank);
 
+  /// Contract a product of sums of operators without expanding it. The
+  /// products of one term from each factor are generated and contracted one
+  /// at a time (see LazyOperatorProduct), skipping those that cannot give
+  /// terms with rank in the range [minrank, maxrank], so the expanded product
+  /// is never stored. The result is the same as the one of contract for the
+  /// expanded product
+  Expression contract(scalar_t factor, const LazyOperatorProduct &product,
+                      const int minrank, const int maxrank);
+
+  /// A sum of products of operators and the smallest and largest rank of the
+  /// terms requested from it (see contract_many)
+  using contraction_request_t = std::tuple<OperatorExpression, int, int>;
+
+  /// Contract several sums of products of operators, each with its own range
+  /// of ranks (e.g., the energy and the residuals of a theory). Each distinct
+  /// product is contracted once over the union of the ranges of the requests
+  /// that contain it, and its terms are added to every request whose range
+  /// includes their rank. Returns the result of each request, which is the
+  /// same as the one of contract. The products are contracted one at a time
+  std::vector<Expression>
+  contract_many(scalar_t factor,
+                const std::vector<contraction_request_t> &requests);
+
+  /// Contract a product of sums of operators on all the processes of
+  /// MPI_COMM_WORLD. The products are distributed among the processes
+  /// according to their contraction_cost, each process contracts its share
+  /// (on nthreads() threads), and the partial results are summed along a
+  /// binary tree in their serialized form. Every process returns the full
+  /// result, which is the same as the one of contract. Without MPI support,
+  /// this is the same as contract
+  Expression contract_distributed(scalar_t factor,
+                                  const OperatorExpression &expr,
+                                  const int minrank, const int maxrank);
+
+  /// Return an estimate of the cost of contracting a product of operators.
+  /// It grows exponentially with the number of elementary contractions, which
+  /// bounds the size of the search of step 2, and is proportional to the
+  /// number of operators plus the number of their creation and annihilation
+  /// operators (the sizes of their graph matrices), which set the cost of
+  /// canonicalizing and evaluating each contraction in step 3
+  double contraction_cost(const OperatorProduct &ops);
+
+  /// Contract the Baker-Campbell-Hausdorff expansion of exp(-B) A exp(B)
+  /// truncated at order n. Each nested commutator is built only with the
+  /// products that can reach the rank range [minrank, maxrank] at its order or
+  /// at a higher one, and it is contracted separately. Only the connected terms
+  /// are generated (the disconnected ones cancel). This requires A and B to be
+  /// sums of single operators, otherwise the expansion is contracted without
+  /// connectivity filter
+  Expression contract_bch(scalar_t factor, const OperatorExpression &A,
+                          const OperatorExpression &B, int n,
+                          const int minrank, const int maxrank);
+
+  /// Contract a product of operators and pass each term to sink as soon as it
+  /// is generated. The terms are canonicalized but not combined, and the
+  /// composite contractions are not stored. Only a bounded number of
+  /// evaluated graphs is remembered, so the memory used does not grow with the
+  /// number of terms. This function does not use the cache or threads
+  void contract(scalar_t factor, const OperatorProduct &ops,
+                const int minrank, const int maxrank, const term_sink_t &sink);
+
+  /// Contract a product of sums of operators and pass each term to sink
+  void contract(scalar_t factor, const OperatorExpression &expr,
+                const int minrank, const int maxrank, const term_sink_t &sink);
+
   /// Set the amount of printing
   void set_print(PrintLevel print);
 
   /// Turn on/off graph canonicalization
   void do_canonicalize_graph(bool val);
 
+  /// Turn on/off the reuse of the elementary and composite contractions
+  /// (steps 1 and 2) of products with the same graph matrices, and of the
+  /// label-independent part of the terms they produce (step 3). The stored
+  /// contractions are released when the reuse is turned off
+  void do_reuse_contractions(bool val);
+
   /// Set the maximum cumulant level
   void set_max_cumulant(int val);
 
-  const std::map<std::string, double> &timers() const;
+  /// Set the maximum cumulant level in the space with this label. It
+  /// replaces the global level for this space
+  void set_max_cumulant(char space, int val);
+
+  /// Limit to val the sum of the levels of the cumulants (lambda_k with
+  /// k >= 2) in the terms with rank or more uncontracted operators. The
+  /// lowest limit that applies to a term is used, so limits can be given for
+  /// several ranks (e.g., set_max_total_cumulant(2, 1) keeps the 3-body
+  /// cumulants only in the fully contracted terms)
+  void set_max_total_cumulant(int val, int rank = 0);
+
+  /// Select which contractions are generated according to how the operators
+  /// are linked
+  void set_connectivity(Connectivity connectivity);
+
+  /// Generate only the terms with cre[s] free creation and ann[s] free
+  /// annihilation operators in each space s. Empty vectors remove the target
+  void set_target(const std::vector<int> &cre, const std::vector<int> &ann);
+
+  /// Set the target from a signature in the format of the keys returned by
+  /// Expression::to_manybody_equation (e.g., "oo|vv" for a+(v) a+(v) a(o) a(o))
+  void set_target(const std::string &signature);
+
+  /// Set the number of threads used to contract the terms of an
+  /// OperatorExpression (0 = use all available hardware threads)
+  void set_nthreads(int n);
+
+  /// Return the number of threads used to contract an OperatorExpression
+  int nthreads() const;
+
+  /// Process the contractions of a product while they are generated. The
+  /// contractions are passed to the other threads through a queue that holds
+  /// up to queue_size of them (0 = generate all the contractions first). Each
+  /// of these threads remembers a bounded number of evaluated graphs, so the
+  /// memory used grows with the number of terms of the result, not with the
+  /// number of contractions. This applies only when more than one thread is
+  /// used for a product, and not with floating-point coefficients
+  void set_pipeline(size_t queue_size);
+
+  /// Set a function called after each product of an OperatorExpression is
+  /// contracted (nullptr = no callback). With several threads, the calls are
+  /// made from the worker threads, one at a time
+  void set_progress_callback(progress_callback_t callback);
+
+  /// Set a flag that is checked before each product of an OperatorExpression
+  /// is contracted (nullptr = no flag). When it is set, the contraction stops
+  /// and throws ContractionCancelled
+  void set_cancel_flag(std::shared_ptr<const std::atomic<bool>> flag);
+
+  /// Set a cache of contracted operator products (nullptr = no cache). The
+  /// same cache can be shared by several objects
+  void set_cache(std::shared_ptr<ContractionCache> cache);
+
+  /// Return the cache of contracted operator products
+  std::shared_ptr<ContractionCache> cache() const;
+
+  /// Save the state of the contractions of OperatorExpression and
+  /// LazyOperatorProduct objects to the files filename.<generation>.<worker>
+  /// every interval seconds (see CheckpointWriter), and resume from the files
+  /// written for the same contraction by a previous run ("" = no
+  /// checkpoints). The state is also saved when a contraction ends or fails.
+  /// The files are kept after a contraction completes, so that a script that
+  /// performs several contractions can be restarted, and should be removed
+  /// when they are no longer needed. With contract_distributed, each process
+  /// uses the files filename.rank<rank>.<generation>.<worker>
+  void set_checkpoint(const std::string &filename, double interval = 60.0);
+
+  /// Bound the memory used to sum the terms of the products of an
+  /// OperatorExpression or a LazyOperatorProduct to budget bytes (0 = no
+  /// limit). When the terms exceed the budget they are written to files in
+  /// directory ("" = the temporary directory of the system) and merged at the
+  /// end (see ExpressionAccumulator). With several threads, the workers add
+  /// their terms to the same accumulator. Cannot be combined with checkpoints
+  void set_memory_budget(size_t budget, const std::string &directory = "");
+
+  /// Return the timers and counters in a single map (the components of the
+  /// names are separated by spaces)
+  std::map<std::string, double> timers() const;
+
+  /// Return the timers and counters accumulated since this object was
+  /// created or since the last call to reset_statistics. The entries are:
+  ///   contract                  time to contract products (summed over the
+  ///                             threads that contract them)
+  ///   cache/hits, cache/misses  lookups in the cache
+  ///   step 1                    time to generate the elementary contractions
+  ///   step 1/elementary contractions, step 1/reused
+  ///   step 2                    time to generate the composite contractions
+  ///   step 2/nodes visited, step 2/pruned nodes   nodes of the search tree
+  ///   step 2/contractions       composite contractions kept
+  ///   step 2/reused
+  ///   steps 2 and 3             time of steps 2 and 3 when they overlap
+  ///   step 3                    time to process the contractions
+  ///   step 3/contractions, step 3/unique contractions
+  ///   step 3/skeletons reused   terms obtained by substituting the labels
+  ///                             of a stored skeleton
+  ///   step 3/terms/emitted      terms generated by the contractions
+  ///   step 3/terms/merged       terms combined with an equal term
+  ///   step 3/terms/cancelled    terms removed because their factor vanished
+  ///   canonicalize_contraction_graph               time
+  ///   canonicalize_contraction_graph/permutations  orders of the operators
+  ///                                                compared
+  ///   evaluate_contraction      time
+  ///   expression/terms/merged, expression/terms/cancelled   the same for the
+  ///                             sum of the products of an OperatorExpression
+  ///   contract_many/products, contract_many/requested products   distinct
+  ///                             products contracted by contract_many and
+  ///                             products in all the requests
+  ///   lazy product/products     products generated from a
+  ///                             LazyOperatorProduct
+  ///   checkpoint/restored products   products restored from checkpoints
+  ///   schedule/split products   products contracted using all the threads
+  ///                             because their cost exceeds the share of one
+  ///   accumulator/runs, accumulator/spilled terms   files written when the
+  ///                             memory budget is exceeded and terms in them
+  const Statistics &statistics() const;
+
+  /// Return the statistics of each product contracted (only when enabled by
+  /// do_product_statistics), stored under the string of the product
+  const std::map<std::string, Statistics> &product_statistics() const;
+
+  /// Turn on/off the collection of statistics for each product
+  void do_product_statistics(bool val);
+
+  /// Reset all the timers and counters
+  void reset_statistics();
+
+  /// Return the orbital space context of this object (nullptr if this object
+  /// uses the global orbital space information)
+  std::shared_ptr<const OrbitalSpaceInfo> orbital_space_info() const;
 
 private:
+  /// Gives the microbenchmarks access to the kernels of steps 2 and 3
+  friend struct WickTheoremKernels;
+
+  /// The orbital space context (nullptr = use the global orbital spaces)
+  std::shared_ptr<const OrbitalSpaceInfo> osi_;
+
   /// A vector of elementary contractions
   std::vector<ElementaryContraction> elementary_contractions_;
 
-  /// The allowed contractions stored as a vector of indices of elementary
+  /// For each elementary contraction, a bit mask of the operators it
+  /// contracts (used to test candidates in the backtracking algorithm)
+  std::vector<uint64_t> elementary_contraction_masks_;
+
+  /// For each permutation of identical operators (except the identity), the
+  /// index of the image of each elementary contraction
+  std::vector<std::vector<int>> contraction_symmetries_;
+
+  /// The allowed contractions stored as lists of indices of elementary
   /// contractions
-  std::vector<std::vector<int>> contractions_;
+  CompositeContractionList contractions_;
+
+  /// The number of contractions equivalent to each of the allowed ones
+  std::vector<int> contraction_weights_;
+
+  /// The composite contractions of a product and their weights
+  struct CompositeContractions {
+    CompositeContractionList contractions;
+    std::vector<int> weights;
+  };
+
+  /// Reuse the contractions of products with the same graph matrices
+  bool reuse_contractions_ = true;
+
+  /// The elementary contractions stored under the key returned by graph_key
+  std::map<std::string,
+           std::shared_ptr<const std::vector<ElementaryContraction>>>
+      reused_elementary_contractions_;
+
+  /// The composite contractions stored under the key returned by graph_key
+  /// extended with the options of step 2
+  std::map<std::string, std::shared_ptr<const CompositeContractions>>
+      reused_composite_contractions_;
 
-  std::map<std::string, double> timers_;
+  /// The timers and counters
+  Statistics stats_;
+
+  /// Collect the statistics of each product
+  bool do_product_statistics_ = false;
+
+  /// The statistics of each product
+  std::map<std::string, Statistics> product_stats_;
+
+  /// Count a term added to a sum under prefix/merged or prefix/cancelled
+  static void count_term(AddOutcome outcome, Statistics &stats,
+                         const std::string &prefix);
+
+  /// Return the sum of the partial results of several threads computed with
+  /// nthreads threads (see merge_expressions) and count the terms merged and
+  /// cancelled under prefix
+  Expression merge(const std::vector<HashedExpression> &partial,
+                   const std::string &prefix, int nthreads);
+
+  /// Add the statistics collected while a product was contracted (stored in
+  /// stats_) to those of the product and restore the total (saved)
+  void merge_product_statistics(const OperatorProduct &ops, Statistics &saved);
 
   /// The number of contractions found
   int ncontractions_ = 0;
@@ -60,12 +397,153 @@ private:
   /// The largest allowed cumulant
   int maxcumulant_ = 100;
 
+  /// The largest allowed cumulant in the spaces with a specific limit
+  std::map<char, int> space_maxcumulant_;
+
+  /// The largest sum of cumulant levels in a term for each rank from which a
+  /// limit applies
+  std::map<int, int> max_total_cumulant_;
+
+  /// The level of the cumulant of each elementary contraction (0 for the
+  /// pair contractions)
+  std::vector<int> elementary_cumulant_levels_;
+
+  /// The connectivity of the contractions generated
+  Connectivity connectivity_ = Connectivity::All;
+
+  /// The target number of free creation and annihilation operators in each
+  /// space (empty = no target)
+  std::vector<int> target_cre_;
+  std::vector<int> target_ann_;
+
   /// Turn on/off graph canonicalization
   bool do_canonicalize_graph_ = true;
 
   /// The default print level
   PrintLevel print_ = PrintLevel::None;
 
+  /// The number of threads used to contract an OperatorExpression
+  int nthreads_ = 1;
+
+  /// The size of the queue used to process the contractions while they are
+  /// generated (0 = generate all the contractions first)
+  size_t pipeline_queue_size_ = 0;
+
+  /// The cache of contracted operator products
+  std::shared_ptr<ContractionCache> cache_;
+
+  /// The function called after each product of an OperatorExpression is
+  /// contracted
+  progress_callback_t progress_callback_;
+
+  /// The flag that cancels a contraction
+  std::shared_ptr<const std::atomic<bool>> cancel_flag_;
+
+  /// The name of the checkpoint files ("" = no checkpoints) and the time
+  /// between two saves
+  std::string checkpoint_filename_;
+  double checkpoint_interval_ = 60.0;
+
+  /// The number of bytes of terms kept in memory by contract_products (0 =
+  /// no limit) and the directory of the files of the terms that exceed it
+  size_t memory_budget_ = 0;
+  std::string spill_directory_;
+
+  /// Throw ContractionCancelled if the cancel flag is set
+  void check_cancelled() const;
+
+  /// Return the key used to store the contraction of ops in the cache. It
+  /// includes all the settings that affect the result
+  std::string cache_key(const OperatorProduct &ops, const int minrank,
+                        const int maxrank) const;
+
+  /// Return a key that identifies the contractions of ops. It depends only on
+  /// the graph matrices of the operators, the orbital space types, and the
+  /// largest cumulant
+  std::string graph_key(const OperatorProduct &ops) const;
+
+  /// Return the elementary contractions of ops, generating them only if no
+  /// product with the same key was contracted before
+  std::vector<ElementaryContraction>
+  reuse_elementary_contractions(const OperatorProduct &ops,
+                                const std::string &key);
+
+  /// Set the composite contractions of ops, generating them only if no
+  /// product with the same key and options was contracted before
+  void reuse_composite_contractions(const OperatorProduct &ops,
+                                    const int minrank, const int maxrank,
+                                    const std::string &key);
+
+  /// Contract a product of operators without using the cache
+  Expression contract_product(scalar_t factor, const OperatorProduct &ops,
+                              const int minrank, const int maxrank);
+
+  /// Contract a product of operators and pass each term to sink (see the
+  /// public function with the same arguments)
+  void contract_product(scalar_t factor, const OperatorProduct &ops,
+                        const int minrank, const int maxrank,
+                        const term_sink_t &sink);
+
+  /// Generate the contractions of ops on this thread and process them on
+  /// nconsumers other threads (steps 2 and 3 of contract_product)
+  Expression contract_pipelined(scalar_t factor, const OperatorProduct &ops,
+                                const int minrank, const int maxrank,
+                                int nconsumers);
+
+  /// A function that stores the next product of operators to contract and
+  /// its factor in its arguments. Returns false when no product is left
+  using product_source_t = std::function<bool(OperatorProduct &, scalar_t &)>;
+
+  /// A function that returns a new source of the same products
+  using product_source_factory_t = std::function<product_source_t()>;
+
+  /// A source that also stores the position of the product in the original
+  /// source (used to skip the products restored from a checkpoint)
+  using indexed_source_t =
+      std::function<bool(OperatorProduct &, scalar_t &, size_t &)>;
+
+  /// Contract the nproducts products of a source and sum the terms. With
+  /// more than one thread, the products are ordered by schedule_products
+  /// and the ones that are split use all the threads
+  Expression contract_products(scalar_t factor,
+                               const product_source_factory_t &make_source,
+                               size_t nproducts, const int minrank,
+                               const int maxrank);
+
+  /// Contract the products of a source using several threads. The workers
+  /// take the products from the source one at a time, and each worker uses a
+  /// private copy of this object and writes its own checkpoints (for the
+  /// contraction with key checkpoint_key, as generation) starting from
+  /// ndone products done. The sum of the terms is added to partial, or to
+  /// accumulator if it is not null (without checkpoints). With floating-point
+  /// coefficients, the terms of the products are added to a single sum in the
+  /// order in which the products were taken
+  void contract_parallel(scalar_t factor, const indexed_source_t &next,
+                         size_t nproducts, size_t ndone, const int minrank,
+                         const int maxrank, int nthreads,
+                         const std::string &checkpoint_key, int generation,
+                         std::vector<HashedExpression> &partial,
+                         ExpressionAccumulator *accumulator = nullptr);
+
+  /// Take the products left in a source and order them by their
+  /// contraction_cost for nthreads threads (see schedule_by_cost). The
+  /// products to split are returned by split, and the others by rest
+  void schedule_products(const indexed_source_t &next, int nthreads,
+                         indexed_source_t &split, indexed_source_t &rest);
+
+  /// Contract the products of a source and sum the terms within the memory
+  /// budget
+  Expression contract_bounded(scalar_t factor,
+                              const product_source_factory_t &make_source,
+                              size_t nproducts, const int minrank,
+                              const int maxrank);
+
+  /// Return a key that identifies the contraction of the products of a
+  /// source with the current options (used to match checkpoints)
+  std::string checkpoint_key(scalar_t factor,
+                             const product_source_factory_t &make_source,
+                             const int minrank, const int maxrank) const;
+
   //
   // Functions for step 1. of the Wick's theorem algorithm
   // implemented in wich_theorem_elementary_contractions.cc
@@ -95,24 +573,103 @@ private:
   // implemented in wich_theorem_composite_contractions.cc
   //
 
+  /// A function that receives the composite contractions found by the
+  /// backtracking algorithm (the elementary contractions a[0],...,a[k-1]),
+  /// the corresponding free graph matrices, and the number of equivalent
+  /// contractions that it represents
+  using contraction_sink_t =
+      std::function<void(const std::vector<int> &, int,
+                         const std::vector<GraphMatrix> &, int)>;
+
+  /// Store the elementary contractions of ops used in step 2, their masks,
+  /// and their images under the permutations of identical operators
+  void set_elementary_contractions(const OperatorProduct &ops,
+                                   std::vector<ElementaryContraction> &&contr);
+
+  /// Return a sink that stores the contractions and their weights
+  contraction_sink_t collect_contractions(CompositeContractionList &contractions,
+                                          std::vector<int> &weights);
+
+  /// Return true if the contractions a[0],...,a[k-1] are the smallest
+  /// (in lexicographic order) among their images under the permutations of
+  /// identical operators, and set weight to the number of distinct images.
+  /// If this is false, no contraction that extends these is the smallest
+  /// either, so only one contraction per set of equivalent ones is generated
+  bool is_canonical_contraction(const std::vector<int> &a, int k,
+                                int &weight) const;
+
   /// Generates all composite contractions for a given contraction
   /// pattern stored in ops
   void generate_composite_contractions(const OperatorProduct &ops,
                                        const int minrank, const int maxrank);
 
   /// Backtracking algorithm used to generate all contractions product of
-  /// elementary contractions
+  /// elementary contractions. The contractions found are passed to sink
+  /// Subtrees that cannot contain contractions with the correct rank are
+  /// skipped, and their number is added to npruned. The number of nodes
+  /// visited is added to nvisited
   void generate_contractions_backtrack(
-      std::vector<int> a, int k,
+      std::vector<int> &a, int k,
       const std::vector<ElementaryContraction> &el_contr_vec,
       std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
-      const int maxrank);
-
-  /// Process a contraction (store it) found by the backtracking algorithm
+      const int maxrank, const contraction_sink_t &sink, size_t &npruned,
+      size_t &nvisited);
+
+  /// Return true if adding more elementary contractions to a solution with
+  /// these free graph matrices can lead to a contraction of rank in the range
+  /// [minrank,maxrank] (and with the target signature, if set). Each
+  /// elementary contraction removes the same number (at least one) of creation
+  /// and annihilation operators in one space
+  bool
+  can_reach_rank(const std::vector<GraphMatrix> &free_graph_matrix_vec,
+                 const int minrank, const int maxrank) const;
+
+  /// Parallel version of the backtracking algorithm. The search tree is split
+  /// at a shallow depth into subtrees that are processed by a pool of threads.
+  /// The contractions are stored in the same order as in the serial algorithm
+  void generate_contractions_parallel(
+      std::vector<int> &a,
+      const std::vector<ElementaryContraction> &el_contr_vec,
+      std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
+      const int maxrank, int nthreads);
+
+  /// Return the sum of the cumulant levels of the contractions
+  /// a[0],...,a[k-1]
+  int total_cumulant(const std::vector<int> &a, int k) const;
+
+  /// Return the largest sum of cumulant levels allowed in a term with rank
+  /// uncontracted operators
+  int max_total_cumulant(int rank) const;
+
+  /// Return true if the free graph matrices match the target signature (or if
+  /// no target is set)
+  bool
+  matches_target(const std::vector<GraphMatrix> &free_graph_matrix_vec) const;
+
+  /// Return true if the elementary contractions can link the operators as
+  /// required by the connectivity option
+  bool is_connectivity_possible(
+      const std::vector<GraphMatrix> &free_graph_matrix_vec) const;
+
+  /// Return true if the contractions a[0],...,a[k-1] satisfy the
+  /// connectivity requirement (if complete is true), or if it can still be
+  /// satisfied by adding more contractions (if complete is false)
+  bool satisfies_connectivity(
+      const std::vector<int> &a, int k,
+      const std::vector<GraphMatrix> &free_graph_matrix_vec,
+      bool complete) const;
+
+  /// Throw an exception if the target or the connectivity options cannot be
+  /// applied to this product of operators
+  void check_options(const OperatorProduct &ops) const;
+
+  /// Process a contraction found by the backtracking algorithm (pass it to
+  /// sink if it has the correct rank and signature)
   void
   process_contraction(const std::vector<int> &a, int k,
                       const std::vector<GraphMatrix> &free_graph_matrix_vec,
-                      const int minrank, const int maxrank);
+                      const int minrank, const int maxrank, int weight,
+                      const contraction_sink_t &sink);
 
   /// Return a vector of indices of elementary contractions that can be added to
   /// the current backtracking solution. All candidates generated here lead to
@@ -139,35 +696,78 @@ private:
   // implemented in wich_theorem_process_contractions.cc
   //
 
-  /// Process the contractions generated in step 2.
+  /// Process the contractions generated in step 2. If more than one thread
+  /// is requested, the contractions are processed in parallel
   Expression process_contractions(scalar_t factor, const OperatorProduct &ops,
                                   const int minrank, const int maxrank);
 
+  /// A contraction graph in canonical form and the sign of the permutation
+  /// that brings a contraction to this form
+  using canonical_contraction_t =
+      std::tuple<OperatorProduct, CompositeContraction, scalar_t>;
+
+  /// Canonicalize the graph of a composite contraction. Timings are added to
+  /// stats
+  canonical_contraction_t canonicalize_composite_contraction(
+      const OperatorProduct &ops, const CompositeContractionView &contraction,
+      Statistics &stats);
+
+  /// Evaluate the n-th canonical contraction graph, canonicalize the term, and
+  /// return the term and its coefficient. Timings are added to stats
+  std::pair<SymbolicTerm, scalar_t>
+  evaluate_composite_contraction(scalar_t factor, const OperatorProduct &ops,
+                                 const CompositeContraction &contractions,
+                                 int n, Statistics &stats);
+
   /// Apply the contraction to this set of operators and produce a term
   std::pair<SymbolicTerm, scalar_t>
   evaluate_contraction(const OperatorProduct &ops,
                        const CompositeContraction &contractions,
                        scalar_t factor);
 
-  /// Return the tensors and operators correspoding to a product of operators
-  std::tuple<std::vector<Tensor>, std::vector<SQOperator>,
-             std::map<std::tuple<int, int, bool, int>, int>>
-  contraction_tensors_sqops(const OperatorProduct &ops);
+  /// The part of a contracted term that does not depend on the labels and
+  /// factors of the operators: the term (the first tensors belong to the
+  /// operators, in the same order), the sign, and the combinatorial factor
+  using contraction_skeleton_t = std::tuple<SymbolicTerm, int, scalar_t>;
 
-  std::vector<int>
-  elements_vec_to_pos(const ElementaryContraction &elements_vec,
-                      std::vector<GraphMatrix> &ops_offset,
-                      std::map<std::tuple<int, int, bool, int>, int> &op_map,
-                      bool creation);
+  /// Return the skeleton of a contraction (see contraction_skeleton_t)
+  contraction_skeleton_t
+  contraction_skeleton(const OperatorProduct &ops,
+                       const CompositeContraction &contractions);
+
+  /// Same as evaluate_contraction, but the skeleton is reused if a
+  /// contraction with the same graph matrices was evaluated before on this
+  /// thread, so only the labels of the operators are substituted. Reuses are
+  /// counted in stats
+  std::pair<SymbolicTerm, scalar_t>
+  evaluate_reused_contraction(const OperatorProduct &ops,
+                              const CompositeContraction &contractions,
+                              scalar_t factor, Statistics &stats);
+
+  /// Return the tensors and operators correspoding to a product of operators
+  /// and store the position of each operator in positions
+  std::pair<std::vector<Tensor>, std::vector<SQOperator>>
+  contraction_tensors_sqops(const OperatorProduct &ops,
+                            SQOperatorPositions &positions);
+
+  /// Append to result the positions of the creation (or annihilation)
+  /// operators contracted by elements_vec. The operators already contracted
+  /// are counted in ops_offset, which is updated
+  void elements_vec_to_pos(const ElementaryContraction &elements_vec,
+                           std::vector<GraphMatrix> &ops_offset,
+                           const SQOperatorPositions &positions, bool creation,
+                           std::vector<int> &result);
 
   /// Return the combinatorial factor corresponding to a contraction pattern
   scalar_t combinatorial_factor(const OperatorProduct &ops,
                                 const CompositeContraction &contractions);
 
-  // Create a canonical contraction graph
+  // Create a canonical contraction graph. The number of orders of the
+  // operators compared is added to npermutations (if not null)
   std::tuple<OperatorProduct, CompositeContraction, scalar_t>
   canonicalize_contraction_graph(const OperatorProduct &ops,
-                                 const CompositeContraction &contractions);
+                                 const CompositeContractionView &contractions,
+                                 size_t *npermutations = nullptr);
 };
 
 #endif // _wicked_diag_theorem_h_
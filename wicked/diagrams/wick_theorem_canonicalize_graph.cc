@@ -1,9 +1,12 @@
 #include <algorithm>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <numeric>
 
 #include "fmt/format.h"
 
+#include "helpers/arena.hpp"
 #include "helpers/combinatorics.h"
 #include "helpers/helpers.h"
 #include "helpers/orbital_space.h"
@@ -38,15 +41,17 @@ void print_contraction_graph(const OperatorProduct &ops,
                              const std::vector<int> contr_perm);
 
 std::string contraction_signature(const OperatorProduct &ops,
-                                  const CompositeContraction &contractions,
-                                  const std::vector<int> &ops_perm,
-                                  const std::vector<int> &contr_perm);
+                                  const CompositeContraction &contractions);
 
 using namespace std;
 
+/// The arena that holds the temporaries of canonicalize_contraction_graph
+static thread_local Arena canonicalize_graph_arena;
+
 std::pair<bool, scalar_t>
-is_ops_permutation_valid(const OperatorProduct &ops, std::vector<int> ops_perm,
-                         const std::vector<std::vector<bool>> &permutable) {
+is_ops_permutation_valid(const OperatorProduct &ops,
+                         const std::pmr::vector<int> &perm,
+                         const std::pmr::vector<bool> &permutable) {
   // ok, so we are given a permutation of some operators and a matrix that tells
   // us which operators/contractions commute. Let's find out if this permutation
   // is consistent with the allowed permutations.
@@ -55,13 +60,14 @@ is_ops_permutation_valid(const OperatorProduct &ops, std::vector<int> ops_perm,
   // this permutation is allowed. We also keep track of the sign, which
   // depends on the number of second quantized operators permuted
   scalar_t sign{1};
+  std::pmr::vector<int> ops_perm(perm, perm.get_allocator());
   int n = ops_perm.size();
   for (int i = 0; i < n - 1; i++) {
     // Last i elements are already in place
     for (int j = 0; j < n - i - 1; j++) {
       if (ops_perm[j + 1] < ops_perm[j]) {
         // permutable
-        if (permutable[ops_perm[j + 1]][ops_perm[j]]) {
+        if (permutable[ops_perm[j + 1] * n + ops_perm[j]]) {
           // the parity is given by the product of number of operators
           sign *= 1 - 2 * ((ops[ops_perm[j + 1]].num_ops() *
                             ops[ops_perm[j]].num_ops()) %
@@ -78,14 +84,15 @@ is_ops_permutation_valid(const OperatorProduct &ops, std::vector<int> ops_perm,
 }
 
 bool do_contractions_commute(int i, int j, const OperatorProduct &ops,
-                             const CompositeContraction &contractions) {
+                             const CompositeContractionView &contractions) {
   // contractions commute if rearranging two operators does not change the final
   // result
   bool do_commute = true;
+  const int nspaces = osi()->num_spaces();
   // loop over all elementary contractions
   for (const auto &el_contr : contractions) {
     // loop over all orbital spaces
-    for (int s = 0; s < orbital_subspaces->num_spaces(); ++s) {
+    for (int s = 0; s < nspaces; ++s) {
       // check if this is a single contraction
       if (el_contr.num_ops() == 2) {
         if (el_contr[i].cre(s) * el_contr[j].ann(s) > 0) {
@@ -100,164 +107,229 @@ bool do_contractions_commute(int i, int j, const OperatorProduct &ops,
   return do_commute;
 }
 
-bool graph_less(const std::pair<int, int> &l, const std::pair<int, int> &r,
-                const std::vector<std::vector<int>> &ops_perms,
-                std::vector<std::vector<int>> &con_perms,
-                const OperatorProduct &ops,
-                const CompositeContraction &contractions) {
-  // here we are given the indices of the permutations of the operators and we
-  // have to determine if permutation l is less than r
-
-  const auto &l_ops_perm = ops_perms[l.first];
-  const auto &r_ops_perm = ops_perms[r.first];
-  const auto &l_con_perm = con_perms[l.second];
-  const auto &r_con_perm = con_perms[r.second];
-
-  // first compare the operators
-  // consider three cases:
-  // 1.  lops <  rops (return true)
-  // 2.  lops == rops (must check the contractions)
-  // 3.  lops >  rops (return false)
-  const int no = l_ops_perm.size();
-  for (int i = 0; i < no; i++) {
-    if (ops[l_ops_perm[i]] < ops[r_ops_perm[i]]) {
+bool contraction_less(const ElementaryContraction &l,
+                      const ElementaryContraction &r,
+                      const std::pmr::vector<int> &ops_perm) {
+  // compare two contractions after the operators are permuted
+  for (int o : ops_perm) {
+    if (l[o] < r[o]) {
       return true;
     }
-    if (ops[r_ops_perm[i]] < ops[l_ops_perm[i]]) {
+    if (r[o] < l[o]) {
       return false;
     }
   }
-
-  // if we made it here lops == rops
-  const int nc = l_con_perm.size();
-  // loop over all the contractions permuted
-  for (int j = 0; j < nc; j++) {
-    const auto &l_con = contractions[l_con_perm[j]];
-    const auto &r_con = contractions[r_con_perm[j]];
-    for (int i = 0; i < no; i++) {
-      if (l_con[l_ops_perm[i]] < r_con[r_ops_perm[i]]) {
-        return false;
-      }
-      if (r_con[r_ops_perm[i]] < l_con[l_ops_perm[i]]) {
-        return true;
-      }
-    }
-  }
   return false;
 }
 
 std::tuple<OperatorProduct, CompositeContraction, scalar_t>
 WickTheorem::canonicalize_contraction_graph(
-    const OperatorProduct &ops, const CompositeContraction &contractions) {
+    const OperatorProduct &ops, const CompositeContractionView &contractions,
+    size_t *npermutations) {
 
   PRINT(PrintLevel::Detailed,
         cout << "  Graph of the contraction to canonicalize:" << endl;
         const auto input_ops_perm = iota_vector<int>(ops.size());
         const auto input_contr_perm = iota_vector<int>(contractions.size());
-        print_contraction_graph(ops, contractions, input_ops_perm,
-                                input_contr_perm););
+        print_contraction_graph(ops, contractions.to_composite_contraction(),
+                                input_ops_perm, input_contr_perm););
 
   const int nops = ops.size();
 
+  // all the temporaries below are allocated from an arena that is released
+  // when this function returns
+  ArenaScope arena(canonicalize_graph_arena);
+
   // create a matrix that tells us if we can permute the position of two
-  // operators
-  std::vector<std::vector<bool>> commutable(nops,
-                                            std::vector<bool>(nops, false));
+  // operators (stored by rows)
+  std::pmr::vector<bool> commutable(nops * nops, false, arena.resource());
   for (int i = 0; i < nops; i++) {
     for (int j = 0; j < nops; j++) {
       // check if commuting operators i and j changes the contraction
       if (do_contractions_commute(i, j, ops, contractions)) {
-        commutable[i][j] = true;
+        commutable[i * nops + j] = true;
       }
     }
   }
 
   PRINT(
       PrintLevel::Detailed, cout << "\n  Commutable operator matrix:" << endl;
-      for (const auto row
-           : commutable) {
+      for (int i = 0; i < nops; i++) {
         cout << "    ";
-        PRINT_ELEMENTS(row);
+        PRINT_ELEMENTS(std::vector<bool>(commutable.begin() + i * nops,
+                                         commutable.begin() + (i + 1) * nops));
         cout << endl;
       };
       cout << endl;);
 
-  // 1. Generate all possible permutation of operators
-  // these vectors store the allowed permutations
-  std::vector<std::vector<int>> ops_perms;
-  std::vector<scalar_t> ops_perms_sign;
-  {
-    // Loop over all permutations of operators
-    std::vector<int> ops_perm(ops.size());
-    std::iota(ops_perm.begin(), ops_perm.end(), 0);
-    do {
-      if (const auto [is_valid, sign] =
-              is_ops_permutation_valid(ops, ops_perm, commutable);
-          is_valid) {
-        ops_perms.push_back(ops_perm);
-        ops_perms_sign.push_back(sign);
-        PRINT(PrintLevel::Detailed, cout << "  Operator permutation: ";
-              PRINT_ELEMENTS(ops_perm);
-              cout << ", sign = " << sign.repr() << " (allowed)" << endl;);
-      } else {
-        PRINT(PrintLevel::Detailed, cout << "  Operator permutation: ";
-              PRINT_ELEMENTS(ops_perm); cout << " (not allowed)" << endl;);
+  // The canonical graph has the lowest sequence of operators and, among
+  // these, the highest sequence of contractions. For a given order of the
+  // operators the best order of the contractions is found by sorting, so we
+  // only search over the orders of the operators. These are built one position
+  // at a time choosing among the lowest operators that can be placed there.
+  // Several choices are possible only when equal operators are available.
+
+  // Operators i < j are equivalent if exchanging them leaves the graph and the
+  // commutation constraints unchanged. Only one of them is tried at a given
+  // position since both choices lead to the same graphs
+  std::pmr::vector<bool> equivalent(nops * nops, false, arena.resource());
+  for (int i = 0; i < nops; i++) {
+    for (int j = i + 1; j < nops; j++) {
+      bool is_equivalent = (ops[i] == ops[j]) and commutable[i * nops + j];
+      for (const auto &contr : contractions) {
+        is_equivalent = is_equivalent and (contr[i] == contr[j]);
       }
-    } while (std::next_permutation(ops_perm.begin(), ops_perm.end()));
-  }
-  PRINT(PrintLevel::Detailed, cout << "\n  Found " << ops_perms.size()
-                                   << " valid operator permutations\n"
-                                   << endl;);
-
-  std::vector<std::vector<int>> con_perms;
-  {
-    // Loop over all permutations of contractions
-    std::vector<int> con_perm(contractions.size());
-    std::iota(con_perm.begin(), con_perm.end(), 0);
-    do {
-      PRINT(PrintLevel::Detailed, cout << "  Contraction permutation: ";
-            PRINT_ELEMENTS(con_perm); cout << endl;);
-      con_perms.push_back(con_perm);
-    } while (std::next_permutation(con_perm.begin(), con_perm.end()));
-  }
-  PRINT(PrintLevel::Detailed, cout << "\n  Found " << con_perms.size()
-                                   << " valid contraction permutations\n"
-                                   << endl;);
-
-  // store all the possible graphs
-  std::vector<std::pair<int, int>> graphs;
-  for (const auto &[o, ops_perm] : enumerate(ops_perms)) {
-    for (const auto &[c, con_perm] : enumerate(con_perms)) {
-      graphs.push_back(std::pair(o, c));
+      for (int k = 0; is_equivalent and (k < nops); k++) {
+        if ((k == i) or (k == j)) {
+          continue;
+        }
+        // an operator in between must commute with both
+        if ((k > i) and (k < j)) {
+          is_equivalent =
+              commutable[i * nops + k] and commutable[j * nops + k];
+        } else {
+          is_equivalent = commutable[i * nops + k] == commutable[j * nops + k];
+        }
+      }
+      equivalent[i * nops + j] = is_equivalent;
     }
   }
 
-  PRINT(PrintLevel::Detailed,
-        cout << "  Found " << graphs.size() << " valid graphs" << endl;);
-
-  // sort all the graphs
-  std::sort(graphs.begin(), graphs.end(),
-            [&](const std::pair<int, int> &l, const std::pair<int, int> &r) {
-              return graph_less(l, r, ops_perms, con_perms, ops, contractions);
-            });
+  // sort the contractions from the highest to the lowest for a given order of
+  // the operators. The result is stored in contr_perm to avoid allocating a
+  // new vector for each candidate
+  std::pmr::vector<int> contr_perm(contractions.size(), arena.resource());
+  auto sort_contractions = [&](const std::pmr::vector<int> &ops_perm) {
+    std::iota(contr_perm.begin(), contr_perm.end(), 0);
+    std::stable_sort(contr_perm.begin(), contr_perm.end(), [&](int l, int r) {
+      return contraction_less(contractions[r], contractions[l], ops_perm);
+    });
+  };
+
+  bool found = false;
+  std::pmr::vector<int> best_ops_perm(arena.resource());
+  std::pmr::vector<int> best_contr_perm(arena.resource());
+
+  // return true if the graph (ops_perm, contr_perm) comes before the best one
+  auto is_better = [&](const std::pmr::vector<int> &ops_perm,
+                       const std::pmr::vector<int> &contr_perm) {
+    if (not found) {
+      return true;
+    }
+    for (int i = 0; i < nops; i++) {
+      if (ops[ops_perm[i]] < ops[best_ops_perm[i]]) {
+        return true;
+      }
+      if (ops[best_ops_perm[i]] < ops[ops_perm[i]]) {
+        return false;
+      }
+    }
+    for (size_t j = 0; j < contr_perm.size(); j++) {
+      const auto &l_con = contractions[contr_perm[j]];
+      const auto &r_con = contractions[best_contr_perm[j]];
+      for (int i = 0; i < nops; i++) {
+        if (r_con[best_ops_perm[i]] < l_con[ops_perm[i]]) {
+          return true;
+        }
+        if (l_con[ops_perm[i]] < r_con[best_ops_perm[i]]) {
+          return false;
+        }
+      }
+    }
+    return false;
+  };
+
+  // depth-first search over the orders of the operators. An operator can be
+  // placed if it commutes with all the operators that precede it in ops and
+  // that are not placed yet
+  std::pmr::vector<int> ops_perm(arena.resource());
+  std::pmr::vector<bool> placed(nops, false, arena.resource());
+  int nleaves = 0;
+  std::function<void()> search = [&]() {
+    const int k = ops_perm.size();
+    if (k == nops) {
+      nleaves++;
+      sort_contractions(ops_perm);
+      // only the best candidate found so far is kept
+      if (is_better(ops_perm, contr_perm)) {
+        found = true;
+        best_ops_perm = ops_perm;
+        std::swap(best_contr_perm, contr_perm);
+        contr_perm.resize(contractions.size());
+      }
+      return;
+    }
+    std::pmr::vector<int> available(arena.resource());
+    for (int j = 0; j < nops; j++) {
+      if (placed[j]) {
+        continue;
+      }
+      bool can_place = true;
+      for (int i = 0; i < j; i++) {
+        if (not placed[i] and not commutable[i * nops + j]) {
+          can_place = false;
+        }
+      }
+      if (can_place) {
+        available.push_back(j);
+      }
+    }
+    int lowest = available[0];
+    for (int j : available) {
+      if (ops[j] < ops[lowest]) {
+        lowest = j;
+      }
+    }
+    // prune this branch if the operators are already higher than the best
+    if (found) {
+      for (int i = 0; i <= k; i++) {
+        const auto &op = (i < k) ? ops[ops_perm[i]] : ops[lowest];
+        if (op < ops[best_ops_perm[i]]) {
+          break;
+        }
+        if (ops[best_ops_perm[i]] < op) {
+          return;
+        }
+      }
+    }
+    std::pmr::vector<int> tried(arena.resource());
+    for (int j : available) {
+      if ((ops[j] != ops[lowest]) or
+          std::any_of(tried.begin(), tried.end(),
+                      [&](int i) { return equivalent[i * nops + j]; })) {
+        continue;
+      }
+      tried.push_back(j);
+      placed[j] = true;
+      ops_perm.push_back(j);
+      search();
+      ops_perm.pop_back();
+      placed[j] = false;
+    }
+  };
+  search();
+  if (npermutations) {
+    *npermutations += nleaves;
+  }
 
-  const auto [canonical_ops_perm_idx, canonical_contr_perm_idx] = graphs[0];
+  PRINT(PrintLevel::Detailed, cout << "  Compared " << nleaves
+                                   << " operator permutations" << endl;);
 
-  // Get the sign associated with rearranging the operators
-  const scalar_t canonical_sign = ops_perms_sign[canonical_ops_perm_idx];
+  const scalar_t canonical_sign =
+      is_ops_permutation_valid(ops, best_ops_perm, commutable).second;
 
   // Get the canonical order of the operators
   OperatorProduct canonical_ops;
-  for (int o : ops_perms[canonical_ops_perm_idx]) {
+  for (int o : best_ops_perm) {
     canonical_ops.push_back(ops[o]);
   }
 
   // Get the canonical order of the contractions
   // permute the order and operator upon a contraction acts
   CompositeContraction canonical_contr;
-  for (int c : con_perms[canonical_contr_perm_idx]) {
+  for (int c : best_contr_perm) {
     std::vector<GraphMatrix> permuted_contr;
-    for (int o : ops_perms[canonical_ops_perm_idx]) {
+    for (int o : best_ops_perm) {
       permuted_contr.push_back(contractions[c][o]);
     }
     canonical_contr.push_back(permuted_contr);
@@ -266,14 +338,14 @@ WickTheorem::canonicalize_contraction_graph(
   PRINT(PrintLevel::Detailed,
         cout << "\n  Canonical form of the contraction:" << endl;
         cout << "    Sign = " << canonical_sign.repr() << endl;
-        cout << "    Operator permutation: ";
-        PRINT_ELEMENTS(ops_perms[canonical_ops_perm_idx]); cout << endl;
-        cout << "    Contraction permutation: ";
-        PRINT_ELEMENTS(con_perms[canonical_contr_perm_idx]); cout << endl;
+        cout << "    Operator permutation: "; PRINT_ELEMENTS(best_ops_perm);
+        cout << endl; cout << "    Contraction permutation: ";
+        PRINT_ELEMENTS(best_contr_perm); cout << endl;
         cout << "    Graph of the canonical contraction:" << endl;
-        print_contraction_graph(ops, contractions,
-                                ops_perms[canonical_ops_perm_idx],
-                                con_perms[canonical_contr_perm_idx]);
+        print_contraction_graph(
+            ops, contractions.to_composite_contraction(),
+            std::vector<int>(best_ops_perm.begin(), best_ops_perm.end()),
+            std::vector<int>(best_contr_perm.begin(), best_contr_perm.end()));
         cout << endl;);
 
   return std::make_tuple(canonical_ops, canonical_contr, canonical_sign);
@@ -1,8 +1,20 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "fmt/format.h"
 
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+
 #include "contraction.h"
 #include "graph_matrix.h"
 #include "operator.h"
@@ -17,12 +29,17 @@
 
 using namespace std;
 
+// The largest number of permutations of identical operators used to skip
+// equivalent contractions
+constexpr size_t max_contraction_symmetries = 5040;
+
 void WickTheorem::generate_composite_contractions(const OperatorProduct &ops,
                                                   const int minrank,
                                                   const int maxrank) {
   PRINT(PrintLevel::Summary,
         std::cout << "\n- Step 2. Generating composite contractions"
                   << std::endl;)
+  check_options(ops);
 
   // this vector is used in the backtracking algorithm to hold the list of
   // elementary contractions
@@ -41,21 +58,65 @@ void WickTheorem::generate_composite_contractions(const OperatorProduct &ops,
         << "\n    "
            "----------------------------------------------------------";)
 
-  // generate all contractions by backtracking
-  generate_contractions_backtrack(a, 0, elementary_contractions_,
-                                  free_graph_matrix_vec, minrank, maxrank);
+  // skip the search if the operators cannot be linked
+  if (not is_connectivity_possible(free_graph_matrix_vec)) {
+    ncontractions_ = 0;
+    PRINT(PrintLevel::Summary,
+          std::cout << "\n\n    The operators cannot be linked" << std::endl;)
+    return;
+  }
+
+  // generate all contractions by backtracking (in parallel only when we are
+  // not printing)
+  const int nthreads = (print_ > PrintLevel::None) ? 1 : this->nthreads();
+  if (nthreads > 1) {
+    generate_contractions_parallel(a, elementary_contractions_,
+                                   free_graph_matrix_vec, minrank, maxrank,
+                                   nthreads);
+  } else {
+    size_t npruned = 0;
+    size_t nvisited = 0;
+    generate_contractions_backtrack(
+        a, 0, elementary_contractions_, free_graph_matrix_vec, minrank, maxrank,
+        collect_contractions(contractions_, contraction_weights_), npruned,
+        nvisited);
+    stats_.add_count("step 2/pruned nodes", npruned);
+    stats_.add_count("step 2/nodes visited", nvisited);
+  }
+  ncontractions_ = contractions_.size();
+  stats_.add_count("step 2/contractions", ncontractions_);
   PRINT(PrintLevel::Summary, std::cout << "\n\n    Total contractions: "
                                        << ncontractions_ << std::endl;)
 }
 
 void WickTheorem::generate_contractions_backtrack(
-    std::vector<int> a, int k,
+    std::vector<int> &a, int k,
     const std::vector<ElementaryContraction> &el_contr_vec,
     std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
-    const int maxrank) {
+    const int maxrank, const contraction_sink_t &sink, size_t &npruned,
+    size_t &nvisited) {
+  nvisited += 1;
+
+  // skip the subtree if it contains only contractions equivalent to others or
+  // if it has too many cumulants (adding contractions cannot remove them)
+  int weight = 1;
+  if ((not is_canonical_contraction(a, k, weight)) or
+      (total_cumulant(a, k) > max_total_cumulant(minrank))) {
+    npruned += 1;
+    return;
+  }
 
   // process this contraction
-  process_contraction(a, k, free_graph_matrix_vec, minrank, maxrank);
+  process_contraction(a, k, free_graph_matrix_vec, minrank, maxrank, weight,
+                      sink);
+
+  // skip the subtree if it has no contractions with the correct rank or
+  // connectivity
+  if (not(can_reach_rank(free_graph_matrix_vec, minrank, maxrank) and
+          satisfies_connectivity(a, k, free_graph_matrix_vec, false))) {
+    npruned += 1;
+    return;
+  }
 
   // build a list of candidate contractions to add to this solution
   k = k + 1;
@@ -66,30 +127,466 @@ void WickTheorem::generate_contractions_backtrack(
   for (const auto &c : candidates) {
     make_move(a, k, c, el_contr_vec, free_graph_matrix_vec);
     generate_contractions_backtrack(a, k, el_contr_vec, free_graph_matrix_vec,
-                                    minrank, maxrank);
+                                    minrank, maxrank, sink, npruned, nvisited);
     unmake_move(a, k, c, el_contr_vec, free_graph_matrix_vec);
   }
 }
 
-void WickTheorem::process_contraction(
-    const std::vector<int> &a, int k,
+// A node of the backtracking tree found when splitting the search. If is_task
+// is true the whole subtree rooted at this node is processed by a thread,
+// otherwise only the node itself is processed
+struct BacktrackSegment {
+  bool is_task;
+  int k;
+  std::vector<int> a;
+  std::vector<GraphMatrix> free_graph_matrix_vec;
+  CompositeContractionList contractions;
+  std::vector<int> weights;
+  size_t npruned = 0;
+  size_t nvisited = 0;
+};
+
+void WickTheorem::generate_contractions_parallel(
+    std::vector<int> &a,
+    const std::vector<ElementaryContraction> &el_contr_vec,
+    std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
+    const int maxrank, int nthreads) {
+  // the smallest number of subtrees assigned to each thread. Many small tasks
+  // balance the load when the subtrees have very different sizes
+  constexpr size_t min_tasks_per_thread = 8;
+  constexpr int max_split_depth = 4;
+
+  // walk the top of the tree in the same order as the serial algorithm and
+  // cut it at depth split_depth
+  std::vector<BacktrackSegment> segments;
+  size_t ntasks = 0;
+  std::function<void(int, int)> split = [&](int k, int split_depth) {
+    if (k == split_depth) {
+      segments.push_back({true, k, a, free_graph_matrix_vec, {}, {}});
+      ntasks++;
+      return;
+    }
+    segments.push_back({false, k, {}, {}, {}, {}});
+    BacktrackSegment &segment = segments.back();
+    segment.nvisited += 1;
+    int weight = 1;
+    if ((not is_canonical_contraction(a, k, weight)) or
+        (total_cumulant(a, k) > max_total_cumulant(minrank))) {
+      segment.npruned += 1;
+      return;
+    }
+    process_contraction(
+        a, k, free_graph_matrix_vec, minrank, maxrank, weight,
+        collect_contractions(segment.contractions, segment.weights));
+    if (not(can_reach_rank(free_graph_matrix_vec, minrank, maxrank) and
+            satisfies_connectivity(a, k, free_graph_matrix_vec, false))) {
+      segment.npruned += 1;
+      return;
+    }
+    k = k + 1;
+    std::vector<int> candidates =
+        construct_candidates(a, k, el_contr_vec, free_graph_matrix_vec);
+    for (const auto &c : candidates) {
+      make_move(a, k, c, el_contr_vec, free_graph_matrix_vec);
+      split(k, split_depth);
+      unmake_move(a, k, c, el_contr_vec, free_graph_matrix_vec);
+    }
+  };
+
+  // increase the depth until there are enough tasks
+  for (int split_depth = 1; split_depth <= max_split_depth; split_depth++) {
+    segments.clear();
+    ntasks = 0;
+    split(0, split_depth);
+    if (ntasks >= min_tasks_per_thread * nthreads) {
+      break;
+    }
+  }
+
+  // the threads pick the next available task until all are done. Each task
+  // owns its solution vector, free graph matrices, and output
+  std::vector<BacktrackSegment *> tasks;
+  for (auto &segment : segments) {
+    if (segment.is_task) {
+      tasks.push_back(&segment);
+    }
+  }
+  std::atomic<size_t> next_task(0);
+  const OrbitalSpaceInfo *caller_osi = osi();
+
+  // when a worker fails, the others stop before their next task and the
+  // exception is rethrown after the threads are joined
+  const int nworkers = std::min(nthreads, static_cast<int>(tasks.size()));
+  std::atomic<bool> failed(false);
+  std::vector<std::exception_ptr> errors(nworkers);
+
+  auto work = [&](int id) {
+    OrbitalSpaceContext context(caller_osi);
+    TraceScope trace("step 2 worker", "thread");
+    try {
+      for (size_t n = next_task++; (not failed) and (n < tasks.size());
+           n = next_task++) {
+        BacktrackSegment &task = *tasks[n];
+        generate_contractions_backtrack(task.a, task.k, el_contr_vec,
+                                        task.free_graph_matrix_vec, minrank,
+                                        maxrank,
+                                        collect_contractions(task.contractions,
+                                                             task.weights),
+                                        task.npruned, task.nvisited);
+      }
+    } catch (...) {
+      errors[id] = std::current_exception();
+      failed = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int id = 0; id < nworkers; id++) {
+    threads.push_back(std::thread(work, id));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // collect the contractions in the order of the serial algorithm
+  for (auto &segment : segments) {
+    contractions_.append(segment.contractions);
+    contraction_weights_.insert(contraction_weights_.end(),
+                                segment.weights.begin(), segment.weights.end());
+    stats_.add_count("step 2/pruned nodes", segment.npruned);
+    stats_.add_count("step 2/nodes visited", segment.nvisited);
+  }
+}
+
+bool WickTheorem::can_reach_rank(
     const std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
-    const int maxrank) {
-  int num_ops = sum_num_ops(free_graph_matrix_vec);
-  if ((num_ops >= minrank) and (num_ops <= maxrank)) {
-    contractions_.push_back(std::vector<int>(a.begin(), a.begin() + k));
-    ncontractions_++;
+    const int maxrank) const {
+  // the number of free operators and the largest number of operators that
+  // can still be contracted
+  int num_ops = 0;
+  int max_contracted = 0;
+  const int nspaces = osi()->num_spaces();
+  const bool has_target = not target_cre_.empty();
+  bool at_target = true;
+  // add the free operators of all vertices with word operations, then read
+  // the counts of each space once
+  GraphMatrix free_total;
+  for (const auto &free_graph_matrix : free_graph_matrix_vec) {
+    free_total += free_graph_matrix;
+  }
+  for (int s = 0; s < nspaces; s++) {
+    const int ncre = free_total.cre(s);
+    const int nann = free_total.ann(s);
+    num_ops += ncre + nann;
+    max_contracted += 2 * std::min(ncre, nann);
+    // contractions only lower the free counts and leave ncre - nann unchanged
+    if (has_target) {
+      if ((ncre < target_cre_[s]) or (nann < target_ann_[s]) or
+          (ncre - nann != target_cre_[s] - target_ann_[s])) {
+        return false;
+      }
+      at_target = at_target and (ncre == target_cre_[s]);
+    }
+  }
+  // contracting more operators moves away from the target
+  if (has_target and at_target) {
+    return false;
+  }
+  // adding contractions removes 2 j operators (j >= 1) from the free ones.
+  // Find the range of j compatible with the rank limits
+  int jmin = std::max(1, (num_ops - maxrank + 1) / 2);
+  int jmax = std::min(max_contracted, num_ops - minrank) / 2;
+  return jmin <= jmax;
+}
+
+void WickTheorem::set_elementary_contractions(
+    const OperatorProduct &ops, std::vector<ElementaryContraction> &&contr) {
+  elementary_contractions_ = std::move(contr);
+  elementary_contraction_masks_.clear();
+  elementary_cumulant_levels_.clear();
+  for (const auto &el_contr : elementary_contractions_) {
+    uint64_t mask = 0;
+    for (int A = 0, nops = el_contr.size(); A < nops; A++) {
+      if (not el_contr[A].empty()) {
+        mask |= (A < 64) ? (uint64_t(1) << A) : ~uint64_t(0);
+      }
+    }
+    elementary_contraction_masks_.push_back(mask);
+    // a contraction of 2 k operators (k >= 2) is a k-body cumulant
+    const int num_ops = el_contr.num_ops();
+    elementary_cumulant_levels_.push_back(num_ops > 2 ? num_ops / 2 : 0);
+  }
+
+  // find the runs of consecutive identical operators that commute and contain
+  // an even number of second quantized operators. Permuting them leaves the
+  // product unchanged. The first operator is kept fixed when the other
+  // operators must be linked to it
+  contraction_symmetries_.clear();
+  const int nops = ops.size();
+  std::vector<std::vector<int>> blocks;
+  size_t order = 1;
+  for (int i = (connectivity_ == Connectivity::LinkedToFirst); i < nops;) {
+    std::vector<int> block{i};
+    if ((ops[i].num_ops() % 2 == 0) and do_operators_commute(ops[i], ops[i])) {
+      while ((block.back() + 1 < nops) and (ops[block.back() + 1] == ops[i])) {
+        block.push_back(block.back() + 1);
+        order *= block.size();
+      }
+    }
+    i += block.size();
+    if (block.size() > 1) {
+      blocks.push_back(block);
+    }
+  }
+  if (blocks.empty() or (order > max_contraction_symmetries)) {
+    return;
+  }
+
+  // find the image of each elementary contraction under each permutation of
+  // the identical operators. The first permutation is the identity
+  std::map<ElementaryContraction, int> index;
+  for (int c = 0, nc = elementary_contractions_.size(); c < nc; c++) {
+    index[elementary_contractions_[c]] = c;
+  }
+  std::vector<int> perm(nops);
+  std::iota(perm.begin(), perm.end(), 0);
+  bool is_identity = true;
+  bool closed = true;
+  std::function<void(size_t)> permute_blocks = [&](size_t b) {
+    if (b == blocks.size()) {
+      if (std::exchange(is_identity, false)) {
+        return;
+      }
+      std::vector<int> image_index;
+      for (const auto &el_contr : elementary_contractions_) {
+        std::vector<GraphMatrix> image(nops);
+        for (int A = 0; A < nops; A++) {
+          image[perm[A]] = el_contr[A];
+        }
+        auto it = index.find(ElementaryContraction(image));
+        if (it == index.end()) {
+          closed = false;
+          return;
+        }
+        image_index.push_back(it->second);
+      }
+      contraction_symmetries_.push_back(std::move(image_index));
+      return;
+    }
+    std::vector<int> targets = blocks[b];
+    do {
+      for (size_t r = 0; r < targets.size(); r++) {
+        perm[blocks[b][r]] = targets[r];
+      }
+      permute_blocks(b + 1);
+    } while (std::next_permutation(targets.begin(), targets.end()));
+  };
+  permute_blocks(0);
+  if (not closed) {
+    contraction_symmetries_.clear();
+  }
+}
+
+bool WickTheorem::is_canonical_contraction(const std::vector<int> &a, int k,
+                                           int &weight) const {
+  weight = 1;
+  if (contraction_symmetries_.empty() or (k == 0)) {
+    return true;
+  }
+  // count the permutations that leave the contractions unchanged
+  thread_local std::vector<int> image;
+  int nstabilizer = 1;
+  for (const auto &image_index : contraction_symmetries_) {
+    image.resize(k);
+    for (int i = 0; i < k; i++) {
+      image[i] = image_index[a[i]];
+    }
+    std::sort(image.begin(), image.end());
+    int i = 0;
+    while ((i < k) and (image[i] == a[i])) {
+      i++;
+    }
+    if (i == k) {
+      nstabilizer += 1;
+    } else if (image[i] < a[i]) {
+      return false;
+    }
+  }
+  weight = (contraction_symmetries_.size() + 1) / nstabilizer;
+  return true;
+}
+
+WickTheorem::contraction_sink_t
+WickTheorem::collect_contractions(CompositeContractionList &contractions,
+                                  std::vector<int> &weights) {
+  return [this, &contractions, &weights](
+             const std::vector<int> &a, int k,
+             const std::vector<GraphMatrix> &free_graph_matrix_vec,
+             int weight) {
+    contractions.push_back(a.data(), a.data() + k);
+    weights.push_back(weight);
     PRINT(
         PrintLevel::Summary, GraphMatrix free_ops;
         for (const auto &free_graph_matrix
              : free_graph_matrix_vec) { free_ops += free_graph_matrix; };
-        cout << fmt::format("\n  {:5d}    {:3d}    ", ncontractions_ + 1,
+        cout << fmt::format("\n  {:5d}    {:3d}    ", contractions.size() + 1,
                             free_ops.num_ops());
         for (int i = 0; i < k; ++i) { cout << fmt::format(" {:3d}", a[i]); };
         cout << std::string(std::max(24 - 4 * k, 2), ' ') << free_ops;)
+  };
+}
+
+void WickTheorem::process_contraction(
+    const std::vector<int> &a, int k,
+    const std::vector<GraphMatrix> &free_graph_matrix_vec, const int minrank,
+    const int maxrank, int weight, const contraction_sink_t &sink) {
+  int num_ops = sum_num_ops(free_graph_matrix_vec);
+  if ((num_ops >= minrank) and (num_ops <= maxrank) and
+      (total_cumulant(a, k) <= max_total_cumulant(num_ops)) and
+      matches_target(free_graph_matrix_vec) and
+      satisfies_connectivity(a, k, free_graph_matrix_vec, true)) {
+    sink(a, k, free_graph_matrix_vec, weight);
+  }
+}
+
+int WickTheorem::total_cumulant(const std::vector<int> &a, int k) const {
+  int total = 0;
+  for (int i = 0; i < k; i++) {
+    total += elementary_cumulant_levels_[a[i]];
+  }
+  return total;
+}
+
+int WickTheorem::max_total_cumulant(int rank) const {
+  // the limits are sorted by rank, so stop at the first one that does not
+  // apply
+  int result = std::numeric_limits<int>::max();
+  for (const auto &[min_rank, n] : max_total_cumulant_) {
+    if (min_rank > rank) {
+      break;
+    }
+    result = std::min(result, n);
+  }
+  return result;
+}
+
+bool WickTheorem::matches_target(
+    const std::vector<GraphMatrix> &free_graph_matrix_vec) const {
+  for (int s = 0, nspaces = target_cre_.size(); s < nspaces; s++) {
+    int ncre = 0;
+    int nann = 0;
+    for (const auto &free_graph_matrix : free_graph_matrix_vec) {
+      ncre += free_graph_matrix.cre(s);
+      nann += free_graph_matrix.ann(s);
+    }
+    if ((ncre != target_cre_[s]) or (nann != target_ann_[s])) {
+      return false;
+    }
   }
+  return true;
 }
 
+void WickTheorem::check_options(const OperatorProduct &ops) const {
+  if ((not target_cre_.empty()) and
+      (target_cre_.size() != static_cast<size_t>(osi()->num_spaces()))) {
+    throw std::runtime_error(
+        "WickTheorem: the target signature does not match the number of "
+        "orbital spaces");
+  }
+  if ((connectivity_ != Connectivity::All) and (ops.size() > 64)) {
+    throw std::runtime_error(
+        "WickTheorem: the connectivity can be selected only for products of "
+        "up to 64 operators");
+  }
+}
+
+bool WickTheorem::is_connectivity_possible(
+    const std::vector<GraphMatrix> &free_graph_matrix_vec) const {
+  if (connectivity_ == Connectivity::All) {
+    return true;
+  }
+  // test the graph that contains all the elementary contractions
+  std::vector<int> all(elementary_contractions_.size());
+  std::iota(all.begin(), all.end(), 0);
+  return satisfies_connectivity(all, all.size(), free_graph_matrix_vec, true);
+}
+
+bool WickTheorem::satisfies_connectivity(
+    const std::vector<int> &a, int k,
+    const std::vector<GraphMatrix> &free_graph_matrix_vec,
+    bool complete) const {
+  const int nops = free_graph_matrix_vec.size();
+  const uint64_t all_ops =
+      (nops < 64) ? (uint64_t(1) << nops) - 1 : ~uint64_t(0);
+
+  if (connectivity_ == Connectivity::LinkedToFirst) {
+    // the operators that share a contraction with the first one
+    uint64_t linked = 1;
+    for (int i = 0; i < k; i++) {
+      uint64_t mask = elementary_contraction_masks_[a[i]];
+      if (mask & 1) {
+        linked |= mask;
+      }
+    }
+    if (complete or linked == all_ops) {
+      return linked == all_ops;
+    }
+    // the operators not linked yet need free operators, and so does the first
+    if (free_graph_matrix_vec[0].empty()) {
+      return false;
+    }
+    for (uint64_t mask = all_ops & ~linked; mask != 0; mask &= mask - 1) {
+      if (free_graph_matrix_vec[__builtin_ctzll(mask)].empty()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (connectivity_ == Connectivity::Connected) {
+    // find the connected components (stored as masks of operators)
+    uint64_t components[64];
+    int ncomponents = 0;
+    for (int A = 0; A < nops; A++) {
+      components[ncomponents++] = uint64_t(1) << A;
+    }
+    for (int i = 0; i < k; i++) {
+      uint64_t merged = elementary_contraction_masks_[a[i]];
+      int n = 0;
+      for (int c = 0; c < ncomponents; c++) {
+        if (components[c] & merged) {
+          merged |= components[c];
+        } else {
+          components[n++] = components[c];
+        }
+      }
+      components[n++] = merged;
+      ncomponents = n;
+    }
+    if (complete or ncomponents == 1) {
+      return ncomponents == 1;
+    }
+    // a component without free operators cannot be linked to the others
+    for (int c = 0; c < ncomponents; c++) {
+      bool has_free_ops = false;
+      for (uint64_t mask = components[c]; mask != 0; mask &= mask - 1) {
+        if (not free_graph_matrix_vec[__builtin_ctzll(mask)].empty()) {
+          has_free_ops = true;
+          break;
+        }
+      }
+      if (not has_free_ops) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 std::vector<int> WickTheorem::construct_candidates(
     std::vector<int> &a, int k,
     const std::vector<ElementaryContraction> &el_contr_vec,
@@ -109,16 +606,18 @@ std::vector<int> WickTheorem::construct_candidates(
 
     // test if this contraction is valid: check that the number of
     // operators to contract is less than or equal to the number of
-    // free (uncontracted) operators
+    // free (uncontracted) operators. Only the operators contracted by c
+    // need to be tested
     bool is_valid_contraction = true;
-    for (int A = 0; A < nops; A++) {
-      for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
-        if (free_graph_matrix_vec[A].cre(s) < el_contr[A].cre(s)) {
-          is_valid_contraction = false;
-        }
-        if (free_graph_matrix_vec[A].ann(s) < el_contr[A].ann(s)) {
-          is_valid_contraction = false;
-        }
+    if (nops <= 64) {
+      for (uint64_t mask = elementary_contraction_masks_[c];
+           is_valid_contraction and mask != 0; mask &= mask - 1) {
+        int A = __builtin_ctzll(mask);
+        is_valid_contraction = free_graph_matrix_vec[A].contains(el_contr[A]);
+      }
+    } else {
+      for (int A = 0; is_valid_contraction and A < nops; A++) {
+        is_valid_contraction = free_graph_matrix_vec[A].contains(el_contr[A]);
       }
     }
     if (is_valid_contraction) {
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+
+#ifdef WICKED_USE_MPI
+#include <mpi.h>
+#endif
+
+#include "helpers/orbital_space.h"
+#include "helpers/trace.h"
+#include "operator.h"
+#include "operator_expression.h"
+#include "serialize.h"
+
+#include "wick_theorem.h"
+
+std::vector<int> balance_load(const std::vector<double> &costs, int nparts) {
+  nparts = std::max(nparts, 1);
+
+  // sort the items by decreasing cost (stable, so equal costs keep their
+  // order)
+  std::vector<size_t> order(costs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+  // assign each item to the part with the lowest total (the first one if
+  // several are equal)
+  std::vector<double> load(nparts, 0.0);
+  std::vector<int> part(costs.size());
+  for (size_t n : order) {
+    const int p = std::min_element(load.begin(), load.end()) - load.begin();
+    part[n] = p;
+    load[p] += costs[n];
+  }
+  return part;
+}
+
+std::pair<std::vector<size_t>, size_t>
+schedule_by_cost(const std::vector<double> &costs, int nthreads) {
+  nthreads = std::max(nthreads, 1);
+  const double total = std::accumulate(costs.begin(), costs.end(), 0.0);
+  const double share = total / nthreads;
+
+  // sort the items by decreasing cost (stable, so equal costs keep their
+  // order). The items to split are the most expensive, so they come first
+  std::vector<size_t> order(costs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return costs[a] > costs[b];
+  });
+  const size_t nsplit =
+      (nthreads > 1)
+          ? std::count_if(costs.begin(), costs.end(),
+                          [share](double c) { return c > share; })
+          : 0;
+  return {order, nsplit};
+}
+
+#ifdef WICKED_USE_MPI
+
+namespace {
+
+/// The largest message sent in one call (MPI counts are int)
+constexpr uint64_t max_message_size = uint64_t(1) << 30;
+
+/// The tag of the messages sent by contract_distributed
+constexpr int reduce_tag = 7117;
+
+void mpi_init() {
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if (not initialized) {
+    // only the calling thread uses MPI
+    int provided = 0;
+    MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+    std::atexit([]() {
+      int finalized = 0;
+      MPI_Finalized(&finalized);
+      if (not finalized) {
+        MPI_Finalize();
+      }
+    });
+  }
+}
+
+void send_string(const std::string &s, int dest) {
+  uint64_t size = s.size();
+  MPI_Send(&size, 1, MPI_UINT64_T, dest, reduce_tag, MPI_COMM_WORLD);
+  for (uint64_t offset = 0; offset < size; offset += max_message_size) {
+    const int count = std::min(size - offset, max_message_size);
+    MPI_Send(s.data() + offset, count, MPI_BYTE, dest, reduce_tag,
+             MPI_COMM_WORLD);
+  }
+}
+
+std::string recv_string(int source) {
+  uint64_t size = 0;
+  MPI_Recv(&size, 1, MPI_UINT64_T, source, reduce_tag, MPI_COMM_WORLD,
+           MPI_STATUS_IGNORE);
+  std::string s(size, '\0');
+  for (uint64_t offset = 0; offset < size; offset += max_message_size) {
+    const int count = std::min(size - offset, max_message_size);
+    MPI_Recv(&s[offset], count, MPI_BYTE, source, reduce_tag, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+  }
+  return s;
+}
+
+/// Copy a string from process root to all the other processes
+void broadcast_string(std::string &s, int root) {
+  uint64_t size = s.size();
+  MPI_Bcast(&size, 1, MPI_UINT64_T, root, MPI_COMM_WORLD);
+  s.resize(size);
+  for (uint64_t offset = 0; offset < size; offset += max_message_size) {
+    const int count = std::min(size - offset, max_message_size);
+    MPI_Bcast(&s[offset], count, MPI_BYTE, root, MPI_COMM_WORLD);
+  }
+}
+
+} // namespace
+
+int mpi_rank() {
+  mpi_init();
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return rank;
+}
+
+int mpi_size() {
+  mpi_init();
+  int size = 1;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  return size;
+}
+
+#else
+
+int mpi_rank() { return 0; }
+
+int mpi_size() { return 1; }
+
+#endif
+
+double WickTheorem::contraction_cost(const OperatorProduct &ops) {
+  OrbitalSpaceContext context(osi_);
+  // the elementary contractions are generated without printing
+  const PrintLevel print = print_;
+  print_ = PrintLevel::None;
+  const size_t nelementary = generate_elementary_contractions(ops).size();
+  print_ = print;
+  int nsqops = 0;
+  for (const auto &op : ops) {
+    nsqops += op.graph_matrix().num_ops();
+  }
+  return (ops.size() + nsqops) *
+         std::exp2(std::min<size_t>(nelementary, 64));
+}
+
+Expression WickTheorem::contract_distributed(scalar_t factor,
+                                             const OperatorExpression &expr,
+                                             const int minrank,
+                                             const int maxrank) {
+  const int nranks = mpi_size();
+  if (nranks == 1) {
+    return contract(factor, expr, minrank, maxrank);
+  }
+#ifdef WICKED_USE_MPI
+  OrbitalSpaceContext context(osi_);
+  const int rank = mpi_rank();
+
+  // every process computes the same partition of the products
+  std::vector<double> costs;
+  for (const auto &[ops, f] : expr.terms()) {
+    costs.push_back(contraction_cost(ops));
+  }
+  const std::vector<int> part = balance_load(costs, nranks);
+
+  OperatorExpression share;
+  size_t n = 0;
+  for (const auto &[ops, f] : expr.terms()) {
+    if (part[n++] == rank) {
+      share.add(ops, f);
+    }
+  }
+  // each process saves the checkpoints of its share to its own files
+  const std::string checkpoint_filename = checkpoint_filename_;
+  if (not checkpoint_filename_.empty()) {
+    checkpoint_filename_ += ".rank" + std::to_string(rank);
+  }
+  Expression sum;
+  try {
+    sum = contract(factor, share, minrank, maxrank);
+  } catch (...) {
+    checkpoint_filename_ = checkpoint_filename;
+    throw;
+  }
+  checkpoint_filename_ = checkpoint_filename;
+
+  // sum the partial results along a binary tree. At the level with distance
+  // step, each process with rank = step (mod 2 step) sends its sum to the
+  // process rank - step and leaves
+  TraceScope trace_reduce("reduce", "mpi");
+  for (int step = 1; step < nranks; step *= 2) {
+    if (rank % (2 * step) == step) {
+      send_string(serialize(sum), rank - step);
+      break;
+    }
+    if (rank + step < nranks) {
+      sum += deserialize_expression(recv_string(rank + step));
+    }
+  }
+
+  trace_reduce.end();
+
+  // the total is on process 0
+  TraceScope trace_broadcast("broadcast", "mpi");
+  std::string data = (rank == 0) ? serialize(sum) : std::string();
+  broadcast_string(data, 0);
+  return (rank == 0) ? sum : deserialize_expression(data);
+#else
+  return contract(factor, expr, minrank, maxrank);
+#endif
+}
@@ -32,21 +32,23 @@ WickTheorem::generate_elementary_contractions(const OperatorProduct &ops) {
       PrintLevel::Summary, cout << "\n  Operator   Space   Cre.   Ann.";
       cout << "\n  ------------------------------";
       for (int op = 0; op < nops; ++op) {
-        for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
-          cout << "\n      " << op << "        " << orbital_subspaces->label(s)
+        for (int s = 0; s < osi()->num_spaces(); s++) {
+          cout << "\n      " << op << "        " << osi()->label(s)
                << "      " << ops[op].cre(s) << "      " << ops[op].ann(s);
         }
       };
       cout << "\n";)
 
   // loop over orbital spaces
-  for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
+  const std::vector<SpaceType> &space_types = osi()->space_types();
+  const int nspaces = osi()->num_spaces();
+  for (int s = 0; s < nspaces; s++) {
     PRINT(PrintLevel::Summary, std::cout
                                    << "\n  Elementary contractions for space "
-                                   << orbital_subspaces->label(s) << ": ";)
+                                   << osi()->label(s) << ": ";)
 
     // differentiate between various types of spaces
-    SpaceType space_type = orbital_subspaces->space_type(s);
+    SpaceType space_type = space_types[s];
 
     // 1. Pairwise contractions 1 cre + 1 ann operator:
     // ┌───┐
@@ -123,7 +125,13 @@ void WickTheorem::elementary_contractions_general(
   }
   // the number of legs is limited by the smallest of number of cre/ann
   // operators and the maximum cumulant level allowed
-  int max_half_legs = std::min(std::min(sumcre, sumann), maxcumulant_);
+  // the limit set for this space replaces the global one
+  int maxcumulant = maxcumulant_;
+  if (auto it = space_maxcumulant_.find(osi()->label(s));
+      it != space_maxcumulant_.end()) {
+    maxcumulant = it->second;
+  }
+  int max_half_legs = std::min(std::min(sumcre, sumann), maxcumulant);
 
   // in this algorithm we loop over all possible lengths of half-leg
   // contractions, partition this number into integers, permute these integers
@@ -133,14 +141,17 @@ void WickTheorem::elementary_contractions_general(
           cout << "\n    " << 2 * half_legs << "-legs contractions";)
     // create partitions of the number of half legs into at most nops numbers.
     // For half_legs = 2 and nops = 2, half_legs_part = [[2],[1,1]]
-    auto half_legs_part = integer_partitions(half_legs, nops);
+    const auto &half_legs_part = tabulated_integer_partitions(half_legs);
     // create lists of leg partitionings among all operators that are
     // compatible with the number of creation and annihilation operators
     //
     // these vectors store the number of cre/ann operators contracted per
     // operator
     std::vector<std::vector<int>> cre_legs_vec, ann_legs_vec;
-    for (const auto part : half_legs_part) {
+    for (const auto &part : half_legs_part) {
+      if (static_cast<int>(part.size()) > nops) {
+        continue;
+      }
       // here we copy the partition and permute it (with added zeros, which
       // signify no contraction)
       std::vector<int> perm(nops, 0);
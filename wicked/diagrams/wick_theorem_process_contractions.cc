@@ -1,6 +1,10 @@
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iomanip>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 
 #include "fmt/format.h"
 
@@ -9,10 +13,12 @@
 #include "helpers/orbital_space.h"
 #include "helpers/stl_utils.hpp"
 #include "helpers/timer.hpp"
+#include "helpers/trace.h"
 
 #include "contraction.h"
 #include "operator.h"
 #include "operator_expression.h"
+#include "tensor_blocks.h"
 
 #include "../algebra/expression.h"
 #include "../algebra/sqoperator.h"
@@ -38,13 +44,30 @@ void print_contraction_graph(const OperatorProduct &ops,
                              const std::vector<int> ops_perm,
                              const std::vector<int> contr_perm);
 
+/// Return a string that identifies a contraction graph
 std::string contraction_signature(const OperatorProduct &ops,
-                                  const CompositeContraction &contractions,
-                                  const std::vector<int> &ops_perm,
-                                  const std::vector<int> &contr_perm);
+                                  const CompositeContraction &contractions);
 
 using namespace std;
 
+// The smallest number of contractions assigned to each thread in step 3
+constexpr size_t min_contractions_per_thread = 16;
+
+namespace {
+/// Buffers reused by WickTheorem::evaluate_contraction to avoid allocations
+struct EvaluateScratch {
+  SQOperatorPositions positions;
+  std::vector<GraphMatrix> ops_offset;
+  std::vector<int> sign_order;
+  std::vector<int> pos_cre_sqops;
+  std::vector<int> pos_ann_sqops;
+  std::vector<std::pair<int, SQOperator>> sorted_sqops;
+  DenseIndexMap pair_contraction_reindex_map;
+};
+
+thread_local EvaluateScratch evaluate_scratch;
+} // namespace
+
 Expression WickTheorem::process_contractions(scalar_t factor,
                                              const OperatorProduct &ops,
                                              const int minrank,
@@ -52,79 +75,228 @@ Expression WickTheorem::process_contractions(scalar_t factor,
   PRINT(PrintLevel::Summary,
         std::cout << "\n- Step 3. Processing contractions" << std::endl;)
 
-  Expression result;
-
-  // loop over all contractions and keep those with the correct rank
+  // select the contractions with the correct rank
   // contraction_vec stores a list of elementary contractions appearing
   // in a term
-  int nprocessed = 0;
+  std::vector<size_t> selected;
   int ops_rank = ops.num_ops();
-  for (const auto &contraction_vec : contractions_) {
+  for (size_t n = 0; n < contractions_.size(); n++) {
     int contr_rank = 0;
-    for (int c : contraction_vec) {
-      contr_rank += elementary_contractions_[c].num_ops();
+    for (const auto &el_contr :
+         contractions_.view(n, elementary_contractions_)) {
+      contr_rank += el_contr.num_ops();
     }
     int term_rank = ops_rank - contr_rank;
-
     if ((term_rank >= minrank) and (term_rank <= maxrank)) {
-      nprocessed++;
-      PRINT(PrintLevel::Basic,
-            cout << "\n\n  Contraction: " << nprocessed
-                 << "  Operator rank: " << ops_rank - contr_rank << endl;)
-
-      CompositeContraction contraction;
-      for (int c : contraction_vec) {
-        contraction.push_back(elementary_contractions_[c]);
-      }
-
-      timer tc;
-      const auto [best_ops, best_contractions, sign] =
-          do_canonicalize_graph_
-              ? canonicalize_contraction_graph(ops, contraction)
-              : std::make_tuple(ops, contraction, scalar_t(1));
-      timers_["canonicalize_contraction_graph"] += tc.get();
-
-      timer te;
-      std::pair<SymbolicTerm, scalar_t> term_factor =
-          evaluate_contraction(best_ops, best_contractions, factor * sign);
-      timers_["evaluate_contraction"] += te.get();
-
-      SymbolicTerm &term = term_factor.first;
-      scalar_t canonicalize_factor = term.canonicalize();
-      result.add(
-          std::make_pair(term, term_factor.second * canonicalize_factor));
-
-      PRINT(PrintLevel::Summary,
-            Term t(term_factor.second * canonicalize_factor, term);
-            cout << "\n    term: " << t << endl;)
+      selected.push_back(n);
     }
   }
-  if (nprocessed == 0) {
+
+  if (selected.size() == 0) {
     PRINT(PrintLevel::Summary, std::cout << "\n  No contractions generated\n"
                                          << std::endl;)
   }
+
+  // process the contractions in parallel only when there is enough work and
+  // when we are not printing
+  int nthreads = std::min(static_cast<size_t>(this->nthreads()),
+                          selected.size() / min_contractions_per_thread);
+  if (print_ > PrintLevel::None) {
+    nthreads = 1;
+  }
+  nthreads = std::max(nthreads, 1);
+
+  // each thread accumulates terms and statistics separately
+  std::vector<HashedExpression> partial(nthreads);
+  std::vector<Statistics> partial_stats(nthreads);
+  const OrbitalSpaceInfo *caller_osi = osi();
+
+  // call fn(id, n) for n = 0, 1, ..., size - 1 using all the threads. When a
+  // thread fails, the others stop and the exception is rethrown here
+  auto parallel_for = [&](size_t size, const auto &fn) {
+    if (nthreads == 1) {
+      for (size_t n = 0; n < size; n++) {
+        fn(0, n);
+      }
+      return;
+    }
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::exception_ptr> errors(nthreads);
+    auto work = [&](int id) {
+      OrbitalSpaceContext context(caller_osi);
+      TraceScope trace("step 3 worker", "thread");
+      try {
+        for (size_t n = next++; (not failed) and (n < size); n = next++) {
+          fn(id, n);
+        }
+      } catch (...) {
+        errors[id] = std::current_exception();
+        failed = true;
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int id = 0; id < nthreads; id++) {
+      threads.push_back(std::thread(work, id));
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  };
+
+  // canonicalize the graph of each contraction and keep only its signature
+  // and its sign, weighted by the number of equivalent contractions not
+  // generated
+  TraceScope trace_canonicalize("canonicalize graphs", "step");
+  std::vector<std::string> signatures(selected.size());
+  std::vector<scalar_t> weighted_signs(selected.size());
+  parallel_for(selected.size(), [&](int id, size_t n) {
+    const auto [best_ops, best_contractions, sign] =
+        canonicalize_composite_contraction(
+            ops, contractions_.view(selected[n], elementary_contractions_),
+            partial_stats[id]);
+    signatures[n] = contraction_signature(best_ops, best_contractions);
+    weighted_signs[n] = scalar_t(contraction_weights_[selected[n]]) * sign;
+  });
+  trace_canonicalize.end();
+
+  // contractions with the same canonical graph give the same term up to a
+  // sign, so we evaluate each graph only once with the sum of the signs. Each
+  // graph is represented by the first contraction that gives it
+  std::vector<std::pair<size_t, scalar_t>> unique;
+  std::unordered_map<std::string, size_t> unique_index;
+  for (size_t n = 0; n < signatures.size(); n++) {
+    auto [it, inserted] =
+        unique_index.emplace(std::move(signatures[n]), unique.size());
+    if (inserted) {
+      unique.emplace_back(n, weighted_signs[n]);
+    } else {
+      unique[it->second].second += weighted_signs[n];
+    }
+  }
+  signatures = std::vector<std::string>();
+  unique_index.clear();
+  stats_.add_count("step 3/contractions", selected.size());
+  stats_.add_count("step 3/unique contractions", unique.size());
+
+  // the canonical graph is rebuilt from the contraction that represents it.
+  // With exact coefficients each thread adds its terms to its partial result.
+  // Otherwise the terms are stored by graph and added in the order of the
+  // graphs, so that the sums do not depend on how the threads shared them
+  TraceScope trace_evaluate("evaluate graphs", "step");
+  std::vector<std::pair<SymbolicTerm, scalar_t>> ordered_terms(
+      exact_coefficients ? 0 : unique.size());
+  parallel_for(unique.size(), [&](int id, size_t n) {
+    const auto &[representative, multiplicity] = unique[n];
+    if (multiplicity == 0) {
+      return;
+    }
+    const auto [best_ops, best_contractions, sign] =
+        canonicalize_composite_contraction(
+            ops,
+            contractions_.view(selected[representative],
+                               elementary_contractions_),
+            partial_stats[id]);
+    const auto [term, c] =
+        evaluate_composite_contraction(factor * multiplicity, best_ops,
+                                       best_contractions, n + 1,
+                                       partial_stats[id]);
+    partial_stats[id].add_count("step 3/terms/emitted");
+    if constexpr (exact_coefficients) {
+      count_term(partial[id].add(term, c), partial_stats[id], "step 3/terms");
+    } else {
+      ordered_terms[n] = {term, c};
+    }
+  });
+  for (auto &[term, c] : ordered_terms) {
+    count_term(partial[0].add(std::move(term), c), stats_, "step 3/terms");
+  }
+  trace_evaluate.end();
+
+  // merge the partial results in the order of the threads
+  for (int id = 0; id < nthreads; id++) {
+    stats_ += partial_stats[id];
+  }
+  return merge(partial, "step 3/terms", nthreads);
+}
+
+WickTheorem::canonical_contraction_t
+WickTheorem::canonicalize_composite_contraction(
+    const OperatorProduct &ops, const CompositeContractionView &contraction,
+    Statistics &stats) {
+  timer tc;
+  size_t npermutations = 0;
+  auto result =
+      do_canonicalize_graph_
+          ? canonicalize_contraction_graph(ops, contraction, &npermutations)
+          : std::make_tuple(ops, contraction.to_composite_contraction(),
+                            scalar_t(1));
+  stats.add_time("canonicalize_contraction_graph", tc.get());
+  stats.add_count("canonicalize_contraction_graph/permutations",
+                  npermutations);
   return result;
 }
 
-std::string contraction_signature(const OperatorProduct &ops,
-                                  const CompositeContraction &contractions,
-                                  const std::vector<int> &ops_perm,
-                                  const std::vector<int> &contr_perm) {
+std::pair<SymbolicTerm, scalar_t> WickTheorem::evaluate_composite_contraction(
+    scalar_t factor, const OperatorProduct &ops,
+    const CompositeContraction &contractions, int n, Statistics &stats) {
+  PRINT(PrintLevel::Basic, int contr_rank = 0;
+        for (const auto &contraction
+             : contractions) { contr_rank += contraction.num_ops(); };
+        cout << "\n\n  Contraction: " << n
+             << "  Operator rank: " << ops.num_ops() - contr_rank << endl;)
+
+  timer te;
+  std::pair<SymbolicTerm, scalar_t> term_factor =
+      (reuse_contractions_ and (print_ == PrintLevel::None))
+          ? evaluate_reused_contraction(ops, contractions, factor, stats)
+          : evaluate_contraction(ops, contractions, factor);
+  stats.add_time("evaluate_contraction", te.get());
+
+  SymbolicTerm &term = term_factor.first;
+  term_factor.second *= term.canonicalize();
+
+  PRINT(PrintLevel::Summary, Term t(term_factor.second, term);
+        cout << "\n    term: " << t << endl;)
+  return term_factor;
+}
 
-  std::string s;
-  int nops = ops.size();
-  for (int i = 0; i < nops; i++) {
-    s += ops[ops_perm[i]].label();
-    s += signature(ops[ops_perm[i]].graph_matrix());
+/// Append to s a string that identifies the graph matrices of the operators
+/// and of the contractions (but not the labels of the operators)
+static void add_graph_signature(const OperatorProduct &ops,
+                                const CompositeContraction &contractions,
+                                std::string &s) {
+  // each count is stored in one character (the counts are less than 128)
+  const int nspaces = osi()->num_spaces();
+  auto add_graph_matrix = [&](const GraphMatrix &gm) {
+    for (int space = 0; space < nspaces; space++) {
+      s += static_cast<char>(gm.cre(space));
+      s += static_cast<char>(gm.ann(space));
+    }
+  };
+  for (const auto &op : ops) {
+    add_graph_matrix(op.graph_matrix());
   }
-
-  // 2. Compare contractions
-  int ncontr = contractions.size();
-  for (int i = 0; i < ncontr; i++) {
-    for (int j = 0; j < nops; j++) {
-      s += signature(contractions[contr_perm[i]][ops_perm[j]]);
+  for (const auto &contraction : contractions) {
+    for (const auto &gm : contraction) {
+      add_graph_matrix(gm);
     }
   }
+}
+
+std::string contraction_signature(const OperatorProduct &ops,
+                                  const CompositeContraction &contractions) {
+  std::string s;
+  for (const auto &op : ops) {
+    s += op.label();
+    s += '\0';
+  }
+  add_graph_signature(ops, contractions, s);
   return s;
 }
 
@@ -132,27 +304,83 @@ std::pair<SymbolicTerm, scalar_t>
 WickTheorem::evaluate_contraction(const OperatorProduct &ops,
                                   const CompositeContraction &contractions,
                                   scalar_t factor) {
+  auto [term, sign, comb_factor] = contraction_skeleton(ops, contractions);
+  for (const auto &op : ops) {
+    factor *= op.factor();
+  }
+  apply_diagonal_blocks(term);
+
+  PRINT(PrintLevel::Summary,
+        cout << fmt::format("  sign =                 {:d}", sign) << endl;
+        cout << fmt::format("  factor =               {:s}", factor.repr())
+             << endl;
+        cout << fmt::format("  combinatorial factor = {:s}", comb_factor.repr())
+             << endl;);
+
+  return std::make_pair(term, sign * factor * comb_factor);
+}
+
+std::pair<SymbolicTerm, scalar_t> WickTheorem::evaluate_reused_contraction(
+    const OperatorProduct &ops, const CompositeContraction &contractions,
+    scalar_t factor, Statistics &stats) {
+  // the skeleton depends only on the graph matrices and on the types of the
+  // orbital spaces, so it is stored for each pattern found on this thread
+  // (the table is emptied when it grows large)
+  constexpr size_t max_stored_skeletons = 1 << 16;
+  thread_local std::unordered_map<std::string, contraction_skeleton_t>
+      stored_skeletons;
+  thread_local std::string key;
+  key.clear();
+  for (SpaceType type : osi()->space_types()) {
+    key += static_cast<char>(type);
+  }
+  key += '\0';
+  add_graph_signature(ops, contractions, key);
+  auto it = stored_skeletons.find(key);
+  if (it == stored_skeletons.end()) {
+    if (stored_skeletons.size() >= max_stored_skeletons) {
+      stored_skeletons.clear();
+    }
+    it = stored_skeletons.emplace(key, contraction_skeleton(ops, contractions))
+             .first;
+  } else {
+    stats.add_count("step 3/skeletons reused");
+  }
+  const auto &[skeleton, sign, comb_factor] = it->second;
+
+  // the first tensors belong to the operators, in the same order
+  std::vector<Tensor> tensors(skeleton.tensors());
+  for (size_t n = 0; n < ops.size(); n++) {
+    if (tensors[n].label_id() != ops[n].label_id()) {
+      tensors[n] = Tensor(ops[n].label_id(), tensors[n].lower(),
+                          tensors[n].upper(), tensors[n].symmetry());
+    }
+  }
+  SymbolicTerm term(skeleton.normal_ordered(), skeleton.ops(), tensors);
+  for (const auto &op : ops) {
+    factor *= op.factor();
+  }
+  apply_diagonal_blocks(term);
+  return std::make_pair(term, sign * factor * comb_factor);
+}
+
+WickTheorem::contraction_skeleton_t
+WickTheorem::contraction_skeleton(const OperatorProduct &ops,
+                                  const CompositeContraction &contractions) {
+  EvaluateScratch &scratch = evaluate_scratch;
+
   // 1. Get the Tensor objects and SQOperator vector corresponding to the
-  // uncontracted term
-  auto tensors_sqops_op_map = contraction_tensors_sqops(ops);
-  std::vector<Tensor> &tensors = std::get<0>(tensors_sqops_op_map);
-  std::vector<SQOperator> &sqops = std::get<1>(tensors_sqops_op_map);
-
-  // this map takes the operator index (op), orbital space (s), the sqop type
-  // (true = cre, false = ann), and an index and maps it to the operators as
-  // they are stored in a vector:
-  //
-  //  std::map<std::tuple<int, int, bool, int>, int> op_map;
-  //                       op space cre    n
-  //
-  std::map<std::tuple<int, int, bool, int>, int> &op_map =
-      std::get<2>(tensors_sqops_op_map);
+  // uncontracted term. The table scratch.positions maps the operator index
+  // (op), orbital space (s), the sqop type (true = cre, false = ann), and an
+  // index (n) to the position of the operator in sqops
+  auto [tensors, sqops] = contraction_tensors_sqops(ops, scratch.positions);
 
   // 2. Apply the contractions to the second quantized operators and add new
   // tensors (density matrices, cumulants)
 
   // counts of how many second quantized operators are not contracted
-  std::vector<GraphMatrix> ops_offset(ops.size());
+  std::vector<GraphMatrix> &ops_offset = scratch.ops_offset;
+  ops_offset.assign(ops.size(), GraphMatrix());
 
   // a counter to keep track of the positions assigned to operators
   int sorted_position = 0;
@@ -164,43 +392,56 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
   // sorting the operators in a unoccupied-unoccupied contraction
   int unoccupied_sign = 1;
 
-  index_map_t pair_contraction_reindex_map;
+  DenseIndexMap &pair_contraction_reindex_map =
+      scratch.pair_contraction_reindex_map;
+  pair_contraction_reindex_map.clear();
 
   // vector to store the order of operators
-  std::vector<int> sign_order(sqops.size(), -1);
+  std::vector<int> &sign_order = scratch.sign_order;
+  sign_order.assign(sqops.size(), -1);
+  // bit arrays to keep track of which operators are contracted (only used
+  // for printing)
   std::vector<std::vector<bool>> bit_map_vec;
 
+  const std::vector<SpaceType> &space_types = osi()->space_types();
+  const int nspaces = osi()->num_spaces();
+
   // Loop over elementary contractions
   for (const ElementaryContraction &contraction : contractions) {
-    // a bit array to keep track of which operators are contracted
-    std::vector<bool> bit_map(sqops.size(), false);
-
     // Find the rank and space of this contraction
     int rank = contraction.num_ops();
     int s = contraction.spaces_in_elementary_contraction()[0];
     nsqops_contracted += rank;
 
     // find the position of the creation operators
-    std::vector<int> pos_cre_sqops =
-        elements_vec_to_pos(contraction, ops_offset, op_map, true);
+    std::vector<int> &pos_cre_sqops = scratch.pos_cre_sqops;
+    pos_cre_sqops.clear();
+    elements_vec_to_pos(contraction, ops_offset, scratch.positions, true,
+                        pos_cre_sqops);
     // find the position of the annihilation operators
-    std::vector<int> pos_ann_sqops =
-        elements_vec_to_pos(contraction, ops_offset, op_map, false);
+    std::vector<int> &pos_ann_sqops = scratch.pos_ann_sqops;
+    pos_ann_sqops.clear();
+    elements_vec_to_pos(contraction, ops_offset, scratch.positions, false,
+                        pos_ann_sqops);
 
     // mark the creation operators contracted and their order
     for (int c : pos_cre_sqops) {
-      bit_map[c] = true;
       sign_order[c] = sorted_position;
       sorted_position += 1;
     }
     // mark the annihilation operators contracted and their order
     for (int a : pos_ann_sqops) {
-      bit_map[a] = true;
       sign_order[a] = sorted_position;
       sorted_position += 1;
     }
+    PRINT(PrintLevel::Basic, std::vector<bool> bit_map(sqops.size(), false);
+          for (int c
+               : pos_cre_sqops) { bit_map[c] = true; };
+          for (int a
+               : pos_ann_sqops) { bit_map[a] = true; };
+          bit_map_vec.push_back(bit_map);)
 
-    SpaceType dmstruc = orbital_subspaces->space_type(s);
+    SpaceType dmstruc = space_types[s];
 
     // Pairwise contractions creation-annihilation:
     // ________
@@ -211,7 +452,7 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
       // Reindex the annihilator (j) to the creator (i)
       Index cre_index = sqops[pos_cre_sqops[0]].index();
       Index ann_index = sqops[pos_ann_sqops[0]].index();
-      pair_contraction_reindex_map[ann_index] = cre_index;
+      pair_contraction_reindex_map.set(ann_index, cre_index);
     }
 
     // Pairwise contractions creation-annihilation:
@@ -223,7 +464,7 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
       // Reindex the creator (j) to the annihilator (i)
       Index cre_index = sqops[pos_cre_sqops[0]].index();
       Index ann_index = sqops[pos_ann_sqops[0]].index();
-      pair_contraction_reindex_map[cre_index] = ann_index;
+      pair_contraction_reindex_map.set(cre_index, ann_index);
       unoccupied_sign *= -1; // this factor is to compensate for the fact that
                              // we order operator in a canonical form in which
                              // annihilators are to the left of creation
@@ -268,14 +509,13 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
       tensors.push_back(
           Tensor(label, lower, upper, SymmetryType::Antisymmetric));
     }
-    bit_map_vec.push_back(bit_map);
   }
 
   // assign an order to the uncontracted operators
   // creation operators come before annihilation operators
   for (SQOperatorType type :
        {SQOperatorType::Creation, SQOperatorType::Annihilation}) {
-    for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
+    for (int s = 0; s < nspaces; s++) {
       for (int i = 0; i < sqops.size(); i++) {
         if ((sign_order[i] == -1) and (sqops[i].index().space() == s) and
             (sqops[i].type() == type)) {
@@ -293,7 +533,8 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
 
   PRINT(PrintLevel::All, PRINT_ELEMENTS(sign_order, "\n  positions: "););
 
-  std::vector<std::pair<int, SQOperator>> sorted_sqops;
+  std::vector<std::pair<int, SQOperator>> &sorted_sqops = scratch.sorted_sqops;
+  sorted_sqops.clear();
   sorted_position = 0;
   for (const auto &sqop : sqops) {
     sorted_sqops.push_back(std::make_pair(sign_order[sorted_position], sqop));
@@ -317,31 +558,24 @@ WickTheorem::evaluate_contraction(const OperatorProduct &ops,
   for (const auto &sqop : sqops) {
     term.add(sqop);
   }
-  for (const auto &op : ops) {
-    factor *= op.factor();
-  }
 
   term.reindex(pair_contraction_reindex_map);
 
-  PRINT(PrintLevel::Summary,
-        cout << fmt::format("  sign =                 {:d}", sign) << endl;
-        cout << fmt::format("  factor =               {:s}", factor.repr())
-             << endl;
-        cout << fmt::format("  combinatorial factor = {:s}", comb_factor.repr())
-             << endl;);
-
-  return std::make_pair(term, sign * factor * comb_factor);
+  return std::make_tuple(std::move(term), sign, comb_factor);
 }
 
-std::tuple<std::vector<Tensor>, std::vector<SQOperator>,
-           std::map<std::tuple<int, int, bool, int>, int>>
-WickTheorem::contraction_tensors_sqops(const OperatorProduct &ops) {
+std::pair<std::vector<Tensor>, std::vector<SQOperator>>
+WickTheorem::contraction_tensors_sqops(const OperatorProduct &ops,
+                                       SQOperatorPositions &positions) {
 
   std::vector<SQOperator> sqops;
   std::vector<Tensor> tensors;
-  std::map<std::tuple<int, int, bool, int>, int> op_map;
 
-  index_counter ic(orbital_subspaces->num_spaces());
+  const int nspaces = osi()->num_spaces();
+  index_counter ic(nspaces);
+  positions.nspaces = nspaces;
+  positions.cre_first.assign(ops.size() * nspaces, 0);
+  positions.ann_zero.assign(ops.size() * nspaces, 0);
 
   // Loop over all operators
   int n = 0;
@@ -349,14 +583,13 @@ WickTheorem::contraction_tensors_sqops(const OperatorProduct &ops) {
     const auto &op = ops[o];
     // Loop over creation operators (lower indices)
     std::vector<Index> lower;
-    for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
+    for (int s = 0; s < nspaces; s++) {
+      positions.cre_first[o * nspaces + s] = n;
       for (int c = 0; c < op.cre(s); c++) {
         Index idx(s, ic.next_index(s)); // get next available index
         sqops.push_back(SQOperator(SQOperatorType::Creation, idx));
         lower.push_back(idx);
-        auto key = std::make_tuple(o, s, true, c);
-        op_map[key] = n;
-        PRINT(PrintLevel::All, print_key(key, n););
+        PRINT(PrintLevel::All, print_key(std::make_tuple(o, s, true, c), n););
         n += 1;
       }
     }
@@ -365,14 +598,13 @@ WickTheorem::contraction_tensors_sqops(const OperatorProduct &ops) {
     // the annihilation operators are layed out in a reversed order (hence the
     // need to reverse the upper indices of the tensor, see below)
     std::vector<Index> upper;
-    for (int s = orbital_subspaces->num_spaces() - 1; s >= 0; s--) {
+    for (int s = nspaces - 1; s >= 0; s--) {
+      positions.ann_zero[o * nspaces + s] = n + op.ann(s) - 1;
       for (int a = op.ann(s) - 1; a >= 0; a--) {
         Index idx(s, ic.next_index(s)); // get next available index
         sqops.push_back(SQOperator(SQOperatorType::Annihilation, idx));
         upper.push_back(idx);
-        auto key = std::make_tuple(o, s, false, a);
-        op_map[key] = n;
-        PRINT(PrintLevel::All, print_key(key, n););
+        PRINT(PrintLevel::All, print_key(std::make_tuple(o, s, false, a), n););
         n += 1;
       }
     }
@@ -380,17 +612,15 @@ WickTheorem::contraction_tensors_sqops(const OperatorProduct &ops) {
     // reverse the order of the upper indices
     std::reverse(upper.begin(), upper.end());
     tensors.push_back(
-        Tensor(op.label(), lower, upper, SymmetryType::Antisymmetric));
+        Tensor(op.label_id(), lower, upper, SymmetryType::Antisymmetric));
   }
-  return make_tuple(tensors, sqops, op_map);
+  return std::make_pair(std::move(tensors), std::move(sqops));
 }
 
-std::vector<int> WickTheorem::elements_vec_to_pos(
+void WickTheorem::elements_vec_to_pos(
     const ElementaryContraction &elements_vec,
-    std::vector<GraphMatrix> &ops_offset,
-    std::map<std::tuple<int, int, bool, int>, int> &op_map, bool creation) {
-
-  std::vector<int> result;
+    std::vector<GraphMatrix> &ops_offset, const SQOperatorPositions &positions,
+    bool creation, std::vector<int> &result) {
 
   int s = elements_vec.spaces_in_elementary_contraction()[0];
 
@@ -400,24 +630,13 @@ std::vector<int> WickTheorem::elements_vec_to_pos(
   for (int v = 0; v < elements_vec.size(); v++) {
     const auto &graph_matrix = elements_vec[v];
     int nops = creation ? graph_matrix.cre(s) : graph_matrix.ann(s);
-    // assign the operator indices
+    // assign the operator indices (start from the leftmost operator)
     int ops_off = creation ? ops_offset[v].cre(s) : ops_offset[v].ann(s);
     for (int i = 0; i < nops; i++) {
-      // find the operator corresponding to this leg
-      auto key =
-          creation
-              ? std::make_tuple(v, s, true,
-                                ops_off + i) // start from the leftmost operator
-              : std::make_tuple(v, s, false, ops_off + i);
-      if (op_map.count(key) == 0) {
-        PRINT(PrintLevel::All, print_key(key, -1););
-        cout << " NOT FOUND!!!" << endl;
-        exit(1);
-      } else {
-        int sqop_pos = op_map[key];
-        result.push_back(sqop_pos);
-        PRINT(PrintLevel::All, print_key(key, sqop_pos););
-      }
+      int sqop_pos = positions(v, s, creation, ops_off + i);
+      result.push_back(sqop_pos);
+      PRINT(PrintLevel::All,
+            print_key(std::make_tuple(v, s, creation, ops_off + i), sqop_pos););
     }
     // update the creator's offset
     if (creation) {
@@ -426,12 +645,24 @@ std::vector<int> WickTheorem::elements_vec_to_pos(
       ops_offset[v].set_ann(s, ops_off + nops);
     }
   }
-  return result;
 }
 
 scalar_t
 WickTheorem::combinatorial_factor(const OperatorProduct &ops,
                                   const CompositeContraction &contractions) {
+  // the factor depends only on the graph matrices, so it is stored for each
+  // pattern found on this thread (the table is emptied when it grows large)
+  constexpr size_t max_stored_factors = 1 << 16;
+  thread_local std::unordered_map<std::string, scalar_t> stored_factors;
+  thread_local std::string key;
+  key.assign(1, static_cast<char>(osi()->num_spaces()));
+  add_graph_signature(ops, contractions, key);
+  if (auto it = stored_factors.find(key); it != stored_factors.end()) {
+    return it->second;
+  }
+  if (stored_factors.size() >= max_stored_factors) {
+    stored_factors.clear();
+  }
 
   scalar_t factor = 1;
 
@@ -443,10 +674,11 @@ WickTheorem::combinatorial_factor(const OperatorProduct &ops,
 
   // for each contraction find the combinatorial factor associated to
   // permutations of contracted indices
+  const int nspaces = osi()->num_spaces();
   for (const auto &contraction : contractions) {
     for (int v = 0; v < contraction.size(); v++) {
       const auto &graph_matrix = contraction[v];
-      for (int s = 0; s < orbital_subspaces->num_spaces(); s++) {
+      for (int s = 0; s < nspaces; s++) {
         const auto &[kcre, kann] = graph_matrix.elements(s);
         const auto &[ncre, nann] = free_graph_matrix[v].elements(s);
         factor *= binomial(ncre, kcre);
@@ -465,5 +697,6 @@ WickTheorem::combinatorial_factor(const OperatorProduct &ops,
   for (const auto &kv : contraction_count) {
     factor /= binomial(kv.second, 1);
   }
+  stored_factors.emplace(key, factor);
   return factor;
 }
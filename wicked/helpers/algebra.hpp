@@ -1,6 +1,7 @@
 #ifndef _wicked_vector_space_h_
 #define _wicked_vector_space_h_
 
+#include <utility>
 #include <vector>
 
 #include "helpers/helpers.h"
@@ -20,6 +21,61 @@ public:
 
   /// add an element
   void add(const T &e, F c = scalar_t(1, 1)) { add_to_map(terms_, e, c); }
+  void add(T &&e, F c = scalar_t(1, 1)) { add_to_map(terms_, std::move(e), c); }
+
+  /// add a * x to this object in place
+  Algebra &axpy(const Algebra &x, F a) {
+    if (a == 0) {
+      return *this;
+    }
+    for (const auto &[e, c] : x.terms()) {
+      add(e, a * c);
+    }
+    return *this;
+  }
+
+  /// add a * x to this object in place. The nodes of x are moved to this
+  /// object, so no element is copied or allocated, and x is left empty
+  Algebra &axpy(Algebra &&x, F a) {
+    if (a == 0) {
+      return *this;
+    }
+    if (&x == this) {
+      if (a == -1) {
+        terms_.clear();
+        return *this;
+      }
+      return *this *= (F(1) + a);
+    }
+    if (terms_.empty()) {
+      terms_ = std::move(x.terms_);
+      x.terms_.clear();
+      return (a == 1) ? *this : (*this *= a);
+    }
+    while (not x.terms_.empty()) {
+      auto node = x.terms_.extract(x.terms_.begin());
+      const F c = a * node.mapped();
+      auto it = terms_.lower_bound(node.key());
+      if ((it != terms_.end()) and not(node.key() < it->first)) {
+        it->second += c;
+        if (it->second == 0) {
+          terms_.erase(it);
+        }
+      } else if (c != 0) {
+        node.mapped() = c;
+        terms_.insert(it, std::move(node));
+      }
+    }
+    return *this;
+  }
+
+  /// remove all the elements and pass them to fn(e, c) as rvalues
+  template <class Fn> void drain(const Fn &fn) {
+    while (not terms_.empty()) {
+      auto node = terms_.extract(terms_.begin());
+      fn(std::move(node.key()), node.mapped());
+    }
+  }
 
   /// test if element is in the space
   bool contains(const T &e) const { return terms_.find(e) != terms_.end(); }
@@ -34,6 +90,7 @@ public:
     }
     return *this;
   }
+  Algebra &operator+=(Algebra &&rhs) { return axpy(std::move(rhs), F(1)); }
   /// subtraction assignment
   Algebra &operator-=(const Algebra &rhs) {
     for (const auto &[e, c] : rhs.terms()) {
@@ -41,6 +98,7 @@ public:
     }
     return *this;
   }
+  Algebra &operator-=(Algebra &&rhs) { return axpy(std::move(rhs), F(-1)); }
   /// multiplication assignment (scalar)
   Algebra &operator*=(const Algebra &rhs) {
     Algebra result;
@@ -49,7 +107,7 @@ public:
         result.add(e * er, c * cr);
       }
     }
-    terms_ = result.terms_;
+    terms_ = std::move(result.terms_);
     return *this;
   }
   /// multiplication assignment (scalar)
@@ -76,4 +134,66 @@ protected:
   vecspace_t terms_;
 };
 
+/// Represents a vector space of objects of type T over the field F stored in a
+/// hash table. Adding an element requires computing its hash (cached by the
+/// table) instead of comparing it with other elements, so this class is used
+/// to accumulate many elements. The elements are sorted only when they are
+/// added to an Algebra object
+template <class T, class F> class HashedAlgebra {
+
+public:
+  using vecspace_t = std::unordered_map<T, F>;
+  HashedAlgebra() {}
+
+  /// size of
+  size_t size() const { return terms_.size(); }
+  const vecspace_t &terms() const { return terms_; }
+
+  /// add an element
+  AddOutcome add(const T &e, F c = scalar_t(1, 1)) {
+    return add_to_map(terms_, e, c);
+  }
+  AddOutcome add(T &&e, F c = scalar_t(1, 1)) {
+    return add_to_map(terms_, std::move(e), c);
+  }
+
+  /// addition assignment
+  HashedAlgebra &operator+=(const HashedAlgebra &rhs) {
+    for (const auto &[e, c] : rhs.terms()) {
+      add(e, c);
+    }
+    return *this;
+  }
+
+  /// addition assignment
+  HashedAlgebra &operator+=(const Algebra<T, F> &rhs) {
+    for (const auto &[e, c] : rhs.terms()) {
+      add(e, c);
+    }
+    return *this;
+  }
+  HashedAlgebra &operator+=(Algebra<T, F> &&rhs) {
+    rhs.drain([this](T &&e, F c) { add(std::move(e), c); });
+    return *this;
+  }
+
+  /// add all the elements to an Algebra object
+  void add_to(Algebra<T, F> &algebra) const & {
+    for (const auto &[e, c] : terms_) {
+      algebra.add(e, c);
+    }
+  }
+
+  /// move all the elements to an Algebra object (this object is left empty)
+  void add_to(Algebra<T, F> &algebra) && {
+    while (not terms_.empty()) {
+      auto node = terms_.extract(terms_.begin());
+      algebra.add(std::move(node.key()), node.mapped());
+    }
+  }
+
+protected:
+  vecspace_t terms_;
+};
+
 #endif // _wicked_vector_space_h_
\ No newline at end of file
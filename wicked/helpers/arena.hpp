@@ -0,0 +1,53 @@
+#ifndef _wicked_arena_h_
+#define _wicked_arena_h_
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+/// A monotonic arena for the temporaries of a single contraction. Memory is
+/// carved out of a buffer owned by the arena (and out of the heap once the
+/// buffer is exhausted) and it is never freed individually. Calling reset()
+/// releases everything at once and rewinds to the start of the buffer, which
+/// is kept, so an arena reused for many contractions does not call malloc
+/// once the buffer is large enough. Containers use the arena through
+/// resource(), e.g., std::pmr::vector<int> v(arena.resource())
+class Arena {
+public:
+  /// Constructor
+  explicit Arena(size_t size = 1 << 16)
+      : buffer_(std::make_unique<std::byte[]>(size)),
+        resource_(buffer_.get(), size) {}
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /// Return the memory resource that allocates from the arena
+  std::pmr::memory_resource *resource() { return &resource_; }
+
+  /// Release all the memory allocated from the arena
+  void reset() { resource_.release(); }
+
+private:
+  std::unique_ptr<std::byte[]> buffer_;
+  std::pmr::monotonic_buffer_resource resource_;
+};
+
+/// Resets an arena when it goes out of scope. All the containers that use the
+/// arena must be destroyed before the scope ends
+class ArenaScope {
+public:
+  explicit ArenaScope(Arena &arena) : arena_(arena) {}
+  ~ArenaScope() { arena_.reset(); }
+
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+
+  /// Return the memory resource that allocates from the arena
+  std::pmr::memory_resource *resource() { return arena_.resource(); }
+
+private:
+  Arena &arena_;
+};
+
+#endif // _wicked_arena_h_
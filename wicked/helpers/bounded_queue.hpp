@@ -0,0 +1,94 @@
+#ifndef _wicked_bounded_queue_h_
+#define _wicked_bounded_queue_h_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/// A bounded queue that can be used by several producer and consumer threads
+/// without locks. Each slot stores a sequence number that tells producers when
+/// it is free and consumers when it is full (the algorithm of D. Vyukov). The
+/// values are copied into and out of the slots, so a type that holds memory
+/// (e.g., a std::vector) reuses it once the slots are warm. The capacity is
+/// rounded up to a power of two
+template <class T> class BoundedQueue {
+public:
+  /// Constructor
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    slots_ = std::make_unique<Slot[]>(size);
+    for (size_t n = 0; n < size; n++) {
+      slots_[n].sequence.store(n, std::memory_order_relaxed);
+    }
+  }
+
+  /// Return the number of values that the queue can hold
+  size_t capacity() const { return mask_ + 1; }
+
+  /// Copy a value at the end of the queue. Return false if the queue is full
+  bool try_push(const T &value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots_[pos & mask_];
+      const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value = value;
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Copy the value at the front of the queue and remove it. Return false if
+  /// the queue is empty
+  bool try_pop(T &value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots_[pos & mask_];
+      const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          value = slot.value;
+          slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  /// The positions of the next value to pop and push (kept on separate cache
+  /// lines)
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+#endif // _wicked_bounded_queue_h_
@@ -1,6 +1,10 @@
 #include "combinatorics.h"
 
-long long int factorial(int n) {
+/// Generate the integer partitions of n with at most maxlen elements
+static std::vector<std::vector<int>> generate_integer_partitions(int n,
+                                                                 int maxlen);
+
+long long int compute_factorial(int n) {
   long long int result = 1;
   for (long long int i = 2; i <= n; ++i) {
     result *= i;
@@ -8,7 +12,7 @@ long long int factorial(int n) {
   return result;
 }
 
-long long int binomial(int n, int k) {
+long long int compute_binomial(int n, int k) {
   if (k > n)
     return 0;
   if (k * 2 > n)
@@ -39,7 +43,39 @@ int permutation_sign(const std::vector<int> &vec) {
   return (sign % 2 == 0) ? 1 : -1;
 }
 
+/// The partitions of the integers 0,...,max_tabulated_partitions
+static const std::vector<std::vector<std::vector<int>>> &partitions_table() {
+  static const std::vector<std::vector<std::vector<int>>> table = [] {
+    std::vector<std::vector<std::vector<int>>> t;
+    for (int n = 0; n <= max_tabulated_partitions; n++) {
+      t.push_back(generate_integer_partitions(n, n));
+    }
+    return t;
+  }();
+  return table;
+}
+
+const std::vector<std::vector<int>> &tabulated_integer_partitions(int n) {
+  if ((n >= 0) and (n <= max_tabulated_partitions)) {
+    return partitions_table()[n];
+  }
+  // larger integers are generated on each call (the last result is kept)
+  thread_local std::vector<std::vector<int>> partitions;
+  partitions = generate_integer_partitions(n, n);
+  return partitions;
+}
+
 std::vector<std::vector<int>> integer_partitions(int n, int maxlen) {
+  std::vector<std::vector<int>> partitions;
+  for (const auto &partition : tabulated_integer_partitions(n)) {
+    if (static_cast<int>(partition.size()) <= maxlen) {
+      partitions.push_back(partition);
+    }
+  }
+  return partitions;
+}
+
+std::vector<std::vector<int>> generate_integer_partitions(int n, int maxlen) {
   std::vector<std::vector<int>> partitions;
   if (n > 1) {
     // Implements the ZS2 algorithm by A. Zoghbiu and I. Stojmenovic'
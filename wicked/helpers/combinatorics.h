@@ -1,20 +1,99 @@
 #ifndef _wicked_combinatorics_h_
 #define _wicked_combinatorics_h_
 
+#include <array>
+#include <utility>
 #include <vector>
 
+/// The largest integer whose factorial fits in a long long int
+constexpr int max_tabulated_factorial = 20;
+
+/// The largest n for which the binomial coefficients (n k) are tabulated
+constexpr int max_tabulated_binomial = 64;
+
+/// The largest integer whose partitions are tabulated
+constexpr int max_tabulated_partitions = 16;
+
+/// A table of the factorials 0!,...,max_tabulated_factorial!
+inline constexpr std::array<long long int, max_tabulated_factorial + 1>
+    factorial_table = [] {
+      std::array<long long int, max_tabulated_factorial + 1> table{};
+      table[0] = 1;
+      for (int n = 1; n <= max_tabulated_factorial; n++) {
+        table[n] = table[n - 1] * n;
+      }
+      return table;
+    }();
+
+/// A table of the binomial coefficients (Pascal's triangle). The entry
+/// [n][k] is zero for k > n
+inline constexpr std::array<std::array<long long int, max_tabulated_binomial + 1>,
+                            max_tabulated_binomial + 1>
+    binomial_table = [] {
+      std::array<std::array<long long int, max_tabulated_binomial + 1>,
+                 max_tabulated_binomial + 1>
+          table{};
+      for (int n = 0; n <= max_tabulated_binomial; n++) {
+        table[n][0] = 1;
+        for (int k = 1; k <= n; k++) {
+          table[n][k] = table[n - 1][k - 1] + table[n - 1][k];
+        }
+      }
+      return table;
+    }();
+
+/// Compute the factorial of an integer (without tables)
+long long int compute_factorial(int n);
+
+/// Compute a binomial coefficient (without tables)
+long long int compute_binomial(int n, int k);
+
 /// Compute the factorial of an integer
-long long int factorial(int n);
+inline long long int factorial(int n) {
+  if ((n >= 0) and (n <= max_tabulated_factorial)) {
+    return factorial_table[n];
+  }
+  return compute_factorial(n);
+}
 
 /// Compute a binomial coefficient
-long long int binomial(int n, int k);
+inline long long int binomial(int n, int k) {
+  if ((k >= 0) and (k <= n) and (n <= max_tabulated_binomial)) {
+    return binomial_table[n][k];
+  }
+  return compute_binomial(n, k);
+}
 
 /// Generate all the integer partitions of the integer n
 /// For example, for n = 4 this code generates
 /// [[1, 1, 1, 1], [2, 1, 1], [2, 2], [3, 1], [4]]
 std::vector<std::vector<int>> integer_partitions(int n, int maxlen = 1024);
 
+/// Return all the integer partitions of the integer n (in the order of
+/// integer_partitions). The partitions of n <= max_tabulated_partitions are
+/// generated only once
+const std::vector<std::vector<int>> &tabulated_integer_partitions(int n);
+
 // Computes the sign of a permutation of integers
 int permutation_sign(const std::vector<int> &vec);
 
+/// Sort a short container in place (insertion sort) and return the sign of the
+/// sorting permutation. When reversed is true the elements are sorted in
+/// decreasing order and equal elements swap places, like sorting the pairs
+/// (element, position) in decreasing order
+template <class Container>
+int sort_with_permutation_sign(Container &c, bool reversed) {
+  int sign = 1;
+  for (std::size_t i = 1, size = c.size(); i < size; i++) {
+    for (std::size_t j = i; j > 0; j--) {
+      bool swap = reversed ? not(c[j] < c[j - 1]) : (c[j] < c[j - 1]);
+      if (not swap)
+        break;
+      std::swap(c[j], c[j - 1]);
+      sign = -sign;
+    }
+  }
+  return sign;
+}
+
 #endif // _wicked_combinatorics_h_
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+#include "floating.h"
+
+floating::floating() : value_(0.0) {}
+
+floating::floating(rational_t numerator, rational_t denominator)
+    : value_(rational(numerator, denominator).to_double()) {}
+
+floating::floating(int numerator, int denominator)
+    : value_(static_cast<double>(numerator) / denominator) {}
+
+floating::floating(rational_t numerator)
+    : value_(rational(numerator).to_double()) {}
+
+floating::floating(const rational &r) : value_(r.to_double()) {}
+
+floating::floating(double value) : value_(value) {}
+
+rational floating::to_rational() const {
+  const double x = std::abs(value_);
+  if (not(x < max_denominator)) {
+    // only the integer part is significant
+    if (not(x < 9.0e18)) {
+      throw std::overflow_error("floating: " + repr() +
+                                " cannot be written as a fraction");
+    }
+    return rational(rational_t(std::llround(value_)));
+  }
+
+  // find the first convergent h/k of the continued fraction of x that is
+  // equal to x (within the tolerance) or the last one with k not larger than
+  // max_denominator
+  int64_t h0 = 0, h1 = 1;
+  int64_t k0 = 1, k1 = 0;
+  double r = x;
+  for (;;) {
+    const double a = std::floor(r);
+    if (a * k1 + k0 > max_denominator) {
+      break;
+    }
+    const int64_t n = static_cast<int64_t>(a);
+    const int64_t h2 = n * h1 + h0;
+    const int64_t k2 = n * k1 + k0;
+    h0 = h1;
+    h1 = h2;
+    k0 = k1;
+    k1 = k2;
+    const double f = r - a;
+    if ((floating(static_cast<double>(h1) / k1) == floating(x)) or
+        (f == 0.0)) {
+      break;
+    }
+    r = 1.0 / f;
+  }
+  return rational(rational_t(value_ < 0.0 ? -h1 : h1), rational_t(k1));
+}
+
+rational_t floating::numerator() const { return to_rational().numerator(); }
+
+rational_t floating::denominator() const {
+  return to_rational().denominator();
+}
+
+std::string floating::str(bool sign) const { return to_rational().str(sign); }
+
+std::string floating::repr() const {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.17g", value_);
+  return "floating(" + std::string(buffer) + ")";
+}
+
+std::string floating::latex() const { return to_rational().latex(); }
+
+std::string floating::compile(const std::string &format) const {
+  return std::to_string(value_);
+}
+
+floating &floating::operator+=(const floating &rhs) {
+  value_ += rhs.value_;
+  return *this;
+}
+
+floating &floating::operator-=(const floating &rhs) {
+  value_ -= rhs.value_;
+  return *this;
+}
+
+floating &floating::operator*=(const floating &rhs) {
+  value_ *= rhs.value_;
+  return *this;
+}
+
+floating &floating::operator/=(const floating &rhs) {
+  value_ /= rhs.value_;
+  return *this;
+}
+
+bool operator==(const floating &lhs, const floating &rhs) {
+  const double a = lhs.to_double();
+  const double b = rhs.to_double();
+  const double scale = std::max({1.0, std::abs(a), std::abs(b)});
+  return std::abs(a - b) <= floating::tolerance * scale;
+}
+
+bool operator!=(const floating &lhs, const floating &rhs) {
+  return (not(lhs == rhs));
+}
+
+floating operator+(floating rhs) { return rhs; }
+
+floating operator-(floating rhs) {
+  rhs *= floating(-1);
+  return rhs;
+}
+
+floating operator+(floating lhs, const floating &rhs) {
+  lhs += rhs;
+  return lhs;
+}
+
+floating operator-(floating lhs, const floating &rhs) {
+  lhs -= rhs;
+  return lhs;
+}
+
+floating operator*(floating lhs, const floating &rhs) {
+  lhs *= rhs;
+  return lhs;
+}
+
+floating operator/(floating lhs, const floating &rhs) {
+  lhs /= rhs;
+  return lhs;
+}
+
+std::ostream &operator<<(std::ostream &os, const floating &rhs) {
+  os << rhs.str(false);
+  return os;
+}
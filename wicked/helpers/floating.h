@@ -0,0 +1,94 @@
+#ifndef _wicked_floating_h_
+#define _wicked_floating_h_
+
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#include "rational.h"
+
+/// A double-precision number with the interface of rational, used for the
+/// coefficients when wicked is built with WICKED_FLOAT_COEFFICIENTS. The
+/// arithmetic does not reduce fractions, which makes exploratory runs cheaper
+/// than with exact coefficients. Two numbers are equal if they differ by at
+/// most tolerance times the larger of 1 and their magnitudes, so add_to_map
+/// removes the terms whose factors cancel up to rounding errors. The
+/// numerator and the denominator are those of the closest fraction with a
+/// small denominator, so the coefficients print as fractions and can be
+/// stored in the formats that use rational numbers
+class floating {
+
+public:
+  /// The tolerance used to compare two numbers
+  static constexpr double tolerance = 1.0e-12;
+
+  /// initialize with zero
+  floating();
+  /// initialize with a fraction (numerator/denominator)
+  floating(rational_t numerator, rational_t denominator);
+  /// initialize with a fraction (numerator/denominator)
+  floating(int numerator, int denominator);
+  /// initialize with an integer
+  floating(rational_t numerator);
+  /// initialize with an integer of any type (a template, so that an integer
+  /// argument is never converted to another overload)
+  template <class I, std::enable_if_t<std::is_integral_v<I>, int> = 0>
+  floating(I numerator) : value_(static_cast<double>(numerator)) {}
+  /// initialize with a rational number
+  floating(const rational &r);
+  /// initialize with a double
+  explicit floating(double value);
+  /// return the numerator of the closest fraction
+  rational_t numerator() const;
+  /// return the denominator of the closest fraction
+  rational_t denominator() const;
+  /// return this converted to a double
+  double to_double() const { return value_; }
+  /// return the closest fraction with a denominator that is at most
+  /// max_denominator
+  rational to_rational() const;
+  /// return a (nice) string representation, and optionally show the sign
+  std::string str(bool sign = false) const;
+  /// return a string representation
+  std::string repr() const;
+  /// return a LaTeX representation
+  std::string latex() const;
+  /// return a compilable representation
+  std::string compile(const std::string &format) const;
+
+  /// addition assignment
+  floating &operator+=(const floating &rhs);
+  /// subtraction assignment
+  floating &operator-=(const floating &rhs);
+  /// multiplication assignment
+  floating &operator*=(const floating &rhs);
+  /// division assignment
+  floating &operator/=(const floating &rhs);
+
+private:
+  /// The largest denominator of the fraction returned by to_rational
+  static constexpr int64_t max_denominator = 1000000000;
+
+  double value_;
+};
+
+/// equal to (within floating::tolerance)
+bool operator==(const floating &lhs, const floating &rhs);
+/// not equal to
+bool operator!=(const floating &lhs, const floating &rhs);
+/// unary plus
+floating operator+(floating rhs);
+/// unary minus
+floating operator-(floating rhs);
+/// addition
+floating operator+(floating lhs, const floating &rhs);
+/// subtraction
+floating operator-(floating lhs, const floating &rhs);
+/// multiplication
+floating operator*(floating lhs, const floating &rhs);
+/// division
+floating operator/(floating lhs, const floating &rhs);
+/// output a floating to a stream
+std::ostream &operator<<(std::ostream &os, const floating &rhs);
+
+#endif // _wicked_floating_h_
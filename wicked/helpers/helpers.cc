@@ -42,6 +42,30 @@ inline std::string &rtrim(std::string &s) {
 // trim from both ends
 inline std::string &trim(std::string &s) { return ltrim(rtrim(s)); }
 
+std::vector<std::string> split(const std::string &s) {
+  auto is_delimiter = [](char c) { return c == ',' or is_space_char(c); };
+  std::vector<std::string> result;
+  const size_t n = s.size();
+  size_t start = 0;
+  bool found_delimiter = false;
+  for (size_t k = 0; k < n;) {
+    if (is_delimiter(s[k])) {
+      result.push_back(s.substr(start, k - start));
+      while (k < n and is_delimiter(s[k])) {
+        k++;
+      }
+      start = k;
+      found_delimiter = true;
+    } else {
+      k++;
+    }
+  }
+  if (start < n or not found_delimiter) {
+    result.push_back(s.substr(start));
+  }
+  return result;
+}
+
 std::vector<std::string> split(const std::string &s, regex re) {
   sregex_token_iterator it(s.begin(), s.end(), re, -1);
   sregex_token_iterator reg_end;
@@ -55,8 +79,13 @@ std::vector<std::string> split(const std::string &s, regex re) {
 
 std::vector<std::string> findall(const string &s, const string &regex) {
   std::vector<std::string> result;
-  std::regex this_regex(regex);
+  thread_local std::unordered_map<std::string, std::regex> compiled;
   try {
+    auto it = compiled.find(regex);
+    if (it == compiled.end()) {
+      it = compiled.emplace(regex, std::regex(regex)).first;
+    }
+    const std::regex &this_regex = it->second;
     std::sregex_iterator next(s.begin(), s.end(), this_regex);
     std::sregex_iterator end;
     std::vector<std::string> matches;
@@ -1,11 +1,14 @@
 #ifndef _wicked_helpers_h_
 #define _wicked_helpers_h_
 
+#include <cctype>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <numeric>
 #include <regex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "wicked-def.h"
@@ -14,14 +17,43 @@
 std::string join(const std::vector<std::string> &svec,
                  const std::string &sep = ",");
 
-/// Split a string.  Default delimiters are spaces (\s) and/or commas
-std::vector<std::string> split(const std::string &s,
-                               std::regex re = std::regex("[\\s,]+"));
+/// Split a string at runs of spaces and/or commas. As when splitting with the
+/// regular expression "[\\s,]+", a leading delimiter gives an empty first
+/// element and trailing delimiters are ignored
+std::vector<std::string> split(const std::string &s);
 
-/// Find all occurences of a pattern
+/// Split a string at the matches of a regular expression
+std::vector<std::string> split(const std::string &s, std::regex re);
+
+/// Find all occurences of a pattern. The compiled regular expressions are
+/// kept for the following calls from the same thread
 std::vector<std::string> findall(const std::string &s,
                                  const std::string &regex);
 
+/// Return true if a character is a space (the regular expression \\s)
+inline bool is_space_char(char c) {
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+/// Return true if a character is a digit (the regular expression \\d)
+inline bool is_digit_char(char c) {
+  return std::isdigit(static_cast<unsigned char>(c));
+}
+
+/// Return true if a character is a letter
+inline bool is_alpha_char(char c) {
+  return std::isalpha(static_cast<unsigned char>(c));
+}
+
+/// Return true if a character is a letter or a digit
+inline bool is_alnum_char(char c) {
+  return std::isalnum(static_cast<unsigned char>(c));
+}
+
+/// Return true if a character is a letter, a digit, or an underscore (the
+/// regular expression \\w)
+inline bool is_word_char(char c) { return is_alnum_char(c) or c == '_'; }
+
 /// Split indices
 std::vector<std::string> split_indices(const std::string &s);
 
@@ -55,26 +87,96 @@ public:
   }
 };
 
+/// Combine the hash value h into seed
+inline void hash_combine(std::size_t &seed, std::size_t h) {
+  seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+/// The 64-bit FNV-1a hash of a string. Unlike std::hash, its value is the same
+/// on every platform, so it can be used to name files
+inline uint64_t fnv1a_hash(const std::string &s) {
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/// What happened when a term was added to a map of terms: it was skipped
+/// (zero factor), inserted, merged with an existing term, or it cancelled an
+/// existing term, which was removed
+enum class AddOutcome { Skipped, Inserted, Merged, Cancelled };
+
+template <class T, class F>
+AddOutcome add_to_map(std::map<T, F> &m, const T &key, const F &value) {
+  // don't add a zero term (with floating coefficients, the factors are
+  // compared to zero within a tolerance)
+  if (value == 0)
+    return AddOutcome::Skipped;
+
+  // insert the key if it is not found (the key is copied only in this case)
+  auto [search, inserted] = m.try_emplace(key, value);
+  if (inserted) {
+    return AddOutcome::Inserted;
+  }
+  // found key: just add the factor to the existing term
+  search->second += value;
+  // if after addition the result is zero, eliminate from map
+  if (search->second == 0) {
+    m.erase(search);
+    return AddOutcome::Cancelled;
+  }
+  return AddOutcome::Merged;
+}
+
+/// Same as above, but the key is moved into the map when it is inserted
 template <class T, class F>
-void add_to_map(std::map<T, F> &m, const T &key, const F &value) {
+AddOutcome add_to_map(std::map<T, F> &m, T &&key, const F &value) {
+  if (value == 0)
+    return AddOutcome::Skipped;
+  auto [search, inserted] = m.try_emplace(std::move(key), value);
+  if (inserted) {
+    return AddOutcome::Inserted;
+  }
+  search->second += value;
+  if (search->second == 0) {
+    m.erase(search);
+    return AddOutcome::Cancelled;
+  }
+  return AddOutcome::Merged;
+}
+
+template <class T, class F>
+AddOutcome add_to_map(std::unordered_map<T, F> &m, const T &key,
+                      const F &value) {
   // don't add a zero term
   if (value == 0)
-    return;
+    return AddOutcome::Skipped;
 
-  // find the key
-  auto search = m.find(key);
+  // find the key or insert it with a zero factor
+  auto [search, inserted] = m.try_emplace(key, F(0));
+  search->second += value;
+  // if after addition the result is zero, eliminate from map
+  if (search->second == 0) {
+    m.erase(search);
+    return AddOutcome::Cancelled;
+  }
+  return inserted ? AddOutcome::Inserted : AddOutcome::Merged;
+}
 
-  if (search != m.end()) {
-    // found key: just add the factor to the existing term
-    search->second += value;
-    // if after addition the result is zero, eliminate from map
-    if (search->second == 0) {
-      m.erase(search);
-    }
-  } else {
-    // key not found:
-    m[key] = value;
+/// Same as above, but the key is moved into the map when it is inserted
+template <class T, class F>
+AddOutcome add_to_map(std::unordered_map<T, F> &m, T &&key, const F &value) {
+  if (value == 0)
+    return AddOutcome::Skipped;
+  auto [search, inserted] = m.try_emplace(std::move(key), F(0));
+  search->second += value;
+  if (search->second == 0) {
+    m.erase(search);
+    return AddOutcome::Cancelled;
   }
+  return inserted ? AddOutcome::Inserted : AddOutcome::Merged;
 }
 
 // A class to count indices
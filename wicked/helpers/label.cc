@@ -0,0 +1,40 @@
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "label.h"
+
+/// Return the unique copy of the string s stored in the table of labels
+static const std::string *intern_label(const std::string &s) {
+  // each thread keeps a cache of the labels that it has seen to avoid taking
+  // the lock of the global table
+  thread_local std::unordered_map<std::string, const std::string *> cache;
+  if (auto it = cache.find(s); it != cache.end()) {
+    return it->second;
+  }
+  // the elements of an unordered_set are never moved, so the pointers stay
+  // valid for the duration of the program
+  static std::unordered_set<std::string> table;
+  static std::mutex mutex;
+  const std::string *p;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    p = &*table.insert(s).first;
+  }
+  cache.emplace(s, p);
+  return p;
+}
+
+Label::Label() {
+  static const std::string *empty = intern_label("");
+  s_ = empty;
+}
+
+Label::Label(const std::string &s) : s_(intern_label(s)) {}
+
+Label::Label(const char *s) : s_(intern_label(s)) {}
+
+std::ostream &operator<<(std::ostream &os, const Label &label) {
+  os << label.str();
+  return os;
+}
@@ -0,0 +1,42 @@
+#ifndef _wicked_label_h_
+#define _wicked_label_h_
+
+#include <ostream>
+#include <string>
+
+/// A label of a tensor or an operator. The strings are stored in a global
+/// table that holds one copy of each label, so that a Label is just a pointer
+/// to its string. Copying and testing labels for equality does not look at the
+/// characters, while comparisons preserve the alphabetical order of the labels
+class Label {
+public:
+  /// Construct an empty label
+  Label();
+  /// Construct a label from a string
+  Label(const std::string &s);
+  /// Construct a label from a C string
+  Label(const char *s);
+
+  /// Return the string of this label
+  const std::string &str() const { return *s_; }
+  operator const std::string &() const { return *s_; }
+
+  bool operator==(const Label &other) const { return s_ == other.s_; }
+  bool operator!=(const Label &other) const { return s_ != other.s_; }
+  bool operator<(const Label &other) const {
+    return (s_ != other.s_) and (*s_ < *other.s_);
+  }
+  bool operator>(const Label &other) const { return other < *this; }
+
+  /// Return a hash value
+  std::size_t hash() const { return reinterpret_cast<std::size_t>(s_); }
+
+private:
+  /// A pointer to the string stored in the table of labels
+  const std::string *s_;
+};
+
+/// Write a label to a stream
+std::ostream &operator<<(std::ostream &os, const Label &label);
+
+#endif // _wicked_label_h_
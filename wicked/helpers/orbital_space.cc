@@ -8,6 +8,30 @@ std::shared_ptr<OrbitalSpaceInfo> orbital_subspaces =
 
 std::shared_ptr<OrbitalSpaceInfo> get_osi() { return orbital_subspaces; }
 
+/// The orbital space context active on this thread (nullptr = use the global)
+thread_local const OrbitalSpaceInfo *thread_osi = nullptr;
+
+const OrbitalSpaceInfo *osi() {
+  return thread_osi ? thread_osi : orbital_subspaces.get();
+}
+
+OrbitalSpaceContext::OrbitalSpaceContext(
+    const std::shared_ptr<const OrbitalSpaceInfo> &osi)
+    : previous_(thread_osi), osi_(osi) {
+  if (osi_) {
+    thread_osi = osi_.get();
+  }
+}
+
+OrbitalSpaceContext::OrbitalSpaceContext(const OrbitalSpaceInfo *osi)
+    : previous_(thread_osi) {
+  if (osi) {
+    thread_osi = osi;
+  }
+}
+
+OrbitalSpaceContext::~OrbitalSpaceContext() { thread_osi = previous_; }
+
 std::map<FieldType, std::string> FieldType_to_str{
     {FieldType::Fermion, "fermion"}, {FieldType::Boson, "boson"}};
 
@@ -80,6 +104,11 @@ void OrbitalSpaceInfo::add_space(char label, FieldType field_type,
                              std::string(1, label) +
                              "\" is already defined. Use another label.");
   }
+  if (space_info_.size() >= static_cast<size_t>(max_orbital_spaces)) {
+    throw std::runtime_error("add_space: Cannot define more than " +
+                             std::to_string(max_orbital_spaces) +
+                             " orbital spaces.");
+  }
 
   size_t pos = space_info_.size();
   label_to_pos_[label] = pos;
@@ -98,6 +127,7 @@ void OrbitalSpaceInfo::add_space(char label, FieldType field_type,
   }
   space_info_.push_back(OrbitalSpace(label, field_type, space_type, indices,
                                      elementary_spaces_int));
+  space_types_.push_back(space_type);
 }
 
 std::string OrbitalSpaceInfo::str() const {
@@ -158,6 +188,7 @@ int OrbitalSpaceInfo::label_to_space(char label) const {
 
 void OrbitalSpaceInfo::reset() {
   space_info_.clear();
+  space_types_.clear();
   label_to_pos_.clear();
   indices_to_pos_.clear();
 }
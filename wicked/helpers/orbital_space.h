@@ -38,6 +38,15 @@ public:
   const std::vector<int> &elementary_spaces() const;
 };
 
+/// The largest number of orbital spaces. The counts of operators stored in
+/// GraphMatrix take 16 bits per space, so this sets the size of every graph
+/// matrix and the number of words processed by each of its operations. It
+/// can be raised with the WICKED_MAX_SPACES build option
+#ifndef WICKED_MAX_SPACES
+#define WICKED_MAX_SPACES 8
+#endif
+constexpr int max_orbital_spaces = WICKED_MAX_SPACES;
+
 class OrbitalSpaceInfo {
 public:
   OrbitalSpaceInfo();
@@ -55,7 +64,7 @@ public:
   //                          const std::vector<char> &elementary_spaces);
 
   /// Return the number of elementary spaces
-  int num_spaces() { return static_cast<int>(space_info_.size()); }
+  int num_spaces() const { return static_cast<int>(space_info_.size()); }
 
   /// The label of an orbital space
   char label(int pos) const;
@@ -67,6 +76,9 @@ public:
   /// the structure of the density matrices
   SpaceType space_type(int pos) const;
 
+  /// @return the space types of all the elementary spaces
+  const std::vector<SpaceType> &space_types() const { return space_types_; }
+
   /// @return the field type
   FieldType field_type(int pos) const;
 
@@ -89,6 +101,9 @@ private:
   /// Vector of spaces
   std::vector<OrbitalSpace> space_info_;
 
+  /// The space type of each space (cached for fast access in inner loops)
+  std::vector<SpaceType> space_types_;
+
   /// Maps a space label to its index
   std::map<char, int> label_to_pos_;
 
@@ -100,6 +115,31 @@ extern std::shared_ptr<OrbitalSpaceInfo> orbital_subspaces;
 
 std::shared_ptr<OrbitalSpaceInfo> get_osi();
 
+/// @return the orbital space information used by the calling thread. This is
+/// the global orbital_subspaces object unless an OrbitalSpaceContext is active
+const OrbitalSpaceInfo *osi();
+
+/// A guard that makes a given OrbitalSpaceInfo object the one returned by
+/// osi() on the calling thread for the lifetime of the guard. Guards can be
+/// nested, and each thread can use a different orbital space definition.
+class OrbitalSpaceContext {
+public:
+  explicit OrbitalSpaceContext(
+      const std::shared_ptr<const OrbitalSpaceInfo> &osi);
+  /// Non-owning version (the caller must keep osi alive)
+  explicit OrbitalSpaceContext(const OrbitalSpaceInfo *osi);
+  ~OrbitalSpaceContext();
+
+  OrbitalSpaceContext(const OrbitalSpaceContext &) = delete;
+  OrbitalSpaceContext &operator=(const OrbitalSpaceContext &) = delete;
+
+private:
+  /// The context that was active when this guard was created
+  const OrbitalSpaceInfo *previous_;
+  /// Keeps the context alive while the guard is active
+  std::shared_ptr<const OrbitalSpaceInfo> osi_;
+};
+
 /// Used to convert a string (e.g., "unoccupied") to a SpaceType
 SpaceType string_to_space_type(const std::string &str);
 
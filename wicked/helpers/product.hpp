@@ -10,8 +10,11 @@ template <class T> class Product {
 public:
   Product() {}
   Product(const prod_t &elements) : elements_(elements) {}
-  Product(const Product &prod) : elements_(prod.elements()) {}
   Product(std::initializer_list<T> elements) : elements_(elements) {}
+  Product(const Product &prod) = default;
+  Product(Product &&prod) = default;
+  Product &operator=(const Product &prod) = default;
+  Product &operator=(Product &&prod) = default;
 
   const prod_t &elements() const { return elements_; }
 
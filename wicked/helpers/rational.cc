@@ -1,5 +1,7 @@
+#include <cctype>
+#include <limits>
 #include <numeric>
-#include <regex>
+#include <stdexcept>
 
 #if USE_BOOST_1024_INT
 #include "boost/lexical_cast.hpp"
@@ -9,146 +11,297 @@
 
 rational::rational() : numerator_(0), denominator_(1) {}
 
-rational::rational(int numerator) {
-  numerator_ = numerator;
-  denominator_ = 1;
-}
+rational::rational(int numerator) : numerator_(numerator), denominator_(1) {}
 
-rational::rational(rational_t numerator) {
-  numerator_ = numerator;
-  denominator_ = 1;
+rational::rational(rational_t numerator) : numerator_(0), denominator_(1) {
+  set(numerator, 1);
 }
 
-rational::rational(rational_t numerator, rational_t denominator) {
-  // enforce a positive denominator
-  numerator_ = denominator < 0 ? -numerator : numerator;
-  denominator_ = denominator < 0 ? -denominator : denominator;
-  // bring to canonical form
+rational::rational(int numerator, int denominator)
+    : numerator_(numerator), denominator_(denominator) {
+  // enforce a positive denominator (int64_t cannot overflow here) and bring
+  // to canonical form
+  if (denominator_ < 0) {
+    numerator_ = -numerator_;
+    denominator_ = -denominator_;
+  }
   reduce();
 }
 
-rational_t rational::numerator() const { return numerator_; }
+rational::rational(rational_t numerator, rational_t denominator)
+    : numerator_(0), denominator_(1) {
+  set(numerator, denominator);
+}
+
+rational::rational(const rational &other)
+    : numerator_(other.numerator_), denominator_(other.denominator_) {
+#if USE_BOOST_1024_INT
+  if (other.big_) {
+    big_ = std::make_unique<std::pair<rational_t, rational_t>>(*other.big_);
+  }
+#endif
+}
+
+rational &rational::operator=(const rational &other) {
+  numerator_ = other.numerator_;
+  denominator_ = other.denominator_;
+#if USE_BOOST_1024_INT
+  if (other.big_) {
+    big_ = std::make_unique<std::pair<rational_t, rational_t>>(*other.big_);
+  } else {
+    big_.reset();
+  }
+#endif
+  return *this;
+}
+
+bool rational::is_big() const {
+#if USE_BOOST_1024_INT
+  return static_cast<bool>(big_);
+#else
+  return false;
+#endif
+}
 
-rational_t rational::denominator() const { return denominator_; }
+rational_t rational::numerator() const {
+#if USE_BOOST_1024_INT
+  if (big_) {
+    return big_->first;
+  }
+#endif
+  return numerator_;
+}
+
+rational_t rational::denominator() const {
+#if USE_BOOST_1024_INT
+  if (big_) {
+    return big_->second;
+  }
+#endif
+  return denominator_;
+}
 
 double rational::to_double() const {
+  if (not is_big()) {
+    return static_cast<double>(numerator_) / static_cast<double>(denominator_);
+  }
   return static_cast<double>(numerator()) / static_cast<double>(denominator());
 }
 
 rational operator+(rational rhs) { return rhs; }
 
 rational operator-(rational rhs) {
-  return rational(-rhs.numerator(), rhs.denominator());
+  rhs *= rational(-1);
+  return rhs;
 }
 
+#if not USE_BOOST_1024_INT
+/// Called when a result does not fit in 64-bit integers and big integers are
+/// not available
+[[noreturn]] static void throw_overflow_error() {
+  throw std::overflow_error(
+      "\nInteger overflow in rational arithmetic. Compile wicked with the "
+      "boost library to use 1024-bit integers.");
+}
+#endif
+
+// The four operations first try to compute the result with 64-bit integers.
+// The builtin functions return true if the result overflows
+
 rational &rational::operator+=(const rational &rhs) {
-  numerator_ = rhs.denominator_ * numerator_ + rhs.numerator_ * denominator_;
-  denominator_ = rhs.denominator_ * denominator_;
-  reduce();
+  if (not is_big() and not rhs.is_big()) {
+    int64_t n1, n2, n, d;
+    bool overflow = __builtin_mul_overflow(numerator_, rhs.denominator_, &n1);
+    overflow |= __builtin_mul_overflow(rhs.numerator_, denominator_, &n2);
+    overflow |= __builtin_add_overflow(n1, n2, &n);
+    overflow |= __builtin_mul_overflow(denominator_, rhs.denominator_, &d);
+    if (not overflow) {
+      set_small(n, d);
+      return *this;
+    }
+  }
+#if not USE_BOOST_1024_INT
+  throw_overflow_error();
+#endif
+  set(rhs.denominator() * numerator() + rhs.numerator() * denominator(),
+      rhs.denominator() * denominator());
   return *this;
 }
 
 rational &rational::operator-=(const rational &rhs) {
-  numerator_ = rhs.denominator_ * numerator_ - rhs.numerator_ * denominator_;
-  denominator_ = rhs.denominator_ * denominator_;
-  reduce();
+  if (not is_big() and not rhs.is_big()) {
+    int64_t n1, n2, n, d;
+    bool overflow = __builtin_mul_overflow(numerator_, rhs.denominator_, &n1);
+    overflow |= __builtin_mul_overflow(rhs.numerator_, denominator_, &n2);
+    overflow |= __builtin_sub_overflow(n1, n2, &n);
+    overflow |= __builtin_mul_overflow(denominator_, rhs.denominator_, &d);
+    if (not overflow) {
+      set_small(n, d);
+      return *this;
+    }
+  }
+#if not USE_BOOST_1024_INT
+  throw_overflow_error();
+#endif
+  set(rhs.denominator() * numerator() - rhs.numerator() * denominator(),
+      rhs.denominator() * denominator());
   return *this;
 }
 
 rational &rational::operator*=(const rational &rhs) {
-  numerator_ *= rhs.numerator();
-  denominator_ *= rhs.denominator();
-  reduce();
+  if (not is_big() and not rhs.is_big()) {
+    int64_t n, d;
+    bool overflow = __builtin_mul_overflow(numerator_, rhs.numerator_, &n);
+    overflow |= __builtin_mul_overflow(denominator_, rhs.denominator_, &d);
+    if (not overflow) {
+      set_small(n, d);
+      return *this;
+    }
+  }
+#if not USE_BOOST_1024_INT
+  throw_overflow_error();
+#endif
+  set(numerator() * rhs.numerator(), denominator() * rhs.denominator());
   return *this;
 }
 
 rational &rational::operator/=(const rational &rhs) {
-  numerator_ *= rhs.denominator();
-  denominator_ *= rhs.numerator();
-  reduce();
+  if (not is_big() and not rhs.is_big()) {
+    int64_t n, d;
+    bool overflow = __builtin_mul_overflow(numerator_, rhs.denominator_, &n);
+    overflow |= __builtin_mul_overflow(denominator_, rhs.numerator_, &d);
+    if (not overflow) {
+      set_small(n, d);
+      return *this;
+    }
+  }
+#if not USE_BOOST_1024_INT
+  throw_overflow_error();
+#endif
+  set(numerator() * rhs.denominator(), denominator() * rhs.numerator());
   return *this;
 }
 
+void rational::set_small(int64_t numerator, int64_t denominator) {
+  // the sign change and the gcd are not defined for the lowest integer
+  constexpr int64_t lowest = std::numeric_limits<int64_t>::min();
+  if ((numerator == lowest) or (denominator == lowest)) {
+    set(numerator, denominator);
+    return;
+  }
+  numerator_ = denominator < 0 ? -numerator : numerator;
+  denominator_ = denominator < 0 ? -denominator : denominator;
+  reduce();
+}
+
+void rational::set(rational_t numerator, rational_t denominator) {
+#if USE_BOOST_1024_INT
+  // enforce a positive denominator
+  if (denominator < 0) {
+    numerator = -numerator;
+    denominator = -denominator;
+  }
+  // bring to canonical form
+  rational_t gcd = boost::gcd(numerator, denominator);
+  if (gcd > 1) {
+    numerator /= gcd;
+    denominator /= gcd;
+  }
+  // use the 64-bit form if possible
+  constexpr int64_t lowest = std::numeric_limits<int64_t>::min();
+  constexpr int64_t highest = std::numeric_limits<int64_t>::max();
+  if ((numerator > lowest) and (numerator <= highest) and
+      (denominator <= highest)) {
+    numerator_ = static_cast<int64_t>(numerator);
+    denominator_ = static_cast<int64_t>(denominator);
+    big_.reset();
+  } else {
+    big_ = std::make_unique<std::pair<rational_t, rational_t>>(numerator,
+                                                               denominator);
+  }
+#else
+  constexpr int64_t lowest = std::numeric_limits<int64_t>::min();
+  if ((numerator == lowest) or (denominator == lowest)) {
+    throw_overflow_error();
+  }
+  numerator_ = denominator < 0 ? -numerator : numerator;
+  denominator_ = denominator < 0 ? -denominator : denominator;
+  reduce();
+#endif
+}
+
+std::string rational::numerator_str() const {
+#if USE_BOOST_1024_INT
+  if (big_) {
+    return boost::lexical_cast<std::string>(big_->first);
+  }
+#endif
+  return std::to_string(numerator_);
+}
+
+std::string rational::denominator_str() const {
+#if USE_BOOST_1024_INT
+  if (big_) {
+    return boost::lexical_cast<std::string>(big_->second);
+  }
+#endif
+  return std::to_string(denominator_);
+}
+
 std::string rational::str(bool sign) const {
   std::string s;
-  if (numerator_ == 0) {
+  if (*this == rational(0)) {
     s = "0";
   } else {
-    if (sign and (numerator_ > 0)) {
+    const bool positive = numerator() > 0;
+    if (sign and positive) {
       s = '+';
     }
-    if (denominator_ == 1) {
-      if (numerator_ == -1) {
-        s += "-";
-      } else {
-        if (numerator_ != 1) {
-#if USE_BOOST_1024_INT
-          s += boost::lexical_cast<std::string>(numerator_);
-#else
-          s += std::to_string(numerator_);
-#endif
-        }
+    if (*this == rational(-1)) {
+      s += "-";
+    } else if (*this != rational(1)) {
+      s += numerator_str();
+      if (is_big() or (denominator_ != 1)) {
+        s += "/" + denominator_str();
       }
-    } else {
-#if USE_BOOST_1024_INT
-      s += boost::lexical_cast<std::string>(numerator_) + "/" +
-           boost::lexical_cast<std::string>(denominator_);
-#else
-      s += std::to_string(numerator_) + "/" + std::to_string(denominator_);
-#endif
     }
   }
   return s;
 }
 
 std::string rational::repr() const {
-#if USE_BOOST_1024_INT
-  return "rational(" + boost::lexical_cast<std::string>(numerator_) + "," +
-         boost::lexical_cast<std::string>(denominator_) + ")";
-#else
-  return "rational(" + std::to_string(numerator_) + "," +
-         std::to_string(denominator_) + ")";
-#endif
+  return "rational(" + numerator_str() + "," + denominator_str() + ")";
 }
 
 std::string rational::latex() const {
   std::string s;
-  if (numerator_ == 0) {
+  if (*this == rational(0)) {
     s = "0";
   } else {
-    if (denominator_ == 1) {
+    if (not is_big() and (denominator_ == 1)) {
       if (numerator_ == 1) {
         s += "+";
       } else if (numerator_ == -1) {
         s += "-";
       } else {
-#if USE_BOOST_1024_INT
-        s += boost::lexical_cast<std::string>(numerator_);
-#else
-        s += std::to_string(numerator_);
-#endif
+        s += numerator_str();
       }
     } else {
-      if (numerator_ > 0) {
-        s += "+";
-      } else {
+      std::string n = numerator_str();
+      if (n[0] == '-') {
         s += "-";
+        n = n.substr(1);
+      } else {
+        s += "+";
       }
-#if USE_BOOST_1024_INT
-      s += "\\frac{" + boost::lexical_cast<std::string>(abs(numerator_)) +
-           "}{" + boost::lexical_cast<std::string>(denominator_) + "}";
-#else
-      s += "\\frac{" + std::to_string(std::abs(numerator_)) + "}{" +
-           std::to_string(denominator_) + "}";
-#endif
+      s += "\\frac{" + n + "}{" + denominator_str() + "}";
     }
   }
   return s;
 }
 
 std::string rational::compile(const std::string &format) const {
-  return std::to_string(static_cast<double>(numerator_) /
-                        static_cast<double>(denominator_));
+  return std::to_string(to_double());
 }
 
 rational operator+(rational lhs, const rational &rhs) {
@@ -172,8 +325,15 @@ rational operator/(rational lhs, const rational &rhs) {
 }
 
 bool operator==(const rational &lhs, const rational &rhs) {
-  if ((lhs.numerator() == 0) and (rhs.numerator() == 0))
-    return true;
+  // both numbers are in canonical form, so a number stored in the 64-bit form
+  // cannot be equal to one stored with big integers
+  if (not lhs.is_big() and not rhs.is_big()) {
+    return (lhs.numerator_ == rhs.numerator_) and
+           (lhs.denominator_ == rhs.denominator_);
+  }
+  if (lhs.is_big() != rhs.is_big()) {
+    return false;
+  }
   return ((lhs.numerator() == rhs.numerator()) and
           (lhs.denominator() == rhs.denominator()));
 }
@@ -188,13 +348,8 @@ std::ostream &operator<<(std::ostream &os, const rational &rhs) {
 }
 
 void rational::reduce() {
-// find the gcd
-#if USE_BOOST_1024_INT
-  rational_t gcd = boost::gcd(numerator_, denominator_);
-#else
-  rational_t gcd = std::gcd(numerator_, denominator_);
-#endif
-  // divide numerator and denominator by the gcd
+  // find the gcd and divide numerator and denominator by it
+  int64_t gcd = std::gcd(numerator_, denominator_);
   if (gcd > 1) {
     numerator_ /= gcd;
     denominator_ /= gcd;
@@ -204,17 +359,34 @@ void rational::reduce() {
 #include <iostream>
 
 rational make_rational_from_str(const std::string &s) {
-  std::smatch sm;
-  auto factor_re = std::regex("^\\s*([+-])?(\\d*)?(\\/)?(\\d*)?\\s*");
-  auto m = std::regex_match(s, sm, factor_re);
-  if (not m) {
+  // parse an optional sign, a numerator, and an optional division sign
+  // followed by a denominator, surrounded by spaces (e.g., " -1/2 ")
+  const size_t n = s.size();
+  size_t k = 0;
+  auto read = [&](auto accept) {
+    const size_t start = k;
+    while (k < n and accept(s[k])) {
+      k++;
+    }
+    return s.substr(start, k - start);
+  };
+  auto is_space = [](char c) {
+    return std::isspace(static_cast<unsigned char>(c));
+  };
+  auto is_digit = [](char c) {
+    return std::isdigit(static_cast<unsigned char>(c));
+  };
+  read(is_space);
+  std::string sign = (k < n and (s[k] == '+' or s[k] == '-')) ? s.substr(k++, 1)
+                                                             : "";
+  std::string numerator_str = read(is_digit);
+  std::string division = (k < n and s[k] == '/') ? s.substr(k++, 1) : "";
+  std::string denominator_str = read(is_digit);
+  read(is_space);
+  if (k != n) {
     throw std::runtime_error("\nCould not convert the string " + s +
                              " to a rational object");
   }
-  std::string sign = sm[1];
-  std::string numerator_str = sm[2];
-  std::string division = sm[3];
-  std::string denominator_str = sm[4];
   int numerator = 1, denominator = 1;
   if (sign == "-") {
     numerator *= -1;
@@ -240,4 +412,10 @@ rational make_rational_from_str(const std::string &s) {
 bool use_boost_1024_int() { return true; }
 #else
 bool use_boost_1024_int() { return false; }
-#endif
\ No newline at end of file
+#endif
+
+#if WICKED_FLOAT_COEFFICIENTS
+bool use_float_coefficients() { return true; }
+#else
+bool use_float_coefficients() { return false; }
+#endif
@@ -1,13 +1,19 @@
 #ifndef _wicked_rational_h_
 #define _wicked_rational_h_
 
+#include <cstdint>
+#include <memory>
 #include <ostream>
+#include <string>
 
 /// USE_BOOST_1024_INT is set to true by CMake if boost is found
 /// otherwise, we use long long int.
 /// Note that long long int is not sufficient for all cases.
 /// For example, the CC equations with up to 8-body excitation operators cannot
 /// be handled with long long int.
+/// In both cases the numerator and denominator are stored as 64-bit integers
+/// when they fit. With boost, results that overflow are promoted to 1024-bit
+/// integers, while without boost an overflow throws an exception.
 #if USE_BOOST_1024_INT
 #include <boost/multiprecision/cpp_int.hpp>
 #include <boost/rational.hpp>
@@ -24,10 +30,17 @@ public:
   rational();
   /// initialize with rational (numerator/denominator)
   rational(rational_t numerator, rational_t denominator);
+  /// initialize with rational (numerator/denominator)
+  rational(int numerator, int denominator);
   /// initialize with integer (numerator)
   rational(rational_t numerator);
   /// initialize with integer (numerator)
   rational(int numerator);
+  /// copy and move constructors and assignment operators
+  rational(const rational &other);
+  rational(rational &&other) noexcept = default;
+  rational &operator=(const rational &other);
+  rational &operator=(rational &&other) noexcept = default;
   /// return the numerator
   rational_t numerator() const;
   /// return the denominator
@@ -52,13 +65,31 @@ public:
   /// division assignment
   rational &operator/=(const rational &rhs);
 
+  /// equal to
+  friend bool operator==(const rational &lhs, const rational &rhs);
+
 private:
-  /// the numerator
-  rational_t numerator_;
-  /// the denominator
-  rational_t denominator_;
-  /// reduce the rational number
+  /// the numerator (when the 64-bit form is used)
+  int64_t numerator_;
+  /// the denominator (when the 64-bit form is used)
+  int64_t denominator_;
+#if USE_BOOST_1024_INT
+  /// the numerator and denominator stored as big integers. This is allocated
+  /// only when they do not fit in 64-bit integers (nullptr = 64-bit form)
+  std::unique_ptr<std::pair<rational_t, rational_t>> big_;
+#endif
+  /// return true if the big integer form is used
+  bool is_big() const;
+  /// set the numerator and the denominator, bring them to canonical form, and
+  /// use the 64-bit form if possible
+  void set(rational_t numerator, rational_t denominator);
+  /// set the 64-bit form, bring it to canonical form
+  void set_small(int64_t numerator, int64_t denominator);
+  /// reduce the 64-bit form
   void reduce();
+  /// return the string representation of the numerator and denominator
+  std::string numerator_str() const;
+  std::string denominator_str() const;
 };
 
 /// equal to
@@ -83,5 +114,7 @@ rational make_rational_from_str(const std::string &s);
 std::ostream &operator<<(std::ostream &os, const rational &rhs);
 /// return true if boost rational is used
 bool use_boost_1024_int();
+/// return true if the coefficients are double-precision numbers
+bool use_float_coefficients();
 
 #endif // _wicked_rational_h_
@@ -0,0 +1,93 @@
+#ifndef _wicked_small_vector_h_
+#define _wicked_small_vector_h_
+
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <vector>
+
+/// A vector that stores up to N elements inline and uses the heap only when
+/// it grows beyond N elements. T must be default constructible and copyable
+template <class T, std::size_t N> class small_vector {
+public:
+  using value_type = T;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  small_vector() {}
+  small_vector(std::initializer_list<T> l) { assign(l.begin(), l.end()); }
+  small_vector(const std::vector<T> &v) { assign(v.begin(), v.end()); }
+  template <class It> small_vector(It first, It last) { assign(first, last); }
+
+  /// Replace the content with the elements in the range [first,last)
+  template <class It> void assign(It first, It last) {
+    size_ = std::distance(first, last);
+    if (size_ <= N) {
+      heap_.clear();
+      std::copy(first, last, inline_.begin());
+    } else {
+      heap_.assign(first, last);
+    }
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T *data() { return size_ <= N ? inline_.data() : heap_.data(); }
+  const T *data() const { return size_ <= N ? inline_.data() : heap_.data(); }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+
+  T &operator[](std::size_t n) { return data()[n]; }
+  const T &operator[](std::size_t n) const { return data()[n]; }
+  T &front() { return data()[0]; }
+  const T &front() const { return data()[0]; }
+  T &back() { return data()[size_ - 1]; }
+  const T &back() const { return data()[size_ - 1]; }
+
+  void push_back(const T &e) {
+    if (size_ < N) {
+      inline_[size_] = e;
+    } else {
+      // move the elements to the heap when the inline storage is full
+      if (size_ == N) {
+        heap_.assign(inline_.begin(), inline_.end());
+      }
+      heap_.push_back(e);
+    }
+    size_++;
+  }
+
+  void clear() {
+    heap_.clear();
+    size_ = 0;
+  }
+
+  /// Convert to a std::vector
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+  bool operator==(const small_vector &other) const {
+    return std::equal(begin(), end(), other.begin(), other.end());
+  }
+  bool operator!=(const small_vector &other) const {
+    return not(*this == other);
+  }
+  bool operator<(const small_vector &other) const {
+    return std::lexicographical_compare(begin(), end(), other.begin(),
+                                        other.end());
+  }
+  bool operator>(const small_vector &other) const { return other < *this; }
+
+private:
+  /// The inline storage (used when size_ <= N)
+  std::array<T, N> inline_;
+  /// The heap storage (used when size_ > N)
+  std::vector<T> heap_;
+  /// The number of elements
+  std::size_t size_ = 0;
+};
+
+#endif // _wicked_small_vector_h_
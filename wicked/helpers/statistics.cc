@@ -0,0 +1,43 @@
+#include <algorithm>
+
+#include "statistics.h"
+
+double Statistics::time(const std::string &path) const {
+  auto it = times_.find(path);
+  return it != times_.end() ? it->second : 0.0;
+}
+
+uint64_t Statistics::count(const std::string &path) const {
+  auto it = counts_.find(path);
+  return it != counts_.end() ? it->second : 0;
+}
+
+void Statistics::clear() {
+  times_.clear();
+  counts_.clear();
+}
+
+Statistics &Statistics::operator+=(const Statistics &rhs) {
+  for (const auto &[path, t] : rhs.times_) {
+    times_[path] += t;
+  }
+  for (const auto &[path, n] : rhs.counts_) {
+    counts_[path] += n;
+  }
+  return *this;
+}
+
+std::map<std::string, double> Statistics::flat() const {
+  std::map<std::string, double> result;
+  auto label = [](std::string path) {
+    std::replace(path.begin(), path.end(), '/', ' ');
+    return path;
+  };
+  for (const auto &[path, t] : times_) {
+    result[label(path)] += t;
+  }
+  for (const auto &[path, n] : counts_) {
+    result[label(path)] += n;
+  }
+  return result;
+}
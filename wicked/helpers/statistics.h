@@ -0,0 +1,55 @@
+#ifndef _wicked_statistics_h_
+#define _wicked_statistics_h_
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/// A set of timers and counters. The entries are named by paths with
+/// components separated by '/' (e.g., "step 2/pruned nodes"), so they form a
+/// hierarchy in which the time spent in a step and the quantities counted in
+/// it are grouped together. Counters are named so that their path is never
+/// the prefix of another entry
+class Statistics {
+public:
+  /// Add a time (in seconds) to the timer with this path
+  void add_time(const std::string &path, double seconds) {
+    times_[path] += seconds;
+  }
+
+  /// Add n to the counter with this path
+  void add_count(const std::string &path, uint64_t n = 1) {
+    counts_[path] += n;
+  }
+
+  /// Return the time of a timer (0 if it was never set)
+  double time(const std::string &path) const;
+
+  /// Return the value of a counter (0 if it was never set)
+  uint64_t count(const std::string &path) const;
+
+  /// The timers
+  const std::map<std::string, double> &times() const { return times_; }
+
+  /// The counters
+  const std::map<std::string, uint64_t> &counts() const { return counts_; }
+
+  /// Return true if there are no timers and counters
+  bool empty() const { return times_.empty() and counts_.empty(); }
+
+  /// Remove all the timers and counters
+  void clear();
+
+  /// Add the timers and counters of another object
+  Statistics &operator+=(const Statistics &rhs);
+
+  /// Return the timers and counters in a single map. The components of the
+  /// paths are separated by spaces (e.g., "step 2 pruned nodes")
+  std::map<std::string, double> flat() const;
+
+private:
+  std::map<std::string, double> times_;
+  std::map<std::string, uint64_t> counts_;
+};
+
+#endif // _wicked_statistics_h_
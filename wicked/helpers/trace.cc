@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+#include "trace.h"
+
+std::atomic<bool> tracing_flag(false);
+
+namespace {
+
+/// A complete event (a begin time and a duration)
+struct TraceEvent {
+  const char *name;
+  const char *category;
+  int tid;
+  double ts;
+  double dur;
+  std::vector<std::pair<const char *, std::string>> args;
+};
+
+std::mutex trace_mutex;
+std::vector<TraceEvent> trace_events;
+
+/// The time when tracing was started (in nanoseconds since the epoch of the
+/// steady clock)
+std::atomic<int64_t> trace_origin(0);
+
+/// Return the time in microseconds since tracing was started
+double trace_now() {
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+  return (now - trace_origin.load(std::memory_order_relaxed)) * 1.0e-3;
+}
+
+/// Return a small integer that identifies this thread
+int trace_thread_id() {
+  static std::atomic<int> next_id(0);
+  thread_local int id = next_id++;
+  return id;
+}
+
+/// Return s as a JSON string
+std::string json_string(const std::string &s) {
+  std::string result = "\"";
+  for (char c : s) {
+    if (c == '"' or c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+} // namespace
+
+void start_tracing() {
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  trace_events.clear();
+  trace_origin = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now().time_since_epoch())
+                     .count();
+  tracing_flag = true;
+}
+
+void stop_tracing() { tracing_flag = false; }
+
+size_t trace_size() {
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  return trace_events.size();
+}
+
+std::string trace_json() {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    events = trace_events;
+  }
+  std::stable_sort(
+      events.begin(), events.end(),
+      [](const TraceEvent &a, const TraceEvent &b) { return a.ts < b.ts; });
+
+  std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (size_t n = 0; n < events.size(); n++) {
+    const auto &e = events[n];
+    std::vector<std::string> args;
+    for (const auto &[key, value] : e.args) {
+      args.push_back(json_string(key) + ": " + json_string(value));
+    }
+    json += fmt::format(
+        "{}\n{{\"name\": {}, \"cat\": {}, \"ph\": \"X\", \"ts\": {:.3f}, "
+        "\"dur\": {:.3f}, \"pid\": 1, \"tid\": {}, \"args\": {{{}}}}}",
+        n > 0 ? "," : "", json_string(e.name), json_string(e.category), e.ts,
+        e.dur, e.tid, fmt::join(args, ", "));
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+void write_trace(const std::string &filename) {
+  std::ofstream file(filename);
+  if (not file) {
+    throw std::runtime_error("write_trace: could not open the file " +
+                             filename);
+  }
+  file << trace_json();
+}
+
+void TraceScope::begin(const char *name, const char *category) {
+  name_ = name;
+  category_ = category;
+  start_ = trace_now();
+}
+
+void TraceScope::end() {
+  if (not active_) {
+    return;
+  }
+  active_ = false;
+  TraceEvent event{name_, category_, trace_thread_id(), start_,
+                   trace_now() - start_, std::move(args_)};
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  trace_events.push_back(std::move(event));
+}
@@ -0,0 +1,86 @@
+#ifndef _wicked_trace_h_
+#define _wicked_trace_h_
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Tracing records the time spent in scoped events (on all threads) and
+/// writes them in the trace-event JSON format read by chrome://tracing and
+/// Perfetto (https://ui.perfetto.dev). Tracing is off by default, and a scope
+/// then costs one relaxed atomic load
+
+/// The flag tested by the trace scopes (use tracing_enabled)
+extern std::atomic<bool> tracing_flag;
+
+/// Return true if the events are recorded
+inline bool tracing_enabled() {
+  return tracing_flag.load(std::memory_order_relaxed);
+}
+
+/// Remove the events recorded and start recording new ones. The times are
+/// measured from this call
+void start_tracing();
+
+/// Stop recording events. The events recorded are kept
+void stop_tracing();
+
+/// Return the number of events recorded
+size_t trace_size();
+
+/// Return the events recorded in the trace-event JSON format
+std::string trace_json();
+
+/// Write the events recorded to a file in the trace-event JSON format
+void write_trace(const std::string &filename);
+
+/// An event that starts when this object is created and ends when it is
+/// destroyed (or when end is called). If tracing is off when the object is
+/// created, nothing is recorded
+class TraceScope {
+public:
+  /// Constructor. The name and category are not copied, so they should be
+  /// string literals
+  TraceScope(const char *name, const char *category)
+      : active_(tracing_enabled()) {
+    if (active_) {
+      begin(name, category);
+    }
+  }
+
+  ~TraceScope() {
+    if (active_) {
+      end();
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  /// Return true if this event is recorded. Use it to skip computing the
+  /// arguments when tracing is off
+  bool active() const { return active_; }
+
+  /// Add an argument shown with the event
+  void add_arg(const char *key, std::string value) {
+    if (active_) {
+      args_.emplace_back(key, std::move(value));
+    }
+  }
+
+  /// End the event before this object is destroyed
+  void end();
+
+private:
+  void begin(const char *name, const char *category);
+
+  bool active_;
+  const char *name_ = nullptr;
+  const char *category_ = nullptr;
+  /// The start time in microseconds since tracing was started
+  double start_ = 0.0;
+  std::vector<std::pair<const char *, std::string>> args_;
+};
+
+#endif // _wicked_trace_h_
@@ -1,6 +1,8 @@
+import contextlib
+
 import wicked
 
-__all__ = ["string_to_expr", "gen_op", "compile_einsum"]
+__all__ = ["string_to_expr", "gen_op", "compile_einsum", "tracing"]
 
 
 def string_to_expr(s):
@@ -8,10 +10,25 @@ def string_to_expr(s):
     This function takes a string, splits it, and converts
     it into an Expression object
     """
-    expr = wicked.Expression()
-    for line in s.split("\n"):
-        expr += wicked.expression(line)
-    return expr
+    return wicked.string_to_expr_lines(s)
+
+
+@contextlib.contextmanager
+def tracing(filename):
+    """
+    Record the time spent in the contractions and the code generators while
+    the block runs and write the events to filename in the trace-event JSON
+    format, which can be opened with https://ui.perfetto.dev
+
+    with wicked.utils.tracing("contraction.json"):
+        wt.contract(...)
+    """
+    wicked.start_tracing()
+    try:
+        yield
+    finally:
+        wicked.stop_tracing()
+        wicked.write_trace(filename)
 
 
 def split(word):
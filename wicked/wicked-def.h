@@ -16,9 +16,18 @@
   {}
 #endif
 
-/// Rational numbers
+/// The coefficients: rational numbers, or double-precision numbers when
+/// WICKED_FLOAT_COEFFICIENTS is set by CMake. exact_coefficients is true if
+/// the sum of several coefficients does not depend on the order of the terms
 #include "helpers/rational.h"
+#if WICKED_FLOAT_COEFFICIENTS
+#include "helpers/floating.h"
+using scalar_t = floating;
+constexpr bool exact_coefficients = false;
+#else
 using scalar_t = rational;
+constexpr bool exact_coefficients = true;
+#endif
 
 /// Bit array
 using bitarray = std::bitset<64>;